@@ -38,11 +38,20 @@
 struct kernel_uxsock_request {
   uint32_t rxq_len;
   uint32_t txq_len;
+  /* NUMA node the application thread creating the context runs on */
+  uint32_t numa_node;
 } __attribute__((packed));
 
+/** Distance between the tx doorbells of one context, one cache line each */
+#define KERNEL_TXDB_STRIDE 64
+
 struct kernel_uxsock_response {
   uint64_t app_out_off;
   uint64_t app_in_off;
+  /* flag set by the application when it is about to block */
+  uint64_t sleep_off;
+  /* tx queue doorbells, one per fast path core KERNEL_TXDB_STRIDE apart */
+  uint64_t txdb_off;
 
   uint32_t app_out_len;
   uint32_t app_in_len;
@@ -69,6 +78,8 @@ enum kernel_appout_type {
   KERNEL_APPOUT_LISTEN_CLOSE,
   KERNEL_APPOUT_ACCEPT_CONN,
   KERNEL_APPOUT_REQ_SCALE,
+  KERNEL_APPOUT_SET_WEIGHT,
+  KERNEL_APPOUT_CONN_PRIO,
 };
 
 /** Open a new connection */
@@ -127,6 +138,22 @@ struct kernel_appout_req_scale {
   uint32_t num_cores;
 } __attribute__((packed));
 
+/** Set transmit scheduling weight and rate cap for application */
+struct kernel_appout_set_weight {
+  uint32_t max_rate;
+  uint16_t weight;
+} __attribute__((packed));
+
+/** Set transmit priority of connection */
+struct kernel_appout_conn_prio {
+  uint64_t opaque;
+  uint32_t remote_ip;
+  uint32_t local_ip;
+  uint16_t remote_port;
+  uint16_t local_port;
+  uint8_t  prio;
+} __attribute__((packed));
+
 /** Common struct for events on kernel -> app queue */
 struct kernel_appout {
   union {
@@ -139,6 +166,8 @@ struct kernel_appout {
     struct kernel_appout_accept_conn  accept_conn;
 
     struct kernel_appout_req_scale    req_scale;
+    struct kernel_appout_set_weight   set_weight;
+    struct kernel_appout_conn_prio    conn_prio;
 
     uint8_t raw[63];
   } __attribute__((packed)) data;
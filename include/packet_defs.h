@@ -169,6 +169,9 @@ struct tcp_hdr {
 #define TCP_OPT_END_OF_OPTIONS 0
 #define TCP_OPT_NO_OP 1
 #define TCP_OPT_MSS 2
+#define TCP_OPT_WINDOW_SCALE 3
+#define TCP_OPT_SACK_PERMITTED 4
+#define TCP_OPT_SACK 5
 #define TCP_OPT_TIMESTAMP 8
 struct tcp_mss_opt {
   uint8_t kind;
@@ -177,6 +180,15 @@ struct tcp_mss_opt {
 } __attribute__((packed));
 
 
+/** Maximum window scale shift (RFC 7323) */
+#define TCP_WSCALE_MAX 14
+
+struct tcp_wscale_opt {
+  uint8_t kind;
+  uint8_t length;
+  uint8_t shift;
+} __attribute__((packed));
+
 struct tcp_timestamp_opt {
   uint8_t kind;
   uint8_t length;
@@ -184,6 +196,25 @@ struct tcp_timestamp_opt {
   beui32_t ts_ecr;
 } __attribute__((packed));
 
+struct tcp_sack_permitted_opt {
+  uint8_t kind;
+  uint8_t length;
+} __attribute__((packed));
+
+/** Maximum number of SACK blocks that fit next to a timestamp option */
+#define TCP_SACK_MAX_BLOCKS 3
+
+struct tcp_sack_block {
+  beui32_t start;
+  beui32_t end;
+} __attribute__((packed));
+
+struct tcp_sack_opt {
+  uint8_t kind;
+  uint8_t length;
+  struct tcp_sack_block blocks[];
+} __attribute__((packed));
+
 
 /******************************************************************************/
 /* Object framing */
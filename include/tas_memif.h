@@ -70,6 +70,22 @@ struct flexnic_info {
   uint32_t qmq_num;
   /** Number of cores in flexnic emulator */
   uint32_t cores_num;
+  /** Number of flow states */
+  uint32_t flowst_num;
+  /** Number of flow lookup table buckets (power of 2) */
+  uint32_t flowht_buckets;
+  /** Offsets of per-flow arrays in internal memory, see flextcp_pl_mem */
+  uint64_t flowst_off;
+  uint64_t flowst_cold_off;
+  uint64_t flowst_ooo_off;
+  uint64_t flowst_sack_off;
+  uint64_t flowst_hdr_off;
+  uint64_t flowht_off;
+  /** Number of app context slots per core (doorbell ids) */
+  uint32_t appctx_num;
+  /** Offset of app context registers in internal memory, per core arrays of
+   * appctx_num entries */
+  uint64_t appctx_off;
 } __attribute__((packed));
 
 
@@ -88,6 +104,7 @@ struct flextcp_pl_krx {
       uint16_t len;
       uint16_t fn_core;
       uint16_t flow_group;
+      uint8_t port;
     } packet;
     uint8_t raw[55];
   } __attribute__((packed)) msg;
@@ -111,6 +128,7 @@ struct flextcp_pl_ktx {
     struct {
       uint64_t addr;
       uint16_t len;
+      uint8_t port;
     } packet;
     struct {
       uint32_t flow_id;
@@ -181,10 +199,9 @@ STATIC_ASSERT(sizeof(struct flextcp_pl_atx) == 16, atx_size);
 #define FLEXNIC_PL_APPST_NUM        8
 #define FLEXNIC_PL_APPST_CTX_NUM   31
 #define FLEXNIC_PL_APPST_CTX_MCS   16
-#define FLEXNIC_PL_APPCTX_NUM      16
-#define FLEXNIC_PL_FLOWST_NUM     (128 * 1024)
-#define FLEXNIC_PL_FLOWHT_ENTRIES (FLEXNIC_PL_FLOWST_NUM * 2)
-#define FLEXNIC_PL_FLOWHT_NBSZ      4
+/** Upper bound for the configurable number of app context slots per core */
+#define FLEXNIC_PL_APPCTX_MAX      64
+#define FLEXNIC_PL_FLOWHT_WAYS      8
 
 /** Application state */
 struct flextcp_pl_appst {
@@ -196,6 +213,11 @@ struct flextcp_pl_appst {
 
   /** IDs of contexts */
   uint16_t ctx_ids[FLEXNIC_PL_APPST_CTX_NUM];
+
+  /** Transmit scheduling weight relative to other apps (0 treated as 1) */
+  uint16_t qm_weight;
+  /** Aggregate transmit rate cap [Kbps], 0 for none */
+  uint32_t qm_rate;
 } __attribute__((packed));
 
 
@@ -209,6 +231,12 @@ struct flextcp_pl_appctx {
   uint32_t tx_len;
   uint32_t appst_id;
   int	   evfd;
+  /** offset of the 32-bit flag the application sets while it is about to
+   * block on evfd, shared by the context's queues on all cores */
+  uint64_t sleep_base;
+  /** offset of the 32-bit doorbell the application sets after adding
+   * entries to the tx queue on this core */
+  uint64_t txdb_base;
 
   /********************************************************/
   /* read-write fields */
@@ -216,34 +244,29 @@ struct flextcp_pl_appctx {
   uint32_t rx_head;
   uint32_t tx_head;
   uint32_t rx_avail;
+  /** connection updates held back in the fast path because the rx queue was
+   * full */
+  uint64_t rx_overflows;
 } __attribute__((packed));
 
 /** Enable out of order receive processing members */
 #define FLEXNIC_PL_OOO_RECV 1
 
 #define FLEXNIC_PL_FLOWST_SLOWPATH 1
+#define FLEXNIC_PL_FLOWST_SACK 2
+#define FLEXNIC_PL_FLOWST_TXSACK 4
 #define FLEXNIC_PL_FLOWST_ECN 8
 #define FLEXNIC_PL_FLOWST_TXFIN 16
 #define FLEXNIC_PL_FLOWST_RXFIN 32
 #define FLEXNIC_PL_FLOWST_RX_MASK (~63ULL)
 
-/** Flow state registers */
+/**
+ * Flow state registers touched for every segment, fits in one cache line.
+ * Everything else is in flextcp_pl_flowst_cold, indexed by flow id.
+ */
 struct flextcp_pl_flowst {
-  /********************************************************/
-  /* read-only fields */
-
-  /** Opaque flow identifier from application */
-  uint64_t opaque;
-
   /** Base address of receive buffer */
   uint64_t rx_base_sp;
-  /** Base address of transmit buffer */
-  uint64_t tx_base;
-
-  /** Length of receive buffer */
-  uint32_t rx_len;
-  /** Length of transmit buffer */
-  uint32_t tx_len;
 
   beui32_t local_ip;
   beui32_t remote_ip;
@@ -251,43 +274,17 @@ struct flextcp_pl_flowst {
   beui16_t local_port;
   beui16_t remote_port;
 
-  /** Remote MAC address */
-  struct eth_addr remote_mac;
-
-  /** Doorbell ID (identifying the app ctx to use) */
-  uint16_t db_id;
-
-  /** Flow group for this connection (rss bucket) */
-  uint16_t flow_group;
-  /** Sequence number of queue pointer bumps */
-  uint16_t bump_seq;
-
-  // 56
-
-  /********************************************************/
-  /* read-write fields */
-
-  /** spin lock */
-  volatile uint32_t lock;
+  /** Length of receive buffer */
+  uint32_t rx_len;
 
   /** Bytes available for received segments at next position */
   uint32_t rx_avail;
-  // 64
   /** Offset in buffer to place next segment */
   uint32_t rx_next_pos;
   /** Next sequence number expected */
   uint32_t rx_next_seq;
   /** Bytes available in remote end for received segments */
   uint32_t rx_remote_avail;
-  /** Duplicate ack count */
-  uint32_t rx_dupack_cnt;
-
-#ifdef FLEXNIC_PL_OOO_RECV
-  /* Start of interval of out-of-order received data */
-  uint32_t rx_ooo_start;
-  /* Length of interval of out-of-order received data */
-  uint32_t rx_ooo_len;
-#endif
 
   /** Number of bytes available to be sent */
   uint32_t tx_avail;
@@ -301,6 +298,56 @@ struct flextcp_pl_flowst {
   /** Timestamp to echo in next packet */
   uint32_t tx_next_ts;
 
+  /** Flow group for this connection (rss bucket) */
+  uint16_t flow_group;
+  /** Window scale shifts: received windows in the low, advertised windows in
+   * the high nibble */
+  uint8_t wscale;
+  /** Duplicate ack count */
+  uint8_t rx_dupack_cnt;
+
+// 64
+} __attribute__((packed, aligned(64)));
+
+/** Flow state registers used rarely or only on the transmit side */
+struct flextcp_pl_flowst_cold {
+  /********************************************************/
+  /* read-only fields */
+
+  /** Opaque flow identifier from application */
+  uint64_t opaque;
+
+  /** Base address of transmit buffer */
+  uint64_t tx_base;
+  /** Length of transmit buffer */
+  uint32_t tx_len;
+
+  /** Remote MAC address */
+  struct eth_addr remote_mac;
+
+  /** Doorbell ID (identifying the app ctx to use) */
+  uint16_t db_id;
+  /** Application ID, used as queue manager scheduling class */
+  uint16_t appst_id;
+  /** Latency sensitive flow, scheduled with strict priority if != 0 */
+  uint8_t prio;
+
+  /********************************************************/
+  /* read-write fields */
+
+  /** Sequence number of queue pointer bumps */
+  uint16_t bump_seq;
+  /** Number of in-order segments received but not acknowledged yet */
+  uint16_t rx_ack_segs;
+
+#ifdef FLEXNIC_PL_OOO_RECV
+  /* Start of first interval of out-of-order received data */
+  uint32_t rx_ooo_start;
+  /* Length of first interval of out-of-order received data (0 if none, see
+   * flextcp_pl_flowst_ooo for all intervals) */
+  uint32_t rx_ooo_len;
+#endif
+
   /** Congestion control rate [kbps] */
   uint32_t tx_rate;
   /** Counter drops */
@@ -314,31 +361,145 @@ struct flextcp_pl_flowst {
   /** RTT estimate */
   uint32_t rtt_est;
 
-// 128
+// 60
 } __attribute__((packed, aligned(64)));
 
-#define FLEXNIC_PL_FLOWHTE_VALID  (1 << 31)
-#define FLEXNIC_PL_FLOWHTE_POSSHIFT 29
-
-/** Flow lookup table entry */
-struct flextcp_pl_flowhte {
-  uint32_t flow_id;
-  uint32_t flow_hash;
+/** Interval of sequence numbers */
+struct flextcp_pl_interval {
+  /** Sequence number of first byte in interval */
+  uint32_t start;
+  /** Length of interval */
+  uint32_t len;
 } __attribute__((packed));
 
+#ifdef FLEXNIC_PL_OOO_RECV
+/** Number of out-of-order intervals tracked per flow */
+#define FLEXNIC_PL_OOO_INTERVALS 7
+
+/**
+ * Out-of-order receive intervals, kept separately from the flow state and
+ * indexed by flow id. Only touched when out-of-order segments are around.
+ */
+struct flextcp_pl_flowst_ooo {
+  /** Number of valid intervals */
+  uint16_t num;
+  /** Index of interval updated last (reported first in SACK blocks) */
+  uint16_t last;
+  uint32_t _pad;
+
+  /** Intervals, sorted by sequence number and not touching each other */
+  struct flextcp_pl_interval intervals[FLEXNIC_PL_OOO_INTERVALS];
+} __attribute__((packed, aligned(64)));
+#endif
+
+/** Number of SACKed intervals tracked per flow on the send side */
+#define FLEXNIC_PL_SACK_INTERVALS 6
+
+/** No holes reported by the receiver */
+#define FLEXNIC_PL_SACK_NONE 0
+/** Receiver reported holes, not (yet) considered lost */
+#define FLEXNIC_PL_SACK_HOLE 1
+/** Holes considered lost and being retransmitted */
+#define FLEXNIC_PL_SACK_RECOVERY 2
+
+/**
+ * Send side SACK scoreboard, kept separately from the flow state and indexed
+ * by flow id. Only touched when FLEXNIC_PL_FLOWST_TXSACK is set on the flow.
+ */
+struct flextcp_pl_flowst_sack {
+  /** Number of valid intervals */
+  uint16_t num;
+  /** Recovery state (FLEXNIC_PL_SACK_*) */
+  uint16_t state;
+  /** Timestamp when the first hole was reported */
+  uint32_t hole_ts;
+  /** Next sequence number to retransmit during recovery */
+  uint32_t rexmit_next;
+  /** Recovery ends once everything up to here is acknowledged */
+  uint32_t recovery_end;
+
+  /** SACKed intervals, sorted by sequence number */
+  struct flextcp_pl_interval intervals[FLEXNIC_PL_SACK_INTERVALS];
+} __attribute__((packed, aligned(64)));
+
+/** Length of headers in segments sent by the fast path: Ethernet, IPv4, TCP
+ * and the timestamp option preceded by two NOPs */
+#define FLEXNIC_PL_TXHDR_LEN 66
+/** Part of the headers stored in the template: Ethernet, IPv4 and TCP without
+ * options. The option prefix is fixed and written by the fast path. */
+#define FLEXNIC_PL_TXHDR_TMPL_LEN 54
+
+/**
+ * Transmit header template, kept separately from the flow state and indexed
+ * by flow id. Built when the flow is added (see fast_flows_hdr_init()), the
+ * fast path copies it into each segment and fills in the rest.
+ */
+struct flextcp_pl_flowst_hdr {
+  /** Headers with IP length, checksums, sequence numbers and window set to
+   * 0 */
+  uint8_t tmpl[FLEXNIC_PL_TXHDR_TMPL_LEN];
+  /** Pseudo header sum without TCP length */
+  uint16_t phdr_sum;
+  /** Network port the flow sends on (index into configured IPs) */
+  uint8_t port;
+  uint8_t _pad[7];
+} __attribute__((packed, aligned(64)));
+
+STATIC_ASSERT(sizeof(struct flextcp_pl_flowst_hdr) == 64, flowst_hdr_size);
+
+/**
+ * Flow lookup table bucket. Each flow has two candidate buckets (see
+ * flowht.h), an entry is valid if its signature is not 0.
+ */
+struct flextcp_pl_flowhtb {
+  /** 16-bit hash signatures, compared all at once */
+  uint16_t sig[FLEXNIC_PL_FLOWHT_WAYS];
+  /** Flow ids for entries */
+  uint32_t flow_id[FLEXNIC_PL_FLOWHT_WAYS];
+  /** Odd while the slow path is modifying the bucket */
+  volatile uint32_t version;
+  uint32_t _pad[3];
+} __attribute__((packed, aligned(64)));
+
 
 #define FLEXNIC_PL_MAX_FLOWGROUPS 4096
 
-/** Layout of internal pipeline memory */
+/**
+ * Layout of internal pipeline memory. The per-flow arrays are sized at
+ * startup and placed behind this struct in the same region, at the offsets
+ * published in struct flexnic_info. The pointers below are only valid in the
+ * TAS process, other processes mapping the region must use the offsets.
+ */
 struct flextcp_pl_mem {
-  /* registers for application context queues */
-  struct flextcp_pl_appctx appctx[FLEXNIC_PL_APPST_CTX_MCS][FLEXNIC_PL_APPCTX_NUM];
+  /* registers for application context queues, appctx_num per core */
+  struct flextcp_pl_appctx *appctx[FLEXNIC_PL_APPST_CTX_MCS];
+  /* number of application context slots per core */
+  uint32_t appctx_num;
 
   /* registers for flow state */
-  struct flextcp_pl_flowst flowst[FLEXNIC_PL_FLOWST_NUM];
+  struct flextcp_pl_flowst *flowst;
+
+  /* rarely used registers for flow state */
+  struct flextcp_pl_flowst_cold *flowst_cold;
+
+#ifdef FLEXNIC_PL_OOO_RECV
+  /* out-of-order intervals for flows */
+  struct flextcp_pl_flowst_ooo *flowst_ooo;
+#endif
+
+  /* SACK scoreboards for flows */
+  struct flextcp_pl_flowst_sack *flowst_sack;
+
+  /* transmit header templates for flows */
+  struct flextcp_pl_flowst_hdr *flowst_hdr;
 
   /* flow lookup table */
-  struct flextcp_pl_flowhte flowht[FLEXNIC_PL_FLOWHT_ENTRIES];
+  struct flextcp_pl_flowhtb *flowht;
+
+  /* number of entries in flow state arrays */
+  uint32_t flowst_num;
+  /* number of flow lookup table buckets - 1 */
+  uint32_t flowht_mask;
 
   /* registers for kernel queues */
   struct flextcp_pl_appctx kctx[FLEXNIC_PL_APPST_CTX_MCS];
@@ -346,7 +507,12 @@ struct flextcp_pl_mem {
   /* registers for application state */
   struct flextcp_pl_appst appst[FLEXNIC_PL_APPST_NUM];
 
+  /* bitmap of registered application contexts, per core */
+  volatile uint64_t appctx_active[FLEXNIC_PL_APPST_CTX_MCS];
+
   uint8_t flow_group_steering[FLEXNIC_PL_MAX_FLOWGROUPS];
+  /* core currently owning flow group, follows steering */
+  uint8_t flow_group_owner[FLEXNIC_PL_MAX_FLOWGROUPS];
 } __attribute__((packed));
 
 /** @} */
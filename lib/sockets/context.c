@@ -230,6 +230,12 @@ static inline void ev_listen_accept(struct flextcp_context *ctx,
   if (ev->ev.listen_accept.status == 0) {
     s->data.connection.status = SOC_CONNECTED;
     flextcp_epoll_set(s, EPOLLOUT);
+
+    /* accepted connections inherit the listener's priority */
+    if ((sl->flags & SOF_PRIO) != 0) {
+      s->flags |= SOF_PRIO;
+      flextcp_connection_set_prio(ctx, c, 1);
+    }
   } else {
     s->data.connection.status = SOC_FAILED;
     flextcp_epoll_set(s, EPOLLERR);
@@ -256,6 +262,10 @@ static inline void ev_conn_open(struct flextcp_context *ctx,
   if (ev->ev.conn_open.status == 0) {
     s->data.connection.status = SOC_CONNECTED;
     flextcp_epoll_set(s, EPOLLOUT);
+
+    if ((s->flags & SOF_PRIO) != 0) {
+      flextcp_connection_set_prio(ctx, c, 1);
+    }
   } else {
     s->data.connection.status = SOC_FAILED;
     flextcp_epoll_set(s, EPOLLERR);
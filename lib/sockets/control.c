@@ -809,7 +809,28 @@ int tas_setsockopt(int sockfd, int level, int optname, const void *optval,
   } else if (level == SOL_SOCKET && optname == SO_KEEPALIVE) {
     /* ignore silently */
   } else if (level == SOL_SOCKET && optname == SO_PRIORITY) {
-    /* ignore silently */
+    if (optlen != sizeof(int)) {
+      errno = EINVAL;
+      ret = -1;
+      goto out;
+    }
+
+    /* any non-zero priority maps to the fast path latency class, applied
+     * once the connection is established if it is not yet */
+    if (*(int *) optval > 0) {
+      s->flags |= SOF_PRIO;
+    } else {
+      s->flags &= ~SOF_PRIO;
+    }
+    if (s->type == SOCK_CONNECTION &&
+        s->data.connection.status == SOC_CONNECTED &&
+        flextcp_connection_set_prio(flextcp_sockctx_get(),
+          &s->data.connection.c, !!(s->flags & SOF_PRIO)) != 0)
+    {
+      errno = ENOBUFS;
+      ret = -1;
+      goto out;
+    }
   } else if (level == IPPROTO_TCP && (optname == TCP_KEEPIDLE ||
        optname == TCP_KEEPINTVL || optname == TCP_KEEPCNT)) {
     /* ignore silently */
@@ -49,6 +49,7 @@ enum socket_flags {
   SOF_BOUND = 2,
   SOF_REUSEPORT = 4,
   SOF_CLOEXEC = 8,
+  SOF_PRIO = 16,
 };
 
 enum conn_status {
@@ -426,6 +426,38 @@ int flextcp_connection_move(struct flextcp_context *ctx,
   return 0;
 }
 
+int flextcp_connection_set_prio(struct flextcp_context *ctx,
+    struct flextcp_connection *conn, uint8_t prio)
+{
+  uint32_t pos = ctx->kin_head;
+  struct kernel_appout *kin = ctx->kin_base;
+
+  kin += pos;
+
+  if (kin->type != KERNEL_APPOUT_INVALID) {
+    fprintf(stderr, "flextcp_connection_set_prio: no queue space\n");
+    return -1;
+  }
+
+  kin->data.conn_prio.local_ip = conn->local_ip;
+  kin->data.conn_prio.remote_ip = conn->remote_ip;
+  kin->data.conn_prio.local_port = conn->local_port;
+  kin->data.conn_prio.remote_port = conn->remote_port;
+  kin->data.conn_prio.opaque = OPAQUE(conn);
+  kin->data.conn_prio.prio = prio;
+  MEM_BARRIER();
+  kin->type = KERNEL_APPOUT_CONN_PRIO;
+  flextcp_kernel_kick();
+
+  pos = pos + 1;
+  if (pos >= ctx->kin_len) {
+    pos = 0;
+  }
+  ctx->kin_head = pos;
+
+  return 0;
+}
+
 static void connection_init(struct flextcp_connection *conn)
 {
   memset(conn, 0, sizeof(*conn));
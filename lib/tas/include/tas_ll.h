@@ -63,6 +63,8 @@ struct flextcp_context {
   struct {
     void *txq_base;
     void *rxq_base;
+    /* tells the fast path core to look at txq */
+    volatile uint32_t *txdb;
     uint32_t rxq_head;
     uint32_t txq_tail;
     uint32_t txq_avail;
@@ -84,6 +86,8 @@ struct flextcp_context {
 
   /* waiting */
   uint64_t last_inev_ts;
+  /* set while about to block, fast path only signals evfd if set */
+  volatile uint32_t *sleeping;
   int evfd;
 };
 
@@ -276,6 +280,20 @@ void flextcp_context_waitclear(struct flextcp_context *ctx);
  */
 int flextcp_context_wait(struct flextcp_context *ctx, int timeout_ms);
 
+/**
+ * Set the transmit scheduling weight and aggregate rate cap of this
+ * application on the fast path (asynchronous, applies to all contexts of the
+ * application). Fast path cores share transmit opportunities between
+ * applications with pending data in proportion to their weights.
+ *
+ * @param weight   Relative weight, 0 for the default weight of 1
+ * @param max_rate Aggregate transmit rate cap in Kbps, 0 for none
+ *
+ * @return 0 on success, -1 if the kernel queue is full.
+ */
+int flextcp_context_set_weight(struct flextcp_context *ctx, uint16_t weight,
+    uint32_t max_rate);
+
 /*****************************************************************************/
 /* Regular TCP connection management */
 
@@ -333,6 +351,18 @@ int flextcp_connection_tx_possible(struct flextcp_context *ctx,
 int flextcp_connection_move(struct flextcp_context *ctx,
         struct flextcp_connection *conn);
 
+/**
+ * Mark connection as latency sensitive (asynchronous). Segments of
+ * connections with priority are sent ahead of other connections on the same
+ * fast path core, for small messages such as RPCs.
+ *
+ * @param prio  1 for priority, 0 for regular scheduling
+ *
+ * @return 0 on success, -1 if the kernel queue is full.
+ */
+int flextcp_connection_set_prio(struct flextcp_context *ctx,
+    struct flextcp_connection *conn, uint8_t prio);
+
 /** @} */
 
 #endif /* ndef TAS_LL_H_ */
@@ -524,6 +524,10 @@ void flextcp_context_tx_done(struct flextcp_context *ctx, uint16_t core)
 
   ctx->queues[core].txq_avail -= sizeof(struct flextcp_pl_atx);
 
+  /* entry must be visible before the fast path sees the doorbell */
+  MEM_BARRIER();
+  *ctx->queues[core].txdb = 1;
+
   flextcp_flexnic_kick(ctx, core);
 }
 
@@ -927,6 +931,32 @@ int flextcp_context_waitfd(struct flextcp_context *ctx)
   return ctx->evfd;
 }
 
+/* Tell the fast path that we are about to block, so it signals evfd for new
+ * entries. Returns -1 and backs off if entries arrived in the meantime. */
+static int context_announce_sleep(struct flextcp_context *ctx)
+{
+  volatile struct flextcp_pl_arx *arx;
+  uint16_t i;
+
+  *ctx->sleeping = 1;
+  /* pairs with the barrier in the fast path between adding entries and
+   * checking the flag */
+  __sync_synchronize();
+
+  for (i = 0; i < ctx->num_queues; i++) {
+    arx = (volatile struct flextcp_pl_arx *)
+      ((uint8_t *) ctx->queues[i].rxq_base + ctx->queues[i].rxq_head);
+    if (arx->type != FLEXTCP_PL_ARX_INVALID) {
+      *ctx->sleeping = 0;
+      ctx->flags &= ~(CTX_FLAG_WANTWAIT | CTX_FLAG_LASTWAIT |
+          CTX_FLAG_POLL_CALLED);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
 int flextcp_context_canwait(struct flextcp_context *ctx)
 {
   /* At a high level this code implements a state machine that ensures that at
@@ -964,8 +994,9 @@ int flextcp_context_canwait(struct flextcp_context *ctx)
     /* in last wait state */
     if ((ctx->flags & CTX_FLAG_POLL_CALLED) != 0) {
       /* if we have polled once more after the grace period, we're good to go to
-       * sleep */
-      return 0;
+       * sleep, unless the fast path added entries before it could see the
+       * sleeping flag */
+      return context_announce_sleep(ctx);
     }
   } else if ((ctx->flags & CTX_FLAG_POLL_CALLED) != 0) {
     /* not currently getting ready to wait, so start */
@@ -988,6 +1019,7 @@ void flextcp_context_waitclear(struct flextcp_context *ctx)
     perror("flextcp_context_waitclear: read failed");
     abort();
   }
+  *ctx->sleeping = 0;
 
   ctx->flags &= ~(CTX_FLAG_WANTWAIT | CTX_FLAG_LASTWAIT | CTX_FLAG_POLL_CALLED);
 }
@@ -27,6 +27,7 @@
 #include <unistd.h>
 #include <sys/un.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 
 #include <kernel_appif.h>
@@ -164,9 +165,14 @@ int flextcp_kernel_newctx(struct flextcp_context *ctx)
   struct kernel_uxsock_request req = {
       .rxq_len = NIC_RXQ_LEN,
       .txq_len = NIC_TXQ_LEN,
+      .numa_node = 0,
     };
+  unsigned cpu;
   uint16_t i;
 
+  /* let TAS place the queues on our node */
+  syscall(SYS_getcpu, &cpu, &req.numa_node, NULL);
+
   /* send request on kernel socket */
   struct iovec iov = {
     .iov_base = &req,
@@ -236,6 +242,9 @@ int flextcp_kernel_newctx(struct flextcp_context *ctx)
   ctx->kout_len = resp->app_in_len /  sizeof(struct kernel_appin);
   ctx->kout_head = 0;
 
+  ctx->sleeping = (volatile uint32_t *) ((uint8_t *) flexnic_mem +
+      resp->sleep_off);
+
   ctx->db_id = resp->flexnic_db_id;
   ctx->num_queues = resp->flexnic_qs_num;
   ctx->next_queue = 0;
@@ -248,6 +257,8 @@ int flextcp_kernel_newctx(struct flextcp_context *ctx)
       (uint8_t *) flexnic_mem + resp->flexnic_qs[i].rxq_off;
     ctx->queues[i].txq_base =
       (uint8_t *) flexnic_mem + resp->flexnic_qs[i].txq_off;
+    ctx->queues[i].txdb = (volatile uint32_t *) ((uint8_t *) flexnic_mem +
+        resp->txdb_off + i * KERNEL_TXDB_STRIDE);
 
     ctx->queues[i].rxq_head = 0;
     ctx->queues[i].txq_tail = 0;
@@ -283,3 +294,31 @@ int flextcp_kernel_reqscale(struct flextcp_context *ctx, uint32_t cores)
 
   return 0;
 }
+
+int flextcp_context_set_weight(struct flextcp_context *ctx, uint16_t weight,
+    uint32_t max_rate)
+{
+  uint32_t pos = ctx->kin_head;
+  struct kernel_appout *kin = ctx->kin_base;
+
+  kin += pos;
+
+  if (kin->type != KERNEL_APPOUT_INVALID) {
+    fprintf(stderr, "flextcp_context_set_weight: no queue space\n");
+    return -1;
+  }
+
+  kin->data.set_weight.weight = weight;
+  kin->data.set_weight.max_rate = max_rate;
+  MEM_BARRIER();
+  kin->type = KERNEL_APPOUT_SET_WEIGHT;
+  flextcp_kernel_kick();
+
+  pos = pos + 1;
+  if (pos >= ctx->kin_len) {
+    pos = 0;
+  }
+  ctx->kin_head = pos;
+
+  return 0;
+}
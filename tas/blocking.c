@@ -63,9 +63,22 @@ void notify_app_core(int appfd, uint64_t *last_ts)
   notify_core(appfd, last_ts, util_rdtsc(), tas_info->poll_cycle_app);
 }
 
-void notify_appctx(struct flextcp_pl_appctx *ctx, uint64_t tsc)
+void notify_appctx(struct flextcp_pl_appctx *ctx)
 {
-  notify_core(ctx->evfd, &ctx->last_ts, tsc, tas_info->poll_cycle_app);
+  volatile uint32_t *sleeping;
+  uint64_t val = 1;
+
+  /* only wake up the app if it announced that it is about to block, clearing
+   * the flag ensures that only one core issues the write */
+  sleeping = (volatile uint32_t *) ((uint8_t *) tas_shm + ctx->sleep_base);
+  if (*sleeping == 0 || !__sync_bool_compare_and_swap(sleeping, 1, 0)) {
+    return;
+  }
+
+  if (write(ctx->evfd, &val, sizeof(uint64_t)) != sizeof(uint64_t)) {
+    perror("notify_appctx: write failed");
+    abort();
+  }
 }
 
 void notify_slowpath_core(void)
@@ -31,6 +31,7 @@
 #include <unistd.h>
 
 #include <utils.h>
+#include <tas_memif.h>
 
 #include <config.h>
 
@@ -70,13 +71,27 @@ enum cfg_params {
   CP_IP_ROUTE,
   CP_IP_ADDR,
   CP_FP_CORES_MAX,
+  CP_FP_FLOWS,
+  CP_FP_APP_CTXS,
+  CP_FP_QMAN,
   CP_FP_NO_INTS,
   CP_FP_NO_XSUMOFFLOAD,
   CP_FP_NO_AUTOSCALE,
   CP_FP_NO_HUGEPAGES,
   CP_FP_VLAN_STRIP,
+  CP_FP_NUMA,
   CP_FP_POLL_INTERVAL_TAS,
   CP_FP_POLL_INTERVAL_APP,
+  CP_FP_TSO_MAX,
+  CP_FP_ACK_SEGS,
+  CP_FP_ACK_DELAY,
+  CP_FP_TX_ZEROCOPY,
+  CP_FP_MBUFS,
+  CP_FP_MBUFS_SHARED,
+  CP_FP_BUFCACHE,
+  CP_FP_RX_DESCS,
+  CP_FP_TX_DESCS,
+  CP_FP_TXQ_LEN,
   CP_KNI_NAME,
   CP_READY_FD,
   CP_DPDK_EXTRA,
@@ -189,6 +204,15 @@ static struct option opts[] = {
     { .name = "fp-cores-max",
       .has_arg = required_argument,
       .val = CP_FP_CORES_MAX },
+    { .name = "fp-flows",
+      .has_arg = required_argument,
+      .val = CP_FP_FLOWS },
+    { .name = "fp-app-ctxs",
+      .has_arg = required_argument,
+      .val = CP_FP_APP_CTXS },
+    { .name = "fp-qman",
+      .has_arg = required_argument,
+      .val = CP_FP_QMAN },
     { .name = "fp-no-ints",
       .has_arg = no_argument,
       .val = CP_FP_NO_INTS },
@@ -204,12 +228,45 @@ static struct option opts[] = {
     { .name = "fp-vlan-strip",
       .has_arg = no_argument,
       .val = CP_FP_VLAN_STRIP },
+    { .name = "fp-numa",
+      .has_arg = no_argument,
+      .val = CP_FP_NUMA },
     { .name = "fp-poll-interval-tas",
       .has_arg = required_argument,
       .val = CP_FP_POLL_INTERVAL_TAS },
     { .name = "fp-poll-interval-app",
       .has_arg = required_argument,
       .val = CP_FP_POLL_INTERVAL_APP },
+    { .name = "fp-tso-max",
+      .has_arg = required_argument,
+      .val = CP_FP_TSO_MAX },
+    { .name = "fp-ack-segs",
+      .has_arg = required_argument,
+      .val = CP_FP_ACK_SEGS },
+    { .name = "fp-ack-delay",
+      .has_arg = required_argument,
+      .val = CP_FP_ACK_DELAY },
+    { .name = "fp-tx-zerocopy",
+      .has_arg = no_argument,
+      .val = CP_FP_TX_ZEROCOPY },
+    { .name = "fp-mbufs",
+      .has_arg = required_argument,
+      .val = CP_FP_MBUFS },
+    { .name = "fp-mbufs-shared",
+      .has_arg = required_argument,
+      .val = CP_FP_MBUFS_SHARED },
+    { .name = "fp-bufcache",
+      .has_arg = required_argument,
+      .val = CP_FP_BUFCACHE },
+    { .name = "fp-rx-descs",
+      .has_arg = required_argument,
+      .val = CP_FP_RX_DESCS },
+    { .name = "fp-tx-descs",
+      .has_arg = required_argument,
+      .val = CP_FP_TX_DESCS },
+    { .name = "fp-txq-len",
+      .has_arg = required_argument,
+      .val = CP_FP_TXQ_LEN },
     { .name = "kni-name",
       .has_arg = required_argument,
       .val = CP_KNI_NAME },
@@ -459,11 +516,18 @@ int config_parse(struct configuration *c, int argc, char *argv[])
         }
         break;
       case CP_IP_ADDR:
-        c->ip_prefix = 0;
-        if (parse_cidr(optarg, &c->ip, &c->ip_prefix) != 0) {
+        if (c->ip_num >= CONFIG_PORTS_MAX) {
+          fprintf(stderr, "More than %u IP addresses\n", CONFIG_PORTS_MAX);
+          goto failed;
+        }
+        c->ip_prefix[c->ip_num] = 0;
+        if (parse_cidr(optarg, &c->ip[c->ip_num], &c->ip_prefix[c->ip_num])
+            != 0)
+        {
           fprintf(stderr, "Parsing IP failed\n");
           goto failed;
         }
+        c->ip_num++;
         break;
       case CP_FP_CORES_MAX:
         if (parse_int32(optarg, &c->fp_cores_max) != 0) {
@@ -471,6 +535,31 @@ int config_parse(struct configuration *c, int argc, char *argv[])
           goto failed;
         }
         break;
+      case CP_FP_FLOWS:
+        if (parse_int32(optarg, &c->fp_flows) != 0 || c->fp_flows == 0) {
+          fprintf(stderr, "fp flows parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_APP_CTXS:
+        if (parse_int32(optarg, &c->fp_app_ctxs) != 0 ||
+            c->fp_app_ctxs < 2 || c->fp_app_ctxs > FLEXNIC_PL_APPCTX_MAX)
+        {
+          fprintf(stderr, "fp app ctxs parsing failed (2 to %u)\n",
+              FLEXNIC_PL_APPCTX_MAX);
+          goto failed;
+        }
+        break;
+      case CP_FP_QMAN:
+        if (!strcmp(optarg, "skiplist")) {
+          c->fp_qman = CONFIG_QMAN_SKIPLIST;
+        } else if (!strcmp(optarg, "wheel")) {
+          c->fp_qman = CONFIG_QMAN_WHEEL;
+        } else {
+          fprintf(stderr, "fp qman parsing failed\n");
+          goto failed;
+        }
+        break;
       case CP_FP_NO_INTS:
         c->fp_interrupts = 0;
         c->fp_poll_interval_tas = UINT32_MAX;
@@ -487,6 +576,9 @@ int config_parse(struct configuration *c, int argc, char *argv[])
       case CP_FP_VLAN_STRIP:
         c->fp_vlan_strip = 1;
         break;
+      case CP_FP_NUMA:
+        c->fp_numa = 1;
+        break;
       case CP_FP_POLL_INTERVAL_TAS:
         if (parse_int32(optarg, &c->fp_poll_interval_tas) != 0) {
           fprintf(stderr, "fp tas poll interval parsing failed\n");
@@ -498,6 +590,79 @@ int config_parse(struct configuration *c, int argc, char *argv[])
           goto failed;
         }
         break;
+      case CP_FP_TSO_MAX:
+        if (parse_int32(optarg, &c->fp_tso_max) != 0 ||
+            c->fp_tso_max > UINT16_MAX)
+        {
+          fprintf(stderr, "fp tso max parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_ACK_SEGS:
+        if (parse_int32(optarg, &c->fp_ack_segs) != 0 ||
+            c->fp_ack_segs == 0 || c->fp_ack_segs > UINT16_MAX)
+        {
+          fprintf(stderr, "fp ack segs parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_ACK_DELAY:
+        if (parse_int32(optarg, &c->fp_ack_delay) != 0) {
+          fprintf(stderr, "fp ack delay parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_TX_ZEROCOPY:
+        c->fp_tx_zerocopy = 1;
+        break;
+      case CP_FP_MBUFS:
+        if (parse_int32(optarg, &c->fp_mbufs) != 0 || c->fp_mbufs == 0) {
+          fprintf(stderr, "fp mbufs parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_MBUFS_SHARED:
+        if (parse_int32(optarg, &c->fp_mbufs_shared) != 0) {
+          fprintf(stderr, "fp shared mbufs parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_BUFCACHE:
+        if (parse_int32(optarg, &c->fp_bufcache) != 0 ||
+            c->fp_bufcache == 0 || c->fp_bufcache > 32768 ||
+            (c->fp_bufcache & (c->fp_bufcache - 1)) != 0)
+        {
+          fprintf(stderr, "fp bufcache parsing failed (power of 2 up to "
+              "32768)\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_RX_DESCS:
+        if (parse_int32(optarg, &c->fp_rx_descs) != 0 ||
+            c->fp_rx_descs == 0 || c->fp_rx_descs > UINT16_MAX)
+        {
+          fprintf(stderr, "fp rx descriptors parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_TX_DESCS:
+        if (parse_int32(optarg, &c->fp_tx_descs) != 0 ||
+            c->fp_tx_descs == 0 || c->fp_tx_descs > UINT16_MAX)
+        {
+          fprintf(stderr, "fp tx descriptors parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_TXQ_LEN:
+        if (parse_int32(optarg, &c->fp_txq_len) != 0 ||
+            c->fp_txq_len == 0 || c->fp_txq_len > 32768 ||
+            (c->fp_txq_len & (c->fp_txq_len - 1)) != 0)
+        {
+          fprintf(stderr, "fp txq len parsing failed (power of 2 up to "
+              "32768)\n");
+          goto failed;
+        }
+        break;
        break;
 
       case CP_KNI_NAME:
@@ -537,8 +702,9 @@ int config_parse(struct configuration *c, int argc, char *argv[])
     goto failed;
   }
 
-  if(c->ip == 0) {
+  if(c->ip_num == 0) {
     fprintf(stderr, "ip-addr is a required argument!\n");
+    goto failed;
   }
 
   return 0;
@@ -551,7 +717,7 @@ failed:
 
 static int config_defaults(struct configuration *c, char *progname)
 {
-  c->ip = 0;
+  c->ip_num = 0;
   c->shm_len = 1024 * 1024 * 1024;
   c->nic_rx_len = 16 * 1024;
   c->nic_tx_len = 16 * 1024;
@@ -585,13 +751,27 @@ static int config_defaults(struct configuration *c, char *progname)
   c->cc_timely_min_rtt = 11;
   c->cc_timely_min_rate = 10000;
   c->fp_cores_max = 1;
+  c->fp_flows = 128 * 1024;
+  c->fp_app_ctxs = 16;
+  c->fp_qman = CONFIG_QMAN_SKIPLIST;
   c->fp_interrupts = 1;
   c->fp_xsumoffload = 1;
   c->fp_autoscale = 1;
   c->fp_hugepages = 1;
   c->fp_vlan_strip = 0;
+  c->fp_numa = 0;
   c->fp_poll_interval_tas = 10000;
   c->fp_poll_interval_app = 10000;
+  c->fp_tso_max = 0;
+  c->fp_ack_segs = 1;
+  c->fp_ack_delay = 100;
+  c->fp_tx_zerocopy = 0;
+  c->fp_mbufs = 2048;
+  c->fp_mbufs_shared = 4096;
+  c->fp_bufcache = 128;
+  c->fp_rx_descs = 256;
+  c->fp_tx_descs = 128;
+  c->fp_txq_len = 1024;
   c->kni_name = NULL;
   c->ready_fd = -1;
   c->quiet = 0;
@@ -673,7 +853,8 @@ static void print_usage(struct configuration *c, char *progname)
       "\n"
       "IP protocol parameters:\n"
       "  --ip-route=DEST[/PREFIX],NEXTHOP  Add route\n"
-      "  --ip-addr=ADDR[/PREFIXLEN]        Set local IP address\n"
+      "  --ip-addr=ADDR[/PREFIXLEN]        Set local IP address, repeat for\n"
+      "                                    each network port\n"
       "\n"
       "ARP protocol parameters:\n"
       "  --arp-timeout=TIMEOUT       ARP request timeout (us) "
@@ -684,6 +865,13 @@ static void print_usage(struct configuration *c, char *progname)
       "Fast path:\n"
       "  --fp-cores-max=CORES        Max cores used for fast path "
           "[default: %"PRIu32"]\n"
+      "  --fp-flows=N                Max number of concurrent flows "
+          "[default: %"PRIu32"]\n"
+      "  --fp-app-ctxs=N             Max number of app contexts "
+          "[default: %"PRIu32"]\n"
+      "  --fp-qman=BACKEND           Queue manager for rate-limited flows "
+          "[default: skiplist]\n"
+      "     Options: skiplist, wheel\n"
       "  --fp-no-ints                Disable Interrupts "
           "[default: enabled]\n"
       "  --fp-no-xsumoffload         Disable TX Checksum offload "
@@ -692,10 +880,32 @@ static void print_usage(struct configuration *c, char *progname)
           "[default: enabled]\n"
       "  --fp-no-hugepages           Disable hugepages for SHM "
           "[default: enabled]\n"
+      "  --fp-numa                   Split SHM across NUMA nodes "
+          "[default: disabled]\n"
       "  --fp-poll-interval-tas      TAS polling interval before blocking "
           "in us [default: %"PRIu32"]\n"
       "  --fp-poll-interval-app      App polling interval before blocking "
           "in us [default: %"PRIu32"]\n"
+      "  --fp-tso-max=BYTES          Max payload per TCP segmentation "
+          "offload segment [default: disabled]\n"
+      "  --fp-ack-segs=N             Send ACK every N in-order segments "
+          "[default: %"PRIu32"]\n"
+      "  --fp-ack-delay=US           Max delay for delayed ACKs in us "
+          "[default: %"PRIu32"]\n"
+      "  --fp-tx-zerocopy            Send payload directly from app buffers "
+          "[default: disabled]\n"
+      "  --fp-mbufs=N                Packet buffers per core "
+          "[default: %"PRIu32"]\n"
+      "  --fp-mbufs-shared=N         Overflow packet buffers shared by cores "
+          "[default: %"PRIu32"]\n"
+      "  --fp-bufcache=N             Packet buffers cached per core "
+          "[default: %"PRIu32"]\n"
+      "  --fp-rx-descs=N             NIC receive descriptors per queue "
+          "[default: %"PRIu32"]\n"
+      "  --fp-tx-descs=N             NIC transmit descriptors per queue "
+          "[default: %"PRIu32"]\n"
+      "  --fp-txq-len=N              Packets queued per core while NIC is "
+          "full [default: %"PRIu32"]\n"
       "  --dpdk-extra=ARG            Add extra DPDK argument\n"
       "\n"
       "Host kernel interface:\n"
@@ -719,7 +929,10 @@ static void print_usage(struct configuration *c, char *progname)
       (double) c->cc_timely_alpha / UINT32_MAX,
       (double) c->cc_timely_beta / UINT32_MAX, c->cc_timely_min_rtt,
       c->cc_timely_min_rate, c->arp_to, c->arp_to_max,
-      c->fp_cores_max, c->fp_poll_interval_tas, c->fp_poll_interval_app);
+      c->fp_cores_max, c->fp_flows, c->fp_app_ctxs, c->fp_poll_interval_tas,
+      c->fp_poll_interval_app,
+      c->fp_ack_segs, c->fp_ack_delay, c->fp_mbufs, c->fp_mbufs_shared,
+      c->fp_bufcache, c->fp_rx_descs, c->fp_tx_descs, c->fp_txq_len);
 }
 
 static inline int parse_int64(const char *s, uint64_t *pi)
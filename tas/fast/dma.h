@@ -32,6 +32,8 @@
 #include <rte_memcpy.h>
 #include <tas.h>
 
+#include "xsum.h"
+
 #ifdef DATAPLANE_STATS
 void dma_dump_stats(void);
 #endif
@@ -52,6 +54,26 @@ static inline void dma_read(uintptr_t addr, size_t len, void *buf)
 #endif
 }
 
+/** Like dma_read(), but also adds the ones' complement sum of the data to
+ * `sum` while copying and returns it */
+static inline uint32_t dma_read_xsum(uintptr_t addr, size_t len, void *buf,
+    uint32_t sum)
+{
+  assert(addr + len >= addr && addr + len <= config.shm_len);
+
+  sum = xsum_copy(buf, (uint8_t *) tas_shm + addr, len, sum);
+
+#ifdef FLEXNIC_TRACE_DMA
+  struct flexnic_trace_entry_dma evt = {
+      .addr = addr,
+      .len = len,
+    };
+  trace_event2(FLEXNIC_TRACE_EV_DMARD, sizeof(evt), &evt,
+      MIN(len, UINT16_MAX - sizeof(evt)), buf);
+#endif
+  return sum;
+}
+
 static inline void dma_write(uintptr_t addr, size_t len, const void *buf)
 {
   assert(addr + len >= addr && addr + len <= config.shm_len);
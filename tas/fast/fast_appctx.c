@@ -36,6 +36,36 @@ void fast_appctx_poll_pf(struct dataplane_context *ctx, uint32_t id)
   rte_prefetch0(dma_pointer(actx->tx_base + actx->tx_head, 1));
 }
 
+/* Returns bitmap of registered contexts that rang their tx doorbell on this
+ * core since the last call, and clears the doorbells. */
+uint64_t fast_appctx_doorbells(struct dataplane_context *ctx)
+{
+  struct flextcp_pl_appctx *actx;
+  volatile uint32_t *db;
+  uint64_t active = fp_state->appctx_active[ctx->id], rung = 0;
+  unsigned id;
+
+  while (active != 0) {
+    id = __builtin_ctzll(active);
+    active &= active - 1;
+
+    actx = &fp_state->appctx[ctx->id][id];
+    db = dma_pointer(actx->txdb_base, sizeof(*db));
+    if (*db != 0) {
+      *db = 0;
+      rung |= 1ULL << id;
+    }
+  }
+
+  /* clear doorbells before looking at the queues, so entries added after we
+   * found a queue empty ring it again */
+  if (rung != 0) {
+    __sync_synchronize();
+  }
+
+  return rung;
+}
+
 int fast_appctx_poll_fetch(struct dataplane_context *ctx, uint32_t id,
     void **pqe)
 {
@@ -65,14 +95,13 @@ int fast_appctx_poll_fetch(struct dataplane_context *ctx, uint32_t id,
 
   /* update RX/TX queue pointers for connection */
   flow_id = atx->msg.connupdate.flow_id;
-  if (flow_id >= FLEXNIC_PL_FLOWST_NUM) {
+  if (flow_id >= fp_state->flowst_num) {
     fprintf(stderr, "fast_appctx_poll: invalid flow id=%u\n", flow_id);
     abort();
   }
 
-  void *fs = &fp_state->flowst[flow_id];
-  rte_prefetch0(fs);
-  rte_prefetch0(fs + 64);
+  rte_prefetch0(&fp_state->flowst[flow_id]);
+  rte_prefetch0(&fp_state->flowst_cold[flow_id]);
 
   actx->tx_head += sizeof(*atx);
   if (actx->tx_head >= actx->tx_len)
@@ -85,8 +114,19 @@ int fast_appctx_poll_bump(struct dataplane_context *ctx, void *pqe,
     struct network_buf_handle *nbh, uint32_t ts)
 {
   struct flextcp_pl_atx *atx = pqe;
+  uint16_t owner;
   int ret;
 
+  /* flow owned by another core, it will complete the entry */
+  owner = flow_owner(ctx, &fp_state->flowst[atx->msg.connupdate.flow_id]);
+  if (owner != ctx->id) {
+    /* ring full, caller retries later */
+    if (flow_fwd(ctx, owner, (uintptr_t) atx | FLOW_FWD_BUMP) != 0) {
+      return -1;
+    }
+    return 1;
+  }
+
   ret = fast_flows_bump(ctx, atx->msg.connupdate.flow_id,
       atx->msg.connupdate.bump_seq, atx->msg.connupdate.rx_bump,
       atx->msg.connupdate.tx_bump, atx->msg.connupdate.flags, nbh, ts);
@@ -130,6 +170,11 @@ int fast_actx_rxq_alloc(struct dataplane_context *ctx,
   actx->rx_head = rxnhead;
   actx->rx_avail -= sizeof(*parx);
 
+  /* have poll_queues() reclaim space */
+  if (actx->rx_avail <= actx->rx_len / 2) {
+    ctx->actx_rxlow |= 1ULL << (actx - fp_state->appctx[ctx->id]);
+  }
+
   *arx = parx;
   return ret;
 }
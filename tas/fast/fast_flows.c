@@ -25,10 +25,10 @@
 #include <assert.h>
 #include <rte_config.h>
 #include <rte_ip.h>
-#include <rte_hash_crc.h>
+#include <rte_malloc.h>
 
 #include <tas_memif.h>
-#include <utils_sync.h>
+#include <flowht.h>
 
 #include "internal.h"
 #include "fastemu.h"
@@ -36,44 +36,127 @@
 
 #define TCP_MSS 1448
 #define TCP_MAX_RTT 100000
+/** Header bytes in data segments (incl. timestamp option) */
+#define TCP_TX_HDRLEN FLEXNIC_PL_TXHDR_LEN
+/** Timestamp option in segments built from the header template */
+#define TCP_TX_TSOPT(p) \
+  ((struct tcp_timestamp_opt *) ((uint8_t *) ((struct pkt_tcp *) (p) + 1) + 2))
+/** Max number of additional buffers chained for one TSO segment */
+#define TCP_TSO_SEGS ((UINT16_MAX + BUFFER_SIZE - 1) / BUFFER_SIZE)
+/** Smaller payloads are copied even with zero-copy transmit enabled */
+#define TCP_ZC_MIN 512
+/** Smaller payloads are summed after copying without checksum offload, the
+ * fused copy and checksum only pays off beyond this */
+#define TCP_XSUM_MIN 1024
 
 //#define SKIP_ACK 1
 
-struct flow_key {
-  ip_addr_t local_ip;
-  ip_addr_t remote_ip;
-  beui16_t local_port;
-  beui16_t remote_port;
-} __attribute__((packed));
-
-#if 1
-#define fs_lock(fs) util_spin_lock(&fs->lock)
-#define fs_unlock(fs) util_spin_unlock(&fs->lock)
-#else
-#define fs_lock(fs) do {} while (0)
-#define fs_unlock(fs) do {} while (0)
-#endif
+/* flags in rx_base_sp are also set by the slow path, so flag updates need to
+ * be atomic even though only the owner core modifies the rest of the state */
+#define fs_flag_set(fs, f) __sync_fetch_and_or(&(fs)->rx_base_sp, f)
+#define fs_flag_clear(fs, f) __sync_fetch_and_and(&(fs)->rx_base_sp, ~(f))
 
 
+static inline int flow_rx_packets(struct dataplane_context *ctx,
+    struct network_buf_handle **nbhs, struct flextcp_pl_flowst *fs,
+    struct tcp_opts *tos, uint16_t num, uint32_t ts);
+static inline uint16_t flow_rx_payload(const struct pkt_tcp *p);
+static inline int flow_rx_ack_delay(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, uint32_t flow_id, uint16_t segs,
+    uint32_t ts);
 static void flow_tx_read(struct flextcp_pl_flowst *fs, uint32_t pos,
     uint16_t len, void *dst);
+static uint32_t flow_tx_read_xsum(struct flextcp_pl_flowst *fs, uint32_t pos,
+    uint16_t len, void *dst);
 static void flow_rx_write(struct flextcp_pl_flowst *fs, uint32_t pos,
     uint16_t len, const void *src);
 #ifdef FLEXNIC_PL_OOO_RECV
 static void flow_rx_seq_write(struct flextcp_pl_flowst *fs, uint32_t seq,
     uint16_t len, const void *src);
+static int flow_rx_ooo_add(struct flextcp_pl_flowst *fs,
+    struct flextcp_pl_flowst_ooo *ooo, uint32_t seq, uint16_t len,
+    const void *src);
+static uint32_t flow_rx_ooo_catchup(struct flextcp_pl_flowst *fs,
+    struct flextcp_pl_flowst_ooo *ooo);
 #endif
+static inline uint16_t flow_tx_chunk(void);
+static inline uint8_t flow_qman_class(const struct flextcp_pl_flowst_cold *fc);
+static inline uint16_t flow_wnd_adv(const struct flextcp_pl_flowst *fs,
+    uint32_t rxwnd);
+static uint16_t flow_tx_alloc(struct dataplane_context *ctx, uint32_t flow_id,
+    uint32_t pos, uint32_t *len, struct network_buf_handle **segs);
 static void flow_tx_segment(struct dataplane_context *ctx,
-    struct network_buf_handle *nbh, struct flextcp_pl_flowst *fs,
-    uint32_t seq, uint32_t ack, uint32_t rxwnd, uint16_t payload,
-    uint32_t payload_pos, uint32_t ts_echo, uint32_t ts_my, uint8_t fin);
-static void flow_tx_ack(struct dataplane_context *ctx, uint32_t seq,
-    uint32_t ack, uint32_t rxwnd, uint32_t echo_ts, uint32_t my_ts,
-    struct network_buf_handle *nbh, struct tcp_timestamp_opt *ts_opt);
+    struct network_buf_handle *nbh, struct network_buf_handle **segs,
+    uint16_t nsegs, struct flextcp_pl_flowst *fs, uint32_t seq, uint32_t ack,
+    uint32_t rxwnd, uint16_t payload, uint32_t payload_pos, uint32_t ts_echo,
+    uint32_t ts_my, uint8_t fin);
+static void flow_tx_ack(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, uint32_t seq, uint32_t ack, uint16_t wnd,
+    uint32_t echo_ts, uint32_t my_ts, struct network_buf_handle *nbh,
+    const struct flextcp_pl_flowst_ooo *ooo);
 static void flow_reset_retransmit(struct flextcp_pl_flowst *fs);
+static inline void flow_tx_drop(struct flextcp_pl_flowst *fs);
+static inline uint32_t flow_tx_pos(const struct flextcp_pl_flowst *fs,
+    uint32_t seq);
+static uint32_t flow_sack_update(struct flextcp_pl_flowst *fs,
+    struct flextcp_pl_flowst_sack *sb, const struct tcp_sack_opt *opt,
+    uint32_t ts);
+static void flow_sack_recover(struct flextcp_pl_flowst *fs,
+    struct flextcp_pl_flowst_sack *sb, int rto);
+static uint32_t flow_sack_pending(const struct flextcp_pl_flowst *fs,
+    const struct flextcp_pl_flowst_sack *sb);
+static int flow_sack_next(struct flextcp_pl_flowst *fs,
+    struct flextcp_pl_flowst_sack *sb, uint32_t *seq, uint32_t *len);
 
 static inline void tcp_checksums(struct network_buf_handle *nbh,
     struct pkt_tcp *p, beui32_t ip_s, beui32_t ip_d, uint16_t l3_paylen);
+static inline void tcp_checksums_tmpl(struct network_buf_handle *nbh,
+    struct pkt_tcp *p, const struct flextcp_pl_flowst_hdr *fh,
+    uint16_t tcp_len, uint16_t sum_len, uint32_t payload_sum);
+static inline int tcp_checksums_ok(struct pkt_tcp *p);
+
+/* part of the flow state not touched for every segment */
+static inline struct flextcp_pl_flowst_cold *flow_cold(
+    const struct flextcp_pl_flowst *fs)
+{
+  return &fp_state->flowst_cold[fs - fp_state->flowst];
+}
+
+/* transmit header template of the flow */
+static inline struct flextcp_pl_flowst_hdr *flow_hdr(
+    const struct flextcp_pl_flowst *fs)
+{
+  return &fp_state->flowst_hdr[fs - fp_state->flowst];
+}
+
+/* copy headers from the flow's template into a segment and add the NOP, NOP,
+ * timestamp option prefix */
+static inline void flow_hdr_copy(struct pkt_tcp *p,
+    const struct flextcp_pl_flowst_hdr *fh)
+{
+  uint8_t *opt = (uint8_t *) (p + 1);
+
+  memcpy(p, fh->tmpl, sizeof(fh->tmpl));
+  opt[0] = opt[1] = TCP_OPT_NO_OP;
+  opt[2] = TCP_OPT_TIMESTAMP;
+  opt[3] = sizeof(struct tcp_timestamp_opt);
+}
+
+/* SACK scoreboard of the flow */
+static inline struct flextcp_pl_flowst_sack *flow_sack(
+    const struct flextcp_pl_flowst *fs)
+{
+  return &fp_state->flowst_sack[fs - fp_state->flowst];
+}
+
+#ifdef FLEXNIC_PL_OOO_RECV
+/* out-of-order intervals of the flow */
+static inline struct flextcp_pl_flowst_ooo *flow_ooo(
+    const struct flextcp_pl_flowst *fs)
+{
+  return &fp_state->flowst_ooo[fs - fp_state->flowst];
+}
+#endif
 
 void fast_flows_qman_pf(struct dataplane_context *ctx, uint32_t *queues,
     uint16_t n)
@@ -82,6 +165,7 @@ void fast_flows_qman_pf(struct dataplane_context *ctx, uint32_t *queues,
 
   for (i = 0; i < n; i++) {
     rte_prefetch0(&fp_state->flowst[queues[i]]);
+    rte_prefetch0(&fp_state->flowst_cold[queues[i]]);
   }
 }
 
@@ -89,12 +173,14 @@ void fast_flows_qman_pfbufs(struct dataplane_context *ctx, uint32_t *queues,
     uint16_t n)
 {
   struct flextcp_pl_flowst *fs;
+  struct flextcp_pl_flowst_cold *fc;
   uint16_t i;
   void *p;
 
   for (i = 0; i < n; i++) {
     fs = &fp_state->flowst[queues[i]];
-    p = dma_pointer(fs->tx_base + fs->tx_next_pos, 1);
+    fc = &fp_state->flowst_cold[queues[i]];
+    p = dma_pointer(fc->tx_base + fs->tx_next_pos, 1);
     rte_prefetch0(p);
     rte_prefetch0(p + 64);
   }
@@ -106,27 +192,25 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
 {
   uint32_t flow_id = queue;
   struct flextcp_pl_flowst *fs = &fp_state->flowst[flow_id];
+  struct flextcp_pl_flowst_cold *fc = &fp_state->flowst_cold[flow_id];
+  struct network_buf_handle *segs[TCP_TSO_SEGS];
   uint32_t avail, len, tx_pos, tx_seq, ack, rx_wnd;
-  uint16_t new_core;
+  uint16_t new_core, nsegs;
   uint8_t fin;
-  int ret = 0;
-
-  fs_lock(fs);
 
   /* if connection has been moved, add to forwarding queue and stop */
-  new_core = fp_state->flow_group_steering[fs->flow_group];
+  new_core = flow_owner(ctx, fs);
   if (new_core != ctx->id) {
     /*fprintf(stderr, "fast_flows_qman: arrived on wrong core, forwarding "
         "%u -> %u (fs=%p, fg=%u)\n", ctx->id, new_core, fs, fs->flow_group);*/
 
-    /* enqueue flo state on forwarding queue */
+    /* enqueue flo state on forwarding queue, or retry later if it is full */
     if (rte_ring_enqueue(ctxs[new_core]->qman_fwd_ring, fs) != 0) {
-      fprintf(stderr, "fast_flows_qman: rte_ring_enqueue failed\n");
-      abort();
+      fwd_retry_add(&ctx->qman_retry, fs);
     }
 
     /* clear queue manager queue */
-    if (qman_set(&ctx->qman, flow_id, 0, 0, 0,
+    if (qman_set(&ctx->qman, flow_id, 0, 0, 0, 0,
           QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_SET_AVAIL) != 0)
     {
       fprintf(stderr, "flast_flows_qman: qman_set clear failed, UNEXPECTED\n");
@@ -135,8 +219,20 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
 
     notify_fastpath_core(new_core);
 
-    ret = -1;
-    goto unlock;
+    return -1;
+  }
+
+  /* during SACK recovery, retransmit holes before sending new data */
+  if (UNLIKELY((fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXSACK) != 0) &&
+      flow_sack_next(fs, &fp_state->flowst_sack[flow_id], &tx_seq, &len) == 0)
+  {
+    tx_pos = flow_tx_pos(fs, tx_seq);
+    nsegs = flow_tx_alloc(ctx, flow_id, tx_pos, &len, segs);
+    fp_state->flowst_sack[flow_id].rexmit_next = tx_seq + len;
+
+    flow_tx_segment(ctx, nbh, segs, nsegs, fs, tx_seq, fs->rx_next_seq,
+        fs->rx_avail, len, tx_pos, fs->tx_next_ts, ts, 0);
+    return 0;
   }
 
   /* calculate how much is available to be sent */
@@ -152,10 +248,10 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
 #ifdef FLEXNIC_TRACING
   struct flextcp_pl_trev_afloqman te_afloqman = {
       .flow_id = flow_id,
-      .tx_base = fs->tx_base,
+      .tx_base = fc->tx_base,
       .tx_avail = fs->tx_avail,
       .tx_next_pos = fs->tx_next_pos,
-      .tx_len = fs->tx_len,
+      .tx_len = fc->tx_len,
       .rx_remote_avail = fs->rx_remote_avail,
       .tx_sent = fs->tx_sent,
     };
@@ -164,10 +260,10 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
 
   /* if there is no data available, stop */
   if (avail == 0) {
-    ret = -1;
-    goto unlock;
+    return -1;
   }
-  len = MIN(avail, TCP_MSS);
+  len = MIN(avail, flow_tx_chunk());
+  nsegs = flow_tx_alloc(ctx, flow_id, fs->tx_next_pos, &len, segs);
 
   /* state snapshot for creating segment */
   tx_seq = fs->tx_next_seq;
@@ -178,8 +274,8 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
   /* update tx flow state */
   fs->tx_next_seq += len;
   fs->tx_next_pos += len;
-  if (fs->tx_next_pos >= fs->tx_len) {
-    fs->tx_next_pos -= fs->tx_len;
+  if (fs->tx_next_pos >= fc->tx_len) {
+    fs->tx_next_pos -= fc->tx_len;
   }
   fs->tx_sent += len;
   fs->tx_avail -= len;
@@ -194,45 +290,58 @@ int fast_flows_qman(struct dataplane_context *ctx, uint32_t queue,
   }
 
   /* send out segment */
-  flow_tx_segment(ctx, nbh, fs, tx_seq, ack, rx_wnd, len, tx_pos,
+  flow_tx_segment(ctx, nbh, segs, nsegs, fs, tx_seq, ack, rx_wnd, len, tx_pos,
       fs->tx_next_ts, ts, fin);
-unlock:
-  fs_unlock(fs);
-  return ret;
+  return 0;
 }
 
 int fast_flows_qman_fwd(struct dataplane_context *ctx,
     struct flextcp_pl_flowst *fs)
 {
+  struct flextcp_pl_flowst_cold *fc = flow_cold(fs);
   unsigned avail;
-  uint16_t flow_id = fs - fp_state->flowst;
+  uint32_t flow_id = fs - fp_state->flowst;
+  uint16_t owner;
 
   /*fprintf(stderr, "fast_flows_qman_fwd: fs=%p\n", fs);*/
 
-  fs_lock(fs);
+  /* flow group moved on again before we got ownership */
+  owner = flow_owner(ctx, fs);
+  if (owner != ctx->id) {
+    if (rte_ring_enqueue(ctxs[owner]->qman_fwd_ring, fs) != 0) {
+      fwd_retry_add(&ctx->qman_retry, fs);
+      return 0;
+    }
+    notify_fastpath_core(owner);
+    return 0;
+  }
 
   avail = tcp_txavail(fs, NULL);
+  if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXSACK) != 0) {
+    avail += flow_sack_pending(fs, flow_sack(fs));
+  }
 
   /* re-arm queue manager */
-  if (qman_set(&ctx->qman, flow_id, fs->tx_rate, avail, TCP_MSS,
-        QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_SET_AVAIL) != 0)
+  if (qman_set(&ctx->qman, flow_id, flow_qman_class(fc), fc->tx_rate, avail,
+        flow_tx_chunk(), QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_SET_AVAIL) != 0)
   {
     fprintf(stderr, "fast_flows_qman_fwd: qman_set failed, UNEXPECTED\n");
     abort();
   }
 
-  fs_unlock(fs);
   return 0;
 }
 
 void fast_flows_packet_parse(struct dataplane_context *ctx,
     struct network_buf_handle **nbhs, void **fss, struct tcp_opts *tos,
-    uint16_t n)
+    uint8_t *drop, uint16_t n)
 {
   struct pkt_tcp *p;
   uint16_t i, len;
+  int xsums;
 
   for (i = 0; i < n; i++) {
+    drop[i] = 0;
     if (fss[i] == NULL)
       continue;
 
@@ -247,11 +356,23 @@ void fast_flows_packet_parse(struct dataplane_context *ctx,
         (IPH_HL(&p->ip) != 5) |
         (TCPH_HDRLEN(&p->tcp) < 5) |
         (len < f_beui16(p->ip.len) + sizeof(p->eth)) |
+        (f_beui16(p->ip.len) < sizeof(p->ip) + sizeof(p->tcp)) |
         (tcp_parse_options(p, len, &tos[i]) != 0) |
         (tos[i].ts == NULL);
 
-    if (cond)
+    if (cond) {
+      fss[i] = NULL;
+      continue;
+    }
+
+    /* drop corrupted segments before they touch the flow state, checksums
+     * the NIC did not verify are checked here */
+    xsums = network_buf_rxxsums(nbhs[i]);
+    if (UNLIKELY(xsums < 0 || (xsums == 0 && !tcp_checksums_ok(p)))) {
       fss[i] = NULL;
+      drop[i] = 1;
+      ctx->xsum_drop++;
+    }
   }
 }
 
@@ -279,21 +400,126 @@ int fast_flows_packet(struct dataplane_context *ctx,
     struct network_buf_handle *nbh, void *fsp, struct tcp_opts *opts,
     uint32_t ts)
 {
-  struct pkt_tcp *p = network_buf_bufoff(nbh);
-  struct flextcp_pl_flowst *fs = fsp;
+  return flow_rx_packets(ctx, &nbh, fsp, opts, 1, ts);
+}
+
+int fast_flows_packet_run(struct dataplane_context *ctx,
+    struct network_buf_handle **nbhs, void *fsp, struct tcp_opts *tos,
+    uint16_t num, uint32_t ts)
+{
+  return flow_rx_packets(ctx, nbhs, fsp, tos, num, ts);
+}
+
+void fast_flows_packet_gro(struct dataplane_context *ctx,
+    struct network_buf_handle **nbhs, void **fss, struct tcp_opts *tos,
+    uint16_t *runs, uint16_t n)
+{
+  struct network_buf_handle *o_nbhs[n];
+  void *o_fss[n];
+  struct tcp_opts o_tos[n];
+  struct pkt_tcp *p, *pl;
+  uint16_t i, j, k = 0, l, run, total;
+  uint8_t taken[n];
+  int merged = 0;
+
+  memset(taken, 0, sizeof(taken));
+  for (i = 0; i < n; i++) {
+    if (taken[i]) {
+      continue;
+    }
+
+    /* start new run */
+    runs[k] = 1;
+    o_nbhs[k] = nbhs[i];
+    o_fss[k] = fss[i];
+    o_tos[k] = tos[i];
+    run = k++;
+
+    p = network_buf_bufoff(nbhs[i]);
+    if (fss[i] == NULL || tos[i].sack != NULL ||
+        IPH_ECN(&p->ip) == IP_ECN_CE ||
+        (TCPH_FLAGS(&p->tcp) & ~TCP_PSH) != TCP_ACK ||
+        (total = flow_rx_payload(p)) == 0)
+    {
+      continue;
+    }
+
+    /* append in-order segments of the same flow, but stop at the first
+     * segment of the flow that does not fit to keep per-flow ordering */
+    for (l = i, j = i + 1; j < n; j++) {
+      if (taken[j] || fss[j] != fss[i]) {
+        continue;
+      }
+
+      pl = network_buf_bufoff(nbhs[l]);
+      p = network_buf_bufoff(nbhs[j]);
+      if (tos[j].sack != NULL || IPH_ECN(&p->ip) == IP_ECN_CE ||
+          (TCPH_FLAGS(&p->tcp) & ~TCP_PSH) != TCP_ACK ||
+          p->tcp.ackno.x != pl->tcp.ackno.x ||
+          f_beui32(p->tcp.seqno) !=
+            f_beui32(pl->tcp.seqno) + flow_rx_payload(pl) ||
+          flow_rx_payload(p) == 0 ||
+          total + flow_rx_payload(p) > UINT16_MAX)
+      {
+        break;
+      }
+
+      total += flow_rx_payload(p);
+      taken[j] = 1;
+      runs[run]++;
+      runs[k] = 0;
+      o_nbhs[k] = nbhs[j];
+      o_fss[k] = fss[j];
+      o_tos[k] = tos[j];
+      k++;
+      l = j;
+      merged = 1;
+    }
+  }
+
+  if (!merged) {
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    nbhs[i] = o_nbhs[i];
+    fss[i] = o_fss[i];
+    tos[i] = o_tos[i];
+  }
+}
+
+/* process `num` segments for one flow. With more than one segment, these
+ * must be in-order segments with identical acks prepared by
+ * fast_flows_packet_gro(), which are handled as one logical segment. If they
+ * can not be (e.g. they are not the next expected segments), returns -1
+ * without touching the flow state, and the caller processes them one by one.
+ * ACKs are sent out by reusing the buffer of the last segment. */
+static inline int flow_rx_packets(struct dataplane_context *ctx,
+    struct network_buf_handle **nbhs, struct flextcp_pl_flowst *fs,
+    struct tcp_opts *tos, uint16_t num, uint32_t ts)
+{
+  struct flextcp_pl_flowst_cold *fc = flow_cold(fs);
+  struct network_buf_handle *nbh = nbhs[num - 1];
+  struct pkt_tcp *p = network_buf_bufoff(nbhs[0]);
+  struct pkt_tcp *p_last = network_buf_bufoff(nbh), *p_i;
+  struct tcp_opts *opts = &tos[num - 1];
   uint32_t payload_bytes, payload_off, seq, ack, old_avail, new_avail,
            orig_payload;
   uint8_t *payload;
-  uint32_t rx_bump = 0, tx_bump = 0, rx_pos, rtt;
+  uint32_t rx_bump = 0, tx_bump = 0, tx_rexmit = 0, rx_pos, rtt, pos;
   int no_permanent_sp = 0;
-  uint16_t tcp_extra_hlen, trim_start, trim_end;
-  uint16_t flow_id = fs - fp_state->flowst;
-  int trigger_ack = 0, fin_bump = 0;
+  uint16_t tcp_extra_hlen, trim_start, trim_end, i, len;
+  uint32_t flow_id = fs - fp_state->flowst;
+  int trigger_ack = 0, fin_bump = 0, delay_ack = 0;
+  uint16_t owner;
 
   tcp_extra_hlen = (TCPH_HDRLEN(&p->tcp) - 5) * 4;
   payload_off = sizeof(*p) + tcp_extra_hlen;
   payload_bytes =
       f_beui16(p->ip.len) - (sizeof(p->ip) + sizeof(p->tcp) + tcp_extra_hlen);
+  for (i = 1; i < num; i++) {
+    payload_bytes += flow_rx_payload(network_buf_bufoff(nbhs[i]));
+  }
   orig_payload = payload_bytes;
 
 #if PL_DEBUG_ARX
@@ -304,7 +530,25 @@ int fast_flows_packet(struct dataplane_context *ctx,
       f_beui32(p->tcp.ackno), TCPH_FLAGS(&p->tcp), payload_bytes);
 #endif
 
-  fs_lock(fs);
+  /* flow belongs to another core, hand segments over one by one */
+  owner = flow_owner(ctx, fs);
+  if (UNLIKELY(owner != ctx->id)) {
+    if (num > 1) {
+      return -1;
+    }
+    if (flow_fwd(ctx, owner, (uintptr_t) nbh | FLOW_FWD_PACKET) != 0) {
+      /* drop, sender will retransmit */
+      return 0;
+    }
+    return 1;
+  }
+
+  /* the app context is not keeping up with connection updates, drop segments
+   * before they change flow state until its overflow queue drains, the sender
+   * retransmits them */
+  if (UNLIKELY((ctx->arx_ovf_blocked & (1ULL << fc->db_id)) != 0)) {
+    return 0;
+  }
 
 #ifdef FLEXNIC_TRACING
   struct flextcp_pl_trev_rxfs te_rxfs = {
@@ -335,11 +579,20 @@ int fast_flows_packet(struct dataplane_context *ctx,
       " rx_pos=%x rx_next_seq=%u rx_avail=%x  tx_pos=%x tx_next_seq=%u"
       " tx_sent=%u sp=%u\n",
       f_beui32(p->ip.dest), f_beui16(p->tcp.dest),
-      f_beui32(p->ip.src), f_beui16(p->tcp.src), fs->opaque, fs->rx_next_pos,
+      f_beui32(p->ip.src), f_beui16(p->tcp.src), fc->opaque, fs->rx_next_pos,
       fs->rx_next_seq, fs->rx_avail, fs->tx_next_pos, fs->tx_next_seq,
       fs->tx_sent, fs->slowpath);
 #endif
 
+  /* coalesced segments must be exactly the next expected ones */
+  if (num > 1 && ((fs->rx_base_sp & (FLEXNIC_PL_FLOWST_SLOWPATH |
+            FLEXNIC_PL_FLOWST_RXFIN)) != 0 ||
+        f_beui32(p->tcp.seqno) != fs->rx_next_seq ||
+        payload_bytes > fs->rx_avail))
+  {
+    return -1;
+  }
+
   /* state indicates slow path */
   if (UNLIKELY((fs->rx_base_sp & FLEXNIC_PL_FLOWST_SLOWPATH) != 0)) {
     fprintf(stderr, "dma_krx_pkt_fastpath: slowpath because of state\n");
@@ -376,16 +629,16 @@ int fast_flows_packet(struct dataplane_context *ctx,
 
   /* Stats for CC */
   if ((TCPH_FLAGS(&p->tcp) & TCP_ACK) == TCP_ACK) {
-    fs->cnt_rx_acks++;
+    fc->cnt_rx_acks += num;
   }
 
   /* if there is a valid ack, process it */
   if (LIKELY((TCPH_FLAGS(&p->tcp) & TCP_ACK) == TCP_ACK &&
       tcp_valid_rxack(fs, ack, &tx_bump) == 0))
   {
-    fs->cnt_rx_ack_bytes += tx_bump;
+    fc->cnt_rx_ack_bytes += tx_bump;
     if ((TCPH_FLAGS(&p->tcp) & TCP_ECE) == TCP_ECE) {
-      fs->cnt_rx_ecn_bytes += tx_bump;
+      fc->cnt_rx_ecn_bytes += tx_bump;
     }
 
     if (LIKELY(tx_bump <= fs->tx_sent)) {
@@ -394,8 +647,8 @@ int fast_flows_packet(struct dataplane_context *ctx,
 #ifdef ALLOW_FUTURE_ACKS
       fs->tx_next_seq += tx_bump - fs->tx_sent;
       fs->tx_next_pos += tx_bump - fs->tx_sent;
-      if (fs->tx_next_pos >= fs->tx_len)
-        fs->tx_next_pos -= fs->tx_len;
+      if (fs->tx_next_pos >= fc->tx_len)
+        fs->tx_next_pos -= fc->tx_len;
       fs->tx_avail -= tx_bump - fs->tx_sent;
       fs->tx_sent = 0;
 #else
@@ -405,13 +658,26 @@ int fast_flows_packet(struct dataplane_context *ctx,
 #endif
     }
 
+    /* update SACK scoreboard, this also detects losses */
+    if (UNLIKELY(opts->sack != NULL ||
+          (fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXSACK) != 0) &&
+        (fs->rx_base_sp & FLEXNIC_PL_FLOWST_SACK) != 0)
+    {
+      tx_rexmit = flow_sack_update(fs, flow_sack(fs), opts->sack, ts);
+    }
+
     /* duplicate ack */
     if (UNLIKELY(tx_bump != 0)) {
       fs->rx_dupack_cnt = 0;
     } else if (UNLIKELY(orig_payload == 0 && ++fs->rx_dupack_cnt >= 3)) {
-      /* reset to last acknowledged position */
-      flow_reset_retransmit(fs);
-      goto unlock;
+      if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXSACK) == 0) {
+        /* reset to last acknowledged position */
+        flow_reset_retransmit(fs);
+        goto out;
+      }
+
+      /* with SACK information losses are detected on the scoreboard */
+      fs->rx_dupack_cnt = 0;
     }
   }
 
@@ -420,7 +686,7 @@ int fast_flows_packet(struct dataplane_context *ctx,
   if (UNLIKELY(tcp_trim_rxbuf(fs, seq, payload_bytes, &trim_start, &trim_end) != 0)) {
     /* packet is completely outside of unused receive buffer */
     trigger_ack = 1;
-    goto unlock;
+    goto out;
   }
 
   /* trim payload to what we can actually use */
@@ -435,35 +701,15 @@ int fast_flows_packet(struct dataplane_context *ctx,
 
     /* if there is no payload abort immediately */
     if (payload_bytes == 0) {
-      goto unlock;
+      goto out;
     }
 
-    /* otherwise check if we can add it to the out of order interval */
-    if (fs->rx_ooo_len == 0) {
-      fs->rx_ooo_start = seq;
-      fs->rx_ooo_len = payload_bytes;
-      flow_rx_seq_write(fs, seq, payload_bytes, payload);
-      /*fprintf(stderr, "created OOO interval (%p start=%u len=%u)\n",
-          fs, fs->rx_ooo_start, fs->rx_ooo_len);*/
-    } else if (seq + payload_bytes == fs->rx_ooo_start) {
-      /* TODO: those two overlap checks should be more sophisticated */
-      fs->rx_ooo_start = seq;
-      fs->rx_ooo_len += payload_bytes;
-      flow_rx_seq_write(fs, seq, payload_bytes, payload);
-      /*fprintf(stderr, "extended OOO interval (%p start=%u len=%u)\n",
-          fs, fs->rx_ooo_start, fs->rx_ooo_len);*/
-    } else if (fs->rx_ooo_start + fs->rx_ooo_len == seq) {
-      /* TODO: those two overlap checks should be more sophisticated */
-      fs->rx_ooo_len += payload_bytes;
-      flow_rx_seq_write(fs, seq, payload_bytes, payload);
-      /*fprintf(stderr, "extended OOO interval (%p start=%u len=%u)\n",
-          fs, fs->rx_ooo_start, fs->rx_ooo_len);*/
-    } else {
-      /*fprintf(stderr, "Sad, no luck with OOO interval (%p ooo.start=%u "
-          "ooo.len=%u seq=%u bytes=%u)\n", fs, fs->rx_ooo_start,
-          fs->rx_ooo_len, seq, payload_bytes);*/
+    /* otherwise add it to the out of order intervals */
+    if (flow_rx_ooo_add(fs, flow_ooo(fs), seq, payload_bytes, payload) != 0) {
+      /*fprintf(stderr, "Sad, no free OOO interval (%p seq=%u bytes=%u)\n",
+          fs, seq, payload_bytes);*/
     }
-    goto unlock;
+    goto out;
   }
 
 #else
@@ -475,7 +721,7 @@ int fast_flows_packet(struct dataplane_context *ctx,
         "(got %u, expect %u, avail %u, payload %u)\n", seq, fs->rx_next_seq,
         fs->rx_avail, payload_bytes);
 #endif
-    goto unlock;
+    goto out;
   }
 
   /* trim payload to what we can actually use */
@@ -491,27 +737,43 @@ int fast_flows_packet(struct dataplane_context *ctx,
   {
     rtt = ts - f_beui32(opts->ts->ts_ecr);
     if (rtt < TCP_MAX_RTT) {
-      if (LIKELY(fs->rtt_est != 0)) {
-        fs->rtt_est = (fs->rtt_est * 7 + rtt) / 8;
+      if (LIKELY(fc->rtt_est != 0)) {
+        fc->rtt_est = (fc->rtt_est * 7 + rtt) / 8;
       } else {
-        fs->rtt_est = rtt;
+        fc->rtt_est = rtt;
       }
     }
   }
 
-  fs->rx_remote_avail = f_beui16(p->tcp.wnd);
+  fs->rx_remote_avail = (uint32_t) f_beui16(p_last->tcp.wnd) <<
+    (fs->wscale & 0xf);
 
   /* make sure we don't receive anymore payload after FIN */
   if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_RXFIN) == FLEXNIC_PL_FLOWST_RXFIN &&
       payload_bytes > 0)
   {
     fprintf(stderr, "fast_flows_packet: data after FIN dropped\n");
-    goto unlock;
+    goto out;
   }
 
   /* if there is payload, dma it to the receive buffer */
   if (payload_bytes > 0) {
-    flow_rx_write(fs, fs->rx_next_pos, payload_bytes, payload);
+    if (LIKELY(num == 1)) {
+      flow_rx_write(fs, fs->rx_next_pos, payload_bytes, payload);
+    } else {
+      /* coalesced segments, payload spread over multiple buffers */
+      for (i = 0, pos = fs->rx_next_pos; i < num; i++) {
+        p_i = network_buf_bufoff(nbhs[i]);
+        len = flow_rx_payload(p_i);
+        flow_rx_write(fs, pos, len, (uint8_t *) p_i + sizeof(*p_i) +
+            (TCPH_HDRLEN(&p_i->tcp) - 5) * 4);
+
+        pos += len;
+        if (pos >= fs->rx_len) {
+          pos -= fs->rx_len;
+        }
+      }
+    }
 
     rx_bump = payload_bytes;
     fs->rx_avail -= payload_bytes;
@@ -525,41 +787,17 @@ int fast_flows_packet(struct dataplane_context *ctx,
     trigger_ack = 1;
 #endif
 
+    /* ACKs for in-order data can be delayed, unless the segment fills a
+     * hole, is marked CE, or the window is about to close */
+    delay_ack = config.fp_ack_segs > 1 && fc->rx_ooo_len == 0 &&
+      IPH_ECN(&p->ip) != IP_ECN_CE &&
+      fs->rx_avail >= 2 * config.fp_ack_segs * TCP_MSS;
+
 #ifdef FLEXNIC_PL_OOO_RECV
     /* if we have out of order segments, check whether buffer is continuous
      * or superfluous */
-    if (UNLIKELY(fs->rx_ooo_len != 0)) {
-      if (tcp_trim_rxbuf(fs, fs->rx_ooo_start, fs->rx_ooo_len, &trim_start,
-            &trim_end) != 0) {
-          /*fprintf(stderr, "dropping ooo (%p ooo.start=%u ooo.len=%u seq=%u "
-              "len=%u next_seq=%u)\n", fs, fs->rx_ooo_start, fs->rx_ooo_len, seq,
-              payload_bytes, fs->rx_next_seq);*/
-        /* completely superfluous: drop out of order interval */
-        fs->rx_ooo_len = 0;
-      } else {
-        /* adjust based on overlap */
-        fs->rx_ooo_start += trim_start;
-        fs->rx_ooo_len -= trim_start + trim_end;
-        /*fprintf(stderr, "adjusting ooo (%p ooo.start=%u ooo.len=%u seq=%u "
-            "len=%u next_seq=%u)\n", fs, fs->rx_ooo_start, fs->rx_ooo_len, seq,
-            payload_bytes, fs->rx_next_seq);*/
-        if (fs->rx_ooo_len > 0 && fs->rx_ooo_start == fs->rx_next_seq) {
-          /* yay, we caught up, make continuous and drop OOO interval */
-          /*fprintf(stderr, "caught up with ooo buffer (%p start=%u len=%u)\n",
-              fs, fs->rx_ooo_start, fs->rx_ooo_len);*/
-
-          rx_bump += fs->rx_ooo_len;
-          fs->rx_avail -= fs->rx_ooo_len;
-          fs->rx_next_pos += fs->rx_ooo_len;
-          if (fs->rx_next_pos >= fs->rx_len) {
-            fs->rx_next_pos -= fs->rx_len;
-          }
-          assert(fs->rx_next_pos < fs->rx_len);
-          fs->rx_next_seq += fs->rx_ooo_len;
-
-          fs->rx_ooo_len = 0;
-        }
-      }
+    if (UNLIKELY(fc->rx_ooo_len != 0)) {
+      rx_bump += flow_rx_ooo_catchup(fs, flow_ooo(fs));
     }
 #endif
   }
@@ -567,18 +805,19 @@ int fast_flows_packet(struct dataplane_context *ctx,
   if ((TCPH_FLAGS(&p->tcp) & TCP_FIN) == TCP_FIN &&
       !(fs->rx_base_sp & FLEXNIC_PL_FLOWST_RXFIN))
   {
-    if (fs->rx_next_seq == f_beui32(p->tcp.seqno) + orig_payload && !fs->rx_ooo_len) {
+    if (fs->rx_next_seq == f_beui32(p->tcp.seqno) + orig_payload && !fc->rx_ooo_len) {
       fin_bump = 1;
-      fs->rx_base_sp |= FLEXNIC_PL_FLOWST_RXFIN;
+      fs_flag_set(fs, FLEXNIC_PL_FLOWST_RXFIN);
       /* FIN takes up sequence number space */
       fs->rx_next_seq++;
       trigger_ack = 1;
+      delay_ack = 0;
     } else {
       fprintf(stderr, "fast_flows_packet: ignored fin because out of order\n");
     }
   }
 
-unlock:
+out:
   /* if we bumped at least one, then we need to add a notification to the
    * queue */
   if (LIKELY(rx_bump != 0 || tx_bump != 0 || fin_bump)) {
@@ -595,14 +834,14 @@ unlock:
 
 #ifdef FLEXNIC_TRACING
     struct flextcp_pl_trev_arx te_arx = {
-        .opaque = fs->opaque,
+        .opaque = fc->opaque,
         .rx_bump = rx_bump,
         .tx_bump = tx_bump,
         .rx_pos = rx_pos,
         .flags = type,
 
         .flow_id = flow_id,
-        .db_id = fs->db_id,
+        .db_id = fc->db_id,
 
         .local_ip = f_beui32(p->ip.dest),
         .remote_ip = f_beui32(p->ip.src),
@@ -612,37 +851,53 @@ unlock:
     trace_event(FLEXNIC_PL_TREV_ARX, sizeof(te_arx), &te_arx);
 #endif
 
-    arx_cache_add(ctx, fs->db_id, fs->opaque, rx_bump, rx_pos, tx_bump, type);
+    arx_cache_add(ctx, fc->db_id, fc->opaque, rx_bump, rx_pos, tx_bump, type);
   }
 
-  /* Flow control: More receiver space? -> might need to start sending */
+  /* Flow control: More receiver space? -> might need to start sending.
+   * Also account for segments that need to be retransmitted. */
   new_avail = tcp_txavail(fs, NULL);
-  if (new_avail > old_avail) {
+  if (new_avail > old_avail || tx_rexmit > 0) {
     /* update qman queue */
-    if (qman_set(&ctx->qman, flow_id, fs->tx_rate, new_avail -
-          old_avail, TCP_MSS, QMAN_SET_RATE | QMAN_SET_MAXCHUNK
-          | QMAN_ADD_AVAIL) != 0)
+    if (qman_set(&ctx->qman, flow_id, flow_qman_class(fc), fc->tx_rate,
+          (new_avail > old_avail ? new_avail - old_avail : 0) + tx_rexmit,
+          flow_tx_chunk(), QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_ADD_AVAIL) != 0)
     {
       fprintf(stderr, "fast_flows_packet: qman_set 1 failed, UNEXPECTED\n");
       abort();
     }
   }
 
+  /* wait for more segments or the delayed ack timer if possible */
+  if (trigger_ack && delay_ack && flow_rx_ack_delay(ctx, fs, flow_id, num,
+        ts) == 0)
+  {
+    trigger_ack = 0;
+  }
+
   /* if we need to send an ack, also send packet to TX pipeline to do so */
   if (trigger_ack) {
-    flow_tx_ack(ctx, fs->tx_next_seq, fs->rx_next_seq, fs->rx_avail,
-        fs->tx_next_ts, ts, nbh, opts->ts);
+    fc->rx_ack_segs = 0;
+    flow_tx_ack(ctx, fs, fs->tx_next_seq, fs->rx_next_seq,
+        flow_wnd_adv(fs, fs->rx_avail),
+        fs->tx_next_ts, ts, nbh,
+#ifdef FLEXNIC_PL_OOO_RECV
+        (UNLIKELY(fc->rx_ooo_len != 0) &&
+         (fs->rx_base_sp & FLEXNIC_PL_FLOWST_SACK) != 0 ?
+         flow_ooo(fs) : NULL)
+#else
+        NULL
+#endif
+        );
   }
 
-  fs_unlock(fs);
   return trigger_ack;
 
 slowpath:
   if (!no_permanent_sp) {
-    fs->rx_base_sp |= FLEXNIC_PL_FLOWST_SLOWPATH;
+    fs_flag_set(fs, FLEXNIC_PL_FLOWST_SLOWPATH);
   }
 
-  fs_unlock(fs);
   /* TODO: should pass current flow state to kernel as well */
   return -1;
 }
@@ -653,16 +908,16 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
     struct network_buf_handle *nbh, uint32_t ts)
 {
   struct flextcp_pl_flowst *fs = &fp_state->flowst[flow_id];
+  struct flextcp_pl_flowst_cold *fc = &fp_state->flowst_cold[flow_id];
   uint32_t rx_avail_prev, old_avail, new_avail, tx_avail;
   int ret = -1;
 
-  fs_lock(fs);
 #ifdef FLEXNIC_TRACING
   struct flextcp_pl_trev_atx te_atx = {
       .rx_bump = rx_bump,
       .tx_bump = tx_bump,
       .bump_seq_ent = bump_seq,
-      .bump_seq_flow = fs->bump_seq,
+      .bump_seq_flow = fc->bump_seq,
       .flags = flags,
 
       .local_ip = f_beui32(fs->local_ip),
@@ -671,14 +926,14 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
       .remote_port = f_beui16(fs->remote_port),
 
       .flow_id = flow_id,
-      .db_id = fs->db_id,
+      .db_id = fc->db_id,
 
       .tx_next_pos = fs->tx_next_pos,
       .tx_next_seq = fs->tx_next_seq,
       .tx_avail_prev = fs->tx_avail,
       .rx_next_pos = fs->rx_next_pos,
       .rx_avail = fs->rx_avail,
-      .tx_len = fs->tx_len,
+      .tx_len = fc->tx_len,
       .rx_len = fs->rx_len,
       .rx_remote_avail = fs->rx_remote_avail,
       .tx_sent = fs->tx_sent,
@@ -688,15 +943,15 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
 
   /* TODO: is this still necessary? */
   /* catch out of order bumps */
-  if ((bump_seq >= fs->bump_seq &&
-        bump_seq - fs->bump_seq > (UINT16_MAX / 2)) ||
-      (bump_seq < fs->bump_seq &&
-       (fs->bump_seq < ((UINT16_MAX / 4) * 3) ||
+  if ((bump_seq >= fc->bump_seq &&
+        bump_seq - fc->bump_seq > (UINT16_MAX / 2)) ||
+      (bump_seq < fc->bump_seq &&
+       (fc->bump_seq < ((UINT16_MAX / 4) * 3) ||
        bump_seq > (UINT16_MAX / 4))))
   {
-    goto unlock;
+    goto out;
   }
-  fs->bump_seq = bump_seq;
+  fc->bump_seq = bump_seq;
 
   if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXFIN) == FLEXNIC_PL_FLOWST_TXFIN &&
       tx_bump != 0)
@@ -710,22 +965,22 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
   {
     /* Closing TX requires at least one byte (dummy) */
     fprintf(stderr, "fast_flows_bump: tx eos without dummy byte\n");
-    goto unlock;
+    goto out;
   }
 
   tx_avail = fs->tx_avail + tx_bump;
 
   /* validate tx bump */
-  if (tx_bump > fs->tx_len || tx_avail > fs->tx_len ||
-      tx_avail + fs->tx_sent > fs->tx_len)
+  if (tx_bump > fc->tx_len || tx_avail > fc->tx_len ||
+      tx_avail + fs->tx_sent > fc->tx_len)
   {
     fprintf(stderr, "fast_flows_bump: tx bump too large\n");
-    goto unlock;
+    goto out;
   }
   /* validate rx bump */
-  if (rx_bump > fs->rx_len || rx_bump + fs->rx_avail > fs->tx_len) {
+  if (rx_bump > fs->rx_len || rx_bump + fs->rx_avail > fc->tx_len) {
     fprintf(stderr, "fast_flows_bump: rx bump too large\n");
-    goto unlock;
+    goto out;
   }
   /* calculate how many bytes can be sent before and after this bump */
   old_avail = tcp_txavail(fs, NULL);
@@ -735,14 +990,14 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
   if ((flags & FLEXTCP_PL_ATX_FLTXDONE) == FLEXTCP_PL_ATX_FLTXDONE &&
       !(fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXFIN))
   {
-    fs->rx_base_sp |= FLEXNIC_PL_FLOWST_TXFIN;
+    fs_flag_set(fs, FLEXNIC_PL_FLOWST_TXFIN);
   }
 
   /* update queue manager queue */
   if (old_avail < new_avail) {
-    if (qman_set(&ctx->qman, flow_id, fs->tx_rate, new_avail -
-          old_avail, TCP_MSS, QMAN_SET_RATE | QMAN_SET_MAXCHUNK
-          | QMAN_ADD_AVAIL) != 0)
+    if (qman_set(&ctx->qman, flow_id, flow_qman_class(fc), fc->tx_rate,
+          new_avail - old_avail, flow_tx_chunk(), QMAN_SET_RATE |
+          QMAN_SET_MAXCHUNK | QMAN_ADD_AVAIL) != 0)
     {
       fprintf(stderr, "flast_flows_bump: qman_set 1 failed, UNEXPECTED\n");
       abort();
@@ -756,24 +1011,66 @@ int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
 
   /* receive buffer freed up from empty, need to send out a window update, if
    * we're not sending anyways. */
-  if (new_avail == 0 && rx_avail_prev == 0 && fs->rx_avail != 0) {
-    flow_tx_segment(ctx, nbh, fs, fs->tx_next_seq, fs->rx_next_seq,
+  if (new_avail == 0 && flow_wnd_adv(fs, rx_avail_prev) == 0 &&
+      flow_wnd_adv(fs, fs->rx_avail) != 0)
+  {
+    flow_tx_segment(ctx, nbh, NULL, 0, fs, fs->tx_next_seq, fs->rx_next_seq,
         fs->rx_avail, 0, 0, fs->tx_next_ts, ts, 0);
     ret = 0;
   }
 
-unlock:
-  fs_unlock(fs);
+out:
   return ret;
 }
 
-/* start retransmitting */
-void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id)
+/* send pending delayed ack for flow whose ack timer expired, forwarding to
+ * the owner core if needed. The caller has already removed the expired timer
+ * so it can be re-armed here. */
+int fast_flows_delayed_ack(struct dataplane_context *ctx, uint32_t flow_id,
+    struct network_buf_handle *nbh, uint32_t ts)
 {
   struct flextcp_pl_flowst *fs = &fp_state->flowst[flow_id];
-  uint32_t old_avail, new_avail = -1;
+  struct flextcp_pl_flowst_cold *fc = &fp_state->flowst_cold[flow_id];
+  uint16_t owner;
+  int ret = -1;
+
+  owner = flow_owner(ctx, fs);
+  if (owner != ctx->id) {
+    /* owner's ring is full, try forwarding again after another delay */
+    if (flow_fwd(ctx, owner, ((uintptr_t) flow_id << FLOW_FWD_TYPE_BITS) |
+          FLOW_FWD_DELACK) != 0)
+    {
+      ack_timer_add(ctx, flow_id, ts + config.fp_ack_delay);
+    }
+    return -1;
+  }
 
-  fs_lock(fs);
+  /* ack might have been sent already, possibly with new segments pending by
+   * now, in which case the ack just goes out a bit early */
+  if (fc->rx_ack_segs != 0) {
+    flow_tx_segment(ctx, nbh, NULL, 0, fs, fs->tx_next_seq, fs->rx_next_seq,
+        fs->rx_avail, 0, 0, fs->tx_next_ts, ts, 0);
+    ret = 0;
+  }
+
+  return ret;
+}
+
+void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id)
+{
+  struct flextcp_pl_flowst *fs = &fp_state->flowst[flow_id];
+  struct flextcp_pl_flowst_cold *fc = &fp_state->flowst_cold[flow_id];
+  struct flextcp_pl_flowst_sack *sb = &fp_state->flowst_sack[flow_id];
+  uint32_t old_avail, new_avail = -1, old_pending = 0, rexmit = 0;
+  uint16_t owner;
+
+  owner = flow_owner(ctx, fs);
+  if (owner != ctx->id) {
+    /* if the ring is full, the slow path retries after the next timeout */
+    flow_fwd(ctx, owner, ((uintptr_t) flow_id << FLOW_FWD_TYPE_BITS) |
+        FLOW_FWD_RETRANSMIT);
+    return;
+  }
 
 #ifdef FLEXNIC_TRACING
     struct flextcp_pl_trev_rexmit te_rexmit = {
@@ -806,7 +1103,15 @@ void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id)
   }
 
 
-  flow_reset_retransmit(fs);
+  if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXSACK) != 0 && sb->num > 0) {
+    /* receiver told us what it has, only retransmit the holes */
+    old_pending = flow_sack_pending(fs, sb);
+    flow_sack_recover(fs, sb, 1);
+    rexmit = flow_sack_pending(fs, sb);
+    rexmit = (rexmit > old_pending ? rexmit - old_pending : 0);
+  } else {
+    flow_reset_retransmit(fs);
+  }
   new_avail = tcp_txavail(fs, NULL);
 
   /*    fprintf(stderr, "fast_flows_retransmit: "
@@ -816,9 +1121,10 @@ void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id)
           fs->tx_next_pos);*/
 
   /* update queue manager */
-  if (new_avail > old_avail) {
-    if (qman_set(&ctx->qman, flow_id, fs->tx_rate, new_avail - old_avail,
-          TCP_MSS, QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_ADD_AVAIL) != 0)
+  if (new_avail > old_avail || rexmit > 0) {
+    if (qman_set(&ctx->qman, flow_id, flow_qman_class(fc), fc->tx_rate,
+          (new_avail > old_avail ? new_avail - old_avail : 0) + rexmit,
+          flow_tx_chunk(), QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_ADD_AVAIL) != 0)
     {
       fprintf(stderr, "flast_flows_bump: qman_set 1 failed, UNEXPECTED\n");
       abort();
@@ -826,7 +1132,6 @@ void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id)
   }
 
 out:
-  fs_unlock(fs);
   return;
 }
 
@@ -834,15 +1139,63 @@ out:
 static void flow_tx_read(struct flextcp_pl_flowst *fs, uint32_t pos,
     uint16_t len, void *dst)
 {
+  struct flextcp_pl_flowst_cold *fc = flow_cold(fs);
   uint32_t part;
 
-  if (LIKELY(pos + len <= fs->tx_len)) {
-    dma_read(fs->tx_base + pos, len, dst);
+  if (LIKELY(pos + len <= fc->tx_len)) {
+    dma_read(fc->tx_base + pos, len, dst);
   } else {
-    part = fs->tx_len - pos;
-    dma_read(fs->tx_base + pos, part, dst);
-    dma_read(fs->tx_base, len - part, (uint8_t *) dst + part);
+    part = fc->tx_len - pos;
+    dma_read(fc->tx_base + pos, part, dst);
+    dma_read(fc->tx_base, len - part, (uint8_t *) dst + part);
+  }
+}
+
+/* same as flow_tx_read, but returns the ones' complement sum of the bytes
+ * read, computed while copying */
+static uint32_t flow_tx_read_xsum(struct flextcp_pl_flowst *fs, uint32_t pos,
+    uint16_t len, void *dst)
+{
+  struct flextcp_pl_flowst_cold *fc = flow_cold(fs);
+  uint32_t part, sum;
+
+  if (LIKELY(pos + len <= fc->tx_len)) {
+    return dma_read_xsum(fc->tx_base + pos, len, dst, 0);
   }
+
+  part = fc->tx_len - pos;
+  sum = dma_read_xsum(fc->tx_base + pos, part, dst, 0);
+  return xsum_add(sum, dma_read_xsum(fc->tx_base, len - part,
+        (uint8_t *) dst + part, 0), part);
+}
+
+/* account for `segs` unacknowledged segments, returns 0 if the ACK can be
+ * delayed, arming the delayed ack timer for the first one */
+static inline int flow_rx_ack_delay(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, uint32_t flow_id, uint16_t segs,
+    uint32_t ts)
+{
+  struct flextcp_pl_flowst_cold *fc = &fp_state->flowst_cold[flow_id];
+  uint32_t n = fc->rx_ack_segs + segs;
+
+  if (n >= config.fp_ack_segs) {
+    return -1;
+  }
+
+  if (fc->rx_ack_segs == 0 &&
+      ack_timer_add(ctx, flow_id, ts + config.fp_ack_delay) != 0)
+  {
+    return -1;
+  }
+
+  fc->rx_ack_segs = n;
+  return 0;
+}
+
+/* payload length of a received segment */
+static inline uint16_t flow_rx_payload(const struct pkt_tcp *p)
+{
+  return f_beui16(p->ip.len) - sizeof(p->ip) - TCPH_HDRLEN(&p->tcp) * 4;
 }
 
 /* write `len` bytes to position `pos` in cirucular receive buffer */
@@ -872,69 +1225,244 @@ static void flow_rx_seq_write(struct flextcp_pl_flowst *fs, uint32_t seq,
   assert(pos < fs->rx_len);
   flow_rx_write(fs, pos, len, src);
 }
+
+/* update out of order summary in flow state from first interval */
+static inline void flow_rx_ooo_sync(struct flextcp_pl_flowst *fs,
+    const struct flextcp_pl_flowst_ooo *ooo)
+{
+  struct flextcp_pl_flowst_cold *fc = flow_cold(fs);
+
+  if (ooo->num > 0) {
+    fc->rx_ooo_start = ooo->intervals[0].start;
+    fc->rx_ooo_len = ooo->intervals[0].len;
+  } else {
+    fc->rx_ooo_len = 0;
+  }
+}
+
+/* add out of order segment to intervals and write it to the receive buffer,
+ * returns -1 if segment was dropped because all intervals are in use. */
+static int flow_rx_ooo_add(struct flextcp_pl_flowst *fs,
+    struct flextcp_pl_flowst_ooo *ooo, uint32_t seq, uint16_t len,
+    const void *src)
+{
+  int i;
+
+  /* everything we get here is within the receive window */
+  i = tcp_intervals_add(ooo->intervals, &ooo->num, FLEXNIC_PL_OOO_INTERVALS,
+      fs->rx_next_seq, seq, len);
+  if (i < 0) {
+    return -1;
+  }
+  ooo->last = i;
+
+  flow_rx_seq_write(fs, seq, len, src);
+  flow_rx_ooo_sync(fs, ooo);
+  return 0;
+}
+
+/* after rx_next_seq has advanced, drop superfluous out of order intervals and
+ * make the ones we caught up with continuous. Returns bytes added to the
+ * receive buffer. */
+static uint32_t flow_rx_ooo_catchup(struct flextcp_pl_flowst *fs,
+    struct flextcp_pl_flowst_ooo *ooo)
+{
+  uint32_t bump = 0, end, len;
+  uint16_t i;
+
+  for (i = 0; i < ooo->num; i++) {
+    end = ooo->intervals[i].start + ooo->intervals[i].len;
+
+    /* interval starts after next expected byte: still a hole */
+    if ((int32_t) (ooo->intervals[i].start - fs->rx_next_seq) > 0)
+      break;
+
+    /* interval ends before next expected byte: completely superfluous */
+    if ((int32_t) (end - fs->rx_next_seq) <= 0)
+      continue;
+
+    /* yay, we caught up, make continuous */
+    len = end - fs->rx_next_seq;
+    bump += len;
+    fs->rx_avail -= len;
+    fs->rx_next_pos += len;
+    if (fs->rx_next_pos >= fs->rx_len) {
+      fs->rx_next_pos -= fs->rx_len;
+    }
+    assert(fs->rx_next_pos < fs->rx_len);
+    fs->rx_next_seq += len;
+  }
+
+  /* remove intervals we're done with */
+  if (i > 0) {
+    memmove(&ooo->intervals[0], &ooo->intervals[i],
+        (ooo->num - i) * sizeof(ooo->intervals[0]));
+    ooo->num -= i;
+    ooo->last = (ooo->last >= i ? ooo->last - i : 0);
+  }
+
+  flow_rx_ooo_sync(fs, ooo);
+  return bump;
+}
 #endif
 
-static void flow_tx_segment(struct dataplane_context *ctx,
-    struct network_buf_handle *nbh, struct flextcp_pl_flowst *fs,
-    uint32_t seq, uint32_t ack, uint32_t rxwnd, uint16_t payload,
-    uint32_t payload_pos, uint32_t ts_echo, uint32_t ts_my, uint8_t fin)
+/* window field advertising `rxwnd` bytes, scaled down by the local shift */
+static inline uint16_t flow_wnd_adv(const struct flextcp_pl_flowst *fs,
+    uint32_t rxwnd)
 {
-  uint16_t hdrs_len, optlen, fin_fl;
-  struct pkt_tcp *p = network_buf_buf(nbh);
-  struct tcp_timestamp_opt *opt_ts;
+  return MIN(0xFFFF, rxwnd >> (fs->wscale >> 4));
+}
 
-  /* calculate header length depending on options */
-  optlen = (sizeof(*opt_ts) + 3) & ~3;
-  hdrs_len = sizeof(*p) + optlen;
+/* payload bytes sent per queue manager event, multiple of MSS with TSO */
+static inline uint16_t flow_tx_chunk(void)
+{
+  if (LIKELY(net_tso_max <= TCP_MSS)) {
+    return TCP_MSS;
+  }
+  return net_tso_max - net_tso_max % TCP_MSS;
+}
 
-  /* fill headers */
-  p->eth.dest = fs->remote_mac;
-  memcpy(&p->eth.src, &eth_addr, ETH_ADDR_LEN);
-  p->eth.type = t_beui16(ETH_TYPE_IP);
+static inline uint8_t flow_qman_class(const struct flextcp_pl_flowst_cold *fc)
+{
+  return (UNLIKELY(fc->prio != 0) ? QMAN_CLASS_PRIO : fc->appst_id);
+}
 
-  IPH_VHL_SET(&p->ip, 4, 5);
-  p->ip._tos = 0;
-  p->ip.len = t_beui16(hdrs_len - offsetof(struct pkt_tcp, ip) + payload);
-  p->ip.id = t_beui16(3); /* TODO: not sure why we have 3 here */
-  p->ip.offset = t_beui16(0);
-  p->ip.ttl = 0xff;
-  p->ip.proto = IP_PROTO_TCP;
-  p->ip.chksum = 0;
-  p->ip.src = fs->local_ip;
-  p->ip.dest = fs->remote_ip;
+/* allocate additional buffers for a segment with `*len` payload bytes at
+ * position `pos` in the transmit buffer. If the pool runs dry, falls back to
+ * copying a single MSS and hands the remaining bytes back to the queue
+ * manager. Returns number of buffers in `segs`. */
+static uint16_t flow_tx_alloc(struct dataplane_context *ctx, uint32_t flow_id,
+    uint32_t pos, uint32_t *len, struct network_buf_handle **segs)
+{
+  uint32_t first = BUFFER_SIZE - TCP_TX_HDRLEN;
+  uint16_t n, got;
+
+  if (net_tx_zerocopy && *len >= TCP_ZC_MIN) {
+    /* payload is attached in place, wrapping around needs a second buffer */
+    n = (pos + *len > fp_state->flowst_cold[flow_id].tx_len ? 2 : 1);
+  } else if (LIKELY(*len <= first)) {
+    return 0;
+  } else {
+    n = (*len - first + BUFFER_SIZE - 1) / BUFFER_SIZE;
+  }
 
-  /* mark as ECN capable if flow marked so */
-  if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_ECN) == FLEXNIC_PL_FLOWST_ECN) {
-    IPH_ECN_SET(&p->ip, IP_ECN_ECT0);
+  got = network_buf_alloc(&ctx->net, n, segs);
+  if (LIKELY(got == n)) {
+    return n;
   }
 
+  network_free(got, segs);
+  if (*len > TCP_MSS) {
+    if (qman_set(&ctx->qman, flow_id, 0, 0, *len - TCP_MSS, 0,
+          QMAN_ADD_AVAIL) != 0)
+    {
+      fprintf(stderr, "flow_tx_alloc: qman_set failed, UNEXPECTED\n");
+      abort();
+    }
+    *len = TCP_MSS;
+  }
+  return 0;
+}
+
+static void flow_tx_segment(struct dataplane_context *ctx,
+    struct network_buf_handle *nbh, struct network_buf_handle **segs,
+    uint16_t nsegs, struct flextcp_pl_flowst *fs, uint32_t seq, uint32_t ack,
+    uint32_t rxwnd, uint16_t payload, uint32_t payload_pos, uint32_t ts_echo,
+    uint32_t ts_my, uint8_t fin)
+{
+  struct flextcp_pl_flowst_cold *fc = flow_cold(fs);
+  struct flextcp_pl_flowst_hdr *fh = flow_hdr(fs);
+  uint16_t hdrs_len, fin_fl, first, off, seg_len, i;
+  uint32_t pos, payload_sum = 0;
+  uint8_t sw_xsum = 0;
+  struct pkt_tcp *p = network_buf_buf(nbh);
+  struct tcp_timestamp_opt *opt_ts;
+
+  /* copy headers from the template and fill in the per-segment fields */
+  hdrs_len = TCP_TX_HDRLEN;
+  flow_hdr_copy(p, fh);
+  p->ip.len = t_beui16(hdrs_len - offsetof(struct pkt_tcp, ip) + payload);
+
   fin_fl = (fin ? TCP_FIN : 0);
 
-  p->tcp.src = fs->local_port;
-  p->tcp.dest = fs->remote_port;
   p->tcp.seqno = t_beui32(seq);
   p->tcp.ackno = t_beui32(ack);
-  TCPH_HDRLEN_FLAGS_SET(&p->tcp, 5 + optlen / 4, TCP_PSH | TCP_ACK | fin_fl);
-  p->tcp.wnd = t_beui16(MIN(0xFFFF, rxwnd));
-  p->tcp.chksum = 0;
-  p->tcp.urgp = t_beui16(0);
+  TCPH_HDRLEN_FLAGS_SET(&p->tcp, (TCP_TX_HDRLEN - offsetof(struct pkt_tcp,
+          tcp)) / 4, TCP_PSH | TCP_ACK | fin_fl);
+  p->tcp.wnd = t_beui16(flow_wnd_adv(fs, rxwnd));
 
-  /* fill in timestamp option */
-  memset(p + 1, 0, optlen);
-  opt_ts = (struct tcp_timestamp_opt *) (p + 1);
-  opt_ts->kind = TCP_OPT_TIMESTAMP;
-  opt_ts->length = sizeof(*opt_ts);
+  opt_ts = TCP_TX_TSOPT(p);
   opt_ts->ts_val = t_beui32(ts_my);
   opt_ts->ts_ecr = t_beui32(ts_echo);
 
-  /* add payload if requested */
-  if (payload > 0) {
-    flow_tx_read(fs, payload_pos, payload, (uint8_t *) p + hdrs_len);
+  /* segment acknowledges everything received so far */
+  fc->rx_ack_segs = 0;
+
+  if (net_tx_zerocopy && nsegs > 0) {
+    /* attach payload in the transmit buffer, split where it wraps around.
+     * The application only reuses buffer space after it was acknowledged, a
+     * retransmission still queued in the NIC at that point only carries bytes
+     * the receiver already has and discards. */
+    first = 0;
+    for (i = 0, off = 0; i < nsegs && off < payload; i++, off += seg_len) {
+      pos = payload_pos + off;
+      if (pos >= fc->tx_len) {
+        pos -= fc->tx_len;
+      }
+
+      seg_len = MIN(payload - off, fc->tx_len - pos);
+      network_buf_attach(&ctx->net, segs[i],
+          dma_pointer(fc->tx_base + pos, seg_len), seg_len);
+    }
+  } else if (!config.fp_xsumoffload && payload >= TCP_XSUM_MIN &&
+      payload <= TCP_MSS)
+  {
+    /* without checksum offload the payload checksum is computed while
+     * copying, everything fits into the first buffer */
+    assert(payload <= BUFFER_SIZE - hdrs_len);
+    sw_xsum = 1;
+    first = payload;
+    i = 0;
+    if (payload > 0) {
+      payload_sum = flow_tx_read_xsum(fs, payload_pos, payload,
+          (uint8_t *) p + hdrs_len);
+    }
+  } else {
+    /* add payload if requested, anything that does not fit into the first
+     * buffer goes into the chained ones */
+    first = MIN(payload, BUFFER_SIZE - hdrs_len);
+    if (payload > 0) {
+      flow_tx_read(fs, payload_pos, first, (uint8_t *) p + hdrs_len);
+    }
+    for (i = 0, off = first; i < nsegs && off < payload; i++, off += seg_len) {
+      pos = payload_pos + off;
+      if (pos >= fc->tx_len) {
+        pos -= fc->tx_len;
+      }
+
+      seg_len = MIN(payload - off, BUFFER_SIZE);
+      flow_tx_read(fs, pos, seg_len, network_buf_buf(segs[i]));
+      network_buf_setoff(segs[i], 0);
+      network_buf_setlen(segs[i], seg_len);
+    }
+  }
+
+  /* a trailing buffer can end up unused when the FIN took the last byte */
+  if (UNLIKELY(i < nsegs)) {
+    network_free(nsegs - i, segs + i);
+    nsegs = i;
   }
 
-  /* checksums */
-  tcp_checksums(nbh, p, fs->local_ip, fs->remote_ip, hdrs_len - offsetof(struct
-        pkt_tcp, tcp) + payload);
+  /* checksums, the payload is only summed here if that did not happen while
+   * copying */
+  if (payload > TCP_MSS) {
+    p->tcp.chksum = tx_tso_enable(nbh, &p->ip, hdrs_len - offsetof(struct
+          pkt_tcp, tcp), TCP_MSS, fs->local_ip, fs->remote_ip);
+  } else {
+    tcp_checksums_tmpl(nbh, p, fh, hdrs_len - offsetof(struct pkt_tcp, tcp) +
+        payload, hdrs_len - offsetof(struct pkt_tcp, tcp) +
+        (sw_xsum ? 0 : payload), payload_sum);
+  }
 
 #ifdef FLEXNIC_TRACING
   struct flextcp_pl_trev_txseg te_txseg = {
@@ -951,19 +1479,27 @@ static void flow_tx_segment(struct dataplane_context *ctx,
   trace_event(FLEXNIC_PL_TREV_TXSEG, sizeof(te_txseg), &te_txseg);
 #endif
 
-  tx_send(ctx, nbh, 0, hdrs_len + payload);
+  tx_send(ctx, nbh, 0, hdrs_len + first, fh->port);
+  if (nsegs > 0) {
+    network_buf_chain(nbh, nsegs, segs);
+  }
 }
 
-static void flow_tx_ack(struct dataplane_context *ctx, uint32_t seq,
-    uint32_t ack, uint32_t rxwnd, uint32_t echots, uint32_t myts,
-    struct network_buf_handle *nbh, struct tcp_timestamp_opt *ts_opt)
+static void flow_tx_ack(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs, uint32_t seq, uint32_t ack, uint16_t wnd,
+    uint32_t echots, uint32_t myts, struct network_buf_handle *nbh,
+    const struct flextcp_pl_flowst_ooo *ooo)
 {
+  struct flextcp_pl_flowst_hdr *fh = flow_hdr(fs);
   struct pkt_tcp *p;
-  struct eth_addr eth;
-  ip_addr_t ip;
-  beui16_t port;
+  struct tcp_timestamp_opt *ts_opt;
   uint16_t hdrlen;
   uint16_t ecn_flags = 0;
+#ifdef FLEXNIC_PL_OOO_RECV
+  struct tcp_sack_opt *sack_opt;
+  uint8_t *opt;
+  uint16_t i, j, n, optlen;
+#endif
 
   p = network_buf_bufoff(nbh);
 
@@ -973,44 +1509,66 @@ static void flow_tx_ack(struct dataplane_context *ctx, uint32_t seq,
       f_beui32(p->ip.src), f_beui16(p->tcp.src), seq, ack);
 #endif
 
-  /* swap addresses */
-  eth = p->eth.src;
-  p->eth.src = p->eth.dest;
-  p->eth.dest = eth;
-  ip = p->ip.src;
-  p->ip.src = p->ip.dest;
-  p->ip.dest = ip;
-  port = p->tcp.src;
-  p->tcp.src = p->tcp.dest;
-  p->tcp.dest = port;
-
-  hdrlen = sizeof(*p) + (TCPH_HDRLEN(&p->tcp) - 5) * 4;
-
   /* If ECN flagged, set TCP response flag */
   if (IPH_ECN(&p->ip) == IP_ECN_CE) {
     ecn_flags = TCP_ECE;
   }
 
-  /* mark ACKs as ECN in-capable */
+  /* overwrite received headers with the template, ACKs are marked ECN
+   * in-capable */
+  flow_hdr_copy(p, fh);
   IPH_ECN_SET(&p->ip, IP_ECN_NONE);
+  hdrlen = TCP_TX_HDRLEN;
+  ts_opt = TCP_TX_TSOPT(p);
+
+#ifdef FLEXNIC_PL_OOO_RECV
+  /* if we have out of order intervals, add SACK blocks after the timestamp
+   * option */
+  if (ooo != NULL && ooo->num > 0) {
+    n = MIN(ooo->num, TCP_SACK_MAX_BLOCKS);
+    opt = (uint8_t *) (p + 1);
+    optlen = TCP_TX_HDRLEN - sizeof(*p);
+
+    opt[optlen] = opt[optlen + 1] = TCP_OPT_NO_OP;
+    sack_opt = (struct tcp_sack_opt *) (opt + optlen + 2);
+    sack_opt->kind = TCP_OPT_SACK;
+    sack_opt->length = sizeof(*sack_opt) + n * sizeof(sack_opt->blocks[0]);
+    optlen += 2 + sack_opt->length;
+
+    /* first block reports the most recently updated interval, the rest
+     * follow in sequence order */
+    sack_opt->blocks[0].start = t_beui32(ooo->intervals[ooo->last].start);
+    sack_opt->blocks[0].end = t_beui32(ooo->intervals[ooo->last].start +
+        ooo->intervals[ooo->last].len);
+    for (i = 0, j = 1; i < ooo->num && j < n; i++) {
+      if (i == ooo->last)
+        continue;
+      sack_opt->blocks[j].start = t_beui32(ooo->intervals[i].start);
+      sack_opt->blocks[j].end = t_beui32(ooo->intervals[i].start +
+          ooo->intervals[i].len);
+      j++;
+    }
+
+    hdrlen = sizeof(*p) + optlen;
+    TCPH_HDRLEN_SET(&p->tcp, 5 + optlen / 4);
+  }
+#endif
 
-  /* change TCP header to ACK */
+  /* fill in ACK fields */
   p->tcp.seqno = t_beui32(seq);
   p->tcp.ackno = t_beui32(ack);
   TCPH_HDRLEN_FLAGS_SET(&p->tcp, TCPH_HDRLEN(&p->tcp), TCP_ACK | ecn_flags);
-  p->tcp.wnd = t_beui16(MIN(0xFFFF, rxwnd));
-  p->tcp.urgp = t_beui16(0);
+  p->tcp.wnd = t_beui16(wnd);
 
   /* fill in timestamp option */
   ts_opt->ts_val = t_beui32(myts);
   ts_opt->ts_ecr = t_beui32(echots);
 
   p->ip.len = t_beui16(hdrlen - offsetof(struct pkt_tcp, ip));
-  p->ip.ttl = 0xff;
 
   /* checksums */
-  tcp_checksums(nbh, p, p->ip.src, p->ip.dest, hdrlen - offsetof(struct
-        pkt_tcp, tcp));
+  tcp_checksums_tmpl(nbh, p, fh, hdrlen - offsetof(struct pkt_tcp, tcp),
+      hdrlen - offsetof(struct pkt_tcp, tcp), 0);
 
 #ifdef FLEXNIC_TRACING
   struct flextcp_pl_trev_txack te_txack = {
@@ -1026,33 +1584,243 @@ static void flow_tx_ack(struct dataplane_context *ctx, uint32_t seq,
   trace_event(FLEXNIC_PL_TREV_TXACK, sizeof(te_txack), &te_txack);
 #endif
 
-  tx_send(ctx, nbh, network_buf_off(nbh), hdrlen);
+  tx_send(ctx, nbh, network_buf_off(nbh), hdrlen, fh->port);
 }
 
 static void flow_reset_retransmit(struct flextcp_pl_flowst *fs)
 {
+  struct flextcp_pl_flowst_cold *fc = flow_cold(fs);
+  struct flextcp_pl_flowst_sack *sb;
   uint32_t x;
 
   /* reset flow state as if we never transmitted those segments */
   fs->rx_dupack_cnt = 0;
 
+  /* SACK information is stale after this */
+  if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXSACK) != 0) {
+    sb = flow_sack(fs);
+    sb->num = 0;
+    sb->state = FLEXNIC_PL_SACK_NONE;
+    fs_flag_clear(fs, FLEXNIC_PL_FLOWST_TXSACK);
+  }
+
   fs->tx_next_seq -= fs->tx_sent;
   if (fs->tx_next_pos >= fs->tx_sent) {
     fs->tx_next_pos -= fs->tx_sent;
   } else {
     x = fs->tx_sent - fs->tx_next_pos;
-    fs->tx_next_pos = fs->tx_len - x;
+    fs->tx_next_pos = fc->tx_len - x;
   }
   fs->tx_avail += fs->tx_sent;
   fs->rx_remote_avail += fs->tx_sent;
   fs->tx_sent = 0;
 
+  flow_tx_drop(fs);
+}
+
+/* account for detected drop for congestion control */
+static inline void flow_tx_drop(struct flextcp_pl_flowst *fs)
+{
+  struct flextcp_pl_flowst_cold *fc = flow_cold(fs);
+
   /* cut rate by half if first drop in control interval */
-  if (fs->cnt_tx_drops == 0) {
-    fs->tx_rate /= 2;
+  if (fc->cnt_tx_drops == 0) {
+    fc->tx_rate /= 2;
+  }
+
+  fc->cnt_tx_drops++;
+}
+
+/* position in transmit buffer for sent but unacknowledged sequence number */
+static inline uint32_t flow_tx_pos(const struct flextcp_pl_flowst *fs,
+    uint32_t seq)
+{
+  const struct flextcp_pl_flowst_cold *fc = flow_cold(fs);
+  uint32_t diff = fs->tx_next_seq - seq;
+
+  if (fs->tx_next_pos >= diff) {
+    return fs->tx_next_pos - diff;
+  } else {
+    return fc->tx_len - (diff - fs->tx_next_pos);
+  }
+}
+
+/* update SACK scoreboard from received ack and detect losses, returns number
+ * of additional bytes that need to be retransmitted. */
+static uint32_t flow_sack_update(struct flextcp_pl_flowst *fs,
+    struct flextcp_pl_flowst_sack *sb, const struct tcp_sack_opt *opt,
+    uint32_t ts)
+{
+  struct flextcp_pl_flowst_cold *fc = flow_cold(fs);
+  uint32_t una = fs->tx_next_seq - fs->tx_sent;
+  uint32_t a, b, end, sacked = 0, old_pending, new_pending;
+  uint16_t i, n;
+
+  old_pending = flow_sack_pending(fs, sb);
+
+  /* drop intervals that have been acknowledged cumulatively */
+  for (i = 0; i < sb->num; i++) {
+    end = sb->intervals[i].start + sb->intervals[i].len;
+    if ((int32_t) (end - una) > 0)
+      break;
+  }
+  if (i > 0) {
+    memmove(&sb->intervals[0], &sb->intervals[i],
+        (sb->num - i) * sizeof(sb->intervals[0]));
+    sb->num -= i;
+  }
+  if (sb->num > 0 && (int32_t) (sb->intervals[0].start - una) < 0) {
+    sb->intervals[0].len -= una - sb->intervals[0].start;
+    sb->intervals[0].start = una;
+  }
+
+  /* add blocks covering data in flight, ignore the rest (e.g. D-SACK) */
+  if (opt != NULL) {
+    n = (opt->length - sizeof(*opt)) / sizeof(opt->blocks[0]);
+    for (i = 0; i < n; i++) {
+      a = f_beui32(opt->blocks[i].start) - una;
+      b = f_beui32(opt->blocks[i].end) - una;
+      if (a >= b || b > fs->tx_sent)
+        continue;
+
+      /* if the scoreboard is full we just lose this block */
+      tcp_intervals_add(sb->intervals, &sb->num, FLEXNIC_PL_SACK_INTERVALS,
+          una, una + a, b - a);
+    }
+  }
+
+  /* recovery is done once everything up to the recovery point is acked */
+  if (sb->state == FLEXNIC_PL_SACK_RECOVERY &&
+      (int32_t) (sb->recovery_end - una) <= 0)
+  {
+    sb->state = FLEXNIC_PL_SACK_NONE;
+  }
+
+  if (sb->num == 0) {
+    sb->state = FLEXNIC_PL_SACK_NONE;
+    fs_flag_clear(fs, FLEXNIC_PL_FLOWST_TXSACK);
+    return 0;
+  }
+  fs_flag_set(fs, FLEXNIC_PL_FLOWST_TXSACK);
+
+  if (sb->state == FLEXNIC_PL_SACK_NONE) {
+    sb->state = FLEXNIC_PL_SACK_HOLE;
+    sb->hole_ts = ts;
+  }
+
+  end = sb->intervals[sb->num - 1].start + sb->intervals[sb->num - 1].len;
+  if (sb->state == FLEXNIC_PL_SACK_HOLE) {
+    for (i = 0; i < sb->num; i++) {
+      sacked += sb->intervals[i].len;
+    }
+
+    /* holes are lost once enough data after them has been delivered, or once
+     * they have been around for longer than an rtt plus a reordering window
+     * (RACK-style) */
+    if (sacked >= 3 * TCP_MSS || (fc->rtt_est != 0 &&
+          ts - sb->hole_ts > fc->rtt_est + fc->rtt_est / 4))
+    {
+      flow_sack_recover(fs, sb, 0);
+    }
+  } else if ((int32_t) (end - sb->recovery_end) > 0) {
+    /* new holes reported during recovery */
+    sb->recovery_end = end;
+  }
+
+  new_pending = flow_sack_pending(fs, sb);
+  return (new_pending > old_pending ? new_pending - old_pending : 0);
+}
+
+/* (re-)start retransmitting holes from the last acknowledged position. After
+ * a timeout everything not SACKed is considered lost, including the tail
+ * after the highest SACK block. */
+static void flow_sack_recover(struct flextcp_pl_flowst *fs,
+    struct flextcp_pl_flowst_sack *sb, int rto)
+{
+  uint32_t end;
+
+  if (rto) {
+    end = fs->tx_next_seq;
+  } else {
+    end = sb->intervals[sb->num - 1].start + sb->intervals[sb->num - 1].len;
+  }
+  if (sb->state != FLEXNIC_PL_SACK_RECOVERY ||
+      (int32_t) (end - sb->recovery_end) > 0)
+  {
+    sb->recovery_end = end;
   }
 
-  fs->cnt_tx_drops++;
+  sb->state = FLEXNIC_PL_SACK_RECOVERY;
+  sb->rexmit_next = fs->tx_next_seq - fs->tx_sent;
+  flow_tx_drop(fs);
+}
+
+/* number of bytes in holes that still need to be retransmitted */
+static uint32_t flow_sack_pending(const struct flextcp_pl_flowst *fs,
+    const struct flextcp_pl_flowst_sack *sb)
+{
+  uint32_t una = fs->tx_next_seq - fs->tx_sent;
+  uint32_t pos, end, i_a, i_b, pending = 0;
+  uint16_t i;
+
+  if (sb->state != FLEXNIC_PL_SACK_RECOVERY ||
+      (int32_t) (sb->recovery_end - una) <= 0)
+  {
+    return 0;
+  }
+
+  end = sb->recovery_end - una;
+  pos = ((int32_t) (sb->rexmit_next - una) > 0 ? sb->rexmit_next - una : 0);
+  for (i = 0; i < sb->num && pos < end; i++) {
+    i_a = sb->intervals[i].start - una;
+    i_b = i_a + sb->intervals[i].len;
+    if (i_a > pos) {
+      pending += MIN(i_a, end) - pos;
+    }
+    pos = MAX(pos, i_b);
+  }
+  if (pos < end) {
+    pending += end - pos;
+  }
+
+  return pending;
+}
+
+/* find next segment to retransmit during recovery, returns -1 if none */
+static int flow_sack_next(struct flextcp_pl_flowst *fs,
+    struct flextcp_pl_flowst_sack *sb, uint32_t *seq, uint32_t *len)
+{
+  uint32_t una = fs->tx_next_seq - fs->tx_sent;
+  uint32_t pos, end, i_a, i_b, hole_end;
+  uint16_t i;
+
+  if (sb->state != FLEXNIC_PL_SACK_RECOVERY ||
+      (int32_t) (sb->recovery_end - una) <= 0)
+  {
+    return -1;
+  }
+
+  end = hole_end = sb->recovery_end - una;
+  pos = ((int32_t) (sb->rexmit_next - una) > 0 ? sb->rexmit_next - una : 0);
+  for (i = 0; i < sb->num; i++) {
+    i_a = sb->intervals[i].start - una;
+    i_b = i_a + sb->intervals[i].len;
+    if (pos < i_a) {
+      hole_end = MIN(i_a, end);
+      break;
+    }
+    pos = MAX(pos, i_b);
+  }
+
+  if (pos >= hole_end) {
+    sb->rexmit_next = sb->recovery_end;
+    return -1;
+  }
+
+  *seq = una + pos;
+  *len = MIN(hole_end - pos, flow_tx_chunk());
+  sb->rexmit_next = *seq + *len;
+  return 0;
 }
 
 static inline void tcp_checksums(struct network_buf_handle *nbh,
@@ -1068,6 +1836,81 @@ static inline void tcp_checksums(struct network_buf_handle *nbh,
   }
 }
 
+/* checksums for a segment with headers from the flow's template, without
+ * offload the first `sum_len` bytes of the TCP segment are summed here and
+ * `payload_sum` covers the rest */
+static inline void tcp_checksums_tmpl(struct network_buf_handle *nbh,
+    struct pkt_tcp *p, const struct flextcp_pl_flowst_hdr *fh,
+    uint16_t tcp_len, uint16_t sum_len, uint32_t payload_sum)
+{
+  uint32_t sum, phdr = fh->phdr_sum + t_beui16(tcp_len).x;
+
+  if (config.fp_xsumoffload) {
+    network_buf_xsumoffload(nbh, sizeof(struct eth_hdr), sizeof(p->ip));
+    p->tcp.chksum = __rte_raw_cksum_reduce(phdr);
+    return;
+  }
+
+  p->ip.chksum = rte_ipv4_cksum((void *) &p->ip);
+
+  sum = xsum_partial(&p->tcp, sum_len, payload_sum);
+  sum = (uint16_t) ~__rte_raw_cksum_reduce(xsum_add(sum, phdr, 0));
+  p->tcp.chksum = (sum == 0 ? 0xffff : sum);
+}
+
+STATIC_ASSERT(sizeof(struct pkt_tcp) == FLEXNIC_PL_TXHDR_TMPL_LEN, tx_tmpl_len);
+
+void fast_flows_hdr_init(uint32_t flow_id, uint8_t port)
+{
+  struct flextcp_pl_flowst *fs = &fp_state->flowst[flow_id];
+  struct flextcp_pl_flowst_cold *fc = &fp_state->flowst_cold[flow_id];
+  struct flextcp_pl_flowst_hdr *fh = &fp_state->flowst_hdr[flow_id];
+  struct pkt_tcp *p = (struct pkt_tcp *) fh->tmpl;
+
+  memset(fh->tmpl, 0, sizeof(fh->tmpl));
+
+  p->eth.dest = fc->remote_mac;
+  memcpy(&p->eth.src, &eth_addrs[port], ETH_ADDR_LEN);
+  p->eth.type = t_beui16(ETH_TYPE_IP);
+
+  IPH_VHL_SET(&p->ip, 4, 5);
+  p->ip.id = t_beui16(3); /* TODO: not sure why we have 3 here */
+  p->ip.ttl = 0xff;
+  p->ip.proto = IP_PROTO_TCP;
+  p->ip.src = fs->local_ip;
+  p->ip.dest = fs->remote_ip;
+
+  /* mark as ECN capable if flow marked so */
+  if ((fs->rx_base_sp & FLEXNIC_PL_FLOWST_ECN) == FLEXNIC_PL_FLOWST_ECN) {
+    IPH_ECN_SET(&p->ip, IP_ECN_ECT0);
+  }
+
+  p->tcp.src = fs->local_port;
+  p->tcp.dest = fs->remote_port;
+  TCPH_HDRLEN_FLAGS_SET(&p->tcp, (TCP_TX_HDRLEN - offsetof(struct pkt_tcp,
+          tcp)) / 4, TCP_ACK);
+
+  fh->phdr_sum = network_ip_phdr_xsum(fs->local_ip, fs->remote_ip,
+      IP_PROTO_TCP, 0);
+  fh->port = port;
+}
+
+/* verify IP and TCP checksums of a received segment in software */
+static inline int tcp_checksums_ok(struct pkt_tcp *p)
+{
+  uint32_t sum;
+
+  if (__rte_raw_cksum_reduce(xsum_partial(&p->ip, sizeof(p->ip), 0)) !=
+      0xffff)
+  {
+    return 0;
+  }
+
+  sum = xsum_partial(&p->tcp, f_beui16(p->ip.len) - sizeof(p->ip), 0);
+  sum = xsum_add(sum, rte_ipv4_phdr_cksum((void *) &p->ip, 0), 0);
+  return __rte_raw_cksum_reduce(sum) == 0xffff;
+}
+
 void fast_flows_kernelxsums(struct network_buf_handle *nbh,
     struct pkt_tcp *p)
 {
@@ -1075,89 +1918,58 @@ void fast_flows_kernelxsums(struct network_buf_handle *nbh,
       f_beui16(p->ip.len) - sizeof(p->ip));
 }
 
-static inline uint32_t flow_hash(struct flow_key *k)
-{
-  return crc32c_sse42_u32(k->local_port.x | (((uint32_t) k->remote_port.x) << 16),
-      crc32c_sse42_u64(k->local_ip.x | (((uint64_t) k->remote_ip.x) << 32), 0));
-}
-
 void fast_flows_packet_fss(struct dataplane_context *ctx,
     struct network_buf_handle **nbhs, void **fss, uint16_t n)
 {
+  const uint32_t mask = fp_state->flowht_mask;
   uint32_t hashes[n];
-  uint32_t h, k, j, eh, fid, ffid;
-  uint16_t i;
+  uint32_t h, b, m, w;
+  int32_t fid;
+  uint16_t i, sig;
   struct pkt_tcp *p;
-  struct flow_key key;
-  struct flextcp_pl_flowhte *e;
-  struct flextcp_pl_flowst *fs;
+  struct flextcp_pl_flowhtb *b1, *b2;
 
-  /* calculate hashes and prefetch hash table buckets */
+  /* calculate hashes and prefetch both candidate buckets */
   for (i = 0; i < n; i++) {
     p = network_buf_bufoff(nbhs[i]);
+    h = flowht_hash(p->ip.dest, p->ip.src, p->tcp.dest, p->tcp.src);
 
-    key.local_ip = p->ip.dest;
-    key.remote_ip = p->ip.src;
-    key.local_port = p->tcp.dest;
-    key.remote_port = p->tcp.src;
-    h = flow_hash(&key);
-
-    rte_prefetch0(&fp_state->flowht[h % FLEXNIC_PL_FLOWHT_ENTRIES]);
-    rte_prefetch0(&fp_state->flowht[(h + 3) % FLEXNIC_PL_FLOWHT_ENTRIES]);
+    b = flowht_bucket(h, mask);
+    rte_prefetch0(&fp_state->flowht[b]);
+    rte_prefetch0(&fp_state->flowht[flowht_alt(b, flowht_sig(h), mask)]);
     hashes[i] = h;
   }
 
-  /* prefetch flow state for buckets with matching hashes
+  /* prefetch flow state for entries with matching signatures
    * (usually 1 per packet, except in case of collisions) */
   for (i = 0; i < n; i++) {
     h = hashes[i];
-    for (j = 0; j < FLEXNIC_PL_FLOWHT_NBSZ; j++) {
-      k = (h + j) % FLEXNIC_PL_FLOWHT_ENTRIES;
-      e = &fp_state->flowht[k];
-
-      ffid = e->flow_id;
-      MEM_BARRIER();
-      eh = e->flow_hash;
-
-      fid = ffid & ((1 << FLEXNIC_PL_FLOWHTE_POSSHIFT) - 1);
-      if ((ffid & FLEXNIC_PL_FLOWHTE_VALID) == 0 || eh != h) {
-        continue;
+    sig = flowht_sig(h);
+    b = flowht_bucket(h, mask);
+    b1 = &fp_state->flowht[b];
+    b2 = &fp_state->flowht[flowht_alt(b, sig, mask)];
+
+    for (m = flowht_match2(b1, b2, sig); m != 0; m &= m - 1) {
+      w = __builtin_ctz(m);
+      if (w < FLEXNIC_PL_FLOWHT_WAYS) {
+        rte_prefetch0(&fp_state->flowst[b1->flow_id[w]]);
+      } else {
+        rte_prefetch0(&fp_state->flowst[b2->flow_id[w - FLEXNIC_PL_FLOWHT_WAYS]]);
       }
-
-      rte_prefetch0(&fp_state->flowst[fid]);
     }
   }
 
-  /* finish hash table lookup by checking 5-tuple in flow state */
+  /* finish hash table lookup by checking 4-tuple in flow state */
   for (i = 0; i < n; i++) {
     p = network_buf_bufoff(nbhs[i]);
-    fss[i] = NULL;
-    h = hashes[i];
-
-    for (j = 0; j < FLEXNIC_PL_FLOWHT_NBSZ; j++) {
-      k = (h + j) % FLEXNIC_PL_FLOWHT_ENTRIES;
-      e = &fp_state->flowht[k];
-
-      ffid = e->flow_id;
-      MEM_BARRIER();
-      eh = e->flow_hash;
-
-      fid = ffid & ((1 << FLEXNIC_PL_FLOWHTE_POSSHIFT) - 1);
-      if ((ffid & FLEXNIC_PL_FLOWHTE_VALID) == 0 || eh != h) {
-        continue;
-      }
-
-      MEM_BARRIER();
-      fs = &fp_state->flowst[fid];
-      if ((fs->local_ip.x == p->ip.dest.x) &
-          (fs->remote_ip.x == p->ip.src.x) &
-          (fs->local_port.x == p->tcp.dest.x) &
-          (fs->remote_port.x == p->tcp.src.x))
-      {
-        rte_prefetch0((uint8_t *) fs + 64);
-        fss[i] = &fp_state->flowst[fid];
-        break;
-      }
+    fid = flowht_lookup(fp_state->flowht, mask, fp_state->flowst, hashes[i],
+        p->ip.dest, p->ip.src, p->tcp.dest, p->tcp.src);
+    if (fid < 0) {
+      fss[i] = NULL;
+      continue;
     }
+
+    rte_prefetch0(&fp_state->flowst_cold[fid]);
+    fss[i] = &fp_state->flowst[fid];
   }
 }
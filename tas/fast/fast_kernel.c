@@ -61,7 +61,7 @@ int fast_kernel_poll(struct dataplane_context *ctx,
 
     ret = 0;
     inject_tcp_ts(buf, len, ts, nbh);
-    tx_send(ctx, nbh, 0, len);
+    tx_send(ctx, nbh, 0, len, ktx->msg.packet.port);
   } else if (ktx->type == FLEXTCP_PL_KTX_PACKET_NOTS) {
     /* send packet without filling in timestamp */
     len = ktx->msg.packet.len;
@@ -70,10 +70,10 @@ int fast_kernel_poll(struct dataplane_context *ctx,
     dma_read(ktx->msg.packet.addr, len, buf);
 
     ret = 0;
-    tx_send(ctx, nbh, 0, len);
+    tx_send(ctx, nbh, 0, len, ktx->msg.packet.port);
   } else if (ktx->type == FLEXTCP_PL_KTX_CONNRETRAN) {
     flow_id = ktx->msg.connretran.flow_id;
-    if (flow_id >= FLEXNIC_PL_FLOWST_NUM) {
+    if (flow_id >= fp_state->flowst_num) {
       fprintf(stderr, "fast_kernel_qman: invalid flow id=%u\n", flow_id);
       abort();
     }
@@ -130,6 +130,7 @@ void fast_kernel_packet(struct dataplane_context *ctx,
 
   krx->msg.packet.len = len;
   krx->msg.packet.fn_core = ctx->id;
+  krx->msg.packet.port = network_buf_port(nbh);
   MEM_BARRIER();
 
   /* krx queue header */
@@ -55,43 +55,49 @@
 
 
 static void dataplane_block(struct dataplane_context *ctx, uint32_t ts);
-static unsigned poll_rx(struct dataplane_context *ctx, uint32_t ts,
-    uint64_t tsc) __attribute__((noinline));
+static unsigned poll_rx(struct dataplane_context *ctx, uint32_t ts)
+    __attribute__((noinline));
+static unsigned poll_flow_fwd(struct dataplane_context *ctx, uint32_t ts)
+    __attribute__((noinline));
+static void rx_process(struct dataplane_context *ctx,
+    struct network_buf_handle **bhs, unsigned n, uint32_t ts);
 static unsigned poll_queues(struct dataplane_context *ctx, uint32_t ts)  __attribute__((noinline));
 static unsigned poll_kernel(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
 static unsigned poll_qman(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
 static unsigned poll_qman_fwd(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
+static unsigned poll_acktimers(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
 static void poll_scale(struct dataplane_context *ctx);
 
 static inline uint8_t bufcache_prealloc(struct dataplane_context *ctx, uint16_t num,
     struct network_buf_handle ***handles);
 static inline void bufcache_alloc(struct dataplane_context *ctx, uint16_t num);
-static inline void bufcache_free(struct dataplane_context *ctx,
-    struct network_buf_handle *handle);
+static inline void bufcache_free_bulk(struct dataplane_context *ctx,
+    struct network_buf_handle **handles, uint16_t num);
 
 static inline void tx_flush(struct dataplane_context *ctx);
 static inline void tx_send(struct dataplane_context *ctx,
-    struct network_buf_handle *nbh, uint16_t off, uint16_t len);
+    struct network_buf_handle *nbh, uint16_t off, uint16_t len, uint8_t port);
 
-static void arx_cache_flush(struct dataplane_context *ctx, uint64_t tsc) __attribute__((noinline));
+static inline uint16_t bump_process(struct dataplane_context *ctx, void *pqe,
+    struct network_buf_handle **handles, uint16_t num_bufs, uint32_t ts);
+static inline uint16_t bump_retry(struct dataplane_context *ctx,
+    struct network_buf_handle **handles, uint16_t max, uint32_t ts);
+
+static void arx_cache_flush(struct dataplane_context *ctx) __attribute__((noinline));
+static unsigned arx_ovf_drain(struct dataplane_context *ctx);
+static inline void arx_ovf_add(struct dataplane_context *ctx, uint16_t id,
+    const struct flextcp_pl_arx *arx);
 
 int dataplane_init(void)
 {
-  if (FLEXNIC_INTERNAL_MEM_SIZE < sizeof(struct flextcp_pl_mem)) {
-    fprintf(stderr, "dataplane_init: internal flexnic memory size not "
-        "sufficient (got %x, need %zx)\n", FLEXNIC_INTERNAL_MEM_SIZE,
-        sizeof(struct flextcp_pl_mem));
-    return -1;
-  }
-
   if (fp_cores_max > FLEXNIC_PL_APPST_CTX_MCS) {
     fprintf(stderr, "dataplane_init: more cores than FLEXNIC_PL_APPST_CTX_MCS "
         "(%u)\n", FLEXNIC_PL_APPST_CTX_MCS);
     return -1;
   }
-  if (FLEXNIC_PL_FLOWST_NUM > FLEXNIC_NUM_QMQUEUES) {
-    fprintf(stderr, "dataplane_init: more flow states than queue manager queues"
-        "(%u > %u)\n", FLEXNIC_PL_FLOWST_NUM, FLEXNIC_NUM_QMQUEUES);
+  if (sizeof(struct flextcp_pl_flowst) != 64) {
+    fprintf(stderr, "dataplane_init: flow state does not fit in one cache "
+        "line (%zu bytes)\n", sizeof(struct flextcp_pl_flowst));
     return -1;
   }
 
@@ -101,6 +107,7 @@ int dataplane_init(void)
 int dataplane_context_init(struct dataplane_context *ctx)
 {
   char name[32];
+  unsigned i;
 
   /* initialize forwarding queue */
   sprintf(name, "qman_fwd_ring_%u", ctx->id);
@@ -111,19 +118,59 @@ int dataplane_context_init(struct dataplane_context *ctx)
     return -1;
   }
 
+  /* initialize rings for events on flows owned by this core */
+  for (i = 0; i < fp_cores_max; i++) {
+    if (i == ctx->id)
+      continue;
+
+    sprintf(name, "flow_fwd_%u_%u", ctx->id, i);
+    if ((ctx->flow_fwd_rings[i] = rte_ring_create(name, FLOW_FWD_RING_SIZE,
+            rte_socket_id(), RING_F_SP_ENQ | RING_F_SC_DEQ)) == NULL)
+    {
+      fprintf(stderr, "initializing flow forwarding ring failed\n");
+      return -1;
+    }
+  }
+
   /* initialize queue manager */
   if (qman_thread_init(ctx) != 0) {
     fprintf(stderr, "initializing qman thread failed\n");
     return -1;
   }
 
+  /* initialize buffer cache */
+  ctx->bufcache_handles = rte_calloc_socket("bufcache", config.fp_bufcache,
+      sizeof(*ctx->bufcache_handles), 0, rte_socket_id());
+  if (ctx->bufcache_handles == NULL) {
+    fprintf(stderr, "initializing buffer cache failed\n");
+    return -1;
+  }
+  ctx->bufcache_mask = config.fp_bufcache - 1;
+
+  /* initialize software transmit queue */
+  ctx->txq_handles = rte_calloc_socket("txq", config.fp_txq_len,
+      sizeof(*ctx->txq_handles), 0, rte_socket_id());
+  if (ctx->txq_handles == NULL) {
+    fprintf(stderr, "initializing transmit queue failed\n");
+    return -1;
+  }
+  ctx->txq_mask = config.fp_txq_len - 1;
+
+  /* initialize app rx queue overflow queues */
+  ctx->arx_ovf = rte_zmalloc_socket("arx_ovf",
+      fp_state->appctx_num * sizeof(*ctx->arx_ovf), 0, rte_socket_id());
+  if (ctx->arx_ovf == NULL) {
+    fprintf(stderr, "initializing app rx overflow queues failed\n");
+    return -1;
+  }
+
   /* initialize network queue */
   if (network_thread_init(ctx) != 0) {
     fprintf(stderr, "initializing rx thread failed\n");
     return -1;
   }
 
-  ctx->poll_next_ctx = ctx->id;
+  ctx->poll_next_ctx = ctx->id % fp_state->appctx_num;
 
   ctx->evfd = eventfd(0, EFD_NONBLOCK);
   assert(ctx->evfd != -1);
@@ -150,6 +197,8 @@ void dataplane_loop(struct dataplane_context *ctx)
   while (!exited) {
     unsigned n = 0;
 
+    ctx->loop_epoch++;
+
     /* count cycles of previous iteration if it was busy */
     prev_cyc = cyc;
     cyc = rte_get_tsc_cycles();
@@ -160,11 +209,12 @@ void dataplane_loop(struct dataplane_context *ctx)
     ts = qman_timestamp(cyc);
 
     STATS_TS(start);
-    n += poll_rx(ctx, ts, cyc);
+    n += poll_rx(ctx, ts);
     STATS_TS(rx);
     tx_flush(ctx);
 
     n += poll_qman_fwd(ctx, ts);
+    n += poll_flow_fwd(ctx, ts);
 
     STATS_TSADD(ctx, cyc_rx, rx - start);
     n += poll_qman(ctx, ts);
@@ -174,6 +224,7 @@ void dataplane_loop(struct dataplane_context *ctx)
     STATS_TS(qs);
     STATS_TSADD(ctx, cyc_qs, qs - qm);
     n += poll_kernel(ctx, ts);
+    n += poll_acktimers(ctx, ts);
 
     /* flush transmit buffer */
     tx_flush(ctx);
@@ -181,20 +232,44 @@ void dataplane_loop(struct dataplane_context *ctx)
     if (ctx->id == 0)
       poll_scale(ctx);
 
-    was_idle = (n == 0);
+    /* keep polling until queued packets and held back updates are out */
+    was_idle = (n == 0 && ctx->txq_num == 0 && ctx->arx_ovf_pending == 0 &&
+        ctx->bump_retry.num == 0 && ctx->qman_retry.num == 0);
     if (config.fp_interrupts && notify_canblock(&nbs, !was_idle, cyc)) {
+      ctx->blocked = 1;
+      MEM_BARRIER();
       dataplane_block(ctx, ts);
+      ctx->blocked = 0;
       notify_canblock_reset(&nbs);
     }
   }
 }
 
+/**
+ * Wait until the core owning the flow group is done with any event it might
+ * have started processing before the caller changed flow state flags. The
+ * owner either finishes its current loop iteration or is blocked.
+ */
+void dataplane_flowgroup_quiesce(uint16_t flow_group)
+{
+  struct dataplane_context *ctx;
+  uint32_t epoch;
+
+  MEM_BARRIER();
+  ctx = ctxs[fp_state->flow_group_owner[flow_group]];
+  epoch = ctx->loop_epoch;
+  while (ctx->loop_epoch == epoch && !ctx->blocked && !exited) {
+    rte_pause();
+  }
+  MEM_BARRIER();
+}
+
 static void dataplane_block(struct dataplane_context *ctx, uint32_t ts)
 {
-  uint32_t max_timeout;
+  uint32_t max_timeout, ack_to;
   uint64_t val;
   int ret, i;
-  struct rte_epoll_event event[2];
+  struct rte_epoll_event event[1 + CONFIG_PORTS_MAX];
 
   if (network_rx_interrupt_ctl(&ctx->net, 1) != 0) {
     return;
@@ -202,7 +277,13 @@ static void dataplane_block(struct dataplane_context *ctx, uint32_t ts)
 
   max_timeout = qman_next_ts(&ctx->qman, ts);
 
-  ret = rte_epoll_wait(RTE_EPOLL_PER_THREAD, event, 2,
+  /* wake up in time for delayed acks */
+  if (ctx->acktimer_num > 0) {
+    ack_to = ctx->acktimers[ctx->acktimer_head].ts - ts;
+    max_timeout = ((int32_t) ack_to <= 0 ? 0 : MIN(max_timeout, ack_to));
+  }
+
+  ret = rte_epoll_wait(RTE_EPOLL_PER_THREAD, event, 1 + CONFIG_PORTS_MAX,
       max_timeout == (uint32_t) -1 ? -1 : max_timeout / 1000);
   if (ret < 0) {
     perror("dataplane_block: rte_epoll_wait failed");
@@ -240,6 +321,7 @@ void dataplane_dump_stats(void)
         "qm=(%"PRIu64",%"PRIu64",%"PRIu64")  "
         "rx=(%"PRIu64",%"PRIu64",%"PRIu64")  "
         "qs=(%"PRIu64",%"PRIu64",%"PRIu64")  "
+        "fwd=(%"PRIu64",%"PRIu64")  "
         "cyc=(%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64")\n", i,
         read_stat(&ctx->stat_qm_poll), read_stat(&ctx->stat_qm_empty),
         read_stat(&ctx->stat_qm_total),
@@ -247,25 +329,20 @@ void dataplane_dump_stats(void)
         read_stat(&ctx->stat_rx_total),
         read_stat(&ctx->stat_qs_poll), read_stat(&ctx->stat_qs_empty),
         read_stat(&ctx->stat_qs_total),
+        read_stat(&ctx->stat_fwd_out), read_stat(&ctx->stat_fwd_in),
         read_stat(&ctx->stat_cyc_db), read_stat(&ctx->stat_cyc_qm),
         read_stat(&ctx->stat_cyc_rx), read_stat(&ctx->stat_cyc_qs));
   }
 }
 #endif
 
-static unsigned poll_rx(struct dataplane_context *ctx, uint32_t ts,
-    uint64_t tsc)
+static unsigned poll_rx(struct dataplane_context *ctx, uint32_t ts)
 {
   int ret;
-  unsigned i, n;
-  uint8_t freebuf[BATCH_SIZE] = { 0 };
-  void *fss[BATCH_SIZE];
-  struct tcp_opts tcpopts[BATCH_SIZE];
+  unsigned n;
   struct network_buf_handle *bhs[BATCH_SIZE];
 
   n = BATCH_SIZE;
-  if (TXBUF_SIZE - ctx->tx_num < n)
-    n = TXBUF_SIZE - ctx->tx_num;
 
   STATS_ADD(ctx, rx_poll, 1);
 
@@ -278,6 +355,25 @@ static unsigned poll_rx(struct dataplane_context *ctx, uint32_t ts,
   STATS_ADD(ctx, rx_total, n);
   n = ret;
 
+  rx_process(ctx, bhs, n, ts);
+  return n;
+}
+
+/* process received packets, either from the NIC or forwarded from other cores
+ * for flows owned by this one */
+static void rx_process(struct dataplane_context *ctx,
+    struct network_buf_handle **bhs, unsigned n, uint32_t ts)
+{
+  int ret;
+  unsigned i, j;
+  uint8_t freebuf[BATCH_SIZE] = { 0 };
+  struct network_buf_handle *frees[BATCH_SIZE];
+  uint16_t num_frees = 0;
+  uint8_t drop[BATCH_SIZE];
+  uint16_t runs[BATCH_SIZE];
+  void *fss[BATCH_SIZE];
+  struct tcp_opts tcpopts[BATCH_SIZE];
+
   /* prefetch packet contents (1st cache line) */
   for (i = 0; i < n; i++) {
     rte_prefetch0(network_buf_bufoff(bhs[i]));
@@ -292,81 +388,195 @@ static unsigned poll_rx(struct dataplane_context *ctx, uint32_t ts,
   }
 
   /* parse packets */
-  fast_flows_packet_parse(ctx, bhs, fss, tcpopts, n);
-
-  for (i = 0; i < n; i++) {
-    /* run fast-path for flows with flow state */
-    if (fss[i] != NULL) {
-      ret = fast_flows_packet(ctx, bhs[i], fss[i], &tcpopts[i], ts);
-    } else {
-      ret = -1;
+  fast_flows_packet_parse(ctx, bhs, fss, tcpopts, drop, n);
+
+  /* group in-order segments of the same flow into runs */
+  fast_flows_packet_gro(ctx, bhs, fss, tcpopts, runs, n);
+
+  for (i = 0; i < n; i += runs[i]) {
+    /* try processing run as one segment, buffer of last one is used for ack */
+    if (runs[i] > 1) {
+      ret = fast_flows_packet_run(ctx, bhs + i, fss[i], tcpopts + i, runs[i],
+          ts);
+      if (ret > 0) {
+        freebuf[i + runs[i] - 1] = 1;
+      }
+      if (ret >= 0) {
+        continue;
+      }
     }
 
-    if (ret > 0) {
-      freebuf[i] = 1;
-    } else if (ret < 0) {
-      fast_kernel_packet(ctx, bhs[i]);
+    for (j = i; j < i + runs[i]; j++) {
+      /* run fast-path for flows with flow state */
+      if (fss[j] != NULL) {
+        ret = fast_flows_packet(ctx, bhs[j], fss[j], &tcpopts[j], ts);
+      } else if (drop[j]) {
+        continue;
+      } else {
+        ret = -1;
+      }
+
+      if (ret > 0) {
+        freebuf[j] = 1;
+      } else if (ret < 0) {
+        fast_kernel_packet(ctx, bhs[j]);
+      }
     }
   }
 
-  arx_cache_flush(ctx, tsc);
+  arx_cache_flush(ctx);
 
   /* free received buffers */
   for (i = 0; i < n; i++) {
     if (freebuf[i] == 0)
-      bufcache_free(ctx, bhs[i]);
+      frees[num_frees++] = bhs[i];
   }
-
-  return n;
+  bufcache_free_bulk(ctx, frees, num_frees);
 }
 
-static unsigned poll_queues(struct dataplane_context *ctx, uint32_t ts)
+static unsigned poll_flow_fwd(struct dataplane_context *ctx, uint32_t ts)
 {
   struct network_buf_handle **handles;
-  void *aqes[BATCH_SIZE];
-  unsigned n, i, total = 0;
-  uint16_t max, k = 0, num_bufs = 0, j;
-  int ret;
+  struct network_buf_handle *pkts[BATCH_SIZE];
+  void *msgs[BATCH_SIZE];
+  unsigned i, j, n, total = 0;
+  uint16_t max, num_bufs = 0, num_pkts = 0;
+  uintptr_t msg;
+  uint32_t flow_id;
 
-  STATS_ADD(ctx, qs_poll, 1);
+  for (i = 0; i < fp_cores_max; i++) {
+    if (ctx->flow_fwd_rings[i] == NULL)
+      continue;
+
+    max = BATCH_SIZE;
+
+    /* allocate buffers for bumps and acks */
+    max = bufcache_prealloc(ctx, max, &handles);
+
+    n = rte_ring_sc_dequeue_burst(ctx->flow_fwd_rings[i], msgs, max, NULL);
+    for (j = 0; j < n; j++) {
+      msg = (uintptr_t) msgs[j];
+      flow_id = msg >> FLOW_FWD_TYPE_BITS;
+      switch (msg & FLOW_FWD_TYPE_MASK) {
+        case FLOW_FWD_PACKET:
+          pkts[num_pkts++] = msgs[j];
+          break;
+
+        case FLOW_FWD_BUMP:
+          num_bufs = bump_process(ctx, (void *) (msg & ~FLOW_FWD_TYPE_MASK),
+              handles, num_bufs, ts);
+          break;
+
+        case FLOW_FWD_RETRANSMIT:
+          fast_flows_retransmit(ctx, flow_id);
+          break;
+
+        case FLOW_FWD_DELACK:
+          if (fast_flows_delayed_ack(ctx, flow_id, handles[num_bufs], ts) == 0)
+            num_bufs++;
+          break;
+      }
+    }
 
-  max = BATCH_SIZE;
-  if (TXBUF_SIZE - ctx->tx_num < max)
-    max = TXBUF_SIZE - ctx->tx_num;
+    /* apply buffer reservations */
+    bufcache_alloc(ctx, num_bufs);
+    num_bufs = 0;
 
-  /* allocate buffers contents */
-  max = bufcache_prealloc(ctx, max, &handles);
+    if (num_pkts > 0) {
+      rx_process(ctx, pkts, num_pkts, ts);
+      num_pkts = 0;
+    }
+    total += n;
+  }
+
+  STATS_ADD(ctx, fwd_in, total);
+  return total;
+}
+
+/** Next app context in bitmap at or after c, wrapping around */
+static inline unsigned actx_next(uint64_t bm, unsigned c)
+{
+  uint64_t m = bm & (~0ULL << c);
+  return __builtin_ctzll(m != 0 ? m : bm);
+}
+
+/* Fetch up to max entries from tx queues of contexts that rang their
+ * doorbell, round robin. */
+static uint16_t actx_fetch(struct dataplane_context *ctx, void **aqes,
+    uint16_t max)
+{
+  unsigned id, i;
+  uint16_t k = 0;
+  uint64_t pend, m;
+
+  ctx->actx_txpend |= fast_appctx_doorbells(ctx);
+  pend = ctx->actx_txpend;
 
-  for (n = 0; n < FLEXNIC_PL_APPCTX_NUM; n++) {
-    fast_appctx_poll_pf(ctx, (ctx->poll_next_ctx + n) % FLEXNIC_PL_APPCTX_NUM);
+  for (m = pend; m != 0; m &= m - 1) {
+    fast_appctx_poll_pf(ctx, __builtin_ctzll(m));
   }
 
-  for (n = 0; n < FLEXNIC_PL_APPCTX_NUM && k < max; n++) {
+  while (pend != 0 && k < max) {
+    id = actx_next(pend, ctx->poll_next_ctx);
+    pend &= ~(1ULL << id);
+
     for (i = 0; i < BATCH_SIZE && k < max; i++) {
-      ret = fast_appctx_poll_fetch(ctx, ctx->poll_next_ctx, &aqes[k]);
-      if (ret == 0)
-        k++;
-      else
+      if (fast_appctx_poll_fetch(ctx, id, &aqes[k]) != 0) {
+        /* drained, the doorbell tells us about new entries */
+        ctx->actx_txpend &= ~(1ULL << id);
         break;
-
-      total++;
+      }
+      k++;
     }
 
-    ctx->poll_next_ctx = (ctx->poll_next_ctx + 1) %
-      FLEXNIC_PL_APPCTX_NUM;
+    ctx->poll_next_ctx = (id + 1) % fp_state->appctx_num;
   }
 
-  for (j = 0; j < k; j++) {
-    ret = fast_appctx_poll_bump(ctx, aqes[j], handles[num_bufs], ts);
-    if (ret == 0)
-      num_bufs++;
+  return k;
+}
+
+static unsigned poll_queues(struct dataplane_context *ctx, uint32_t ts)
+{
+  struct network_buf_handle **handles;
+  void *aqes[BATCH_SIZE];
+  unsigned id, total = 0;
+  uint16_t max, k, num_bufs = 0, j;
+  uint64_t m;
+
+  STATS_ADD(ctx, qs_poll, 1);
+
+  max = BATCH_SIZE;
+
+  /* allocate buffers contents */
+  max = bufcache_prealloc(ctx, max, &handles);
+
+  if (ctx->bump_retry.num > 0) {
+    /* bumps that could not be forwarded go first, new entries wait to keep
+     * the bumps of a flow in order */
+    k = ctx->bump_retry.num;
+    num_bufs = bump_retry(ctx, handles, max, ts);
+    total += k - ctx->bump_retry.num;
+  } else {
+    k = actx_fetch(ctx, aqes, max);
+    for (j = 0; j < k; j++) {
+      num_bufs = bump_process(ctx, aqes[j], handles, num_bufs, ts);
+    }
+    total += k;
   }
 
   /* apply buffer reservations */
   bufcache_alloc(ctx, num_bufs);
 
-  for (n = 0; n < FLEXNIC_PL_APPCTX_NUM; n++)
-    fast_actx_rxq_probe(ctx, n);
+  /* reclaim rx queue space of contexts running low */
+  for (m = ctx->actx_rxlow; m != 0; m &= m - 1) {
+    id = __builtin_ctzll(m);
+    if (fast_actx_rxq_probe(ctx, id) != 0)
+      ctx->actx_rxlow &= ~(1ULL << id);
+  }
+
+  /* move held back updates to rx queues that have space again */
+  if (ctx->arx_ovf_pending != 0)
+    total += arx_ovf_drain(ctx);
 
   STATS_ADD(ctx, qs_total, total);
   if (total == 0)
@@ -383,8 +593,6 @@ static unsigned poll_kernel(struct dataplane_context *ctx, uint32_t ts)
   int ret;
 
   max = BATCH_SIZE;
-  if (TXBUF_SIZE - ctx->tx_num < max)
-    max = TXBUF_SIZE - ctx->tx_num;
 
   max = (max > 8 ? 8 : max);
   /* allocate buffers contents */
@@ -415,9 +623,13 @@ static unsigned poll_qman(struct dataplane_context *ctx, uint32_t ts)
   uint16_t off = 0, max;
   int ret, i, use;
 
+  /* NIC is backed up, leave segments in the queue manager until the software
+   * transmit queue has drained */
+  if (ctx->txq_num > 0) {
+    return 0;
+  }
+
   max = BATCH_SIZE;
-  if (TXBUF_SIZE - ctx->tx_num < max)
-    max = TXBUF_SIZE - ctx->tx_num;
 
   STATS_ADD(ctx, qm_poll, 1);
 
@@ -466,7 +678,16 @@ static unsigned poll_qman(struct dataplane_context *ctx, uint32_t ts)
 static unsigned poll_qman_fwd(struct dataplane_context *ctx, uint32_t ts)
 {
   void *flow_states[4 * BATCH_SIZE];
-  int ret, i;
+  uint32_t i, n;
+  int ret;
+
+  /* flows we could not forward earlier, entries that fail again are put back
+   * at the front of the list */
+  n = ctx->qman_retry.num;
+  ctx->qman_retry.num = 0;
+  for (i = 0; i < n; i++) {
+    fast_flows_qman_fwd(ctx, ctx->qman_retry.ents[i]);
+  }
 
   /* poll queue manager forwarding ring */
   ret = rte_ring_dequeue_burst(ctx->qman_fwd_ring, flow_states, 4 * BATCH_SIZE, NULL);
@@ -474,41 +695,80 @@ static unsigned poll_qman_fwd(struct dataplane_context *ctx, uint32_t ts)
     fast_flows_qman_fwd(ctx, flow_states[i]);
   }
 
-  return ret;
+  return ret + n;
+}
+
+static unsigned poll_acktimers(struct dataplane_context *ctx, uint32_t ts)
+{
+  struct network_buf_handle **handles;
+  struct ack_timer *at;
+  uint32_t flow_id;
+  unsigned n = 0;
+  uint16_t max, off = 0;
+
+  if (ctx->acktimer_num == 0 ||
+      (int32_t) (ts - ctx->acktimers[ctx->acktimer_head].ts) < 0)
+  {
+    return 0;
+  }
+
+  max = BATCH_SIZE;
+
+  /* allocate buffers for acks */
+  max = bufcache_prealloc(ctx, max, &handles);
+
+  /* send out acks for expired timers */
+  while (off < max && ctx->acktimer_num > 0) {
+    at = &ctx->acktimers[ctx->acktimer_head];
+    if ((int32_t) (ts - at->ts) < 0) {
+      break;
+    }
+
+    /* remove the timer first, so it can be re-armed if forwarding fails */
+    flow_id = at->flow_id;
+    ctx->acktimer_head = (ctx->acktimer_head + 1) & (ACKTIMER_SIZE - 1);
+    ctx->acktimer_num--;
+    n++;
+
+    if (fast_flows_delayed_ack(ctx, flow_id, handles[off], ts) == 0) {
+      off++;
+    }
+  }
+
+  /* apply buffer reservations */
+  bufcache_alloc(ctx, off);
+
+  return n;
 }
 
 static inline uint8_t bufcache_prealloc(struct dataplane_context *ctx, uint16_t num,
     struct network_buf_handle ***handles)
 {
-  uint16_t grow, res, head, g, i;
-  struct network_buf_handle *nbh;
+  uint32_t size = (uint32_t) ctx->bufcache_mask + 1;
+  uint32_t grow, res, head, g;
 
   /* try refilling buffer cache */
   if (ctx->bufcache_num < num) {
-    grow = BUFCACHE_SIZE - ctx->bufcache_num;
-    head = (ctx->bufcache_head + ctx->bufcache_num) & (BUFCACHE_SIZE - 1);
+    ctx->bufcache_misses++;
+    grow = size - ctx->bufcache_num;
+    head = (ctx->bufcache_head + ctx->bufcache_num) & ctx->bufcache_mask;
 
-    if (head + grow <= BUFCACHE_SIZE) {
+    if (head + grow <= size) {
       res = network_buf_alloc(&ctx->net, grow, ctx->bufcache_handles + head);
     } else {
-      g = BUFCACHE_SIZE - head;
+      g = size - head;
       res = network_buf_alloc(&ctx->net, g, ctx->bufcache_handles + head);
       if (res == g) {
         res += network_buf_alloc(&ctx->net, grow - g, ctx->bufcache_handles);
       }
     }
 
-    for (i = 0; i < res; i++) {
-      g = (head + i) & (BUFCACHE_SIZE - 1);
-      nbh = ctx->bufcache_handles[g];
-      ctx->bufcache_handles[g] = (struct network_buf_handle *)
-        ((uintptr_t) nbh);
-    }
-
     ctx->bufcache_num += res;
+  } else {
+    ctx->bufcache_hits++;
   }
-  num = MIN(num, (ctx->bufcache_head + ctx->bufcache_num <= BUFCACHE_SIZE ?
-        ctx->bufcache_num : BUFCACHE_SIZE - ctx->bufcache_head));
+  num = MIN(num, (ctx->bufcache_head + ctx->bufcache_num <= size ?
+        ctx->bufcache_num : size - ctx->bufcache_head));
 
   *handles = ctx->bufcache_handles + ctx->bufcache_head;
 
@@ -519,49 +779,63 @@ static inline void bufcache_alloc(struct dataplane_context *ctx, uint16_t num)
 {
   assert(num <= ctx->bufcache_num);
 
-  ctx->bufcache_head = (ctx->bufcache_head + num) & (BUFCACHE_SIZE - 1);
+  ctx->bufcache_head = (ctx->bufcache_head + num) & ctx->bufcache_mask;
   ctx->bufcache_num -= num;
 }
 
-static inline void bufcache_free(struct dataplane_context *ctx,
-    struct network_buf_handle *handle)
+static inline void bufcache_free_bulk(struct dataplane_context *ctx,
+    struct network_buf_handle **handles, uint16_t num)
 {
-  uint32_t head, num;
-
-  num = ctx->bufcache_num;
-  if (num < BUFCACHE_SIZE) {
-    /* free to cache */
-    head = (ctx->bufcache_head + num) & (BUFCACHE_SIZE - 1);
-    ctx->bufcache_handles[head] = handle;
-    ctx->bufcache_num = num + 1;
-    network_buf_reset(handle);
-  } else {
-    /* free to network buffer manager */
-    network_free(1, &handle);
+  uint32_t head, n, i;
+
+  /* free to cache as far as there is space */
+  n = MIN(num, (uint32_t) ctx->bufcache_mask + 1 - ctx->bufcache_num);
+  head = ctx->bufcache_head + ctx->bufcache_num;
+  for (i = 0; i < n; i++) {
+    network_buf_reset(handles[i]);
+    ctx->bufcache_handles[(head + i) & ctx->bufcache_mask] = handles[i];
+  }
+  ctx->bufcache_num += n;
+
+  /* free rest to network buffer manager */
+  if (n < num) {
+    network_free(num - n, handles + n);
   }
 }
 
 static inline void tx_flush(struct dataplane_context *ctx)
 {
+  uint32_t n;
   int ret;
-  unsigned i;
+
+  /* packets queued earlier go out first */
+  while (ctx->txq_num > 0) {
+    n = MIN(ctx->txq_num, (uint32_t) ctx->txq_mask + 1 - ctx->txq_head);
+    ret = network_send(&ctx->net, n, ctx->txq_handles + ctx->txq_head);
+    ctx->txq_head = (ctx->txq_head + ret) & ctx->txq_mask;
+    ctx->txq_num -= ret;
+
+    if (ret < n) {
+      /* NIC is full, queue the send buffer behind */
+      ctx->tx_stalls++;
+      if (ctx->tx_num > 0) {
+        tx_spill(ctx, 0);
+      }
+      return;
+    }
+  }
 
   if (ctx->tx_num == 0) {
     return;
   }
 
-  /* try to send out packets */
+  /* try to send out packets, queue what the NIC does not take */
   ret = network_send(&ctx->net, ctx->tx_num, ctx->tx_handles);
-
   if (ret == ctx->tx_num) {
-    /* everything sent */
     ctx->tx_num = 0;
-  } else if (ret > 0) {
-    /* move unsent packets to front */
-    for (i = ret; i < ctx->tx_num; i++) {
-      ctx->tx_handles[i - ret] = ctx->tx_handles[i];
-    }
-    ctx->tx_num -= ret;
+  } else {
+    ctx->tx_stalls++;
+    tx_spill(ctx, ret);
   }
 }
 
@@ -591,33 +865,183 @@ static void poll_scale(struct dataplane_context *ctx)
   fp_scale_to = 0;
 }
 
-static void arx_cache_flush(struct dataplane_context *ctx, uint64_t tsc)
+/* Process app queue entry, or queue it for retrying if bumps are already
+ * waiting or the flow owner's ring is full. Returns updated number of used
+ * buffers. */
+static inline uint16_t bump_process(struct dataplane_context *ctx, void *pqe,
+    struct network_buf_handle **handles, uint16_t num_bufs, uint32_t ts)
+{
+  int ret;
+
+  if (ctx->bump_retry.num == 0) {
+    ret = fast_appctx_poll_bump(ctx, pqe, handles[num_bufs], ts);
+    if (ret == 0) {
+      return num_bufs + 1;
+    } else if (ret > 0) {
+      return num_bufs;
+    }
+  }
+
+  fwd_retry_add(&ctx->bump_retry, pqe);
+  return num_bufs;
+}
+
+/* Retry waiting bumps in order. Once a bump fails, later ones for the same
+ * flow group stay queued behind it so bumps of a flow are never reordered.
+ * Returns number of used buffers. */
+static inline uint16_t bump_retry(struct dataplane_context *ctx,
+    struct network_buf_handle **handles, uint16_t max, uint32_t ts)
+{
+  struct fwd_retry *r = &ctx->bump_retry;
+  struct flextcp_pl_atx *atx;
+  uint64_t failed[FLEXNIC_PL_MAX_FLOWGROUPS / 64];
+  uint32_t i, kept = 0;
+  uint16_t fg, num_bufs = 0;
+  int ret, any_failed = 0;
+
+  for (i = 0; i < r->num; i++) {
+    atx = r->ents[i];
+    fg = fp_state->flowst[atx->msg.connupdate.flow_id].flow_group;
+    if (num_bufs >= max ||
+        (any_failed && (failed[fg / 64] & (1ULL << (fg % 64))) != 0))
+    {
+      r->ents[kept++] = atx;
+      continue;
+    }
+
+    ret = fast_appctx_poll_bump(ctx, atx, handles[num_bufs], ts);
+    if (ret < 0) {
+      if (!any_failed) {
+        memset(failed, 0, sizeof(failed));
+        any_failed = 1;
+      }
+      failed[fg / 64] |= 1ULL << (fg % 64);
+      r->ents[kept++] = atx;
+    } else if (ret == 0) {
+      num_bufs++;
+    }
+  }
+
+  r->num = kept;
+  return num_bufs;
+}
+
+static void arx_cache_flush(struct dataplane_context *ctx)
 {
   uint16_t i;
   struct flextcp_pl_appctx *actx;
   struct flextcp_pl_arx *parx[BATCH_SIZE];
+  uint64_t notified;
 
+  /* updates go behind held back ones for the same context to keep their
+   * order */
   for (i = 0; i < ctx->arx_num; i++) {
     actx = &fp_state->appctx[ctx->id][ctx->arx_ctx[i]];
-    if (fast_actx_rxq_alloc(ctx, actx, &parx[i]) != 0) {
-      /* TODO: how do we handle this? */
-      fprintf(stderr, "arx_cache_flush: no space in app rx queue\n");
-      abort();
+    if ((ctx->arx_ovf_pending & (1ULL << ctx->arx_ctx[i])) != 0 ||
+        fast_actx_rxq_alloc(ctx, actx, &parx[i]) != 0)
+    {
+      arx_ovf_add(ctx, ctx->arx_ctx[i], &ctx->arx_cache[i]);
+      parx[i] = NULL;
     }
   }
 
   for (i = 0; i < ctx->arx_num; i++) {
-    rte_prefetch0(parx[i]);
+    if (parx[i] != NULL)
+      rte_prefetch0(parx[i]);
   }
 
   for (i = 0; i < ctx->arx_num; i++) {
-    *parx[i] = ctx->arx_cache[i];
+    if (parx[i] != NULL)
+      *parx[i] = ctx->arx_cache[i];
   }
 
+  /* entries must be visible before we look at the sleeping flags, pairs with
+   * the barrier in flextcp_context_canwait() */
+  __sync_synchronize();
+
+  /* one notification per context and batch */
+  notified = 0;
   for (i = 0; i < ctx->arx_num; i++) {
-    actx = &fp_state->appctx[ctx->id][ctx->arx_ctx[i]];
-    notify_appctx(actx, tsc);
+    if ((notified & (1ULL << ctx->arx_ctx[i])) != 0) {
+      continue;
+    }
+    notified |= 1ULL << ctx->arx_ctx[i];
+    notify_appctx(&fp_state->appctx[ctx->id][ctx->arx_ctx[i]]);
   }
 
   ctx->arx_num = 0;
 }
+
+/* hold back update for an app context whose rx queue is full, merging it with
+ * a held back update for the same flow */
+static inline void arx_ovf_add(struct dataplane_context *ctx, uint16_t id,
+    const struct flextcp_pl_arx *arx)
+{
+  struct arx_ovf *ovf = &ctx->arx_ovf[id];
+  struct flextcp_pl_arx_connupdate *cu;
+  uint16_t i;
+
+  fp_state->appctx[ctx->id][id].rx_overflows++;
+
+  for (i = 0; i < ovf->num; i++) {
+    cu = &ovf->entries[(ovf->head + i) % ARX_OVF_SIZE].msg.connupdate;
+    if (cu->opaque == arx->msg.connupdate.opaque) {
+      cu->rx_bump += arx->msg.connupdate.rx_bump;
+      cu->tx_bump += arx->msg.connupdate.tx_bump;
+      cu->flags |= arx->msg.connupdate.flags;
+      return;
+    }
+  }
+
+  /* flows of the context stop accepting segments before this can fill up */
+  assert(ovf->num < ARX_OVF_SIZE);
+  ovf->entries[(ovf->head + ovf->num) % ARX_OVF_SIZE] = *arx;
+  ovf->num++;
+
+  ctx->arx_ovf_pending |= 1ULL << id;
+  if (ovf->num > ARX_OVF_SIZE - BATCH_SIZE) {
+    ctx->arx_ovf_blocked |= 1ULL << id;
+  }
+}
+
+/* move held back updates to app rx queues with space */
+static unsigned arx_ovf_drain(struct dataplane_context *ctx)
+{
+  struct flextcp_pl_appctx *actx;
+  struct flextcp_pl_arx *parx;
+  struct arx_ovf *ovf;
+  uint64_t pending = ctx->arx_ovf_pending;
+  unsigned total = 0;
+  uint16_t id, n;
+
+  while (pending != 0) {
+    id = __builtin_ctzll(pending);
+    pending &= pending - 1;
+
+    ovf = &ctx->arx_ovf[id];
+    actx = &fp_state->appctx[ctx->id][id];
+    for (n = 0; ovf->num > 0 && fast_actx_rxq_alloc(ctx, actx, &parx) == 0;
+        n++)
+    {
+      *parx = ovf->entries[ovf->head];
+      ovf->head = (ovf->head + 1) % ARX_OVF_SIZE;
+      ovf->num--;
+    }
+    if (n == 0) {
+      continue;
+    }
+
+    __sync_synchronize();
+    notify_appctx(actx);
+    total += n;
+
+    if (ovf->num <= ARX_OVF_SIZE - BATCH_SIZE) {
+      ctx->arx_ovf_blocked &= ~(1ULL << id);
+    }
+    if (ovf->num == 0) {
+      ctx->arx_ovf_pending &= ~(1ULL << id);
+    }
+  }
+
+  return total;
+}
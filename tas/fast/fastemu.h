@@ -39,11 +39,14 @@ void fast_kernel_packet(struct dataplane_context *ctx,
 void fast_appctx_poll_pf(struct dataplane_context *ctx, uint32_t id);
 int fast_appctx_poll_fetch(struct dataplane_context *ctx, uint32_t id,
     void **pqe);
+/* returns 0 if nbh was used, 1 if not, and -1 if the entry could not be
+ * forwarded to the flow owner yet and has to be retried */
 int fast_appctx_poll_bump(struct dataplane_context *ctx, void *pqe,
     struct network_buf_handle *nbh, uint32_t ts);
 
 int fast_appctx_poll(struct dataplane_context *ctx, uint32_t id,
     struct network_buf_handle *nbh, uint32_t ts);
+uint64_t fast_appctx_doorbells(struct dataplane_context *ctx);
 int fast_actx_rxq_alloc(struct dataplane_context *ctx,
     struct flextcp_pl_appctx *actx, struct flextcp_pl_arx **arx);
 int fast_actx_rxq_probe(struct dataplane_context *ctx, uint32_t id);
@@ -60,16 +63,24 @@ int fast_flows_qman_fwd(struct dataplane_context *ctx,
 int fast_flows_packet(struct dataplane_context *ctx,
     struct network_buf_handle *nbh, void *fs, struct tcp_opts *opts,
     uint32_t ts);
+int fast_flows_packet_run(struct dataplane_context *ctx,
+    struct network_buf_handle **nbhs, void *fs, struct tcp_opts *tos,
+    uint16_t num, uint32_t ts);
+void fast_flows_packet_gro(struct dataplane_context *ctx,
+    struct network_buf_handle **nbhs, void **fss, struct tcp_opts *tos,
+    uint16_t *runs, uint16_t n);
 void fast_flows_packet_fss(struct dataplane_context *ctx,
     struct network_buf_handle **nbhs, void **fss, uint16_t n);
 void fast_flows_packet_parse(struct dataplane_context *ctx,
     struct network_buf_handle **nbhs, void **fss, struct tcp_opts *tos,
-    uint16_t n);
+    uint8_t *drop, uint16_t n);
 void fast_flows_packet_pfbufs(struct dataplane_context *ctx,
     void **fss, uint16_t n);
 void fast_flows_kernelxsums(struct network_buf_handle *nbh,
     struct pkt_tcp *p);
 
+int fast_flows_delayed_ack(struct dataplane_context *ctx, uint32_t flow_id,
+    struct network_buf_handle *nbh, uint32_t ts);
 int fast_flows_bump(struct dataplane_context *ctx, uint32_t flow_id,
     uint16_t bump_seq, uint32_t rx_tail, uint32_t tx_head, uint8_t flags,
     struct network_buf_handle *nbh, uint32_t ts);
@@ -78,18 +89,43 @@ void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id);
 /*****************************************************************************/
 /* Helpers */
 
+/**
+ * Move packets from the send buffer starting at `off` to the end of the
+ * software transmit queue, dropping those that do not fit, and empty the send
+ * buffer.
+ */
+static inline void tx_spill(struct dataplane_context *ctx, uint16_t off)
+{
+  uint32_t n, i, tail;
+
+  n = MIN(ctx->tx_num - off, (uint32_t) ctx->txq_mask + 1 - ctx->txq_num);
+  tail = ctx->txq_head + ctx->txq_num;
+  for (i = 0; i < n; i++) {
+    ctx->txq_handles[(tail + i) & ctx->txq_mask] = ctx->tx_handles[off + i];
+  }
+  ctx->txq_num += n;
+
+  if (off + n < ctx->tx_num) {
+    ctx->tx_drops += ctx->tx_num - off - n;
+    network_free_pkts(ctx->tx_num - off - n, ctx->tx_handles + off + n);
+  }
+  ctx->tx_num = 0;
+}
+
 static inline void tx_send(struct dataplane_context *ctx,
-    struct network_buf_handle *nbh, uint16_t off, uint16_t len)
+    struct network_buf_handle *nbh, uint16_t off, uint16_t len, uint8_t port)
 {
-  uint32_t i = ctx->tx_num;
+  uint32_t i;
 
-  if (i >= TXBUF_SIZE) {
-    fprintf(stderr, "tx_send: transmit buffer full, unexpected\n");
-    abort();
+  /* send buffer full, queue its contents behind what is already waiting */
+  if (ctx->tx_num >= TXBUF_SIZE) {
+    tx_spill(ctx, 0);
   }
+  i = ctx->tx_num;
 
   network_buf_setoff(nbh, off);
   network_buf_setlen(nbh, len);
+  network_buf_setport(nbh, port);
   ctx->tx_handles[i] = nbh;
   ctx->tx_num = i + 1;
 }
@@ -101,6 +137,97 @@ static inline uint16_t tx_xsum_enable(struct network_buf_handle *nbh,
       ip_s, ip_d, IP_PROTO_TCP, l3_paylen);
 }
 
+static inline uint16_t tx_tso_enable(struct network_buf_handle *nbh,
+    struct ip_hdr *iph, uint8_t l4l, uint16_t mss, beui32_t ip_s,
+    beui32_t ip_d)
+{
+  return network_buf_tcptso(nbh, sizeof(struct eth_hdr), sizeof(*iph), l4l,
+      mss, ip_s, ip_d, IP_PROTO_TCP);
+}
+
+static inline int ack_timer_add(struct dataplane_context *ctx,
+    uint32_t flow_id, uint32_t ts)
+{
+  uint16_t i;
+
+  if (ctx->acktimer_num >= ACKTIMER_SIZE) {
+    return -1;
+  }
+
+  i = (ctx->acktimer_head + ctx->acktimer_num) & (ACKTIMER_SIZE - 1);
+  ctx->acktimers[i].flow_id = flow_id;
+  ctx->acktimers[i].ts = ts;
+  ctx->acktimer_num++;
+  return 0;
+}
+
+/**
+ * Returns the core that currently owns the flow group of this flow, i.e. the
+ * only core allowed to touch the flow state. When the flow group has been
+ * steered to another core, ownership is handed over lazily by the previous
+ * owner the next time it sees an event for the group.
+ */
+static inline uint16_t flow_owner(struct dataplane_context *ctx,
+    struct flextcp_pl_flowst *fs)
+{
+  uint16_t fg = fs->flow_group;
+  uint16_t owner = fp_state->flow_group_owner[fg];
+  uint16_t steer;
+
+  if (owner == ctx->id &&
+      (steer = fp_state->flow_group_steering[fg]) != owner)
+  {
+    /* make flow state updates visible before handing over */
+    MEM_BARRIER();
+    fp_state->flow_group_owner[fg] = steer;
+    owner = steer;
+  }
+  return owner;
+}
+
+/**
+ * Hand an event for a flow over to the core owning it.
+ *
+ * @param ctx   Context of this core
+ * @param core  Owner core to forward to
+ * @param msg   Pointer or flow id tagged with a #flow_fwd_type
+ *
+ * @return 0 on success, -1 if the forwarding ring is full.
+ */
+static inline int flow_fwd(struct dataplane_context *ctx, uint16_t core,
+    uintptr_t msg)
+{
+  if (rte_ring_sp_enqueue(ctxs[core]->flow_fwd_rings[ctx->id],
+        (void *) msg) != 0)
+  {
+    return -1;
+  }
+
+#ifdef DATAPLANE_STATS
+  __sync_fetch_and_add(&ctx->stat_fwd_out, 1);
+#endif
+  notify_fastpath_core(core);
+  return 0;
+}
+
+/** Queue an event for retrying later, doubling the list when it is full. */
+static inline void fwd_retry_add(struct fwd_retry *r, void *ent)
+{
+  void **ents;
+  uint32_t len;
+
+  if (r->num == r->len) {
+    len = (r->len == 0 ? FWD_RETRY_SIZE : 2 * r->len);
+    if ((ents = rte_realloc(r->ents, len * sizeof(*ents), 0)) == NULL) {
+      fprintf(stderr, "fwd_retry_add: growing retry list failed\n");
+      abort();
+    }
+    r->ents = ents;
+    r->len = len;
+  }
+  r->ents[r->num++] = ent;
+}
+
 static inline void arx_cache_add(struct dataplane_context *ctx, uint16_t ctx_id,
     uint64_t opaque, uint32_t rx_bump, uint32_t rx_pos, uint32_t tx_bump,
     uint16_t type_flags)
@@ -62,12 +62,17 @@ extern volatile unsigned fp_scale_to;
 #define QMAN_SET_AVAIL    (1 << 3)
 #define QMAN_ADD_AVAIL    (1 << 4)
 
+/** Queue manager classes: one per application, plus the latency class that
+ * is served with strict priority */
+#define QMAN_CLASS_PRIO FLEXNIC_PL_APPST_NUM
+#define QMAN_CLASSES (FLEXNIC_PL_APPST_NUM + 1)
+
 int qman_thread_init(struct dataplane_context *ctx);
 uint32_t qman_timestamp(uint64_t tsc);
 int qman_poll(struct qman_thread *t, unsigned num, unsigned *q_ids,
     uint16_t *q_bytes);
-int qman_set(struct qman_thread *t, uint32_t id, uint32_t rate, uint32_t avail,
-    uint16_t max_chunk, uint8_t flags);
+int qman_set(struct qman_thread *t, uint32_t id, uint8_t cls, uint32_t rate,
+    uint32_t avail, uint16_t max_chunk, uint8_t flags);
 uint32_t qman_next_ts(struct qman_thread *t, uint32_t cur_ts);
 
 void *util_create_shmsiszed(const char *name, size_t size, void *addr);
@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include <rte_config.h>
 #include <rte_memcpy.h>
@@ -36,18 +37,40 @@
 #include <rte_ip.h>
 #include <rte_version.h>
 #include <rte_spinlock.h>
+#include <rte_gso.h>
+#include <rte_memory.h>
+#include <rte_dev.h>
 
 #include <utils.h>
 #include <utils_rng.h>
 #include <tas_memif.h>
 #include "internal.h"
 
-#define PERTHREAD_MBUFS 2048
 #define MBUF_SIZE (BUFFER_SIZE + sizeof(struct rte_mbuf) + RTE_PKTMBUF_HEADROOM)
-#define RX_DESCRIPTORS 256
-#define TX_DESCRIPTORS 128
-
-uint8_t net_port_id = 0;
+/** Header space reserved in TSO segments */
+#define TSO_HDRS_MAX 128
+/** Max number of packets produced by software segmentation */
+#define GSO_SEGS_MAX 64
+/** Page size of the shared memory region with huge pages enabled */
+#define SHM_HUGE_PGSIZE (2 * 1024 * 1024)
+/** Receive offloads needed to skip checksum verification in software */
+#define RX_XSUM_OFFLOADS (DEV_RX_OFFLOAD_IPV4_CKSUM | DEV_RX_OFFLOAD_TCP_CKSUM)
+
+struct network_gso {
+  struct rte_gso_ctx ctx;
+  uint16_t num;
+  uint16_t head;
+  /** port the pending segments go out on */
+  uint8_t port;
+  struct rte_mbuf *segs[GSO_SEGS_MAX];
+};
+
+uint8_t net_ports = 0;
+uint16_t net_port_ids[CONFIG_PORTS_MAX];
+uint16_t net_tso_max = 0;
+uint8_t net_tso_sw = 0;
+uint8_t net_tx_zerocopy = 0;
+struct rte_mempool *net_shared_pool = NULL;
 static struct rte_eth_conf port_conf = {
     .rxmode = {
       .mq_mode = ETH_MQ_RX_RSS,
@@ -73,25 +96,30 @@ static struct rte_eth_conf port_conf = {
 static unsigned num_threads;
 static struct network_rx_thread **net_threads;
 
+/** Capabilities common to all ports, used to configure them identically */
 static struct rte_eth_dev_info eth_devinfo;
-#if RTE_VER_YEAR < 19
-  struct ether_addr eth_addr;
-#else
-  struct rte_ether_addr eth_addr;
-#endif
+static struct rte_device *eth_devices[CONFIG_PORTS_MAX];
+struct eth_addr eth_addrs[CONFIG_PORTS_MAX];
 
 uint16_t rss_reta_size;
 static struct rte_eth_rss_reta_entry64 *rss_reta = NULL;
 static uint16_t *rss_core_buckets = NULL;
 
-static struct rte_mempool *mempool_alloc(void);
+static struct rte_mempool *mempool_alloc(const char *prefix, unsigned n);
+static int devinfo_merge(struct rte_eth_dev_info *di);
+static int tso_setup(void);
+static struct network_gso *gso_alloc(struct rte_mempool *pool);
+static int zerocopy_setup(void);
+static struct rte_mbuf_ext_shared_info *zerocopy_shinfo_alloc(void);
 static int reta_setup(void);
+static int reta_update(void);
 static int reta_mlx5_resize(void);
 static rte_spinlock_t initlock = RTE_SPINLOCK_INITIALIZER;
 
 int network_init(unsigned n_threads)
 {
-  uint8_t count;
+  struct rte_eth_dev_info di;
+  uint8_t count, i;
   int ret;
   uint16_t p;
 
@@ -103,27 +131,39 @@ int network_init(unsigned n_threads)
     goto error_exit;
   }
 
-  /* make sure there is only one port */
+  /* one port per configured IP address */
 #if RTE_VER_YEAR < 18
   count = rte_eth_dev_count();
 #else
   count = rte_eth_dev_count_avail();
 #endif
-  if (count == 0) {
-    fprintf(stderr, "No ethernet devices\n");
-    goto error_exit;
-  } else if (count > 1) {
-    fprintf(stderr, "Multiple ethernet devices\n");
+  if (count < config.ip_num) {
+    fprintf(stderr, "Not enough ethernet devices for %u IP addresses "
+        "(found %u)\n", config.ip_num, count);
     goto error_exit;
+  } else if (count > config.ip_num) {
+    fprintf(stderr, "Warning: only using the first %u of %u ethernet "
+        "devices\n", config.ip_num, count);
   }
 
   RTE_ETH_FOREACH_DEV(p) {
-    net_port_id = p;
+    if (net_ports == config.ip_num) {
+      break;
+    }
+    net_port_ids[net_ports++] = p;
   }
 
-  /* get mac address and device info */
-  rte_eth_macaddr_get(net_port_id, &eth_addr);
-  rte_eth_dev_info_get(net_port_id, &eth_devinfo);
+  /* get mac addresses and device info */
+  for (i = 0; i < net_ports; i++) {
+    rte_eth_macaddr_get(net_port_ids[i], (void *) &eth_addrs[i]);
+    rte_eth_dev_info_get(net_port_ids[i], &di);
+    eth_devices[i] = di.device;
+    if (i == 0) {
+      eth_devinfo = di;
+    } else if (devinfo_merge(&di) != 0) {
+      goto error_exit;
+    }
+  }
 
   if (eth_devinfo.max_rx_queues < n_threads ||
       eth_devinfo.max_tx_queues < n_threads)
@@ -149,15 +189,46 @@ int network_init(unsigned n_threads)
     port_conf.txmode.offloads =
       DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM;
 
+  /* let the NIC verify receive checksums, otherwise they are checked in
+   * software */
+  if ((eth_devinfo.rx_offload_capa & RX_XSUM_OFFLOADS) == RX_XSUM_OFFLOADS) {
+    port_conf.rxmode.offloads |= RX_XSUM_OFFLOADS;
+  } else {
+    fprintf(stderr, "Warning: NIC does not support receive checksum "
+        "offload, verifying checksums in software.\n");
+  }
+
+  /* enable tcp segmentation offload if requested */
+  if (config.fp_tso_max > 0 && tso_setup() != 0) {
+    goto error_exit;
+  }
+
+  /* register shared memory for zero-copy transmit if requested */
+  if (config.fp_tx_zerocopy && zerocopy_setup() != 0) {
+    goto error_exit;
+  }
+
+  /* overflow pool for cores that ran out of buffers in their own */
+  if (config.fp_mbufs_shared > 0 &&
+      (net_shared_pool = mempool_alloc("mbuf_pool_shared",
+          config.fp_mbufs_shared)) == NULL)
+  {
+    fprintf(stderr, "network_init: allocating shared mempool failed\n");
+    goto error_exit;
+  }
+
   /* disable rx interrupts if requested */
   if (!config.fp_interrupts)
     port_conf.intr_conf.rxq = 0;
 
-  /* initialize port */
-  ret = rte_eth_dev_configure(net_port_id, n_threads, n_threads, &port_conf);
-  if (ret < 0) {
-    fprintf(stderr, "rte_eth_dev_configure failed\n");
-    goto error_exit;
+  /* initialize ports */
+  for (i = 0; i < net_ports; i++) {
+    ret = rte_eth_dev_configure(net_port_ids[i], n_threads, n_threads,
+        &port_conf);
+    if (ret < 0) {
+      fprintf(stderr, "rte_eth_dev_configure failed (port %u)\n", i);
+      goto error_exit;
+    }
   }
 
 
@@ -173,13 +244,10 @@ int network_init(unsigned n_threads)
 #endif
   eth_devinfo.default_rxconf.offloads = 0;
 
-  /* enable per-queue checksum offload if requested */
-  eth_devinfo.default_txconf.offloads = 0;
-  if (config.fp_xsumoffload)
-    eth_devinfo.default_txconf.offloads =
-      DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM;
+  /* enable per-queue checksum and segmentation offloads if requested */
+  eth_devinfo.default_txconf.offloads = port_conf.txmode.offloads;
 
-  memcpy(&tas_info->mac_address, &eth_addr, 6);
+  memcpy(&tas_info->mac_address, &eth_addrs[0], 6);
 
   return 0;
 
@@ -190,21 +258,38 @@ error_exit:
 
 void network_cleanup(void)
 {
-  rte_eth_dev_stop(net_port_id);
+  uint8_t i;
+
+  for (i = 0; i < net_ports; i++) {
+    rte_eth_dev_stop(net_port_ids[i]);
+  }
+#if RTE_VERSION >= RTE_VERSION_NUM(19, 5, 0, 0)
+  if (net_tx_zerocopy) {
+    for (i = 0; i < net_ports; i++) {
+      rte_dev_dma_unmap(eth_devices[i], tas_shm, (uintptr_t) tas_shm,
+          config.shm_len);
+    }
+    rte_extmem_unregister(tas_shm, config.shm_len);
+  }
+#endif
   rte_free(net_threads);
 }
 
 void network_dump_stats(void)
 {
   struct rte_eth_stats stats;
-  if (rte_eth_stats_get(0, &stats) == 0) {
-    fprintf(stderr, "network stats: ipackets=%"PRIu64" opackets=%"PRIu64
-        " ibytes=%"PRIu64" obytes=%"PRIu64" imissed=%"PRIu64" ierrors=%"PRIu64
-        " oerrors=%"PRIu64" rx_nombuf=%"PRIu64"\n", stats.ipackets,
-        stats.opackets, stats.ibytes, stats.obytes, stats.imissed,
-        stats.ierrors, stats.oerrors, stats.rx_nombuf);
-  } else {
-    fprintf(stderr, "failed to get stats\n");
+  uint8_t i;
+
+  for (i = 0; i < net_ports; i++) {
+    if (rte_eth_stats_get(net_port_ids[i], &stats) == 0) {
+      fprintf(stderr, "network stats port %u: ipackets=%"PRIu64" opackets=%"
+          PRIu64" ibytes=%"PRIu64" obytes=%"PRIu64" imissed=%"PRIu64
+          " ierrors=%"PRIu64" oerrors=%"PRIu64" rx_nombuf=%"PRIu64"\n", i,
+          stats.ipackets, stats.opackets, stats.ibytes, stats.obytes,
+          stats.imissed, stats.ierrors, stats.oerrors, stats.rx_nombuf);
+    } else {
+      fprintf(stderr, "failed to get stats (port %u)\n", i);
+    }
   }
 }
 
@@ -215,58 +300,75 @@ int network_thread_init(struct dataplane_context *ctx)
   static volatile uint32_t start_done = 0;
 
   struct network_thread *t = &ctx->net;
+  uint8_t i;
   int ret;
 
   /* allocate mempool */
-  if ((t->pool = mempool_alloc()) == NULL) {
+  if ((t->pool = mempool_alloc("mbuf_pool", config.fp_mbufs)) == NULL) {
     goto error_mpool;
   }
 
-  /* initialize tx queue */
+  /* allocate software segmentation state */
+  if (net_tso_sw && (t->gso = gso_alloc(t->pool)) == NULL) {
+    goto error_gso;
+  }
+
+  /* allocate shared info for external buffers attached by this thread */
+  if (net_tx_zerocopy && (t->zc_shinfo = zerocopy_shinfo_alloc()) == NULL) {
+    goto error_gso;
+  }
+
+  /* initialize tx queue on every port */
   t->queue_id = ctx->id;
-  rte_spinlock_lock(&initlock);
-  ret = rte_eth_tx_queue_setup(net_port_id, t->queue_id, TX_DESCRIPTORS,
-          rte_socket_id(), &eth_devinfo.default_txconf);
-  rte_spinlock_unlock(&initlock);
-  if (ret != 0) {
-    fprintf(stderr, "network_thread_init: rte_eth_tx_queue_setup failed\n");
-    goto error_tx_queue;
+  t->rx_port = 0;
+  for (i = 0; i < net_ports; i++) {
+    rte_spinlock_lock(&initlock);
+    ret = rte_eth_tx_queue_setup(net_port_ids[i], t->queue_id, config.fp_tx_descs,
+            rte_socket_id(), &eth_devinfo.default_txconf);
+    rte_spinlock_unlock(&initlock);
+    if (ret != 0) {
+      fprintf(stderr, "network_thread_init: rte_eth_tx_queue_setup failed\n");
+      goto error_tx_queue;
+    }
   }
 
   /* barrier to make sure tx queues are initialized first */
   __sync_add_and_fetch(&tx_init_done, 1);
   while (tx_init_done < num_threads);
 
-  /* initialize rx queue */
-  t->queue_id = ctx->id;
-  rte_spinlock_lock(&initlock);
-  ret = rte_eth_rx_queue_setup(net_port_id, t->queue_id, RX_DESCRIPTORS,
-          rte_socket_id(), &eth_devinfo.default_rxconf, t->pool);
-  rte_spinlock_unlock(&initlock);
-  if (ret != 0) {
-    fprintf(stderr, "network_thread_init: rte_eth_rx_queue_setup failed\n");
-    goto error_rx_queue;
+  /* initialize rx queue on every port */
+  for (i = 0; i < net_ports; i++) {
+    rte_spinlock_lock(&initlock);
+    ret = rte_eth_rx_queue_setup(net_port_ids[i], t->queue_id, config.fp_rx_descs,
+            rte_socket_id(), &eth_devinfo.default_rxconf, t->pool);
+    rte_spinlock_unlock(&initlock);
+    if (ret != 0) {
+      fprintf(stderr, "network_thread_init: rte_eth_rx_queue_setup failed\n");
+      goto error_rx_queue;
+    }
   }
 
   /* barrier to make sure rx queues are initialized first */
   __sync_add_and_fetch(&rx_init_done, 1);
   while (rx_init_done < num_threads);
 
-  /* start device if this ìs core 0 */
+  /* start devices if this ìs core 0 */
   if (ctx->id == 0) {
-    if (rte_eth_dev_start(net_port_id) != 0) {
-      fprintf(stderr, "rte_eth_dev_start failed\n");
-      goto error_tx_queue;
-    }
-
-    /* enable vlan stripping if configured */
-    if (config.fp_vlan_strip) {
-      ret = rte_eth_dev_get_vlan_offload(net_port_id);
-      ret |= ETH_VLAN_STRIP_OFFLOAD;
-      if (rte_eth_dev_set_vlan_offload(net_port_id, ret)) {
-        fprintf(stderr, "network_thread_init: vlan off set failed\n");
+    for (i = 0; i < net_ports; i++) {
+      if (rte_eth_dev_start(net_port_ids[i]) != 0) {
+        fprintf(stderr, "rte_eth_dev_start failed (port %u)\n", i);
         goto error_tx_queue;
       }
+
+      /* enable vlan stripping if configured */
+      if (config.fp_vlan_strip) {
+        ret = rte_eth_dev_get_vlan_offload(net_port_ids[i]);
+        ret |= ETH_VLAN_STRIP_OFFLOAD;
+        if (rte_eth_dev_set_vlan_offload(net_port_ids[i], ret)) {
+          fprintf(stderr, "network_thread_init: vlan off set failed\n");
+          goto error_tx_queue;
+        }
+      }
     }
 
     /* setting up RETA failed */
@@ -282,10 +384,10 @@ int network_thread_init(struct dataplane_context *ctx)
   /* barrier wait for main thread to start the device */
   while (!start_done);
 
-  if (config.fp_interrupts) {
-    /* setup rx queue interrupt */
+  /* setup rx queue interrupts */
+  for (i = 0; config.fp_interrupts && i < net_ports; i++) {
     rte_spinlock_lock(&initlock);
-    ret = rte_eth_dev_rx_intr_ctl_q(net_port_id, t->queue_id,
+    ret = rte_eth_dev_rx_intr_ctl_q(net_port_ids[i], t->queue_id,
         RTE_EPOLL_PER_THREAD, RTE_INTR_EVENT_ADD, NULL);
     rte_spinlock_unlock(&initlock);
     if (ret != 0) {
@@ -302,6 +404,8 @@ error_int_queue:
 error_rx_queue:
   /* TODO: destroy tx queue */
 error_tx_queue:
+  /* TODO: free gso state */
+error_gso:
   /* TODO: free mempool */
 error_mpool:
   rte_free(t);
@@ -310,21 +414,262 @@ error_mpool:
 
 int network_rx_interrupt_ctl(struct network_thread *t, int turnon)
 {
-  if(turnon) {
-    return rte_eth_dev_rx_intr_enable(net_port_id, t->queue_id);
+  uint8_t i;
+  int ret = 0;
+
+  for (i = 0; i < net_ports && ret == 0; i++) {
+    if(turnon) {
+      ret = rte_eth_dev_rx_intr_enable(net_port_ids[i], t->queue_id);
+    } else {
+      ret = rte_eth_dev_rx_intr_disable(net_port_ids[i], t->queue_id);
+    }
+  }
+  return ret;
+}
+
+/* send out remaining segments of the last software segmented packet */
+static inline int gso_flush(struct network_thread *t)
+{
+  struct network_gso *g = t->gso;
+
+  if (g->head == g->num) {
+    return 0;
+  }
+
+  g->head += rte_eth_tx_burst(net_port_ids[g->port], t->queue_id,
+      g->segs + g->head, g->num - g->head);
+  return (g->head == g->num ? 0 : -1);
+}
+
+/* split up TSO segment into MSS sized packets */
+static void gso_segment(struct network_gso *g, struct rte_mbuf *mb)
+{
+  struct pkt_tcp *p;
+  struct rte_mbuf *seg;
+  int ret, i;
+
+  g->ctx.gso_size = mb->l2_len + mb->l3_len + mb->l4_len + mb->tso_segsz;
+  ret = rte_gso_segment(mb, &g->ctx, g->segs, GSO_SEGS_MAX);
+  if (ret <= 0) {
+    /* drop packet, tcp will retransmit */
+    fprintf(stderr, "gso_segment: rte_gso_segment failed (%d)\n", ret);
+    rte_pktmbuf_free(mb);
+    g->num = g->head = 0;
+    return;
+  }
+
+#if RTE_VERSION >= RTE_VERSION_NUM(20, 11, 0, 0)
+  /* since 20.11 the input packet is not released by rte_gso_segment */
+  if (ret > 1) {
+    rte_pktmbuf_free(mb);
+  }
+#endif
+
+  /* rte_gso does not update tcp checksums, switch packets over to regular
+   * checksum offload with the pseudo header checksum including the length */
+  for (i = 0; i < ret; i++) {
+    seg = g->segs[i];
+    p = rte_pktmbuf_mtod(seg, struct pkt_tcp *);
+
+    seg->ol_flags = PKT_TX_IPV4 | PKT_TX_IP_CKSUM | PKT_TX_TCP_CKSUM;
+    p->ip.chksum = 0;
+    p->tcp.chksum = network_ip_phdr_xsum(p->ip.src, p->ip.dest, IP_PROTO_TCP,
+        f_beui16(p->ip.len) - IPH_HL(&p->ip) * 4);
+  }
+
+  g->num = ret;
+  g->head = 0;
+}
+
+int network_send_gso(struct network_thread *t, uint8_t port, unsigned num,
+    struct network_buf_handle **bhs)
+{
+  struct rte_mbuf **mbs = (struct rte_mbuf **) bhs;
+  unsigned i = 0, j;
+
+  while (i < num && gso_flush(t) == 0) {
+    /* pass through batch of regular packets */
+    for (j = i; j < num && !(mbs[j]->ol_flags & PKT_TX_TCP_SEG); j++);
+    if (j > i) {
+      i += rte_eth_tx_burst(net_port_ids[port], t->queue_id, mbs + i, j - i);
+      if (i < j) {
+        break;
+      }
+      continue;
+    }
+
+    /* segments are sent out on the next iteration */
+    gso_segment(t->gso, mbs[i]);
+    t->gso->port = port;
+    i++;
+  }
+
+  gso_flush(t);
+  return i;
+}
+
+static int tso_setup(void)
+{
+  uint64_t capa = eth_devinfo.tx_offload_capa;
+  uint32_t max_segs;
+
+  if (!config.fp_xsumoffload) {
+    fprintf(stderr, "Warning: TSO requires checksum offload, disabling "
+        "TSO.\n");
+    return 0;
+  }
+
+  /* bound by ip packet length and number of buffers the NIC accepts */
+  max_segs = UINT16_MAX / BUFFER_SIZE + 1;
+  if (eth_devinfo.tx_desc_lim.nb_seg_max != 0 &&
+      eth_devinfo.tx_desc_lim.nb_seg_max < max_segs)
+  {
+    max_segs = eth_devinfo.tx_desc_lim.nb_seg_max;
+  }
+  net_tso_max = MIN(config.fp_tso_max, MIN(UINT16_MAX - TSO_HDRS_MAX,
+        max_segs * BUFFER_SIZE - TSO_HDRS_MAX));
+
+  if ((capa & DEV_TX_OFFLOAD_MULTI_SEGS) != 0) {
+    port_conf.txmode.offloads |= DEV_TX_OFFLOAD_MULTI_SEGS;
+  }
+
+  if ((capa & DEV_TX_OFFLOAD_TCP_TSO) != 0) {
+    port_conf.txmode.offloads |= DEV_TX_OFFLOAD_TCP_TSO;
+    net_tso_sw = 0;
   } else {
-    return rte_eth_dev_rx_intr_disable(net_port_id, t->queue_id);
+    fprintf(stderr, "Warning: NIC does not support TSO, falling back to "
+        "software segmentation.\n");
+    net_tso_sw = 1;
   }
+
+  return 0;
 }
 
-static struct rte_mempool *mempool_alloc(void)
+static struct network_gso *gso_alloc(struct rte_mempool *pool)
 {
   static unsigned pool_id = 0;
+  struct network_gso *g;
   unsigned n;
   char name[32];
+
+  if ((g = rte_zmalloc("net gso", sizeof(*g), 0)) == NULL) {
+    fprintf(stderr, "gso_alloc: rte_zmalloc failed\n");
+    return NULL;
+  }
+
+  /* indirect mbufs referencing payload in the original segment */
   n = __sync_fetch_and_add(&pool_id, 1);
-  snprintf(name, 32, "mbuf_pool_%u\n", n);
-  return rte_mempool_create(name, PERTHREAD_MBUFS, MBUF_SIZE, 32,
+  snprintf(name, 32, "gso_pool_%u", n);
+  g->ctx.indirect_pool = rte_pktmbuf_pool_create(name, config.fp_mbufs, 32, 0,
+      0, rte_socket_id());
+  if (g->ctx.indirect_pool == NULL) {
+    fprintf(stderr, "gso_alloc: rte_pktmbuf_pool_create failed\n");
+    rte_free(g);
+    return NULL;
+  }
+
+  g->ctx.direct_pool = pool;
+  g->ctx.gso_types = DEV_TX_OFFLOAD_TCP_TSO;
+  g->ctx.flag = 0;
+  return g;
+}
+
+#if RTE_VERSION >= RTE_VERSION_NUM(19, 5, 0, 0)
+static void zerocopy_free_cb(void *addr, void *opaque)
+{
+  /* never called, network threads hold on to a reference */
+}
+
+static int zerocopy_setup(void)
+{
+  size_t pgsz;
+  uint8_t i;
+
+  if (!config.fp_xsumoffload) {
+    fprintf(stderr, "Warning: zero-copy transmit requires checksum offload, "
+        "disabling it.\n");
+    return 0;
+  }
+
+  if ((eth_devinfo.tx_offload_capa & DEV_TX_OFFLOAD_MULTI_SEGS) == 0) {
+    fprintf(stderr, "Warning: NIC does not support multi-segment packets, "
+        "disabling zero-copy transmit.\n");
+    return 0;
+  }
+
+  /* external buffers are handed to the NIC with their virtual address */
+  if (rte_eal_iova_mode() != RTE_IOVA_VA) {
+    fprintf(stderr, "Warning: zero-copy transmit requires IOVA as VA mode, "
+        "disabling it.\n");
+    return 0;
+  }
+
+  pgsz = (config.fp_hugepages ? SHM_HUGE_PGSIZE : sysconf(_SC_PAGESIZE));
+  if (rte_extmem_register(tas_shm, config.shm_len, NULL, 0, pgsz) != 0) {
+    fprintf(stderr, "zerocopy_setup: rte_extmem_register failed (%d)\n",
+        rte_errno);
+    return -1;
+  }
+
+  for (i = 0; i < net_ports; i++) {
+    if (rte_dev_dma_map(eth_devices[i], tas_shm, (uintptr_t) tas_shm,
+          config.shm_len) != 0)
+    {
+      fprintf(stderr, "zerocopy_setup: rte_dev_dma_map failed (%d)\n",
+          rte_errno);
+      while (i-- > 0) {
+        rte_dev_dma_unmap(eth_devices[i], tas_shm, (uintptr_t) tas_shm,
+            config.shm_len);
+      }
+      rte_extmem_unregister(tas_shm, config.shm_len);
+      return -1;
+    }
+  }
+
+  port_conf.txmode.offloads |= DEV_TX_OFFLOAD_MULTI_SEGS;
+  net_tx_zerocopy = 1;
+  return 0;
+}
+
+static struct rte_mbuf_ext_shared_info *zerocopy_shinfo_alloc(void)
+{
+  struct rte_mbuf_ext_shared_info *shinfo;
+
+  if ((shinfo = rte_zmalloc("net zc shinfo", sizeof(*shinfo), 0)) == NULL) {
+    fprintf(stderr, "zerocopy_shinfo_alloc: rte_zmalloc failed\n");
+    return NULL;
+  }
+
+  /* the reference held here keeps the count from ever dropping to zero, as
+   * the memory belongs to the application buffers and is never freed. Mbufs
+   * attached to it go back to the pool once the NIC is done with them. */
+  shinfo->free_cb = zerocopy_free_cb;
+  shinfo->fcb_opaque = NULL;
+  rte_mbuf_ext_refcnt_set(shinfo, 1);
+  return shinfo;
+}
+#else
+static int zerocopy_setup(void)
+{
+  fprintf(stderr, "Warning: zero-copy transmit requires DPDK 19.05 or newer, "
+      "disabling it.\n");
+  return 0;
+}
+
+static struct rte_mbuf_ext_shared_info *zerocopy_shinfo_alloc(void)
+{
+  return NULL;
+}
+#endif
+
+static struct rte_mempool *mempool_alloc(const char *prefix, unsigned n)
+{
+  static unsigned pool_id = 0;
+  unsigned id;
+  char name[32];
+  id = __sync_fetch_and_add(&pool_id, 1);
+  snprintf(name, 32, "%s_%u", prefix, id);
+  return rte_mempool_create(name, n, MBUF_SIZE, 32,
           sizeof(struct rte_pktmbuf_pool_private), rte_pktmbuf_pool_init, NULL,
           rte_pktmbuf_init, NULL, rte_socket_id(), 0);
 
@@ -358,6 +703,22 @@ static inline uint16_t core_max(uint16_t num)
   return i_max;
 }
 
+/* all ports share the same redirection table, so flow groups map to the same
+ * core no matter which port a flow is on */
+static int reta_update(void)
+{
+  uint8_t i;
+
+  for (i = 0; i < net_ports; i++) {
+    if (rte_eth_dev_rss_reta_update(net_port_ids[i], rss_reta, rss_reta_size)
+        != 0)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
+
 int network_scale_up(uint16_t old, uint16_t new)
 {
   uint16_t i, j, k, c, share = rss_reta_size / new;
@@ -389,7 +750,7 @@ int network_scale_up(uint16_t old, uint16_t new)
     }
   }
 
-  if (rte_eth_dev_rss_reta_update(net_port_id, rss_reta, rss_reta_size) != 0) {
+  if (reta_update() != 0) {
     fprintf(stderr, "network_scale_up: rte_eth_dev_rss_reta_update failed\n");
     return -1;
   }
@@ -424,7 +785,7 @@ int network_scale_down(uint16_t old, uint16_t new)
     }
   }
 
-  if (rte_eth_dev_rss_reta_update(net_port_id, rss_reta, rss_reta_size) != 0) {
+  if (reta_update() != 0) {
     fprintf(stderr, "network_scale_down: rte_eth_dev_rss_reta_update failed\n");
     return -1;
   }
@@ -460,10 +821,11 @@ static int reta_setup()
     rss_reta[i / RTE_RETA_GROUP_SIZE].mask = -1ULL;
     rss_reta[i / RTE_RETA_GROUP_SIZE].reta[i % RTE_RETA_GROUP_SIZE] = c;
     fp_state->flow_group_steering[i] = c;
+    fp_state->flow_group_owner[i] = c;
     c = (c + 1) % fp_cores_cur;
   }
 
-  if (rte_eth_dev_rss_reta_update(net_port_id, rss_reta, rss_reta_size) != 0) {
+  if (reta_update() != 0) {
     fprintf(stderr, "reta_setup: rte_eth_dev_rss_reta_update failed\n");
     return -1;
   }
@@ -498,3 +860,28 @@ static int reta_mlx5_resize(void)
 
   return 0;
 }
+
+/* restrict capabilities in eth_devinfo to those also supported by `di` */
+static int devinfo_merge(struct rte_eth_dev_info *di)
+{
+  struct rte_eth_dev_info *m = &eth_devinfo;
+
+  if (di->reta_size != m->reta_size) {
+    fprintf(stderr, "devinfo_merge: ports have different RSS redirection "
+        "table sizes (%u and %u)\n", m->reta_size, di->reta_size);
+    return -1;
+  }
+
+  m->max_rx_queues = MIN(m->max_rx_queues, di->max_rx_queues);
+  m->max_tx_queues = MIN(m->max_tx_queues, di->max_tx_queues);
+  m->rx_offload_capa &= di->rx_offload_capa;
+  m->tx_offload_capa &= di->tx_offload_capa;
+  m->flow_type_rss_offloads &= di->flow_type_rss_offloads;
+  if (m->tx_desc_lim.nb_seg_max == 0 ||
+      (di->tx_desc_lim.nb_seg_max != 0 &&
+       di->tx_desc_lim.nb_seg_max < m->tx_desc_lim.nb_seg_max))
+  {
+    m->tx_desc_lim.nb_seg_max = di->tx_desc_lim.nb_seg_max;
+  }
+  return 0;
+}
@@ -31,16 +31,30 @@
 #include <rte_ethdev.h>
 #include <rte_mbuf.h>
 #include <rte_ip.h>
+#include <rte_version.h>
 
 #include <fastpath.h>
 
 struct network_buf_handle;
 
-extern uint8_t net_port_id;
+/** Number of network ports, one per configured IP address */
+extern uint8_t net_ports;
+/** DPDK port ids of the network ports */
+extern uint16_t net_port_ids[CONFIG_PORTS_MAX];
 extern uint16_t rss_reta_size;
+/** Max TCP payload bytes per TSO segment, 0 if TSO is disabled */
+extern uint16_t net_tso_max;
+/** TSO segments are split up in software before sending them out */
+extern uint8_t net_tso_sw;
+/** Payload is attached from the shared memory region instead of copied */
+extern uint8_t net_tx_zerocopy;
+/** Overflow mempool shared by all cores, NULL if disabled */
+extern struct rte_mempool *net_shared_pool;
 
 int network_thread_init(struct dataplane_context *ctx);
 int network_rx_interrupt_ctl(struct network_thread *t, int turnon);
+int network_send_gso(struct network_thread *t, uint8_t port, unsigned num,
+    struct network_buf_handle **bhs);
 
 int network_scale_up(uint16_t old, uint16_t new);
 int network_scale_down(uint16_t old, uint16_t new);
@@ -86,19 +100,83 @@ static inline void network_buf_setlen(struct network_buf_handle *bh,
   mb->pkt_len = mb->data_len = len;
 }
 
+/** network port (index into net_port_ids) the packet was received on */
+static inline uint8_t network_buf_port(struct network_buf_handle *bh)
+{
+  return ((struct rte_mbuf *) bh)->port;
+}
+
+/** set network port to send the packet out on */
+static inline void network_buf_setport(struct network_buf_handle *bh,
+    uint8_t port)
+{
+  ((struct rte_mbuf *) bh)->port = port;
+}
+
+/** append `num` buffers in `segs` to the packet in `bh` */
+static inline void network_buf_chain(struct network_buf_handle *bh,
+    unsigned num, struct network_buf_handle **segs)
+{
+  struct rte_mbuf *mb = (struct rte_mbuf *) bh;
+  struct rte_mbuf *last = mb;
+  unsigned i;
+
+  for (i = 0; i < num; i++) {
+    last->next = (struct rte_mbuf *) segs[i];
+    last = last->next;
+    mb->pkt_len += last->data_len;
+  }
+  mb->nb_segs = num + 1;
+}
+
+/** attach `len` bytes at `addr` in the shared memory region to `bh`, the
+ * memory must stay untouched until the NIC returns the buffer */
+static inline void network_buf_attach(struct network_thread *t,
+    struct network_buf_handle *bh, void *addr, uint16_t len)
+{
+#if RTE_VERSION >= RTE_VERSION_NUM(19, 5, 0, 0)
+  struct rte_mbuf *mb = (struct rte_mbuf *) bh;
+
+  rte_mbuf_ext_refcnt_update(t->zc_shinfo, 1);
+  rte_pktmbuf_attach_extbuf(mb, addr, (uintptr_t) addr, len, t->zc_shinfo);
+  mb->pkt_len = mb->data_len = len;
+#else
+  /* zero-copy transmit is never enabled with older DPDK versions */
+  abort();
+#endif
+}
+
 
 static inline int network_poll(struct network_thread *t, unsigned num,
     struct network_buf_handle **bhs)
 {
   struct rte_mbuf **mbs = (struct rte_mbuf **) bhs;
+  unsigned i, n, total = 0;
+  uint8_t j, port = t->rx_port;
+
+  /* start with the next port every time so none of them is starved */
+  t->rx_port = (port + 1 < net_ports ? port + 1 : 0);
+  for (j = 0; j < net_ports && total < num; j++) {
+    n = rte_eth_rx_burst(net_port_ids[port], t->queue_id, mbs + total,
+        num - total);
+
+    /* mbufs carry the DPDK port id, translate to our port index */
+    if (net_port_ids[port] != port) {
+      for (i = total; i < total + n; i++) {
+        mbs[i]->port = port;
+      }
+    }
+
+    total += n;
+    port = (port + 1 < net_ports ? port + 1 : 0);
+  }
 
-  num = rte_eth_rx_burst(net_port_id, t->queue_id, mbs, num);
+  num = total;
   if (num == 0) {
     return 0;
   }
 
 #ifdef FLEXNIC_TRACE_TX
-  unsigned i;
   for (i = 0; i < num; i++) {
     trace_event(FLEXNIC_TRACE_EV_RXPKT, network_buf_len(bhs[i]),
         network_buf_bufoff(bhs[i]));
@@ -112,45 +190,109 @@ static inline int network_send(struct network_thread *t, unsigned num,
     struct network_buf_handle **bhs)
 {
   struct rte_mbuf **mbs = (struct rte_mbuf **) bhs;
+  unsigned i, j, n;
+  uint8_t port;
 
 #ifdef FLEXNIC_TRACE_TX
-  unsigned i;
   for (i = 0; i < num; i++) {
     trace_event(FLEXNIC_TRACE_EV_TXPKT, network_buf_len(bhs[i]),
         network_buf_bufoff(bhs[i]));
   }
 #endif
 
-  return rte_eth_tx_burst(net_port_id, t->queue_id, mbs, num);
+  /* send out runs of packets for the same port */
+  for (i = 0; i < num; ) {
+    port = mbs[i]->port;
+    for (j = i + 1; j < num && mbs[j]->port == port; j++);
+
+    if (net_tso_sw) {
+      n = network_send_gso(t, port, j - i, bhs + i);
+    } else {
+      n = rte_eth_tx_burst(net_port_ids[port], t->queue_id, mbs + i, j - i);
+    }
+
+    i += n;
+    if (i < j) {
+      break;
+    }
+  }
+
+  return i;
 }
 
 
+/**
+ * Allocate up to `num` buffers. Prefers the core's own pool and falls back to
+ * the shared overflow pool, halving the request while neither can serve it
+ * in one bulk allocation.
+ *
+ * @return Number of buffers allocated.
+ */
 static inline int network_buf_alloc(struct network_thread *t, unsigned num,
     struct network_buf_handle **bhs)
 {
   struct rte_mbuf **mbs = (struct rte_mbuf **) bhs;
-  unsigned i;
 
-  /* try bulk alloc first. if it fails try individual mbufs */
-  if (rte_pktmbuf_alloc_bulk(t->pool, mbs, num) == 0) {
-    return num;
+  for (; num > 0; num /= 2) {
+    if (rte_pktmbuf_alloc_bulk(t->pool, mbs, num) == 0) {
+      return num;
+    }
+
+    if (net_shared_pool != NULL &&
+        rte_pktmbuf_alloc_bulk(net_shared_pool, mbs, num) == 0)
+    {
+      t->stat_shared_allocs += num;
+      return num;
+    }
   }
 
+  t->stat_alloc_fails++;
+  return 0;
+}
+
+/**
+ * Free buffers like rte_pktmbuf_free_seg(), chained segments are not followed
+ * (see network_free_pkts()). Runs of buffers from the same pool go back with
+ * one bulk put.
+ */
+static inline void network_free(unsigned num, struct network_buf_handle **bufs)
+{
+  struct rte_mbuf *m, *put[32];
+  struct rte_mempool *mp = NULL;
+  unsigned i, n = 0;
+
   for (i = 0; i < num; i++) {
-    if ((mbs[i] = rte_pktmbuf_alloc(t->pool)) == NULL) {
-      break;
+    /* detaches external and indirect buffers, NULL if still referenced */
+    m = rte_pktmbuf_prefree_seg((struct rte_mbuf *) bufs[i]);
+    if (m == NULL) {
+      continue;
     }
+
+    if (n == 32 || (n > 0 && m->pool != mp)) {
+      rte_mempool_put_bulk(mp, (void **) put, n);
+      n = 0;
+    }
+    mp = m->pool;
+    put[n++] = m;
   }
 
-  return i;
+  if (n > 0) {
+    rte_mempool_put_bulk(mp, (void **) put, n);
+  }
 }
 
-static inline void network_free(unsigned num, struct network_buf_handle **bufs)
+/** Free packets including any further segments chained to them */
+static inline void network_free_pkts(unsigned num,
+    struct network_buf_handle **bufs)
 {
+#if RTE_VERSION >= RTE_VERSION_NUM(19, 11, 0, 0)
+  rte_pktmbuf_free_bulk((struct rte_mbuf **) bufs, num);
+#else
   unsigned i;
   for (i = 0; i < num; i++) {
-    rte_pktmbuf_free_seg((struct rte_mbuf *) bufs[i]);
+    rte_pktmbuf_free((struct rte_mbuf *) bufs[i]);
   }
+#endif
 }
 
 /** calculate ip pseudo header xsum */
@@ -172,9 +314,9 @@ static inline uint16_t network_ip_phdr_xsum(beui32_t ip_src, beui32_t ip_dst,
   return (uint16_t) sum;
 }
 
-static inline uint16_t network_buf_tcpxsums(struct network_buf_handle *bh, uint8_t l2l,
-    uint8_t l3l, void *ip_hdr, beui32_t ip_s, beui32_t ip_d, uint8_t ip_proto,
-    uint16_t l3_paylen)
+/** Request checksum offload, the caller fills in the pseudo header sum */
+static inline void network_buf_xsumoffload(struct network_buf_handle *bh,
+    uint8_t l2l, uint8_t l3l)
 {
   struct rte_mbuf * restrict mb = (struct rte_mbuf *) bh;
   mb->tx_offload = l2l | ((uint32_t) l3l << 7);
@@ -182,10 +324,47 @@ static inline uint16_t network_buf_tcpxsums(struct network_buf_handle *bh, uint8
   mb->l3_len = l3l;
   mb->l4_len = 0;*/
   mb->ol_flags = PKT_TX_IPV4 | PKT_TX_IP_CKSUM | PKT_TX_TCP_CKSUM;
+}
 
+static inline uint16_t network_buf_tcpxsums(struct network_buf_handle *bh, uint8_t l2l,
+    uint8_t l3l, void *ip_hdr, beui32_t ip_s, beui32_t ip_d, uint8_t ip_proto,
+    uint16_t l3_paylen)
+{
+  network_buf_xsumoffload(bh, l2l, l3l);
   return network_ip_phdr_xsum(ip_s, ip_d, ip_proto, l3_paylen);
 }
 
+/**
+ * Receive checksum status reported by the NIC.
+ *
+ * @return 1 if IP and TCP checksums were verified, -1 if either is bad, 0 if
+ *   the NIC did not check them.
+ */
+static inline int network_buf_rxxsums(struct network_buf_handle *bh)
+{
+  struct rte_mbuf *mb = (struct rte_mbuf *) bh;
+  uint64_t ip = mb->ol_flags & PKT_RX_IP_CKSUM_MASK;
+  uint64_t l4 = mb->ol_flags & PKT_RX_L4_CKSUM_MASK;
+
+  if (ip == PKT_RX_IP_CKSUM_BAD || l4 == PKT_RX_L4_CKSUM_BAD) {
+    return -1;
+  }
+  return (ip == PKT_RX_IP_CKSUM_GOOD && l4 == PKT_RX_L4_CKSUM_GOOD);
+}
+
+static inline uint16_t network_buf_tcptso(struct network_buf_handle *bh,
+    uint8_t l2l, uint8_t l3l, uint8_t l4l, uint16_t mss, beui32_t ip_s,
+    beui32_t ip_d, uint8_t ip_proto)
+{
+  struct rte_mbuf * restrict mb = (struct rte_mbuf *) bh;
+  mb->tx_offload = l2l | ((uint32_t) l3l << 7) | ((uint32_t) l4l << 16) |
+    ((uint64_t) mss << 24);
+  mb->ol_flags = PKT_TX_IPV4 | PKT_TX_IP_CKSUM | PKT_TX_TCP_SEG;
+
+  /* for TSO the pseudo header checksum does not include the length */
+  return network_ip_phdr_xsum(ip_s, ip_d, ip_proto, 0);
+}
+
 static inline int network_buf_flowgroup(struct network_buf_handle *bh,
     uint16_t *fg)
 {
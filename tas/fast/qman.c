@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <rte_config.h>
@@ -42,16 +43,41 @@
 #define dprintf(...) do { } while (0)
 
 #define FLAG_INSKIPLIST 1
-#define FLAG_INNOLIMITL 2
+#define FLAG_INREADY 2
+#define FLAG_INWHEEL 4
+#define FLAG_ACTIVE (FLAG_INSKIPLIST | FLAG_INREADY | FLAG_INWHEEL)
 
 /** Skiplist: bits per level */
 #define SKIPLIST_BITS 3
+/** Queue states are allocated in chunks of 2^QUEUE_CHUNK_BITS */
+#define QUEUE_CHUNK_BITS 10
+#define QUEUE_CHUNK_SIZE (1 << QUEUE_CHUNK_BITS)
 /** Index list: invalid index */
 #define IDXLIST_INVAL (-1U)
 
+/** Timing wheel: level 0 slot granularity (1024ns) */
+#define WHEEL_GRAN_BITS 10
+/** Timing wheel: slots per level */
+#define WHEEL_SLOT_BITS 10
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_WORDS (WHEEL_SLOTS / 64)
+/** Timing wheel: ticks (level 0 slots) covered by 32-bit timestamps */
+#define WHEEL_TICK_MASK ((1U << (32 - WHEEL_GRAN_BITS)) - 1)
+#define WHEEL_PERIOD_MASK (WHEEL_TICK_MASK >> WHEEL_SLOT_BITS)
+
+/** Max interval between transmissions of a queue (ns), keeps timestamps
+ * comparable across the 32-bit wrap-around */
+#define MAX_TX_INTERVAL (1U << 30)
+
+/** Bytes a class may send per round and unit of weight */
+#define CLASS_QUANTUM (16 * 1024)
+/** Max time a rate capped class can lag behind its cap and catch up (ns) */
+#define CLASS_CAP_SLACK 10000
+/** Max queues served from the priority class in a row while other classes
+ * are waiting */
+#define PRIO_MAX_BURST 16
+
 #define RNG_SEED 0x12345678
-#define TIMESTAMP_BITS 32
-#define TIMESTAMP_MASK 0xFFFFFFFF
 
 /** Queue state */
 struct queue {
@@ -59,43 +85,118 @@ struct queue {
   uint32_t next_idxs[QMAN_SKIPLIST_LEVELS];
   /** Time stamp */
   uint32_t next_ts;
-  /** Assigned Rate */
-  uint32_t rate;
+  /** Assigned rate as ns per byte: (bytes * tx_mult) >> tx_shift, 0 for
+   * queues without rate limit */
+  uint32_t tx_mult;
   /** Number of entries in queue */
   uint32_t avail;
   /** Maximum chunk size when de-queueing */
   uint16_t max_chunk;
-  /** Flags: FLAG_INSKIPLIST, FLAG_INNOLIMITL */
-  uint16_t flags;
+  /** Flags: FLAG_INSKIPLIST, FLAG_INREADY, FLAG_INWHEEL */
+  uint8_t flags;
+  uint8_t tx_shift;
 } __attribute__((packed));
 STATIC_ASSERT((sizeof(struct queue) == 32), queue_size);
 
+/** Chunk of queue states, with the class and rate of each queue kept
+ * separately to keep struct queue at 32 bytes */
+struct queue_chunk {
+  struct queue queues[QUEUE_CHUNK_SIZE];
+  uint8_t classes[QUEUE_CHUNK_SIZE];
+  /** Rate [Kbps] tx_mult and tx_shift were computed for */
+  uint32_t rates[QUEUE_CHUNK_SIZE];
+};
+
+/**
+ * Scheduling class: queues of one application that are ready to send, served
+ * by deficit round robin across classes. Rate-limited queues only get here
+ * once due according to their own rate. A class can additionally be capped to
+ * an aggregate rate. The priority class (QMAN_CLASS_PRIO) is served ahead of
+ * all others and does not use deficit or rate cap.
+ */
+struct qman_class {
+  /** FIFO of ready queues, linked through next_idxs[0] */
+  uint32_t head_idx;
+  uint32_t tail_idx;
+  /** Bytes left to send in the current round, negative if overdrawn */
+  int32_t deficit;
+  /** Time stamp from which the class may send again if rate capped */
+  uint32_t cap_ts;
+  /** Rate cap [Kbps] the multiplier was computed for, 0 if not capped */
+  uint32_t cap_rate;
+  uint32_t cap_mult;
+  uint8_t cap_shift;
+};
+STATIC_ASSERT(QMAN_CLASSES <= 32, qman_classes);
 
+/**
+ * Timing wheel for rate-limited queues (alternative to the skip list).
+ * Level 0 has one slot per tick (2^WHEEL_GRAN_BITS ns), level 1 one slot per
+ * WHEEL_SLOTS ticks (period). Queues due further out than level 1 covers are
+ * kept in its last slot and re-inserted when that slot is cascaded. Slots are
+ * FIFO lists linked through next_idxs[0], bitmaps track non-empty slots.
+ */
+struct qman_wheel {
+  /** Current tick, everything in earlier slots has been processed */
+  uint32_t cur;
+  /** Number of queues in wheel */
+  uint32_t num;
+  uint32_t head[2][WHEEL_SLOTS];
+  uint32_t tail[2][WHEEL_SLOTS];
+  uint64_t nonempty[2][WHEEL_WORDS];
+};
+
+
+/** Queue state for index, chunk must be allocated */
+static inline struct queue *queue_get(struct qman_thread *t, uint32_t idx);
+/** Class of queue for index, chunk must be allocated */
+static inline uint8_t queue_class(struct qman_thread *t, uint32_t idx);
 /** Actually update queue state: must run on queue's home core */
-static inline void set_impl(struct qman_thread *t, uint32_t id, uint32_t rate,
-    uint32_t avail, uint16_t max_chunk, uint8_t flags);
+static inline void set_impl(struct qman_thread *t, uint32_t id, uint8_t cls,
+    uint32_t rate, uint32_t avail, uint16_t max_chunk, uint8_t flags);
 
-/** Add queue to the no limit list */
-static inline void queue_activate_nolimit(struct qman_thread *t,
+/** Add queue to the ready FIFO of its class */
+static inline void queue_activate_ready(struct qman_thread *t,
     struct queue *q, uint32_t idx);
-static inline unsigned poll_nolimit(struct qman_thread *t, uint32_t cur_ts,
+static inline unsigned poll_classes(struct qman_thread *t, uint32_t cur_ts,
     unsigned num, unsigned *q_ids, uint16_t *q_bytes);
+static inline unsigned class_drr(struct qman_thread *t, uint32_t cur_ts,
+    uint32_t *eligible, unsigned *q_id, uint16_t *q_bytes);
+static inline unsigned class_prio(struct qman_thread *t, unsigned *q_id,
+    uint16_t *q_bytes);
+static inline void class_update(struct qman_thread *t, uint8_t c);
+static inline int class_throttled(struct qman_class *cls, uint32_t cur_ts);
 
 /** Add queue to the skip list list */
 static inline void queue_activate_skiplist(struct qman_thread *t,
     struct queue *q, uint32_t idx);
 static inline unsigned poll_skiplist(struct qman_thread *t, uint32_t cur_ts,
-    unsigned num, unsigned *q_ids, uint16_t *q_bytes);
+    unsigned num);
 static inline uint8_t queue_level(struct qman_thread *t);
 
+/** Add queue to the timing wheel */
+static inline void queue_activate_wheel(struct qman_thread *t,
+    struct queue *q, uint32_t idx);
+static inline unsigned poll_wheel(struct qman_thread *t, uint32_t cur_ts,
+    unsigned num);
+static inline int wheel_next_ts(struct qman_thread *t, uint32_t *ts);
+
+static inline void queue_clamp_ts(struct qman_thread *t, struct queue *q);
+
 static inline void queue_fire(struct qman_thread *t,
     struct queue *q, uint32_t idx, unsigned *q_id, uint16_t *q_bytes);
 static inline void queue_activate(struct qman_thread *t, struct queue *q,
     uint32_t idx);
+static inline void queue_set_rate(struct queue *q, uint32_t rate);
+static inline uint32_t rate_mult(uint32_t rate, uint8_t *shift);
+static inline uint32_t rate_interval(uint32_t mult, uint8_t shift,
+    uint32_t bytes);
 static inline uint32_t timestamp(void);
-static inline int timestamp_lessthaneq(struct qman_thread *t, uint32_t a,
-    uint32_t b);
-static inline int64_t rel_time(uint32_t cur_ts, uint32_t ts_in);
+static inline int timestamp_lessthaneq(uint32_t a, uint32_t b);
+
+/** TSC to ns and us conversion factors (32 fractional bits) */
+static uint64_t tsc_ns_mult;
+static uint64_t tsc_us_mult;
 
 
 int qman_thread_init(struct dataplane_context *ctx)
@@ -103,8 +204,11 @@ int qman_thread_init(struct dataplane_context *ctx)
   struct qman_thread *t = &ctx->qman;
   unsigned i;
 
-  if ((t->queues = calloc(1, sizeof(*t->queues) * FLEXNIC_NUM_QMQUEUES))
-      == NULL)
+  /* only the chunk directory is allocated up front, queue state is allocated
+   * once this core sees the first flow in a chunk */
+  t->queue_num = fp_state->flowst_num;
+  if ((t->queue_chunks = calloc((t->queue_num + QUEUE_CHUNK_SIZE - 1) /
+          QUEUE_CHUNK_SIZE, sizeof(*t->queue_chunks))) == NULL)
   {
     fprintf(stderr, "qman_thread_init: queues malloc failed\n");
     return -1;
@@ -113,9 +217,32 @@ int qman_thread_init(struct dataplane_context *ctx)
   for (i = 0; i < QMAN_SKIPLIST_LEVELS; i++) {
     t->head_idx[i] = IDXLIST_INVAL;
   }
-  t->nolimit_head_idx = t->nolimit_tail_idx = IDXLIST_INVAL;
+
+  if ((t->classes = calloc(QMAN_CLASSES, sizeof(*t->classes))) == NULL) {
+    fprintf(stderr, "qman_thread_init: classes malloc failed\n");
+    return -1;
+  }
+  for (i = 0; i < QMAN_CLASSES; i++) {
+    t->classes[i].head_idx = t->classes[i].tail_idx = IDXLIST_INVAL;
+  }
+  t->class_active = 0;
+  t->class_cur = 0;
+  t->prio_burst = 0;
+
+  t->wheel = NULL;
+  if (config.fp_qman == CONFIG_QMAN_WHEEL) {
+    if ((t->wheel = calloc(1, sizeof(*t->wheel))) == NULL) {
+      fprintf(stderr, "qman_thread_init: wheel malloc failed\n");
+      return -1;
+    }
+    memset(t->wheel->head, 0xff, sizeof(t->wheel->head));
+    memset(t->wheel->tail, 0xff, sizeof(t->wheel->tail));
+  }
   utils_rng_init(&t->rng, RNG_SEED * ctx->id + ctx->id);
 
+  tsc_ns_mult = (1000000000ULL << 32) / rte_get_tsc_hz();
+  tsc_us_mult = (1000000ULL << 32) / rte_get_tsc_hz();
+
   t->ts_virtual = 0;
   t->ts_real = timestamp();
 
@@ -124,66 +251,70 @@ int qman_thread_init(struct dataplane_context *ctx)
 
 uint32_t qman_timestamp(uint64_t cycles)
 {
-  static uint64_t freq = 0;
-
-  if (freq == 0)
-    freq = rte_get_tsc_hz();
-
-  cycles *= 1000000ULL;
-  cycles /= freq;
-  return cycles;
+  return ((unsigned __int128) cycles * tsc_us_mult) >> 32;
 }
 
 uint32_t qman_next_ts(struct qman_thread *t, uint32_t cur_ts)
 {
   uint32_t ts = timestamp();
   uint32_t ret_ts = t->ts_virtual + (ts - t->ts_real);
-
-  if(t->nolimit_head_idx != IDXLIST_INVAL) {
-    // Nolimit queue has work - immediate timeout
-    fprintf(stderr, "QMan nolimit has work\n");
-    return 0;
+  uint32_t next = -1, next_ts, active;
+  struct qman_class *cls;
+  uint8_t c;
+
+  for (active = t->class_active; active != 0; active &= active - 1) {
+    c = __builtin_ctz(active);
+    cls = &t->classes[c];
+    if (!class_throttled(cls, ts)) {
+      // Class has ready queues - immediate timeout
+      fprintf(stderr, "QMan class has work\n");
+      return 0;
+    }
+    // Rate capped class - timeout when it may send again
+    next = MIN(next, (cls->cap_ts - ts) / 1000);
   }
 
-  uint32_t idx = t->head_idx[0];
-  if(idx != IDXLIST_INVAL) {
-    struct queue *q = &t->queues[idx];
-
-    if(timestamp_lessthaneq(t, q->next_ts, ret_ts)) {
-      // Fired in the past - immediate timeout
-      return 0;
-    } else {
-      // Timeout in the future - return difference
-      return rel_time(ret_ts, q->next_ts) / 1000;
+  if (t->wheel != NULL) {
+    if (wheel_next_ts(t, &next_ts) != 0) {
+      // Wheel empty
+      return next;
     }
+  } else if (t->head_idx[0] != IDXLIST_INVAL) {
+    next_ts = queue_get(t, t->head_idx[0])->next_ts;
+  } else {
+    // List empty
+    return next;
   }
 
-  // List empty - no timeout
-  return -1;
+  if (timestamp_lessthaneq(next_ts, ret_ts)) {
+    // Fired in the past - immediate timeout
+    return 0;
+  }
+  // Timeout in the future - return difference
+  return MIN(next, (next_ts - ret_ts) / 1000);
 }
 
 int qman_poll(struct qman_thread *t, unsigned num, unsigned *q_ids,
     uint16_t *q_bytes)
 {
-  unsigned x, y;
   uint32_t ts = timestamp();
 
-  /* poll nolimit list and skiplist alternating the order between */
-  if (t->nolimit_first) {
-    x = poll_nolimit(t, ts, num, q_ids, q_bytes);
-    y = poll_skiplist(t, ts, num - x, q_ids + x, q_bytes + x);
+  /* move rate-limited queues that are due to their classes' ready FIFOs, then
+   * pick queues to send from across classes */
+  if (t->wheel != NULL) {
+    poll_wheel(t, ts, num);
   } else {
-    x = poll_skiplist(t, ts, num, q_ids, q_bytes);
-    y = poll_nolimit(t, ts, num - x, q_ids + x, q_bytes + x);
+    poll_skiplist(t, ts, num);
   }
-  t->nolimit_first = !t->nolimit_first;
 
-  return x + y;
+  return poll_classes(t, ts, num, q_ids, q_bytes);
 }
 
-int qman_set(struct qman_thread *t, uint32_t id, uint32_t rate, uint32_t avail,
-    uint16_t max_chunk, uint8_t flags)
+int qman_set(struct qman_thread *t, uint32_t id, uint8_t cls, uint32_t rate,
+    uint32_t avail, uint16_t max_chunk, uint8_t flags)
 {
+  struct queue_chunk **chunk;
+
 #ifdef FLEXNIC_TRACE_QMAN
   struct flexnic_trace_entry_qman_set evt = {
       .id = id, .rate = rate, .avail = avail, .max_chunk = max_chunk,
@@ -192,29 +323,62 @@ int qman_set(struct qman_thread *t, uint32_t id, uint32_t rate, uint32_t avail,
   trace_event(FLEXNIC_TRACE_EV_QMSET, sizeof(evt), &evt);
 #endif
 
-  dprintf("qman_set: id=%u rate=%u avail=%u max_chunk=%u qidx=%u tid=%u\n",
+  dprintf("qman_set: id=%u tx_mult=%u avail=%u max_chunk=%u qidx=%u tid=%u\n",
       id, rate, avail, max_chunk, qidx, tid);
 
-  if (id >= FLEXNIC_NUM_QMQUEUES) {
+  if (id >= t->queue_num) {
     fprintf(stderr, "qman_set: invalid queue id: %u >= %u\n", id,
-        FLEXNIC_NUM_QMQUEUES);
+        t->queue_num);
+    return -1;
+  }
+
+  if (cls >= QMAN_CLASSES) {
+    fprintf(stderr, "qman_set: invalid class: %u >= %u\n", cls,
+        QMAN_CLASSES);
+    return -1;
+  }
+
+  chunk = &t->queue_chunks[id >> QUEUE_CHUNK_BITS];
+  if (*chunk == NULL && (*chunk = calloc(1, sizeof(**chunk))) == NULL) {
+    fprintf(stderr, "qman_set: allocating queue chunk failed\n");
     return -1;
   }
 
-  set_impl(t, id, rate, avail, max_chunk, flags);
+  set_impl(t, id, cls, rate, avail, max_chunk, flags);
 
   return 0;
 }
 
+static inline struct queue *queue_get(struct qman_thread *t, uint32_t idx)
+{
+  return &t->queue_chunks[idx >> QUEUE_CHUNK_BITS]->queues
+      [idx & (QUEUE_CHUNK_SIZE - 1)];
+}
+
+static inline uint8_t queue_class(struct qman_thread *t, uint32_t idx)
+{
+  return t->queue_chunks[idx >> QUEUE_CHUNK_BITS]->classes
+      [idx & (QUEUE_CHUNK_SIZE - 1)];
+}
+
 /** Actually update queue state: must run on queue's home core */
-static void inline set_impl(struct qman_thread *t, uint32_t idx, uint32_t rate,
-    uint32_t avail, uint16_t max_chunk, uint8_t flags)
+static void inline set_impl(struct qman_thread *t, uint32_t idx, uint8_t cls,
+    uint32_t rate, uint32_t avail, uint16_t max_chunk, uint8_t flags)
 {
-  struct queue *q = &t->queues[idx];
+  struct queue_chunk *chunk = t->queue_chunks[idx >> QUEUE_CHUNK_BITS];
+  uint32_t ci = idx & (QUEUE_CHUNK_SIZE - 1);
+  struct queue *q = &chunk->queues[ci];
   int new_avail = 0;
 
+  /* class is set along with the rate, a queue already in a ready FIFO is
+   * accounted to its old class one last time */
   if ((flags & QMAN_SET_RATE) != 0) {
-    q->rate = rate;
+    /* callers pass the rate on every update, it rarely changes */
+    if (chunk->rates[ci] != rate) {
+      queue_set_rate(q, rate);
+      chunk->rates[ci] = rate;
+    }
+    chunk->classes[ci] = cls;
   }
 
   if ((flags & QMAN_SET_MAXCHUNK) != 0) {
@@ -229,64 +393,194 @@ static void inline set_impl(struct qman_thread *t, uint32_t idx, uint32_t rate,
     new_avail = 1;
   }
 
-  dprintf("set_impl: t=%p q=%p idx=%u avail=%u rate=%u qflags=%x flags=%x\n", t, q, idx, q->avail, q->rate, q->flags, flags);
+  dprintf("set_impl: t=%p q=%p idx=%u avail=%u tx_mult=%u qflags=%x flags=%x\n", t, q, idx, q->avail, q->tx_mult, q->flags, flags);
 
-  if (new_avail && q->avail > 0
-      && ((q->flags & (FLAG_INSKIPLIST | FLAG_INNOLIMITL)) == 0)) {
+  if (new_avail && q->avail > 0 && ((q->flags & FLAG_ACTIVE) == 0)) {
     queue_activate(t, q, idx);
   }
 }
 
 /*****************************************************************************/
-/* Managing no-limit queues */
+/* Managing scheduling classes */
 
-/** Add queue to the no limit list */
-static inline void queue_activate_nolimit(struct qman_thread *t,
+/** Add queue to the ready FIFO of its class */
+static inline void queue_activate_ready(struct qman_thread *t,
     struct queue *q, uint32_t idx)
 {
-  struct queue *q_tail;
+  uint8_t c = queue_class(t, idx);
+  struct qman_class *cls = &t->classes[c];
 
-  assert((q->flags & (FLAG_INSKIPLIST | FLAG_INNOLIMITL)) == 0);
+  assert((q->flags & FLAG_ACTIVE) == 0);
 
-  dprintf("queue_activate_nolimit: t=%p q=%p avail=%u rate=%u flags=%x\n", t, q, q->avail, q->rate, q->flags);
+  dprintf("queue_activate_ready: t=%p q=%p avail=%u tx_mult=%u flags=%x c=%u\n", t, q, q->avail, q->tx_mult, q->flags, c);
 
-  q->flags |= FLAG_INNOLIMITL;
+  q->flags |= FLAG_INREADY;
   q->next_idxs[0] = IDXLIST_INVAL;
-  if (t->nolimit_tail_idx == IDXLIST_INVAL) {
-    t->nolimit_head_idx = t->nolimit_tail_idx = idx;
+  if (cls->tail_idx == IDXLIST_INVAL) {
+    cls->head_idx = cls->tail_idx = idx;
+    t->class_active |= 1U << c;
     return;
   }
 
-  q_tail = &t->queues[t->nolimit_tail_idx];
-  q_tail->next_idxs[0] = idx;
-  t->nolimit_tail_idx = idx;
+  queue_get(t, cls->tail_idx)->next_idxs[0] = idx;
+  cls->tail_idx = idx;
 }
 
-/** Poll no-limit queues */
-static inline unsigned poll_nolimit(struct qman_thread *t, uint32_t cur_ts,
-    unsigned num, unsigned *q_ids, uint16_t *q_bytes)
+/** Next class in bitmap at or after c, wrapping around */
+static inline uint8_t class_next(uint32_t bm, uint8_t c)
 {
-  unsigned cnt;
+  uint32_t m = bm & (~0U << c);
+  return __builtin_ctz(m != 0 ? m : bm);
+}
+
+/** Remove first queue from ready FIFO of class */
+static inline struct queue *class_pop(struct qman_thread *t, uint8_t c,
+    uint32_t *idx)
+{
+  struct qman_class *cls = &t->classes[c];
   struct queue *q;
+
+  *idx = cls->head_idx;
+  q = queue_get(t, *idx);
+
+  cls->head_idx = q->next_idxs[0];
+  if (q->next_idxs[0] == IDXLIST_INVAL) {
+    cls->tail_idx = IDXLIST_INVAL;
+    t->class_active &= ~(1U << c);
+  }
+
+  q->flags &= ~FLAG_INREADY;
+  dprintf("class_pop: t=%p q=%p idx=%u avail=%u tx_mult=%u flags=%x c=%u\n", t, q, *idx, q->avail, q->tx_mult, q->flags, c);
+  return q;
+}
+
+/** Serve ready queues: the priority class first, limited to PRIO_MAX_BURST
+ * queues in a row while others wait, then the other classes with deficit round
+ * robin */
+static inline unsigned poll_classes(struct qman_thread *t, uint32_t cur_ts,
+    unsigned num, unsigned *q_ids, uint16_t *q_bytes)
+{
+  unsigned cnt = 0;
+  uint32_t eligible, active;
+  uint8_t c;
+
+  /* skip classes that have reached their rate cap */
+  eligible = 0;
+  active = t->class_active & ~(1U << QMAN_CLASS_PRIO);
+  for (; active != 0; active &= active - 1) {
+    c = __builtin_ctz(active);
+    class_update(t, c);
+    if (!class_throttled(&t->classes[c], cur_ts)) {
+      eligible |= 1U << c;
+    }
+  }
+
+  while (cnt < num) {
+    if ((t->class_active & (1U << QMAN_CLASS_PRIO)) != 0 &&
+        (t->prio_burst < PRIO_MAX_BURST || eligible == 0))
+    {
+      if (class_prio(t, q_ids + cnt, q_bytes + cnt)) {
+        t->prio_burst++;
+        cnt++;
+      }
+    } else if (eligible != 0) {
+      if (class_drr(t, cur_ts, &eligible, q_ids + cnt, q_bytes + cnt)) {
+        t->prio_burst = 0;
+        cnt++;
+      }
+    } else {
+      break;
+    }
+  }
+
+  return cnt;
+}
+
+/** Fire next queue from the priority class, returns 1 if a queue was fired */
+static inline unsigned class_prio(struct qman_thread *t, unsigned *q_id,
+    uint16_t *q_bytes)
+{
   uint32_t idx;
+  struct queue *q = class_pop(t, QMAN_CLASS_PRIO, &idx);
 
-  for (cnt = 0; cnt < num && t->nolimit_head_idx != IDXLIST_INVAL;) {
-    idx = t->nolimit_head_idx;
-    q = t->queues + idx;
+  if (q->avail == 0) {
+    return 0;
+  }
+  queue_fire(t, q, idx, q_id, q_bytes);
+  return 1;
+}
 
-    t->nolimit_head_idx = q->next_idxs[0];
-    if (q->next_idxs[0] == IDXLIST_INVAL)
-      t->nolimit_tail_idx = IDXLIST_INVAL;
+/** Fire next queue from the class whose turn it is in the deficit round
+ * robin, returns 1 if a queue was fired. Classes that run out of ready queues
+ * or hit their rate cap are removed from eligible. */
+static inline unsigned class_drr(struct qman_thread *t, uint32_t cur_ts,
+    uint32_t *eligible, unsigned *q_id, uint16_t *q_bytes)
+{
+  uint8_t c = class_next(*eligible, t->class_cur);
+  struct qman_class *cls = &t->classes[c];
+  struct queue *q;
+  uint32_t idx, weight;
+  unsigned ret = 0;
+
+  t->class_cur = c;
 
-    q->flags &= ~FLAG_INNOLIMITL;
-    dprintf("poll_nolimit: t=%p q=%p idx=%u avail=%u rate=%u flags=%x\n", t, q, idx, q->avail, q->rate, q->flags);
+  /* start of this class' turn in the round */
+  if (cls->deficit <= 0) {
+    weight = fp_state->appst[c].qm_weight;
+    cls->deficit += (weight != 0 ? weight : 1) * CLASS_QUANTUM;
+  }
+
+  if (cls->deficit > 0) {
+    q = class_pop(t, c, &idx);
     if (q->avail > 0) {
-      queue_fire(t, q, idx, q_ids + cnt, q_bytes + cnt);
-      cnt++;
+      queue_fire(t, q, idx, q_id, q_bytes);
+      cls->deficit -= *q_bytes;
+      ret = 1;
+
+      /* account against rate cap, allowing to catch up a little if the class
+       * fell behind */
+      if (cls->cap_mult != 0) {
+        if (cur_ts - cls->cap_ts > CLASS_CAP_SLACK) {
+          cls->cap_ts = cur_ts - CLASS_CAP_SLACK;
+        }
+        cls->cap_ts += rate_interval(cls->cap_mult, cls->cap_shift, *q_bytes);
+      }
     }
   }
 
-  return cnt;
+  if ((t->class_active & (1U << c)) == 0) {
+    /* class ran out of ready queues, no credit for idle classes */
+    *eligible &= ~(1U << c);
+    cls->deficit = 0;
+  } else if (class_throttled(cls, cur_ts)) {
+    *eligible &= ~(1U << c);
+  } else if (cls->deficit > 0) {
+    /* class keeps its turn */
+    return ret;
+  }
+  t->class_cur = (c + 1) % QMAN_CLASSES;
+  return ret;
+}
+
+/** Pick up changes to the rate cap of a class */
+static inline void class_update(struct qman_thread *t, uint8_t c)
+{
+  struct qman_class *cls = &t->classes[c];
+  uint32_t rate = fp_state->appst[c].qm_rate;
+
+  if (rate != cls->cap_rate) {
+    cls->cap_rate = rate;
+    cls->cap_mult = rate_mult(rate, &cls->cap_shift);
+  }
+}
+
+/** Whether class is rate capped and may not send at cur_ts yet. cap_ts is at
+ * most MAX_TX_INTERVAL ahead, anything else is a stale time stamp from the
+ * past. */
+static inline int class_throttled(struct qman_class *cls, uint32_t cur_ts)
+{
+  return cls->cap_mult != 0 &&
+    (uint32_t) (cls->cap_ts - cur_ts) - 1 < MAX_TX_INTERVAL;
 }
 
 /*****************************************************************************/
@@ -295,7 +589,7 @@ static inline unsigned poll_nolimit(struct qman_thread *t, uint32_t cur_ts,
 static inline uint32_t queue_new_ts(struct qman_thread *t, struct queue *q,
     uint32_t bytes)
 {
-  return t->ts_virtual + ((uint64_t) bytes * 8 * 1000000) / q->rate;
+  return t->ts_virtual + rate_interval(q->tx_mult, q->tx_shift, bytes);
 }
 
 /** Add queue to the skip list list */
@@ -305,35 +599,25 @@ static inline void queue_activate_skiplist(struct qman_thread *t,
   uint8_t level;
   int8_t l;
   uint32_t preds[QMAN_SKIPLIST_LEVELS];
-  uint32_t pred, idx, ts, max_ts;
+  uint32_t pred, idx, ts;
 
-  assert((q->flags & (FLAG_INSKIPLIST | FLAG_INNOLIMITL)) == 0);
+  assert((q->flags & FLAG_ACTIVE) == 0);
 
-  dprintf("queue_activate_skiplist: t=%p q=%p idx=%u avail=%u rate=%u flags=%x ts_virt=%u next_ts=%u\n", t, q, q_idx, q->avail, q->rate, q->flags,
+  dprintf("queue_activate_skiplist: t=%p q=%p idx=%u avail=%u tx_mult=%u flags=%x ts_virt=%u next_ts=%u\n", t, q, q_idx, q->avail, q->tx_mult, q->flags,
       t->ts_virtual, q->next_ts);
 
-  /* make sure queue has a reasonable next_ts:
-   *  - not in the past
-   *  - not more than if it just sent max_chunk at the current rate
-   */
+  queue_clamp_ts(t, q);
   ts = q->next_ts;
-  max_ts = queue_new_ts(t, q, q->max_chunk);
-  if (timestamp_lessthaneq(t, ts, t->ts_virtual)) {
-    ts = q->next_ts = t->ts_virtual;
-  } else if (!timestamp_lessthaneq(t, ts, max_ts)) {
-    ts = q->next_ts = max_ts;
-  }
-  q->next_ts = ts;
 
   /* find predecessors at all levels top-down */
   pred = IDXLIST_INVAL;
   for (l = QMAN_SKIPLIST_LEVELS - 1; l >= 0; l--) {
     idx = (pred != IDXLIST_INVAL ? pred : t->head_idx[l]);
     while (idx != IDXLIST_INVAL &&
-        timestamp_lessthaneq(t, t->queues[idx].next_ts, ts))
+        timestamp_lessthaneq(queue_get(t, idx)->next_ts, ts))
     {
       pred = idx;
-      idx = t->queues[idx].next_idxs[l];
+      idx = queue_get(t, idx)->next_idxs[l];
     }
     preds[l] = pred;
     dprintf("    pred[%u] = %d\n", l, pred);
@@ -350,8 +634,8 @@ static inline void queue_activate_skiplist(struct qman_thread *t,
     } else {
       idx = preds[l];
       if (idx != IDXLIST_INVAL) {
-        q->next_idxs[l] = t->queues[idx].next_idxs[l];
-        t->queues[idx].next_idxs[l] = q_idx;
+        q->next_idxs[l] = queue_get(t, idx)->next_idxs[l];
+        queue_get(t, idx)->next_idxs[l] = q_idx;
       } else {
         q->next_idxs[l] = t->head_idx[l];
         t->head_idx[l] = q_idx;
@@ -362,9 +646,9 @@ static inline void queue_activate_skiplist(struct qman_thread *t,
   q->flags |= FLAG_INSKIPLIST;
 }
 
-/** Poll skiplist queues */
+/** Move due skiplist queues to their classes */
 static inline unsigned poll_skiplist(struct qman_thread *t, uint32_t cur_ts,
-    unsigned num, unsigned *q_ids, uint16_t *q_bytes)
+    unsigned num)
 {
   unsigned cnt;
   uint32_t idx, max_vts;
@@ -383,12 +667,12 @@ static inline unsigned poll_skiplist(struct qman_thread *t, uint32_t cur_ts,
       break;
     }
 
-    q = &t->queues[idx];
+    q = queue_get(t, idx);
 
     /* beyond max_vts */
     dprintf("poll_skiplist: next_ts=%u vts=%u rts=%u max_vts=%u cur_ts=%u\n",
         q->next_ts, t->ts_virtual, t->ts_real, max_vts, cur_ts);
-    if (!timestamp_lessthaneq(t, q->next_ts, max_vts)) {
+    if (!timestamp_lessthaneq(q->next_ts, max_vts)) {
       t->ts_virtual = max_vts;
       break;
     }
@@ -403,10 +687,10 @@ static inline unsigned poll_skiplist(struct qman_thread *t, uint32_t cur_ts,
     /* advance virtual timestamp */
     t->ts_virtual = q->next_ts;
 
-    dprintf("poll_skiplist: t=%p q=%p idx=%u avail=%u rate=%u flags=%x\n", t, q, idx, q->avail, q->rate, q->flags);
+    dprintf("poll_skiplist: t=%p q=%p idx=%u avail=%u tx_mult=%u flags=%x\n", t, q, idx, q->avail, q->tx_mult, q->flags);
 
     if (q->avail > 0) {
-      queue_fire(t, q, idx, q_ids + cnt, q_bytes + cnt);
+      queue_activate_ready(t, q, idx);
       cnt++;
     }
   }
@@ -415,9 +699,9 @@ static inline unsigned poll_skiplist(struct qman_thread *t, uint32_t cur_ts,
   if (cnt == num) {
     idx = t->head_idx[0];
     if (idx != IDXLIST_INVAL &&
-        timestamp_lessthaneq(t, t->queues[idx].next_ts, max_vts))
+        timestamp_lessthaneq(queue_get(t, idx)->next_ts, max_vts))
     {
-      t->ts_virtual = t->queues[idx].next_ts;
+      t->ts_virtual = queue_get(t, idx)->next_ts;
     } else {
       t->ts_virtual = max_vts;
     }
@@ -427,6 +711,21 @@ static inline unsigned poll_skiplist(struct qman_thread *t, uint32_t cur_ts,
   return cnt;
 }
 
+/** Make sure queue has a reasonable next_ts:
+ *  - not in the past
+ *  - not more than if it just sent max_chunk at the current rate
+ */
+static inline void queue_clamp_ts(struct qman_thread *t, struct queue *q)
+{
+  uint32_t max_ts = queue_new_ts(t, q, q->max_chunk);
+
+  if (timestamp_lessthaneq(q->next_ts, t->ts_virtual)) {
+    q->next_ts = t->ts_virtual;
+  } else if (!timestamp_lessthaneq(q->next_ts, max_ts)) {
+    q->next_ts = max_ts;
+  }
+}
+
 /** Level for queue added to skiplist */
 static inline uint8_t queue_level(struct qman_thread *t)
 {
@@ -434,6 +733,198 @@ static inline uint8_t queue_level(struct qman_thread *t)
   return (x < QMAN_SKIPLIST_LEVELS ? x : QMAN_SKIPLIST_LEVELS - 1);
 }
 
+/*****************************************************************************/
+/* Managing timing wheel queues */
+
+static inline uint32_t wheel_tick(uint32_t ts)
+{
+  return ts >> WHEEL_GRAN_BITS;
+}
+
+/** Distance from slot `from` to the next non-empty slot at or after it, or
+ * WHEEL_SLOTS if the level is empty */
+static inline uint32_t wheel_find(const uint64_t *bm, uint32_t from)
+{
+  uint32_t i, w = from / 64;
+  uint64_t m = bm[w] & (~0ULL << (from % 64));
+
+  for (i = 0; i <= WHEEL_WORDS; i++) {
+    if (m != 0) {
+      return (w * 64 + __builtin_ctzll(m) - from) & (WHEEL_SLOTS - 1);
+    }
+    w = (w + 1) % WHEEL_WORDS;
+    m = bm[w];
+  }
+  return WHEEL_SLOTS;
+}
+
+static inline void wheel_append(struct qman_thread *t, struct queue *q,
+    uint32_t idx, unsigned level, uint32_t slot)
+{
+  struct qman_wheel *w = t->wheel;
+  uint32_t tail = w->tail[level][slot];
+
+  q->next_idxs[0] = IDXLIST_INVAL;
+  if (tail == IDXLIST_INVAL) {
+    w->head[level][slot] = idx;
+    w->nonempty[level][slot / 64] |= 1ULL << (slot % 64);
+  } else {
+    queue_get(t, tail)->next_idxs[0] = idx;
+  }
+  w->tail[level][slot] = idx;
+}
+
+/** Insert queue into the slot for its next_ts */
+static inline void wheel_insert(struct qman_thread *t, struct queue *q,
+    uint32_t idx)
+{
+  struct qman_wheel *w = t->wheel;
+  uint32_t d, p, dp;
+
+  /* ticks until queue is due, 0 if already due */
+  d = (wheel_tick(q->next_ts) - w->cur) & WHEEL_TICK_MASK;
+  if (d > WHEEL_TICK_MASK / 2) {
+    d = 0;
+  }
+
+  if (d < WHEEL_SLOTS) {
+    wheel_append(t, q, idx, 0, (w->cur + d) & (WHEEL_SLOTS - 1));
+  } else {
+    /* periods ahead, clamped to the furthest level 1 slot */
+    p = w->cur >> WHEEL_SLOT_BITS;
+    dp = ((((w->cur + d) & WHEEL_TICK_MASK) >> WHEEL_SLOT_BITS) - p) &
+      WHEEL_PERIOD_MASK;
+    if (dp >= WHEEL_SLOTS) {
+      dp = WHEEL_SLOTS - 1;
+    }
+    wheel_append(t, q, idx, 1, (p + dp) & (WHEEL_SLOTS - 1));
+  }
+}
+
+/** Add queue to the timing wheel */
+static inline void queue_activate_wheel(struct qman_thread *t,
+    struct queue *q, uint32_t idx)
+{
+  assert((q->flags & FLAG_ACTIVE) == 0);
+
+  queue_clamp_ts(t, q);
+  wheel_insert(t, q, idx);
+  q->flags |= FLAG_INWHEEL;
+  t->wheel->num++;
+}
+
+/** Move queues from level 1 slot for the current period into level 0 */
+static inline void wheel_cascade(struct qman_thread *t)
+{
+  struct qman_wheel *w = t->wheel;
+  uint32_t slot = (w->cur >> WHEEL_SLOT_BITS) & (WHEEL_SLOTS - 1);
+  uint32_t idx, next;
+  struct queue *q;
+
+  idx = w->head[1][slot];
+  w->head[1][slot] = w->tail[1][slot] = IDXLIST_INVAL;
+  w->nonempty[1][slot / 64] &= ~(1ULL << (slot % 64));
+
+  for (; idx != IDXLIST_INVAL; idx = next) {
+    q = queue_get(t, idx);
+    next = q->next_idxs[0];
+    wheel_insert(t, q, idx);
+  }
+}
+
+/** Move due timing wheel queues to their classes */
+static inline unsigned poll_wheel(struct qman_thread *t, uint32_t cur_ts,
+    unsigned num)
+{
+  struct qman_wheel *w = t->wheel;
+  unsigned cnt;
+  uint32_t idx, max_vts, end, slot, step, d;
+  struct queue *q;
+
+  /* maximum virtual time stamp that can be reached */
+  max_vts = t->ts_virtual + (cur_ts - t->ts_real);
+  end = wheel_tick(max_vts);
+
+  for (cnt = 0; cnt < num;) {
+    slot = w->cur & (WHEEL_SLOTS - 1);
+    idx = w->head[0][slot];
+
+    if (idx != IDXLIST_INVAL) {
+      /* remove queue from slot */
+      q = queue_get(t, idx);
+      w->head[0][slot] = q->next_idxs[0];
+      if (q->next_idxs[0] == IDXLIST_INVAL) {
+        w->tail[0][slot] = IDXLIST_INVAL;
+        w->nonempty[0][slot / 64] &= ~(1ULL << (slot % 64));
+      }
+      assert((q->flags & FLAG_INWHEEL) != 0);
+      q->flags &= ~FLAG_INWHEEL;
+      w->num--;
+
+      /* advance virtual timestamp, slots are not sorted internally */
+      if (timestamp_lessthaneq(t->ts_virtual, q->next_ts) &&
+          timestamp_lessthaneq(q->next_ts, max_vts))
+      {
+        t->ts_virtual = q->next_ts;
+      }
+
+      if (q->avail > 0) {
+        queue_activate_ready(t, q, idx);
+        cnt++;
+      }
+      continue;
+    }
+
+    /* current slot empty, stop once we reach max_vts */
+    d = (end - w->cur) & WHEEL_TICK_MASK;
+    if (d == 0 || d > WHEEL_TICK_MASK / 2) {
+      t->ts_virtual = max_vts;
+      break;
+    }
+    if (w->num == 0) {
+      w->cur = end;
+      t->ts_virtual = max_vts;
+      break;
+    }
+
+    /* skip to next non-empty slot, but stop at period boundaries to
+     * cascade level 1 */
+    step = wheel_find(w->nonempty[0], (slot + 1) & (WHEEL_SLOTS - 1)) + 1;
+    step = MIN(step, WHEEL_SLOTS - slot);
+    step = MIN(step, d);
+    w->cur = (w->cur + step) & WHEEL_TICK_MASK;
+    if ((w->cur & (WHEEL_SLOTS - 1)) == 0) {
+      wheel_cascade(t);
+    }
+  }
+
+  t->ts_real = cur_ts;
+  return cnt;
+}
+
+/** Time stamp of the earliest non-empty slot, -1 if wheel is empty */
+static inline int wheel_next_ts(struct qman_thread *t, uint32_t *ts)
+{
+  struct qman_wheel *w = t->wheel;
+  uint32_t d, p;
+
+  if (w->num == 0) {
+    return -1;
+  }
+
+  d = wheel_find(w->nonempty[0], w->cur & (WHEEL_SLOTS - 1));
+  if (d < WHEEL_SLOTS) {
+    *ts = (w->cur + d) << WHEEL_GRAN_BITS;
+    return 0;
+  }
+
+  p = (w->cur >> WHEEL_SLOT_BITS) & (WHEEL_SLOTS - 1);
+  d = wheel_find(w->nonempty[1], p);
+  *ts = (((w->cur >> WHEEL_SLOT_BITS) + d) << WHEEL_SLOT_BITS) <<
+    WHEEL_GRAN_BITS;
+  return 0;
+}
+
 /*****************************************************************************/
 
 static inline void queue_fire(struct qman_thread *t,
@@ -446,8 +937,8 @@ static inline void queue_fire(struct qman_thread *t,
   bytes = (q->avail <= q->max_chunk ? q->avail : q->max_chunk);
   q->avail -= bytes;
 
-  dprintf("queue_fire: t=%p q=%p idx=%u gidx=%u bytes=%u avail=%u rate=%u\n", t, q, idx, idx, bytes, q->avail, q->rate);
-  if (q->rate > 0) {
+  dprintf("queue_fire: t=%p q=%p idx=%u gidx=%u bytes=%u avail=%u tx_mult=%u\n", t, q, idx, idx, bytes, q->avail, q->tx_mult);
+  if (q->tx_mult != 0) {
     q->next_ts = queue_new_ts(t, q, bytes);
   }
 
@@ -469,63 +960,59 @@ static inline void queue_fire(struct qman_thread *t,
 static inline void queue_activate(struct qman_thread *t, struct queue *q,
     uint32_t idx)
 {
-  if (q->rate == 0) {
-    queue_activate_nolimit(t, q, idx);
+  if (q->tx_mult == 0) {
+    queue_activate_ready(t, q, idx);
+  } else if (t->wheel != NULL) {
+    queue_activate_wheel(t, q, idx);
   } else {
     queue_activate_skiplist(t, q, idx);
   }
 }
 
-static inline uint32_t timestamp(void)
+static inline void queue_set_rate(struct queue *q, uint32_t rate)
 {
-  static uint64_t freq = 0;
-  uint64_t cycles = rte_get_tsc_cycles();
-
-  if (freq == 0)
-    freq = rte_get_tsc_hz();
+  uint8_t shift;
 
-  cycles *= 1000000000ULL;
-  cycles /= freq;
-  return cycles;
+  q->tx_mult = rate_mult(rate, &shift);
+  q->tx_shift = shift;
 }
 
-/** Relative timestamp, ignoring wrap-arounds */
-static inline int64_t rel_time(uint32_t cur_ts, uint32_t ts_in)
+/** Precompute multiplier and shift for ns per byte at rate [Kbps], 0 if
+ * rate is 0 (unlimited) */
+static inline uint32_t rate_mult(uint32_t rate, uint8_t *shift)
 {
-  uint64_t ts = ts_in;
-  const uint64_t middle = (1ULL << (TIMESTAMP_BITS - 1));
-  uint64_t start, end;
+  /* 8 * 10^6 ns per byte at 1 Kbps */
+  const uint64_t ns_per_byte = 8ULL * 1000 * 1000;
+  uint8_t s = 32;
 
-  if (cur_ts < middle) {
-    /* negative interval is split in half */
-    start = (cur_ts - middle) & TIMESTAMP_MASK;
-    end = (1ULL << TIMESTAMP_BITS);
-    if (start <= ts && ts < end) {
-      /* in first half of negative interval, smallest timestamps */
-      return ts - start - middle;
-    } else {
-      /* in second half or in positive interval */
-      return ts - cur_ts;
-    }
-  } else if (cur_ts == middle) {
-    /* intervals not split */
-    return ts - cur_ts;
-  } else {
-    /* higher interval is split */
-    start = 0;
-    end = ((cur_ts + middle) & TIMESTAMP_MASK) + 1;
-    if (start <= cur_ts && ts < end) {
-      /* in second half of positive interval, largest timestamps */
-      return ts + ((1ULL << TIMESTAMP_BITS) - cur_ts);
-    } else {
-      /* in negative interval or first half of positive interval */
-      return ts - cur_ts;
-    }
+  if (rate == 0) {
+    *shift = 0;
+    return 0;
+  }
+
+  /* largest shift where the multiplier still fits in 32 bits */
+  while ((ns_per_byte << s) / rate > UINT32_MAX) {
+    s--;
   }
+  *shift = s;
+  return (ns_per_byte << s) / rate;
+}
+
+/** Time to send bytes at rate given by multiplier and shift (ns) */
+static inline uint32_t rate_interval(uint32_t mult, uint8_t shift,
+    uint32_t bytes)
+{
+  uint64_t interval = ((uint64_t) bytes * mult) >> shift;
+  return MIN(interval, MAX_TX_INTERVAL);
+}
+
+static inline uint32_t timestamp(void)
+{
+  return ((unsigned __int128) rte_get_tsc_cycles() * tsc_ns_mult) >> 32;
 }
 
-static inline int timestamp_lessthaneq(struct qman_thread *t, uint32_t a,
-    uint32_t b)
+/** Wrap-safe comparison, timestamps must be less than 2^31 ns apart */
+static inline int timestamp_lessthaneq(uint32_t a, uint32_t b)
 {
-  return rel_time(t->ts_virtual, a) <= rel_time(t->ts_virtual, b);
+  return (int32_t) (a - b) <= 0;
 }
@@ -224,10 +224,74 @@ static inline uint32_t tcp_txavail(const struct flextcp_pl_flowst *fs,
   return MIN(buf_avail, fc_avail);
 }
 
+/**
+ * Add interval [seq, seq + len) to a sorted list of non-touching intervals,
+ * merging it with intervals it overlaps or touches. All positions are
+ * calculated relative to #base to handle sequence number wrap-arounds, so all
+ * intervals have to be within 2^31 bytes after #base.
+ *
+ * @param ivs   Interval array.
+ * @param pnum  Pointer to number of valid intervals in array.
+ * @param max   Capacity of interval array.
+ * @param base  Sequence number all intervals start at or after.
+ * @param seq   Sequence number of first byte in new interval.
+ * @param len   Length of new interval.
+ *
+ * @return Index of the interval containing the new one, or -1 if a new
+ *         interval would be needed but the array is full.
+ */
+static inline int tcp_intervals_add(struct flextcp_pl_interval *ivs,
+    uint16_t *pnum, uint16_t max, uint32_t base, uint32_t seq, uint32_t len)
+{
+  uint32_t a = seq - base, b = a + len, i_a, i_b;
+  uint16_t i, j, num = *pnum;
+
+  /* find first interval ending at or after start of new one */
+  for (i = 0; i < num; i++) {
+    i_b = ivs[i].start - base + ivs[i].len;
+    if (i_b >= a)
+      break;
+  }
+
+  /* find first interval starting after end of new one */
+  for (j = i; j < num; j++) {
+    i_a = ivs[j].start - base;
+    if (i_a > b)
+      break;
+  }
+
+  if (i == j) {
+    /* no overlap with any interval, need a new one */
+    if (num >= max) {
+      return -1;
+    }
+
+    memmove(&ivs[i + 1], &ivs[i], (num - i) * sizeof(ivs[0]));
+    ivs[i].start = seq;
+    ivs[i].len = len;
+    *pnum = num + 1;
+  } else {
+    /* merge intervals i to j - 1 with new one */
+    i_a = ivs[i].start - base;
+    i_b = ivs[j - 1].start - base + ivs[j - 1].len;
+    a = MIN(a, i_a);
+    b = MAX(b, i_b);
+
+    ivs[i].start = base + a;
+    ivs[i].len = b - a;
+    memmove(&ivs[i + 1], &ivs[j], (num - j) * sizeof(ivs[0]));
+    *pnum = num - (j - i - 1);
+  }
+
+  return i;
+}
+
 /** Pointers to parsed TCP options */
 struct tcp_opts {
   /** Timestamp option */
   struct tcp_timestamp_opt *ts;
+  /** SACK option */
+  struct tcp_sack_opt *sack;
 };
 
 /**
@@ -249,6 +313,7 @@ static inline int tcp_parse_options(const struct pkt_tcp *p, uint16_t len,
   uint8_t opt_kind, opt_len, opt_avail;
 
   opts->ts = NULL;
+  opts->sack = NULL;
 
   /* whole header not in buf */
   if (TCPH_HDRLEN(&p->tcp) < 5 || opts_len > (len - sizeof(*p))) {
@@ -280,6 +345,18 @@ static inline int tcp_parse_options(const struct pkt_tcp *p, uint16_t len,
         }
 
         opts->ts = (struct tcp_timestamp_opt *) (opt + off);
+      } else if (opt_kind == TCP_OPT_SACK) {
+        if (opt_len > opt_avail ||
+            opt_len < sizeof(struct tcp_sack_opt) +
+            sizeof(struct tcp_sack_block) ||
+            (opt_len - sizeof(struct tcp_sack_opt)) %
+            sizeof(struct tcp_sack_block) != 0)
+        {
+          fprintf(stderr, "parse_options: sack opt_len=%u\n", opt_len);
+          return -1;
+        }
+
+        opts->sack = (struct tcp_sack_opt *) (opt + off);
       }
     }
     off += opt_len;
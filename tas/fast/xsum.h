@@ -0,0 +1,143 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef XSUM_H_
+#define XSUM_H_
+
+/**
+ * Internet checksum helpers for when the NIC does not compute checksums.
+ *
+ * Partial sums use the representation of DPDK's __rte_raw_cksum(): 16-bit
+ * words in host byte order summed into a 32-bit value, so they can be mixed
+ * with rte_ipv4_phdr_cksum() and reduced with __rte_raw_cksum_reduce().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/** Fold 64-bit accumulator into a 32-bit partial sum */
+static inline uint32_t xsum_fold32(uint64_t sum)
+{
+  sum = (sum & 0xffffffff) + (sum >> 32);
+  sum = (sum & 0xffffffff) + (sum >> 32);
+  return sum;
+}
+
+/** Sum of `len` bytes at `src` added to `sum`, also copied to `dst` if `copy`
+ * is set. Both variants below inline this with a constant `copy`. */
+static inline uint32_t xsum_impl(void *dst, const void *src, size_t len,
+    uint32_t sum, int copy)
+{
+  const uint8_t *s = src;
+  uint8_t *d = dst;
+  uint64_t acc = sum;
+  uint32_t w32;
+  uint16_t w16;
+
+#ifdef __AVX2__
+  const __m256i mask = _mm256_set1_epi64x(0xffffffff);
+  __m256i v, acc_v = _mm256_setzero_si256();
+  uint64_t lanes[4];
+
+  /* 32-bit words zero-extended into 64-bit lanes, no carries lost for
+   * anything shorter than 2^32 words */
+  for (; len >= 32; len -= 32, s += 32, d += 32) {
+    v = _mm256_loadu_si256((const __m256i *) s);
+    if (copy) {
+      _mm256_storeu_si256((__m256i *) d, v);
+    }
+    acc_v = _mm256_add_epi64(acc_v, _mm256_and_si256(v, mask));
+    acc_v = _mm256_add_epi64(acc_v, _mm256_srli_epi64(v, 32));
+  }
+
+  _mm256_storeu_si256((__m256i *) lanes, acc_v);
+  acc += (uint64_t) xsum_fold32(lanes[0]) + xsum_fold32(lanes[1]) +
+    xsum_fold32(lanes[2]) + xsum_fold32(lanes[3]);
+#endif
+
+  for (; len >= 4; len -= 4, s += 4, d += 4) {
+    memcpy(&w32, s, 4);
+    if (copy) {
+      memcpy(d, &w32, 4);
+    }
+    acc += w32;
+  }
+
+  if (len >= 2) {
+    memcpy(&w16, s, 2);
+    if (copy) {
+      memcpy(d, &w16, 2);
+    }
+    acc += w16;
+    len -= 2;
+    s += 2;
+    d += 2;
+  }
+
+  /* trailing byte is padded with a zero byte at the end */
+  if (len > 0) {
+    if (copy) {
+      *d = *s;
+    }
+    w16 = 0;
+    memcpy(&w16, s, 1);
+    acc += w16;
+  }
+
+  return xsum_fold32(acc);
+}
+
+/** Ones' complement sum of `len` bytes at `buf` added to `sum` */
+static inline uint32_t xsum_partial(const void *buf, size_t len, uint32_t sum)
+{
+  return xsum_impl(NULL, buf, len, sum, 0);
+}
+
+/** Copy `len` bytes from `src` to `dst` while adding their ones' complement
+ * sum to `sum`, touching each byte only once */
+static inline uint32_t xsum_copy(void *dst, const void *src, size_t len,
+    uint32_t sum)
+{
+  return xsum_impl(dst, src, len, sum, 1);
+}
+
+/** Add partial sum of a block starting `off` bytes into the summed data, a
+ * block at an odd offset has its bytes swapped relative to the word
+ * boundaries */
+static inline uint32_t xsum_add(uint32_t sum, uint32_t part, size_t off)
+{
+  if ((off & 1) != 0) {
+    part = (part & 0xffff) + (part >> 16);
+    part = (part & 0xffff) + (part >> 16);
+    part = ((part & 0xff) << 8) | (part >> 8);
+  }
+  return xsum_fold32((uint64_t) sum + part);
+}
+
+#endif /* ndef XSUM_H_ */
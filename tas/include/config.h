@@ -27,6 +27,9 @@
 
 #include <stdint.h>
 
+/** Maximum number of network ports (and local IP addresses) */
+#define CONFIG_PORTS_MAX 4
+
 /** Supported congestion control algorithms. */
 enum config_cc_algorithm {
   /** Window-based DCTCP */
@@ -39,6 +42,14 @@ enum config_cc_algorithm {
   CONFIG_CC_CONST_RATE,
 };
 
+/** Supported queue manager backends for rate-limited flows. */
+enum config_qman {
+  /** Skip list sorted by next transmit time */
+  CONFIG_QMAN_SKIPLIST,
+  /** Timing wheel with fixed slot granularity */
+  CONFIG_QMAN_WHEEL,
+};
+
 /** Struct containing the parsed configuration parameters */
 struct configuration {
   /* shared memory size */
@@ -63,10 +74,12 @@ struct configuration {
   uint32_t tcp_handshake_to;
   /** # of retries for dropped handshake packets */
   uint32_t tcp_handshake_retries;
-  /** IP address for this host */
-  uint32_t ip;
-  /** IP prefix length for this host */
-  uint8_t ip_prefix;
+  /** IP addresses for this host, one per network port */
+  uint32_t ip[CONFIG_PORTS_MAX];
+  /** IP prefix lengths for this host */
+  uint8_t ip_prefix[CONFIG_PORTS_MAX];
+  /** Number of IP addresses (and network ports) configured */
+  uint8_t ip_num;
   /** List of routes */
   struct config_route *routes;
   /** Initial ARP timeout in [us] */
@@ -113,6 +126,12 @@ struct configuration {
   uint32_t cc_timely_min_rate;
   /** FP: maximal number of cores used */
   uint32_t fp_cores_max;
+  /** FP: maximal number of concurrent flows */
+  uint32_t fp_flows;
+  /** FP: number of app context slots (including the one reserved) */
+  uint32_t fp_app_ctxs;
+  /** FP: queue manager backend */
+  enum config_qman fp_qman;
   /** FP: interrupts (blocking) enabled */
   uint32_t fp_interrupts;
   /** FP: tcp checksum offload enabled */
@@ -123,10 +142,32 @@ struct configuration {
   uint32_t fp_hugepages;
   /** FP: enable vlan stripping */
   uint32_t fp_vlan_strip;
+  /** FP: place shared memory on the NUMA nodes of its users */
+  uint32_t fp_numa;
   /** FP: polling interval for TAS */
   uint32_t fp_poll_interval_tas;
   /** FP: polling interval for app */
   uint32_t fp_poll_interval_app;
+  /** FP: max payload bytes per TSO segment (0 to disable) */
+  uint32_t fp_tso_max;
+  /** FP: send ACK every fp_ack_segs in-order segments */
+  uint32_t fp_ack_segs;
+  /** FP: max delay for delayed ACKs [us] */
+  uint32_t fp_ack_delay;
+  /** FP: attach payload in app tx buffers to packets instead of copying */
+  uint32_t fp_tx_zerocopy;
+  /** FP: packet buffers in the mempool of each core */
+  uint32_t fp_mbufs;
+  /** FP: packet buffers in the overflow mempool shared by all cores */
+  uint32_t fp_mbufs_shared;
+  /** FP: packet buffers cached per core (power of 2) */
+  uint32_t fp_bufcache;
+  /** FP: NIC receive descriptors per queue */
+  uint32_t fp_rx_descs;
+  /** FP: NIC transmit descriptors per queue */
+  uint32_t fp_tx_descs;
+  /** FP: packets queued per core while the NIC is full (power of 2) */
+  uint32_t fp_txq_len;
   /** SP: kni interface name */
   char *kni_name;
   /** Ready signal fd */
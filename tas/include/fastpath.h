@@ -34,39 +34,114 @@
 #include <utils_rng.h>
 
 #define BATCH_SIZE 16
-#define BUFCACHE_SIZE 128
 #define TXBUF_SIZE (2 * BATCH_SIZE)
+#define ACKTIMER_SIZE 256
+#define FLOW_FWD_RING_SIZE (8 * 1024)
+/** Connection updates held back per app context with a full rx queue */
+#define ARX_OVF_SIZE 64
+/** Initial length of the lists of events waiting for room in a full ring */
+#define FWD_RETRY_SIZE (2 * BATCH_SIZE)
 
 
+struct network_gso;
+struct rte_mbuf_ext_shared_info;
+
+/** Connection updates for an app context that did not fit into its rx
+ * queue, at most one per flow */
+struct arx_ovf {
+  struct flextcp_pl_arx entries[ARX_OVF_SIZE];
+  uint16_t head;
+  uint16_t num;
+};
+
+STATIC_ASSERT(FLEXNIC_PL_APPCTX_MAX <= 64, appctx_bitmap);
+
 struct network_thread {
   struct rte_mempool *pool;
+  struct network_gso *gso;
+  struct rte_mbuf_ext_shared_info *zc_shinfo;
   uint16_t queue_id;
+  /** port polled first on the next receive */
+  uint8_t rx_port;
+
+  /** allocations that got no buffers at all */
+  uint64_t stat_alloc_fails;
+  /** buffers allocated from the shared overflow pool */
+  uint64_t stat_shared_allocs;
 };
 
 /** Skiplist: #levels */
 #define QMAN_SKIPLIST_LEVELS 4
 
+struct qman_wheel;
+struct qman_class;
+struct queue_chunk;
+
 struct qman_thread {
   /************************************/
   /* read-only */
-  struct queue *queues;
+  uint32_t queue_num;
+  /* timing wheel, NULL if skip list is used */
+  struct qman_wheel *wheel;
 
   /************************************/
   /* modified by owner thread */
+  /* queue state in chunks, allocated on first use of a chunk */
+  struct queue_chunk **queue_chunks;
+  /* scheduling classes (one per application) with ready queues */
+  struct qman_class *classes;
   uint32_t head_idx[QMAN_SKIPLIST_LEVELS];
-  uint32_t nolimit_head_idx;
-  uint32_t nolimit_tail_idx;
   uint32_t ts_real;
   uint32_t ts_virtual;
   struct utils_rng rng;
-  bool nolimit_first;
+  /* bitmap of classes with ready queues */
+  uint32_t class_active;
+  /* class currently served by deficit round robin */
+  uint8_t class_cur;
+  /* queues served from priority class in a row */
+  uint16_t prio_burst;
+};
+
+
+/**
+ * Events handed over to the core owning a flow's flow group, stored in the
+ * low bits of the pointer or flow id enqueued on the forwarding ring.
+ */
+enum flow_fwd_type {
+  /** Received packet (mbuf pointer) */
+  FLOW_FWD_PACKET = 0,
+  /** App queue pointer bump (app queue entry pointer) */
+  FLOW_FWD_BUMP = 1,
+  /** Retransmit request from slow path (flow id) */
+  FLOW_FWD_RETRANSMIT = 2,
+  /** Expired delayed ACK (flow id) */
+  FLOW_FWD_DELACK = 3,
 };
+#define FLOW_FWD_TYPE_BITS 2
+#define FLOW_FWD_TYPE_MASK ((1 << FLOW_FWD_TYPE_BITS) - 1)
 
+/** Events waiting for room in another core's ring, grows when full */
+struct fwd_retry {
+  void **ents;
+  uint32_t num;
+  uint32_t len;
+};
+
+/** Pending delayed ACK */
+struct ack_timer {
+  uint32_t flow_id;
+  /** Timestamp when ACK is due */
+  uint32_t ts;
+};
 
 struct dataplane_context {
   struct network_thread net;
   struct qman_thread qman;
   struct rte_ring *qman_fwd_ring;
+  /** Flow states that did not fit into the owner's qman_fwd_ring */
+  struct fwd_retry qman_retry;
+  /** Events for flows owned by this core, one ring per source core */
+  struct rte_ring *flow_fwd_rings[FLEXNIC_PL_APPST_CTX_MCS];
   uint16_t id;
   int evfd;
   struct rte_epoll_event ev;
@@ -77,24 +152,69 @@ struct dataplane_context {
   uint16_t arx_ctx[BATCH_SIZE];
   uint16_t arx_num;
 
+  /* overflow queues, one per app context */
+  struct arx_ovf *arx_ovf;
+  /* bitmap of app contexts with held back updates */
+  uint64_t arx_ovf_pending;
+  /* bitmap of app contexts whose flows do not accept segments until their
+   * overflow queue drains */
+  uint64_t arx_ovf_blocked;
+
   /********************************************************/
   /* send buffer */
   struct network_buf_handle *tx_handles[TXBUF_SIZE];
   uint16_t tx_num;
 
+  /* packets the NIC did not take yet, ring of config.fp_txq_len entries */
+  struct network_buf_handle **txq_handles;
+  uint16_t txq_mask;
+  uint16_t txq_head;
+  uint16_t txq_num;
+
+  /********************************************************/
+  /* delayed acks, ordered by deadline */
+  struct ack_timer acktimers[ACKTIMER_SIZE];
+  uint16_t acktimer_head;
+  uint16_t acktimer_num;
+
   /********************************************************/
   /* polling queues */
   uint32_t poll_next_ctx;
+  /* bitmap of app contexts that rang their doorbell and might have tx queue
+   * entries */
+  uint64_t actx_txpend;
+  /* bitmap of app contexts with at most half of their rx queue known free */
+  uint64_t actx_rxlow;
+  /* app queue entries to forward once the owner's ring has room again, in
+   * order, no further bumps are processed before these */
+  struct fwd_retry bump_retry;
 
   /********************************************************/
-  /* pre-allocated buffers for polling doorbells and queue manager */
-  struct network_buf_handle *bufcache_handles[BUFCACHE_SIZE];
+  /* pre-allocated buffers for polling doorbells and queue manager, ring of
+   * config.fp_bufcache entries */
+  struct network_buf_handle **bufcache_handles;
+  uint16_t bufcache_mask;
   uint16_t bufcache_num;
   uint16_t bufcache_head;
+  /* preallocations served from the cache / needing a refill */
+  uint64_t bufcache_hits;
+  uint64_t bufcache_misses;
 
   uint64_t loadmon_cyc_busy;
 
+  /********************************************************/
+  /* progress of the main loop, read by the slow path to wait until this core
+   * is done with events it might have started before a flow state change */
+  volatile uint32_t loop_epoch;
+  volatile uint8_t blocked;
+
   uint64_t kernel_drop;
+  /* received segments dropped for bad checksums */
+  uint64_t xsum_drop;
+  /* flushes where the NIC did not take all packets */
+  uint64_t tx_stalls;
+  /* packets dropped because the software tx queue was full */
+  uint64_t tx_drops;
 #ifdef DATAPLANE_STATS
   /********************************************************/
   /* Stats */
@@ -110,6 +230,9 @@ struct dataplane_context {
   uint64_t stat_qs_empty;
   uint64_t stat_qs_total;
 
+  uint64_t stat_fwd_out;
+  uint64_t stat_fwd_in;
+
   uint64_t stat_cyc_db;
   uint64_t stat_cyc_qm;
   uint64_t stat_cyc_rx;
@@ -123,6 +246,9 @@ int dataplane_init(void);
 int dataplane_context_init(struct dataplane_context *ctx);
 void dataplane_context_destroy(struct dataplane_context *ctx);
 void dataplane_loop(struct dataplane_context *ctx);
+void dataplane_flowgroup_quiesce(uint16_t flow_group);
+/** Build transmit header template for a flow once its state is filled in */
+void fast_flows_hdr_init(uint32_t flow_id, uint8_t port);
 #ifdef DATAPLANE_STATS
 void dataplane_dump_stats(void);
 #endif
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Bucketized cuckoo flow lookup table, shared between the slow path (single
+ * writer) and the fast path cores (lock-free readers).
+ *
+ * Every flow hashes to two buckets of FLEXNIC_PL_FLOWHT_WAYS entries, the
+ * second one derived from the first and the 16-bit signature, so entries can
+ * be moved between their two buckets without knowing the full hash. Readers
+ * compare the signatures of both buckets with one vector compare, verify
+ * candidates against the 4-tuple in the flow state, and retry if the writer
+ * changed one of the buckets in the meantime (version counter).
+ */
+
+#ifndef FLOWHT_H_
+#define FLOWHT_H_
+
+#include <stdint.h>
+#include <immintrin.h>
+#include <tas_memif.h>
+
+/** CRC32 hash over flow 4-tuple */
+static inline uint32_t flowht_hash(beui32_t lip, beui32_t rip, beui16_t lp,
+    beui16_t rp)
+{
+  uint32_t h;
+  h = _mm_crc32_u64(0, lip.x | (((uint64_t) rip.x) << 32));
+  return _mm_crc32_u32(h, lp.x | (((uint32_t) rp.x) << 16));
+}
+
+/** Signature for hash, never 0 (marks empty entries) */
+static inline uint16_t flowht_sig(uint32_t h)
+{
+  uint16_t sig = h >> 16;
+  return sig + (sig == 0);
+}
+
+/** Primary bucket for hash, `mask` is the number of buckets - 1 */
+static inline uint32_t flowht_bucket(uint32_t h, uint32_t mask)
+{
+  return h & mask;
+}
+
+/** Other bucket for an entry with signature `sig` in bucket `b` */
+static inline uint32_t flowht_alt(uint32_t b, uint16_t sig, uint32_t mask)
+{
+  return (b ^ (((sig * 0x5bd1e995U) >> 17) | 1)) & mask;
+}
+
+/** Bit mask of ways in bucket with matching signature */
+static inline uint32_t flowht_match(const struct flextcp_pl_flowhtb *b,
+    uint16_t sig)
+{
+  __m128i c = _mm_cmpeq_epi16(_mm_load_si128((const __m128i *) b->sig),
+      _mm_set1_epi16(sig));
+  /* narrow to one byte per way */
+  return _mm_movemask_epi8(_mm_packs_epi16(c, _mm_setzero_si128()));
+}
+
+/** Bit masks of matching ways in both buckets (low and high 8 bits) */
+static inline uint32_t flowht_match2(const struct flextcp_pl_flowhtb *b1,
+    const struct flextcp_pl_flowhtb *b2, uint16_t sig)
+{
+#ifdef __AVX2__
+  __m256i s = _mm256_set_m128i(_mm_load_si128((const __m128i *) b2->sig),
+      _mm_load_si128((const __m128i *) b1->sig));
+  __m256i c = _mm256_cmpeq_epi16(s, _mm256_set1_epi16(sig));
+  /* packing works per lane: b1 ways end up in bits 0-7, b2 in 16-23 */
+  uint32_t m = _mm256_movemask_epi8(_mm256_packs_epi16(c,
+        _mm256_setzero_si256()));
+  return (m & 0xff) | ((m >> 8) & 0xff00);
+#else
+  return flowht_match(b1, sig) | (flowht_match(b2, sig) << 8);
+#endif
+}
+
+static inline uint32_t flowht_read_begin(const struct flextcp_pl_flowhtb *b)
+{
+  uint32_t v;
+
+  while (((v = b->version) & 1) != 0) {
+    _mm_pause();
+  }
+  MEM_BARRIER();
+  return v;
+}
+
+static inline int flowht_read_retry(const struct flextcp_pl_flowhtb *b,
+    uint32_t v)
+{
+  MEM_BARRIER();
+  return b->version != v;
+}
+
+/**
+ * Look up flow id for 4-tuple.
+ *
+ * @param ht    Table buckets
+ * @param mask  Number of buckets - 1
+ * @param fst   Flow states to verify candidates against
+ * @param h     Hash from flowht_hash()
+ *
+ * @return Flow id, or -1 if not found.
+ */
+static inline int32_t flowht_lookup(const struct flextcp_pl_flowhtb *ht,
+    uint32_t mask, const struct flextcp_pl_flowst *fst, uint32_t h,
+    beui32_t lip, beui32_t rip, beui16_t lp, beui16_t rp)
+{
+  const struct flextcp_pl_flowhtb *b1, *b2, *b;
+  const struct flextcp_pl_flowst *fs;
+  uint32_t v1, v2, m, i, fid;
+  uint16_t sig = flowht_sig(h);
+  int32_t res;
+
+  i = flowht_bucket(h, mask);
+  b1 = &ht[i];
+  b2 = &ht[flowht_alt(i, sig, mask)];
+
+  do {
+    v1 = flowht_read_begin(b1);
+    v2 = flowht_read_begin(b2);
+
+    res = -1;
+    m = flowht_match2(b1, b2, sig);
+    while (m != 0) {
+      i = __builtin_ctz(m);
+      m &= m - 1;
+      b = (i < FLEXNIC_PL_FLOWHT_WAYS ? b1 : b2);
+      fid = b->flow_id[i % FLEXNIC_PL_FLOWHT_WAYS];
+
+      fs = &fst[fid];
+      if ((fs->local_ip.x == lip.x) & (fs->remote_ip.x == rip.x) &
+          (fs->local_port.x == lp.x) & (fs->remote_port.x == rp.x))
+      {
+        res = fid;
+        break;
+      }
+    }
+  } while (flowht_read_retry(b1, v1) | flowht_read_retry(b2, v2));
+
+  return res;
+}
+
+/* slow path writer, see slow/flowht.c */
+int flowht_insert(struct flextcp_pl_flowhtb *ht, uint32_t mask, uint32_t h,
+    uint32_t flow_id);
+int flowht_remove(struct flextcp_pl_flowhtb *ht, uint32_t mask, uint32_t h,
+    uint32_t flow_id);
+
+#endif /* ndef FLOWHT_H_ */
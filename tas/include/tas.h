@@ -38,11 +38,14 @@ extern struct configuration config;
 extern void *tas_shm;
 extern struct flextcp_pl_mem *fp_state;
 extern struct flexnic_info *tas_info;
-#if RTE_VER_YEAR < 19
-  extern struct ether_addr eth_addr;
-#else
-  extern struct rte_ether_addr eth_addr;
-#endif
+/** Number of NUMA nodes the DMA memory is split across, 1 unless fp_numa */
+extern unsigned tas_shm_nodes;
+/** Bytes of DMA memory per NUMA node, the last node also gets the rest */
+extern size_t tas_shm_node_len;
+/** NUMA node each fast path core runs on */
+extern uint8_t fp_core_nodes[FLEXNIC_PL_APPST_CTX_MCS];
+/** MAC addresses of the network ports, indexed like config.ip */
+extern struct eth_addr eth_addrs[CONFIG_PORTS_MAX];
 extern unsigned fp_cores_max;
 
 
@@ -66,14 +69,10 @@ struct notify_blockstate {
 };
 
 void notify_fastpath_core(unsigned core);
-void notify_appctx(struct flextcp_pl_appctx *ctx, uint64_t tsc);
+void notify_appctx(struct flextcp_pl_appctx *ctx);
 void notify_app_core(int appfd, uint64_t *last_tsc);
 void notify_slowpath_core(void);
 int notify_canblock(struct notify_blockstate *nbs, int had_data, uint64_t tsc);
 void notify_canblock_reset(struct notify_blockstate *nbs);
 
-/* should become config options */
-#define FLEXNIC_INTERNAL_MEM_SIZE (1024 * 1024 * 32)
-#define FLEXNIC_NUM_QMQUEUES (128 * 1024)
-
 #endif /* ndef TAS_H_ */
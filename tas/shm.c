@@ -33,6 +33,7 @@
 #include <errno.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <numa.h>
 
 #include <utils.h>
 #include <rte_config.h>
@@ -45,7 +46,40 @@
 void *tas_shm = NULL;
 struct flextcp_pl_mem *fp_state = NULL;
 struct flexnic_info *tas_info = NULL;
-
+unsigned tas_shm_nodes = 1;
+size_t tas_shm_node_len = 0;
+
+/** Page size of the shared memory regions with huge pages enabled */
+#define SHM_HUGE_PGSIZE (2 * 1024 * 1024)
+
+/** NUMA placement of a shared memory region */
+enum shm_numa {
+  /** Default policy, pages end up on the node of the thread clearing them */
+  SHM_NUMA_NONE,
+  /** Split into tas_shm_nodes parts of tas_shm_node_len bytes, one per
+   * node */
+  SHM_NUMA_SPLIT,
+  /** Pages interleaved across all nodes */
+  SHM_NUMA_INTERLEAVE,
+};
+
+/* layout of internal memory region, sized by number of flows */
+static struct {
+  size_t size;
+  uint32_t flowht_buckets;
+  uint64_t flowst_off;
+  uint64_t flowst_cold_off;
+  uint64_t flowst_ooo_off;
+  uint64_t flowst_sack_off;
+  uint64_t flowst_hdr_off;
+  uint64_t flowht_off;
+  uint64_t appctx_off;
+} int_layout;
+
+/* create shared memory region with pages placed according to `numa` */
+static void *create_shm(const char *name, size_t size, enum shm_numa numa);
+/* determine number of NUMA nodes to split the DMA memory across */
+static int numa_setup(void);
 /* destroy shared memory region */
 static void destroy_shm(const char *name, size_t size, void *addr);
 /* create shared memory region using huge pages */
@@ -56,36 +90,36 @@ static void destroy_shm_huge(const char *name, size_t size, void *addr)
     __attribute__((used));
 /* convert microseconds to cycles */
 static uint64_t us_to_cycles(uint32_t us);
+/* calculate layout of internal memory and set up pointers into it */
+static void internal_layout(void);
+static void internal_pointers(void);
 
 /* Allocate DMA memory before DPDK grabs all huge pages */
 int shm_preinit(void)
 {
-  /* create shm for dma memory */
-  if (config.fp_hugepages) {
-    tas_shm = util_create_shmsiszed_huge(FLEXNIC_NAME_DMA_MEM,
-        config.shm_len, NULL);
-  } else {
-    tas_shm = util_create_shmsiszed(FLEXNIC_NAME_DMA_MEM, config.shm_len,
-        NULL);
+  if (config.fp_numa && numa_setup() != 0) {
+    return -1;
   }
+
+  /* create shm for dma memory */
+  tas_shm = create_shm(FLEXNIC_NAME_DMA_MEM, config.shm_len,
+      (tas_shm_nodes > 1 ? SHM_NUMA_SPLIT : SHM_NUMA_NONE));
   if (tas_shm == NULL) {
     fprintf(stderr, "mapping flexnic dma memory failed\n");
     return -1;
   }
 
-  /* create shm for internal memory */
-  if (config.fp_hugepages) {
-    fp_state = util_create_shmsiszed_huge(FLEXNIC_NAME_INTERNAL_MEM,
-        FLEXNIC_INTERNAL_MEM_SIZE, NULL);
-  } else {
-    fp_state = util_create_shmsiszed(FLEXNIC_NAME_INTERNAL_MEM,
-        FLEXNIC_INTERNAL_MEM_SIZE, NULL);
-  }
+  /* create shm for internal memory, all fast path cores access flow state
+   * so spread it evenly */
+  internal_layout();
+  fp_state = create_shm(FLEXNIC_NAME_INTERNAL_MEM, int_layout.size,
+      (tas_shm_nodes > 1 ? SHM_NUMA_INTERLEAVE : SHM_NUMA_NONE));
   if (fp_state == NULL) {
     fprintf(stderr, "mapping flexnic internal memory failed\n");
     shm_cleanup();
     return -1;
   }
+  internal_pointers();
 
   return 0;
 }
@@ -103,9 +137,19 @@ int shm_init(unsigned num)
   }
 
   tas_info->dma_mem_size = config.shm_len;
-  tas_info->internal_mem_size = FLEXNIC_INTERNAL_MEM_SIZE;
-  tas_info->qmq_num = FLEXNIC_NUM_QMQUEUES;
+  tas_info->internal_mem_size = int_layout.size;
+  tas_info->qmq_num = config.fp_flows;
   tas_info->cores_num = num;
+  tas_info->flowst_num = config.fp_flows;
+  tas_info->flowht_buckets = int_layout.flowht_buckets;
+  tas_info->flowst_off = int_layout.flowst_off;
+  tas_info->flowst_cold_off = int_layout.flowst_cold_off;
+  tas_info->flowst_ooo_off = int_layout.flowst_ooo_off;
+  tas_info->flowst_sack_off = int_layout.flowst_sack_off;
+  tas_info->flowst_hdr_off = int_layout.flowst_hdr_off;
+  tas_info->flowht_off = int_layout.flowht_off;
+  tas_info->appctx_num = config.fp_app_ctxs;
+  tas_info->appctx_off = int_layout.appctx_off;
   tas_info->mac_address = 0;
   tas_info->poll_cycle_app = us_to_cycles(config.fp_poll_interval_app);
   tas_info->poll_cycle_tas = us_to_cycles(config.fp_poll_interval_tas);
@@ -121,11 +165,9 @@ void shm_cleanup(void)
   /* cleanup internal memory region */
   if (fp_state != NULL) {
     if (config.fp_hugepages) {
-      destroy_shm_huge(FLEXNIC_NAME_INTERNAL_MEM, FLEXNIC_INTERNAL_MEM_SIZE,
-          fp_state);
+      destroy_shm_huge(FLEXNIC_NAME_INTERNAL_MEM, int_layout.size, fp_state);
     } else {
-      destroy_shm(FLEXNIC_NAME_INTERNAL_MEM, FLEXNIC_INTERNAL_MEM_SIZE,
-          fp_state);
+      destroy_shm(FLEXNIC_NAME_INTERNAL_MEM, int_layout.size, fp_state);
     }
   }
 
@@ -183,6 +225,94 @@ error_out:
   return NULL;
 }
 
+static void *create_shm(const char *name, size_t size, enum shm_numa numa)
+{
+  int fd;
+  unsigned i;
+  size_t len;
+  void *p;
+  char path[128];
+
+  if (numa == SHM_NUMA_NONE) {
+    return (config.fp_hugepages ? util_create_shmsiszed_huge(name, size, NULL)
+        : util_create_shmsiszed(name, size, NULL));
+  }
+
+  if (config.fp_hugepages) {
+    snprintf(path, sizeof(path), "%s/%s", FLEXNIC_HUGE_PREFIX, name);
+    fd = open(path, O_CREAT | O_RDWR, 0666);
+  } else {
+    fd = shm_open(name, O_CREAT | O_RDWR, 0666);
+  }
+  if (fd == -1) {
+    perror("create_shm: open failed");
+    return NULL;
+  }
+  if (ftruncate(fd, size) != 0) {
+    perror("create_shm: ftruncate failed");
+    goto error_remove;
+  }
+
+  /* no MAP_POPULATE: the policy has to be set before pages are allocated */
+  if ((p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) ==
+      (void *) -1)
+  {
+    perror("create_shm: mmap failed");
+    goto error_remove;
+  }
+
+  if (numa == SHM_NUMA_SPLIT) {
+    for (i = 0; i < tas_shm_nodes; i++) {
+      len = (i == tas_shm_nodes - 1 ? size - i * tas_shm_node_len :
+          tas_shm_node_len);
+      numa_tonode_memory((uint8_t *) p + i * tas_shm_node_len, len, i);
+    }
+  } else {
+    numa_interleave_memory(p, size, numa_all_nodes_ptr);
+  }
+
+  /* fault in all pages on their nodes */
+  memset(p, 0, size);
+
+  close(fd);
+  return p;
+
+error_remove:
+  close(fd);
+  if (config.fp_hugepages) {
+    unlink(path);
+  } else {
+    shm_unlink(name);
+  }
+  return NULL;
+}
+
+static int numa_setup(void)
+{
+  int nodes;
+
+  if (numa_available() < 0) {
+    fprintf(stderr, "Warning: NUMA not available, ignoring --fp-numa\n");
+    return 0;
+  }
+
+  nodes = numa_num_configured_nodes();
+  if (nodes <= 1) {
+    return 0;
+  }
+
+  /* parts need to be page aligned to bind them separately */
+  tas_shm_node_len = (config.shm_len / nodes) & ~(SHM_HUGE_PGSIZE - 1ULL);
+  if (tas_shm_node_len == 0) {
+    fprintf(stderr, "numa_setup: shared memory too small to split across %d "
+        "nodes\n", nodes);
+    return -1;
+  }
+
+  tas_shm_nodes = nodes;
+  return 0;
+}
+
 static void destroy_shm(const char *name, size_t size, void *addr)
 {
   if (munmap(addr, size) != 0) {
@@ -250,3 +380,66 @@ static uint64_t us_to_cycles(uint32_t us)
   return (rte_get_tsc_hz() * us) / 1000000;
 }
 
+/* reserve cache-aligned array of `len` bytes at end of layout */
+static uint64_t internal_alloc(size_t len)
+{
+  uint64_t off = (int_layout.size + 63) & ~63ULL;
+  int_layout.size = off + len;
+  return off;
+}
+
+static void internal_layout(void)
+{
+  uint32_t n = config.fp_flows, nb;
+
+  /* at least twice as many table entries as flows, power of 2 buckets */
+  for (nb = 1; (uint64_t) nb * FLEXNIC_PL_FLOWHT_WAYS < 2ULL * n; nb *= 2);
+
+  int_layout.size = sizeof(struct flextcp_pl_mem);
+  int_layout.flowht_buckets = nb;
+  int_layout.flowst_off =
+      internal_alloc(n * sizeof(struct flextcp_pl_flowst));
+  int_layout.flowst_cold_off =
+      internal_alloc(n * sizeof(struct flextcp_pl_flowst_cold));
+#ifdef FLEXNIC_PL_OOO_RECV
+  int_layout.flowst_ooo_off =
+      internal_alloc(n * sizeof(struct flextcp_pl_flowst_ooo));
+#endif
+  int_layout.flowst_sack_off =
+      internal_alloc(n * sizeof(struct flextcp_pl_flowst_sack));
+  int_layout.flowst_hdr_off =
+      internal_alloc(n * sizeof(struct flextcp_pl_flowst_hdr));
+  int_layout.flowht_off =
+      internal_alloc(nb * sizeof(struct flextcp_pl_flowhtb));
+  int_layout.appctx_off =
+      internal_alloc(MIN(config.fp_cores_max, FLEXNIC_PL_APPST_CTX_MCS) *
+          config.fp_app_ctxs * sizeof(struct flextcp_pl_appctx));
+
+  /* round up to huge page size */
+  int_layout.size = (int_layout.size + (SHM_HUGE_PGSIZE - 1)) &
+      ~(SHM_HUGE_PGSIZE - 1ULL);
+}
+
+static void internal_pointers(void)
+{
+  uint8_t *base = (uint8_t *) fp_state;
+  struct flextcp_pl_appctx *appctx;
+  uint32_t i;
+
+  fp_state->flowst = (void *) (base + int_layout.flowst_off);
+  fp_state->flowst_cold = (void *) (base + int_layout.flowst_cold_off);
+#ifdef FLEXNIC_PL_OOO_RECV
+  fp_state->flowst_ooo = (void *) (base + int_layout.flowst_ooo_off);
+#endif
+  fp_state->flowst_sack = (void *) (base + int_layout.flowst_sack_off);
+  fp_state->flowst_hdr = (void *) (base + int_layout.flowst_hdr_off);
+  fp_state->flowht = (void *) (base + int_layout.flowht_off);
+  fp_state->flowst_num = config.fp_flows;
+  fp_state->flowht_mask = int_layout.flowht_buckets - 1;
+
+  appctx = (void *) (base + int_layout.appctx_off);
+  for (i = 0; i < MIN(config.fp_cores_max, FLEXNIC_PL_APPST_CTX_MCS); i++) {
+    fp_state->appctx[i] = appctx + i * config.fp_app_ctxs;
+  }
+  fp_state->appctx_num = config.fp_app_ctxs;
+}
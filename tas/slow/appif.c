@@ -107,7 +107,7 @@ int appif_init(void)
   }
 
   /* create freelist of doorbells (0 is used by kernel) */
-  for (i = FLEXNIC_PL_APPST_CTX_NUM; i > 0; i--) {
+  for (i = config.fp_app_ctxs - 1; i > 0; i--) {
     if ((adb = malloc(sizeof(*adb))) == NULL) {
       perror("appif_init: malloc doorbell failed");
       return -1;
@@ -157,7 +157,8 @@ unsigned appif_poll(void)
       }
 
       if (nicif_appctx_add(app->id, ctx->doorbell->id, rxq_offs,
-            app->req.rxq_len, txq_offs, app->req.txq_len, ctx->evfd) != 0)
+            app->req.rxq_len, txq_offs, app->req.txq_len, ctx->evfd,
+            app->resp->sleep_off, app->resp->txdb_off) != 0)
       {
         fprintf(stderr, "appif_poll: registering context failed\n");
         uxsocket_error(app);
@@ -433,8 +434,8 @@ static void uxsocket_receive(struct application *app)
 {
   ssize_t rx;
   struct app_context *ctx;
-  struct packetmem_handle *pm_in, *pm_out;
-  uintptr_t off_in, off_out, off_rxq, off_txq;
+  struct packetmem_handle *pm_in, *pm_out, *pm_sleep, *pm_txdb;
+  uintptr_t off_in, off_out, off_rxq, off_txq, off_sleep, off_txdb;
   size_t kin_qsize, kout_qsize, ctx_sz;
   struct epoll_event ev;
   uint16_t i;
@@ -491,25 +492,44 @@ static void uxsocket_receive(struct application *app)
   kout_qsize = config.app_kout_len;
 
   /* allocate packet memory for kernel queues */
-  if (packetmem_alloc(kin_qsize, &off_in, &pm_in) != 0) {
+  if (packetmem_alloc_node(kin_qsize, app->req.numa_node, &off_in, &pm_in)
+      != 0)
+  {
     fprintf(stderr, "uxsocket_receive: packetmem_alloc in failed\n");
     goto error_pktmem_in;
   }
-  if (packetmem_alloc(kout_qsize, &off_out, &pm_out) != 0) {
+  if (packetmem_alloc_node(kout_qsize, app->req.numa_node, &off_out, &pm_out)
+      != 0)
+  {
     fprintf(stderr, "uxsocket_receive: packetmem_alloc out failed\n");
     goto error_pktmem_out;
   }
+  /* sleeping flag gets its own cache line, the app writes it on every wait */
+  if (packetmem_alloc_node(64, app->req.numa_node, &off_sleep, &pm_sleep)
+      != 0)
+  {
+    fprintf(stderr, "uxsocket_receive: packetmem_alloc sleep failed\n");
+    goto error_pktmem_sleep;
+  }
+  if (packetmem_alloc_node(tas_info->cores_num * KERNEL_TXDB_STRIDE,
+        app->req.numa_node, &off_txdb, &pm_txdb) != 0)
+  {
+    fprintf(stderr, "uxsocket_receive: packetmem_alloc txdb failed\n");
+    goto error_pktmem_txdb;
+  }
+  memset((uint8_t *) tas_shm + off_txdb, 0,
+      tas_info->cores_num * KERNEL_TXDB_STRIDE);
 
   /* allocate packet memory for flexnic queues */
   for (i = 0; i < tas_info->cores_num; i++) {
-    if (packetmem_alloc(app->req.rxq_len, &off_rxq, &ctx->handles[i].rxq)
-        != 0)
+    if (packetmem_alloc_node(app->req.rxq_len, app->req.numa_node, &off_rxq,
+          &ctx->handles[i].rxq) != 0)
     {
       fprintf(stderr, "uxsocket_receive: packetmem_alloc rxq failed\n");
       goto error_pktmem;
     }
-    if (packetmem_alloc(app->req.txq_len, &off_txq, &ctx->handles[i].txq)
-        != 0)
+    if (packetmem_alloc_node(app->req.txq_len, app->req.numa_node, &off_txq,
+          &ctx->handles[i].txq) != 0)
     {
       fprintf(stderr, "uxsocket_receive: packetmem_alloc txq failed\n");
       packetmem_free(ctx->handles[i].rxq);
@@ -544,6 +564,11 @@ static void uxsocket_receive(struct application *app)
   ctx->kout_pos = 0;
   memset(ctx->kout_base, 0, kout_qsize);
 
+  ctx->sleep_handle = pm_sleep;
+  ctx->sleeping = (uint32_t *) ((uint8_t *) tas_shm + off_sleep);
+  *ctx->sleeping = 0;
+  ctx->txdb_handle = pm_txdb;
+
   ctx->ready = 0;
   assert(evfd != 0);	// XXX: Will be 0 if request was broken up
   ctx->evfd = evfd;
@@ -557,6 +582,8 @@ static void uxsocket_receive(struct application *app)
   app->resp->app_out_len = kin_qsize;
   app->resp->app_in_off = off_out;
   app->resp->app_in_len = kout_qsize;
+  app->resp->sleep_off = off_sleep;
+  app->resp->txdb_off = off_txdb;
   app->resp->flexnic_db_id = ctx->doorbell->id;
   app->resp->flexnic_qs_num = tas_info->cores_num;
   app->resp->status = 0;
@@ -592,6 +619,10 @@ static void uxsocket_receive(struct application *app)
 error_dballoc:
   /* TODO: for () packetmem_free(ctx->txq_handle) */
 error_pktmem:
+  packetmem_free(pm_txdb);
+error_pktmem_txdb:
+  packetmem_free(pm_sleep);
+error_pktmem_sleep:
   packetmem_free(pm_out);
 error_pktmem_out:
   packetmem_free(pm_in);
@@ -51,6 +51,10 @@ struct app_context {
 
   struct app_doorbell *doorbell;
 
+  struct packetmem_handle *sleep_handle;
+  uint32_t *sleeping;
+  struct packetmem_handle *txdb_handle;
+
   int ready, evfd;
   uint64_t last_ts;
   struct app_context *next;
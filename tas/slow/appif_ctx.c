@@ -47,6 +47,10 @@ static int kin_accept_conn(struct application *app, struct app_context *ctx,
     volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
 static int kin_req_scale(struct application *app, struct app_context *ctx,
     volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
+static int kin_set_weight(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
+static int kin_conn_prio(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
 
 static void appif_ctx_kick(struct app_context *ctx)
 {
@@ -78,7 +82,7 @@ void appif_conn_opened(struct connection *c, int status)
 
     kout->data.conn_opened.seq_rx = c->remote_seq;
     kout->data.conn_opened.seq_tx = c->local_seq;
-    kout->data.conn_opened.local_ip = config.ip;
+    kout->data.conn_opened.local_ip = c->local_ip;
     kout->data.conn_opened.local_port = c->local_port;
     kout->data.conn_opened.flow_id = c->flow_id;
     kout->data.conn_opened.fn_core = c->fn_core;
@@ -195,7 +199,7 @@ void appif_accept_conn(struct connection *c, int status)
 
     kout->data.accept_connection.seq_rx = c->remote_seq;
     kout->data.accept_connection.seq_tx = c->local_seq;
-    kout->data.accept_connection.local_ip = config.ip;
+    kout->data.accept_connection.local_ip = c->local_ip;
     kout->data.accept_connection.remote_ip = c->remote_ip;
     kout->data.accept_connection.remote_port = c->remote_port;
     kout->data.accept_connection.flow_id = c->flow_id;
@@ -274,6 +278,16 @@ unsigned appif_ctx_poll(struct application *app, struct app_context *ctx)
       kout_inc += kin_req_scale(app, ctx, kin, kout);
       break;
 
+    case KERNEL_APPOUT_SET_WEIGHT:
+      /* transmit scheduling weight */
+      kout_inc += kin_set_weight(app, ctx, kin, kout);
+      break;
+
+    case KERNEL_APPOUT_CONN_PRIO:
+      /* connection priority */
+      kout_inc += kin_conn_prio(app, ctx, kin, kout);
+      break;
+
     case KERNEL_APPOUT_LISTEN_CLOSE:
     default:
       fprintf(stderr, "kin_poll: unsupported request type %u\n", kin->type);
@@ -498,3 +512,42 @@ static int kin_req_scale(struct application *app, struct app_context *ctx,
 
   return 0;
 }
+
+static int kin_set_weight(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout)
+{
+  if (nicif_app_weight(app->id, kin->data.set_weight.weight,
+        kin->data.set_weight.max_rate) != 0)
+  {
+    fprintf(stderr, "kin_set_weight: nicif_app_weight failed\n");
+  }
+
+  return 0;
+}
+
+static int kin_conn_prio(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout)
+{
+  struct connection *conn;
+
+  for (conn = app->conns; conn != NULL; conn = conn->app_next) {
+    if (conn->local_ip == kin->data.conn_prio.local_ip &&
+        conn->remote_ip == kin->data.conn_prio.remote_ip &&
+        conn->local_port == kin->data.conn_prio.local_port &&
+        conn->remote_port == kin->data.conn_prio.remote_port &&
+        conn->opaque == kin->data.conn_prio.opaque)
+    {
+      break;
+    }
+  }
+  if (conn == NULL) {
+    fprintf(stderr, "kin_conn_prio: connection not found\n");
+    return 0;
+  }
+
+  if (nicif_connection_prio(conn->flow_id, kin->data.conn_prio.prio) != 0) {
+    fprintf(stderr, "kin_conn_prio: nicif_connection_prio failed\n");
+  }
+
+  return 0;
+}
@@ -40,6 +40,7 @@ struct arp_entry {
     int status;
     uint32_t ip;
     uint8_t mac[ETH_ADDR_LEN];
+    uint8_t port;
     struct nicif_completion *compl;
 
     uint32_t timeout;
@@ -49,8 +50,9 @@ struct arp_entry {
     struct arp_entry *next;
 };
 
-static inline int response_tx(const void *dst_mac, uint32_t dst_ip);
-static inline int request_tx(uint32_t dst_ip);
+static inline int response_tx(const void *dst_mac, uint32_t dst_ip,
+    uint8_t port);
+static inline int request_tx(uint32_t dst_ip, uint8_t port);
 static inline struct arp_entry *ae_lookup(uint32_t ip);
 
 static struct arp_entry *arp_table = NULL;
@@ -58,27 +60,38 @@ static struct arp_entry *arp_table = NULL;
 int arp_init(void)
 {
   uint64_t mac;
-  struct arp_entry *lb = malloc(sizeof(struct arp_entry));
-  assert(lb != NULL);
-
-  lb->status = 0;
-  lb->ip = config.ip;
-  memcpy(lb->mac, &eth_addr, ETH_ADDR_LEN);
-  lb->compl = NULL;
-  lb->next = NULL;
-  lb->prev = NULL;
-  arp_table = lb;
+  uint8_t i;
+  struct arp_entry *lb;
+
+  /* static entries for the local address of each port */
+  for (i = 0; i < config.ip_num; i++) {
+    lb = malloc(sizeof(struct arp_entry));
+    assert(lb != NULL);
+
+    lb->status = 0;
+    lb->ip = config.ip[i];
+    memcpy(lb->mac, &eth_addrs[i], ETH_ADDR_LEN);
+    lb->port = i;
+    lb->compl = NULL;
+    lb->prev = NULL;
+    lb->next = arp_table;
+    if (arp_table != NULL) {
+      arp_table->prev = lb;
+    }
+    arp_table = lb;
 
-  mac = 0;
-  memcpy(&mac, &eth_addr, ETH_ADDR_LEN);
+    mac = 0;
+    memcpy(&mac, &eth_addrs[i], ETH_ADDR_LEN);
 
-  if (!config.quiet)
-    printf("host ip: %x MAC: %lx\n", config.ip, mac);
+    if (!config.quiet)
+      printf("host ip: %x MAC: %lx port: %u\n", config.ip[i], mac, i);
+  }
 
   return 0;
 }
 
-int arp_request(struct nicif_completion *comp, uint32_t ip, uint64_t *mac)
+int arp_request(struct nicif_completion *comp, uint32_t ip, uint8_t port,
+    uint64_t *mac)
 {
   struct arp_entry *ae;
 
@@ -108,12 +121,13 @@ int arp_request(struct nicif_completion *comp, uint32_t ip, uint64_t *mac)
 
   ae->status = 1;
   ae->ip = ip;
+  ae->port = port;
   ae->compl = comp;
   comp->el.next = NULL;
   comp->ptr = mac;
 
   /* send out request */
-  if (request_tx(ip) != 0) {
+  if (request_tx(ip, port) != 0) {
     /* timeout will take care of re-trying */
     fprintf(stderr, "arp_timeout: sending out request failed\n");
   }
@@ -135,7 +149,7 @@ int arp_request(struct nicif_completion *comp, uint32_t ip, uint64_t *mac)
   return 1;
 }
 
-void arp_packet(const void *pkt, uint16_t len)
+void arp_packet(const void *pkt, uint16_t len, uint8_t port)
 {
   const struct pkt_arp *parp = pkt;
   const struct arp_hdr *arp = &parp->arp;
@@ -159,13 +173,13 @@ void arp_packet(const void *pkt, uint16_t len)
   if (op == ARP_OPER_REQUEST) {
     /* handle ARP request */
     ARP_DEBUG("arp request received (%x)\n", f_beui32(arp->spa));
-    if (f_beui32(arp->tpa) != config.ip) {
+    if (port >= config.ip_num || f_beui32(arp->tpa) != config.ip[port]) {
       /* ARP request not for me */
       return;
     }
 
     /* send response */
-    if (response_tx(&arp->sha, f_beui32(arp->spa)) != 0) {
+    if (response_tx(&arp->sha, f_beui32(arp->spa), port) != 0) {
       fprintf(stderr, "arp_packet: sending response failed\n");
       return;
     }
@@ -259,7 +273,7 @@ void arp_timeout(struct timeout *to, enum timeout_type type)
   }
 
   /* send out another request */
-  if (request_tx(ae->ip) != 0) {
+  if (request_tx(ae->ip, ae->port) != 0) {
     fprintf(stderr, "arp_timeout: sending out request failed\n");
   }
 
@@ -268,22 +282,25 @@ void arp_timeout(struct timeout *to, enum timeout_type type)
   util_timeout_arm(&timeout_mgr, &ae->to, ae->timeout, TO_ARP_REQ);
 }
 
-static inline int response_tx(const void *dst_mac, uint32_t dst_ip)
+static inline int response_tx(const void *dst_mac, uint32_t dst_ip,
+    uint8_t port)
 {
   struct pkt_arp *parp_out;
   uint32_t new_tail;
 
   /* allocate tx buffer */
-  if (nicif_tx_alloc(sizeof(*parp_out), (void **) &parp_out, &new_tail) != 0) {
+  if (nicif_tx_alloc(sizeof(*parp_out), port, (void **) &parp_out, &new_tail)
+      != 0)
+  {
     return -1;
   }
 
   /* fill in response */
-  memcpy(&parp_out->eth.src, &eth_addr, ETH_ADDR_LEN);
-  memcpy(&parp_out->arp.sha, &eth_addr, ETH_ADDR_LEN);
+  memcpy(&parp_out->eth.src, &eth_addrs[port], ETH_ADDR_LEN);
+  memcpy(&parp_out->arp.sha, &eth_addrs[port], ETH_ADDR_LEN);
   memcpy(&parp_out->eth.dest, dst_mac, ETH_ADDR_LEN);
   memcpy(&parp_out->arp.tha, dst_mac, ETH_ADDR_LEN);
-  parp_out->arp.spa = t_beui32(config.ip);
+  parp_out->arp.spa = t_beui32(config.ip[port]);
   parp_out->arp.tpa = t_beui32(dst_ip);
 
   parp_out->eth.type = t_beui16(ETH_TYPE_ARP);
@@ -299,23 +316,25 @@ static inline int response_tx(const void *dst_mac, uint32_t dst_ip)
   return 0;
 }
 
-static inline int request_tx(uint32_t dst_ip)
+static inline int request_tx(uint32_t dst_ip, uint8_t port)
 {
   struct pkt_arp *parp_out;
   uint32_t new_tail;
   uint64_t dst_mac = 0xffffffffffffULL;
 
   /* allocate tx buffer */
-  if (nicif_tx_alloc(sizeof(*parp_out), (void **) &parp_out, &new_tail) != 0) {
+  if (nicif_tx_alloc(sizeof(*parp_out), port, (void **) &parp_out, &new_tail)
+      != 0)
+  {
     return -1;
   }
 
   /* fill in response */
-  memcpy(&parp_out->eth.src, &eth_addr, ETH_ADDR_LEN);
-  memcpy(&parp_out->arp.sha, &eth_addr, ETH_ADDR_LEN);
+  memcpy(&parp_out->eth.src, &eth_addrs[port], ETH_ADDR_LEN);
+  memcpy(&parp_out->arp.sha, &eth_addrs[port], ETH_ADDR_LEN);
   memcpy(&parp_out->eth.dest, &dst_mac, ETH_ADDR_LEN);
   memcpy(&parp_out->arp.tha, &dst_mac, ETH_ADDR_LEN);
-  parp_out->arp.spa = t_beui32(config.ip);
+  parp_out->arp.spa = t_beui32(config.ip[port]);
   parp_out->arp.tpa = t_beui32(dst_ip);
 
   parp_out->eth.type = t_beui16(ETH_TYPE_ARP);
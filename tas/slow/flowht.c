@@ -0,0 +1,173 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <tas_memif.h>
+#include <utils.h>
+#include <flowht.h>
+
+/** Maximum number of entries moved for one insertion */
+#define FLOWHT_MAX_PATH 64
+
+struct flowht_pos {
+  uint32_t bucket;
+  uint16_t way;
+};
+
+static inline void bucket_write_begin(struct flextcp_pl_flowhtb *b)
+{
+  b->version++;
+  MEM_BARRIER();
+}
+
+static inline void bucket_write_end(struct flextcp_pl_flowhtb *b)
+{
+  MEM_BARRIER();
+  b->version++;
+}
+
+static inline int bucket_free_way(const struct flextcp_pl_flowhtb *b)
+{
+  uint32_t m = flowht_match(b, 0);
+  return (m == 0 ? -1 : __builtin_ctz(m));
+}
+
+static inline void entry_set(struct flextcp_pl_flowhtb *b, uint16_t way,
+    uint16_t sig, uint32_t flow_id)
+{
+  bucket_write_begin(b);
+  b->flow_id[way] = flow_id;
+  MEM_BARRIER();
+  b->sig[way] = sig;
+  bucket_write_end(b);
+}
+
+static inline void entry_clear(struct flextcp_pl_flowhtb *b, uint16_t way)
+{
+  bucket_write_begin(b);
+  b->sig[way] = 0;
+  bucket_write_end(b);
+}
+
+static inline int path_contains(const struct flowht_pos *path, unsigned n,
+    uint32_t bucket, uint16_t way)
+{
+  unsigned i;
+  for (i = 0; i < n; i++) {
+    if (path[i].bucket == bucket && path[i].way == way)
+      return 1;
+  }
+  return 0;
+}
+
+/* Insert entry for flow. If both buckets are full, entries are moved to their
+ * alternate buckets along a path ending in a free slot. Moves are applied from
+ * the end of the path, copying each entry before clearing its old slot, so
+ * readers always find every entry in one of its buckets. */
+int flowht_insert(struct flextcp_pl_flowhtb *ht, uint32_t mask, uint32_t h,
+    uint32_t flow_id)
+{
+  static uint16_t victim = 0;
+  struct flowht_pos path[FLOWHT_MAX_PATH];
+  uint32_t b[2], cur, alt;
+  uint16_t sig = flowht_sig(h), vsig, w;
+  int i, n, f;
+
+  b[0] = flowht_bucket(h, mask);
+  b[1] = flowht_alt(b[0], sig, mask);
+
+  /* common case: free slot in one of the buckets */
+  for (i = 0; i < 2; i++) {
+    if ((f = bucket_free_way(&ht[b[i]])) >= 0) {
+      entry_set(&ht[b[i]], f, sig, flow_id);
+      return 0;
+    }
+  }
+
+  /* look for path to a free slot, without modifying the table */
+  cur = b[victim & 1];
+  for (n = 0; n < FLOWHT_MAX_PATH; n++) {
+    /* pick victim not on the path yet */
+    for (i = 0; i < FLEXNIC_PL_FLOWHT_WAYS; i++) {
+      w = (victim + i) % FLEXNIC_PL_FLOWHT_WAYS;
+      if (!path_contains(path, n, cur, w))
+        break;
+    }
+    if (i == FLEXNIC_PL_FLOWHT_WAYS) {
+      break;
+    }
+    victim++;
+
+    path[n].bucket = cur;
+    path[n].way = w;
+
+    vsig = ht[cur].sig[w];
+    alt = flowht_alt(cur, vsig, mask);
+    if ((f = bucket_free_way(&ht[alt])) < 0) {
+      cur = alt;
+      continue;
+    }
+
+    /* found one, move entries along the path starting at the end */
+    entry_set(&ht[alt], f, vsig, ht[cur].flow_id[w]);
+    entry_clear(&ht[cur], w);
+    for (i = n - 1; i >= 0; i--) {
+      entry_set(&ht[path[i + 1].bucket], path[i + 1].way,
+          ht[path[i].bucket].sig[path[i].way],
+          ht[path[i].bucket].flow_id[path[i].way]);
+      entry_clear(&ht[path[i].bucket], path[i].way);
+    }
+
+    entry_set(&ht[path[0].bucket], path[0].way, sig, flow_id);
+    return 0;
+  }
+
+  fprintf(stderr, "flowht_insert: no free slot found\n");
+  return -1;
+}
+
+int flowht_remove(struct flextcp_pl_flowhtb *ht, uint32_t mask, uint32_t h,
+    uint32_t flow_id)
+{
+  struct flextcp_pl_flowhtb *bs[2];
+  uint16_t sig = flowht_sig(h);
+  uint32_t i, m, w;
+
+  i = flowht_bucket(h, mask);
+  bs[0] = &ht[i];
+  bs[1] = &ht[flowht_alt(i, sig, mask)];
+
+  for (i = 0; i < 2; i++) {
+    for (m = flowht_match(bs[i], sig); m != 0; m &= m - 1) {
+      w = __builtin_ctz(m);
+      if (bs[i]->flow_id[w] == flow_id) {
+        entry_clear(bs[i], w);
+        return 0;
+      }
+    }
+  }
+
+  fprintf(stderr, "flowht_remove: table entry not found\n");
+  return -1;
+}
@@ -102,16 +102,34 @@ unsigned nicif_poll(void);
  * @param txq_base Base addresses of context transmit queue
  * @param txq_len  Length of context transmit queue
  * @param evfd     Event FD used to ping app
+ * @param sleep_base Offset of flag app sets before blocking on evfd
+ * @param txdb_base  Offset of tx doorbells, KERNEL_TXDB_STRIDE apart per core
  *
  * @return 0 on success, <0 else
  */
 int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
-    uint32_t rxq_len, uint64_t *txq_base, uint32_t txq_len, int evfd);
+    uint32_t rxq_len, uint64_t *txq_base, uint32_t txq_len, int evfd,
+    uint64_t sleep_base, uint64_t txdb_base);
+
+/**
+ * Set transmit scheduling parameters for application.
+ *
+ * @param appid    Application ID
+ * @param weight   Share of transmit opportunities relative to other apps
+ * @param max_rate Aggregate transmit rate cap [Kbps], 0 for none
+ *
+ * @return 0 on success, <0 else
+ */
+int nicif_app_weight(uint16_t appid, uint16_t weight, uint32_t max_rate);
 
 /** Flags for connections (used in nicif_connection_add()) */
 enum nicif_connection_flags {
   /** Enable ECN for connection. */
   NICIF_CONN_ECN        = (1 <<  2),
+  /** Send SACK blocks for out-of-order data (negotiated on handshake). */
+  NICIF_CONN_SACK       = (1 <<  3),
+  /** Scale windows (negotiated on handshake). */
+  NICIF_CONN_WSCALE     = (1 <<  4),
 };
 
 /**
@@ -131,9 +149,12 @@ enum nicif_connection_flags {
  * @param local_seq   Next sequence number for transmission
  * @param app_opaque  Opaque value to pass in notificaitions
  * @param flags       See #nicif_connection_flags.
+ * @param wscale_rx   Window scale shift for windows received from the remote
+ * @param wscale_tx   Window scale shift for windows advertised locally
  * @param rate        Congestion rate to set [Kbps]
  * @param fn_core     FlexNIC emulator core for the connection
  * @param flow_group  Flow group
+ * @param net_port    Network port to send segments out on
  * @param pf_id       Pointer to location where flow id should be stored
  *
  * @return 0 on success, <0 else
@@ -142,8 +163,8 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
     uint16_t port_local, uint32_t ip_remote, uint16_t port_remote,
     uint64_t rx_base, uint32_t rx_len, uint64_t tx_base, uint32_t tx_len,
     uint32_t remote_seq, uint32_t local_seq, uint64_t app_opaque,
-    uint32_t flags, uint32_t rate, uint32_t fn_core, uint16_t flow_group,
-    uint32_t *pf_id);
+    uint32_t flags, uint8_t wscale_rx, uint8_t wscale_tx, uint32_t rate,
+    uint32_t fn_core, uint16_t flow_group, uint8_t net_port, uint32_t *pf_id);
 
 /**
  * Disable connection fast path (mark as sp'd and remove from hash table).
@@ -176,6 +197,16 @@ void nicif_connection_free(uint32_t f_id);
  */
 int nicif_connection_move(uint32_t dst_db, uint32_t f_id);
 
+/**
+ * Set transmit priority of flow.
+ *
+ * @param f_id    ID of flow
+ * @param prio    1 to schedule the flow ahead of other flows, 0 otherwise
+ *
+ * @return 0 on success, <0 else
+ */
+int nicif_connection_prio(uint32_t f_id, uint8_t prio);
+
 /**
  * Connection statistics for congestion control
  * (see nicif_connection_stats()).
@@ -232,13 +263,14 @@ int nicif_connection_retransmit(uint32_t f_id, uint16_t core);
  * TODO: we probably want an asynchronous version of this.
  *
  * @param len     Length of packet to be sent
+ * @param port    Network port to send the packet out on
  * @param buf     Pointer to location where base address will be stored
  * @param opaque  Pointer to location to store opaque value that needs to be
  *                passed to nicif_tx_send().
  *
  * @return 0 on success, <0 else
  */
-int nicif_tx_alloc(uint16_t len, void **buf, uint32_t *opaque);
+int nicif_tx_alloc(uint16_t len, uint8_t port, void **buf, uint32_t *opaque);
 
 /**
  * Actually send out transmit buffer (lens need to match).
@@ -280,6 +312,25 @@ int packetmem_init(void);
 int packetmem_alloc(size_t length, uintptr_t *off,
     struct packetmem_handle **handle);
 
+/**
+ * Allocate packet memory of specified length on a NUMA node, falls back to
+ * other nodes if there is not enough memory left on it.
+ *
+ * @param length  Required number of bytes
+ * @param node    Preferred NUMA node
+ * @param off     Pointer to location where offset in DMA region should be
+ *                stored
+ * @param handle  Pointer to location where handle for memory region should be
+ *                stored
+ *
+ * @return 0 on success, <0 else
+ */
+int packetmem_alloc_node(size_t length, unsigned node, uintptr_t *off,
+    struct packetmem_handle **handle);
+
+/** NUMA node of packet memory region (0 unless fp_numa is enabled) */
+unsigned packetmem_node(struct packetmem_handle *handle);
+
 /**
  * Free packet memory region.
  *
@@ -462,6 +513,8 @@ struct connection {
     uint16_t remote_port;
     /** Local port number. */
     uint16_t local_port;
+    /** Network port the connection sends on. */
+    uint8_t net_port;
   /**@}*/
 
   /**
@@ -476,6 +529,10 @@ struct connection {
     uint32_t local_seq;
     /** Timestamp received with SYN/SYN-ACK packet */
     uint32_t syn_ts;
+    /** Window scale shift for windows advertised by the peer. */
+    uint8_t remote_wscale;
+    /** Window scale shift for windows we advertise. */
+    uint8_t local_wscale;
   /**@}*/
 
   /**
@@ -651,11 +708,12 @@ int tcp_accept(struct app_context *ctx, uint64_t opaque,
  * @param len Length of packet
  * @param fn_core FlexNIC emulator core
  * @param flow_group Flow group (rss bucket for steering)
+ * @param port Network port the packet was received on
  *
  * @return 0 if packet has been consumed, <0 otherwise.
  */
 int tcp_packet(const void *pkt, uint16_t len, uint32_t fn_core,
-    uint16_t flow_group);
+    uint16_t flow_group, uint8_t port);
 
 /**
  * Destroy already closed/failed connection.
@@ -734,21 +792,24 @@ int arp_init(void);
  *
  * @param comp  Context for asynchronous return
  * @param ip    IP address to be resolved
+ * @param port  Network port to send the request out on
  * @param mac   Pointer of memory location where destination MAC should be
  *              stored.
  *
  * @return 0 on success, < 0 on error, and > 0 if request was sent but response
  *    is still pending.
  */
-int arp_request(struct nicif_completion *comp, uint32_t ip, uint64_t *mac);
+int arp_request(struct nicif_completion *comp, uint32_t ip, uint8_t port,
+    uint64_t *mac);
 
 /**
  * RX processing for an ARP packet.
  *
- * @param pkt Pointer to packet
- * @param len Length of packet
+ * @param pkt   Pointer to packet
+ * @param len   Length of packet
+ * @param port  Network port the packet was received on
  */
-void arp_packet(const void *pkt, uint16_t len);
+void arp_packet(const void *pkt, uint16_t len, uint8_t port);
 
 /**
  * ARP timeout triggered.
@@ -779,10 +840,12 @@ int routing_init(void);
  * @param ip    IP address to be resolved
  * @param mac   Pointer of memory location where destination MAC should be
  *              stored.
+ * @param port  Pointer to location where the egress port is stored
  *
  * @return 0 on success, < 0 on error, and > 0 for asynchronous return.
  */
-int routing_resolve(struct nicif_completion *comp, uint32_t ip, uint64_t *mac);
+int routing_resolve(struct nicif_completion *comp, uint32_t ip, uint64_t *mac,
+    uint8_t *port);
 
 /** @} */
 
@@ -93,7 +93,8 @@ int kni_init(void)
   conf.name[RTE_KNI_NAMESIZE - 1] = 0;
   conf.mbuf_size = MBUF_SIZE;
 #if RTE_VER_YEAR >= 18
-  memcpy(conf.mac_addr, &eth_addr, sizeof(eth_addr));
+  /* the kni interface is attached to the first port */
+  memcpy(conf.mac_addr, &eth_addrs[0], sizeof(eth_addrs[0]));
   conf.mtu = KNI_MTU;
 #endif
 
@@ -153,7 +154,7 @@ unsigned kni_poll(void)
 
   n = rte_kni_rx_burst(kni_if, &mb, 1);
   if (n == 1) {
-    if (nicif_tx_alloc(rte_pktmbuf_pkt_len(mb), &buf, &op) == 0) {
+    if (nicif_tx_alloc(rte_pktmbuf_pkt_len(mb), 0, &buf, &op) == 0) {
       memcpy(buf, rte_pktmbuf_mtod(mb, void *), rte_pktmbuf_pkt_len(mb));
       nicif_tx_send(op, 1);
     } else {
@@ -29,10 +29,12 @@
 
 #include <tas.h>
 #include <tas_memif.h>
+#include <kernel_appif.h>
+#include <fastpath.h>
+#include <flowht.h>
 #include <packet_defs.h>
 #include <utils.h>
 #include <utils_timeout.h>
-#include <utils_sync.h>
 #include "internal.h"
 
 #include <rte_config.h>
@@ -54,19 +56,14 @@ static int adminq_init(void);
 static int adminq_init_core(uint16_t core);
 static inline int rxq_poll(void);
 static inline void process_packet(const void *buf, uint16_t len,
-    uint32_t fn_core, uint16_t flow_group);
+    uint32_t fn_core, uint16_t flow_group, uint8_t port);
 static inline volatile struct flextcp_pl_ktx *ktx_try_alloc(uint32_t core,
     struct nic_buffer **buf, uint32_t *new_tail);
-static inline uint32_t flow_hash(ip_addr_t lip, beui16_t lp,
-    ip_addr_t rip, beui16_t rp);
-static inline int flow_slot_alloc(uint32_t h, uint32_t *i, uint32_t *d);
-static inline int flow_slot_clear(uint32_t f_id, ip_addr_t lip, beui16_t lp,
-    ip_addr_t rip, beui16_t rp);
-static void flow_id_alloc_init(void);
+static int flow_id_alloc_init(void);
 static int flow_id_alloc(uint32_t *fid);
 static void flow_id_free(uint32_t flow_id);
 
-struct flow_id_item flow_id_items[FLEXNIC_PL_FLOWST_NUM];
+struct flow_id_item *flow_id_items;
 struct flow_id_item *flow_id_freelist;
 
 static uint32_t fn_cores;
@@ -98,7 +95,10 @@ int nicif_init(void)
   }
 
   /* prepare flow_id allocator */
-  flow_id_alloc_init();
+  if (flow_id_alloc_init()) {
+    fprintf(stderr, "nicif_init: initializing flow ids failed\n");
+    return -1;
+  }
 
   if (adminq_init()) {
     fprintf(stderr, "nicif_init: initializing admin queue failed\n");
@@ -128,7 +128,8 @@ unsigned nicif_poll(void)
 
 /** Register application context */
 int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
-    uint32_t rxq_len, uint64_t *txq_base, uint32_t txq_len, int evfd)
+    uint32_t rxq_len, uint64_t *txq_base, uint32_t txq_len, int evfd,
+    uint64_t sleep_base, uint64_t txdb_base)
 {
   struct flextcp_pl_appctx *actx;
   struct flextcp_pl_appst *ast = &fp_state->appst[appid];
@@ -140,6 +141,12 @@ int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
     return -1;
   }
 
+  if (db >= fp_state->appctx_num) {
+    fprintf(stderr, "nicif_appctx_add: doorbell id too high (%u, max=%u)\n",
+        db, fp_state->appctx_num);
+    return -1;
+  }
+
   if (ast->ctx_num + 1 >= FLEXNIC_PL_APPST_CTX_NUM) {
     fprintf(stderr, "nicif_appctx_add: too many contexts in app\n");
     return -1;
@@ -152,7 +159,10 @@ int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
     actx->rx_base = rxq_base[i];
     actx->tx_base = txq_base[i];
     actx->rx_avail = rxq_len;
+    actx->rx_overflows = 0;
     actx->evfd = evfd;
+    actx->sleep_base = sleep_base;
+    actx->txdb_base = txdb_base + i * KERNEL_TXDB_STRIDE;
   }
 
   MEM_BARRIER();
@@ -163,6 +173,12 @@ int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
     actx->rx_len = rxq_len;
   }
 
+  /* registers are set up, fast path cores can start polling the context */
+  MEM_BARRIER();
+  for (i = 0; i < tas_info->cores_num; i++) {
+    fp_state->appctx_active[i] |= 1ULL << db;
+  }
+
   MEM_BARRIER();
   ast->ctx_ids[ast->ctx_num] = db;
   MEM_BARRIER();
@@ -171,19 +187,37 @@ int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
   return 0;
 }
 
+/** Set transmit scheduling parameters for application */
+int nicif_app_weight(uint16_t appid, uint16_t weight, uint32_t max_rate)
+{
+  struct flextcp_pl_appst *ast;
+
+  if (appid >= FLEXNIC_PL_APPST_NUM) {
+    fprintf(stderr, "nicif_app_weight: app id too high (%u, max=%u)\n", appid,
+        FLEXNIC_PL_APPST_NUM);
+    return -1;
+  }
+
+  /* picked up by the queue managers on their next round */
+  ast = &fp_state->appst[appid];
+  ast->qm_weight = weight;
+  ast->qm_rate = max_rate;
+  return 0;
+}
+
 /** Register flow */
 int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
     uint16_t port_local, uint32_t ip_remote, uint16_t port_remote,
     uint64_t rx_base, uint32_t rx_len, uint64_t tx_base, uint32_t tx_len,
     uint32_t remote_seq, uint32_t local_seq, uint64_t app_opaque,
-    uint32_t flags, uint32_t rate, uint32_t fn_core, uint16_t flow_group,
-    uint32_t *pf_id)
+    uint32_t flags, uint8_t wscale_rx, uint8_t wscale_tx, uint32_t rate,
+    uint32_t fn_core, uint16_t flow_group, uint8_t net_port, uint32_t *pf_id)
 {
   struct flextcp_pl_flowst *fs;
+  struct flextcp_pl_flowst_cold *fc;
   beui32_t lip = t_beui32(ip_local), rip = t_beui32(ip_remote);
   beui16_t lp = t_beui16(port_local), rp = t_beui16(port_remote);
-  uint32_t i, d, f_id, hash;
-  struct flextcp_pl_flowhte *hte = fp_state->flowht;
+  uint32_t f_id;
 
   /* allocate flow id */
   if (flow_id_alloc(&f_id) != 0) {
@@ -191,28 +225,24 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
     return -1;
   }
 
-  /* calculate hash and find empty slot */
-  hash = flow_hash(lip, lp, rip, rp);
-  if (flow_slot_alloc(hash, &i, &d) != 0) {
-    flow_id_free(f_id);
-    fprintf(stderr, "nicif_connection_add: allocating slot failed\n");
-    return -1;
-  }
-  assert(i < FLEXNIC_PL_FLOWHT_ENTRIES);
-  assert(d < FLEXNIC_PL_FLOWHT_NBSZ);
-
   if ((flags & NICIF_CONN_ECN) == NICIF_CONN_ECN) {
     rx_base |= FLEXNIC_PL_FLOWST_ECN;
   }
+  if ((flags & NICIF_CONN_SACK) == NICIF_CONN_SACK) {
+    rx_base |= FLEXNIC_PL_FLOWST_SACK;
+  }
 
   fs = &fp_state->flowst[f_id];
-  fs->opaque = app_opaque;
+  fc = &fp_state->flowst_cold[f_id];
+  fc->opaque = app_opaque;
   fs->rx_base_sp = rx_base;
-  fs->tx_base = tx_base;
+  fc->tx_base = tx_base;
   fs->rx_len = rx_len;
-  fs->tx_len = tx_len;
-  memcpy(&fs->remote_mac, &mac_remote, ETH_ADDR_LEN);
-  fs->db_id = db;
+  fc->tx_len = tx_len;
+  memcpy(&fc->remote_mac, &mac_remote, ETH_ADDR_LEN);
+  fc->db_id = db;
+  fc->appst_id = fp_state->appctx[0][db].appst_id;
+  fc->prio = 0;
 
   fs->local_ip = lip;
   fs->remote_ip = rip;
@@ -220,28 +250,42 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
   fs->remote_port = rp;
 
   fs->flow_group = flow_group;
-  fs->lock = 0;
-  fs->bump_seq = 0;
+  fc->bump_seq = 0;
 
   fs->rx_avail = rx_len;
   fs->rx_next_pos = 0;
   fs->rx_next_seq = remote_seq;
   fs->rx_remote_avail = rx_len; /* XXX */
+  fc->rx_ack_segs = 0;
+  fs->wscale = wscale_rx | (wscale_tx << 4);
+#ifdef FLEXNIC_PL_OOO_RECV
+  fc->rx_ooo_start = 0;
+  fc->rx_ooo_len = 0;
+  fp_state->flowst_ooo[f_id].num = 0;
+  fp_state->flowst_ooo[f_id].last = 0;
+#endif
+  fp_state->flowst_sack[f_id].num = 0;
+  fp_state->flowst_sack[f_id].state = FLEXNIC_PL_SACK_NONE;
 
   fs->tx_sent = 0;
   fs->tx_next_pos = 0;
   fs->tx_next_seq = local_seq;
   fs->tx_avail = 0;
   fs->tx_next_ts = 0;
-  fs->tx_rate = rate;
-  fs->rtt_est = 0;
+  fc->tx_rate = rate;
+  fc->rtt_est = 0;
 
-  /* write to empty entry first */
-  MEM_BARRIER();
-  hte[i].flow_hash = hash;
+  fast_flows_hdr_init(f_id, net_port);
+
+  /* make flow state visible before adding lookup table entry */
   MEM_BARRIER();
-  hte[i].flow_id = FLEXNIC_PL_FLOWHTE_VALID |
-      (d << FLEXNIC_PL_FLOWHTE_POSSHIFT) | f_id;
+  if (flowht_insert(fp_state->flowht, fp_state->flowht_mask,
+        flowht_hash(lip, rip, lp, rp), f_id) != 0)
+  {
+    flow_id_free(f_id);
+    fprintf(stderr, "nicif_connection_add: allocating slot failed\n");
+    return -1;
+  }
 
   *pf_id = f_id;
   return 0;
@@ -252,20 +296,21 @@ int nicif_connection_disable(uint32_t f_id, uint32_t *tx_seq, uint32_t *rx_seq,
 {
   struct flextcp_pl_flowst *fs = &fp_state->flowst[f_id];
 
-  util_spin_lock(&fs->lock);
+  /* only the owner core modifies flow state, so after it has seen the flag
+   * the state is stable */
+  __sync_fetch_and_or(&fs->rx_base_sp, FLEXNIC_PL_FLOWST_SLOWPATH);
+  dataplane_flowgroup_quiesce(fs->flow_group);
 
   *tx_seq = fs->tx_next_seq;
   *rx_seq = fs->rx_next_seq;
-  fs->rx_base_sp |= FLEXNIC_PL_FLOWST_SLOWPATH;
 
   *rx_closed = !!(fs->rx_base_sp & FLEXNIC_PL_FLOWST_RXFIN);
   *tx_closed = !!(fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXFIN) &&
       fs->tx_sent == 0;
 
-  util_spin_unlock(&fs->lock);
-
-  flow_slot_clear(f_id, fs->local_ip, fs->local_port, fs->remote_ip,
-      fs->remote_port);
+  flowht_remove(fp_state->flowht, fp_state->flowht_mask,
+      flowht_hash(fs->local_ip, fs->remote_ip, fs->local_port,
+        fs->remote_port), f_id);
   return 0;
 }
 
@@ -277,7 +322,16 @@ void nicif_connection_free(uint32_t f_id)
 /** Move flow to new db */
 int nicif_connection_move(uint32_t dst_db, uint32_t f_id)
 {
-  fp_state->flowst[f_id].db_id = dst_db;
+  fp_state->flowst_cold[f_id].db_id = dst_db;
+  fp_state->flowst_cold[f_id].appst_id = fp_state->appctx[0][dst_db].appst_id;
+  return 0;
+}
+
+/** Set transmit priority of flow, applied by the queue manager with the
+ * flow's next update */
+int nicif_connection_prio(uint32_t f_id, uint8_t prio)
+{
+  fp_state->flowst_cold[f_id].prio = prio;
   return 0;
 }
 
@@ -286,19 +340,21 @@ int nicif_connection_stats(uint32_t f_id,
     struct nicif_connection_stats *p_stats)
 {
   struct flextcp_pl_flowst *fs;
+  struct flextcp_pl_flowst_cold *fc;
 
-  if (f_id >= FLEXNIC_PL_FLOWST_NUM) {
+  if (f_id >= fp_state->flowst_num) {
     fprintf(stderr, "nicif_connection_stats: bad flow id\n");
     return -1;
   }
 
   fs = &fp_state->flowst[f_id];
-  p_stats->c_drops = fs->cnt_tx_drops;
-  p_stats->c_acks = fs->cnt_rx_acks;
-  p_stats->c_ackb = fs->cnt_rx_ack_bytes;
-  p_stats->c_ecnb = fs->cnt_rx_ecn_bytes;
+  fc = &fp_state->flowst_cold[f_id];
+  p_stats->c_drops = fc->cnt_tx_drops;
+  p_stats->c_acks = fc->cnt_rx_acks;
+  p_stats->c_ackb = fc->cnt_rx_ack_bytes;
+  p_stats->c_ecnb = fc->cnt_rx_ecn_bytes;
   p_stats->txp = fs->tx_sent != 0;
-  p_stats->rtt = fs->rtt_est;
+  p_stats->rtt = fc->rtt_est;
 
   return 0;
 }
@@ -313,15 +369,15 @@ int nicif_connection_stats(uint32_t f_id,
  */
 int nicif_connection_setrate(uint32_t f_id, uint32_t rate)
 {
-  struct flextcp_pl_flowst *fs;
+  struct flextcp_pl_flowst_cold *fc;
 
-  if (f_id >= FLEXNIC_PL_FLOWST_NUM) {
+  if (f_id >= fp_state->flowst_num) {
     fprintf(stderr, "nicif_connection_stats: bad flow id\n");
     return -1;
   }
 
-  fs = &fp_state->flowst[f_id];
-  fs->tx_rate = rate;
+  fc = &fp_state->flowst_cold[f_id];
+  fc->tx_rate = rate;
 
   return 0;
 }
@@ -349,7 +405,7 @@ int nicif_connection_retransmit(uint32_t f_id, uint16_t flow_group)
 }
 
 /** Allocate transmit buffer */
-int nicif_tx_alloc(uint16_t len, void **pbuf, uint32_t *opaque)
+int nicif_tx_alloc(uint16_t len, uint8_t port, void **pbuf, uint32_t *opaque)
 {
   volatile struct flextcp_pl_ktx *ktx;
   struct nic_buffer *buf;
@@ -360,6 +416,7 @@ int nicif_tx_alloc(uint16_t len, void **pbuf, uint32_t *opaque)
 
   ktx->msg.packet.addr = buf->addr;
   ktx->msg.packet.len = len;
+  ktx->msg.packet.port = port;
   *pbuf = buf->buf;
   return 0;
 }
@@ -513,7 +570,7 @@ static inline int rxq_poll(void)
   switch (type) {
     case FLEXTCP_PL_KRX_PACKET:
       process_packet(buf->buf, krx->msg.packet.len, krx->msg.packet.fn_core,
-          krx->msg.packet.flow_group);
+          krx->msg.packet.flow_group, krx->msg.packet.port);
       break;
 
     default:
@@ -528,7 +585,7 @@ static inline int rxq_poll(void)
 }
 
 static inline void process_packet(const void *buf, uint16_t len,
-    uint32_t fn_core, uint16_t flow_group)
+    uint32_t fn_core, uint16_t flow_group, uint8_t port)
 {
   const struct eth_hdr *eth = buf;
   const struct ip_hdr *ip = (struct ip_hdr *) (eth + 1);
@@ -541,7 +598,7 @@ static inline void process_packet(const void *buf, uint16_t len,
       return;
     }
 
-    arp_packet(buf, len);
+    arp_packet(buf, len, port);
   } else if (f_beui16(eth->type) == ETH_TYPE_IP) {
     if (len < sizeof(*eth) + sizeof(*ip)) {
       fprintf(stderr, "process_packet: short ip packet\n");
@@ -554,7 +611,7 @@ static inline void process_packet(const void *buf, uint16_t len,
         return;
       }
 
-      to_kni = !!tcp_packet(buf, len, fn_core, flow_group);
+      to_kni = !!tcp_packet(buf, len, fn_core, flow_group, port);
     }
   }
 
@@ -586,141 +643,19 @@ static inline volatile struct flextcp_pl_ktx *ktx_try_alloc(uint32_t core,
   return ktx;
 }
 
-static inline uint32_t flow_hash(ip_addr_t lip, beui16_t lp,
-    ip_addr_t rip, beui16_t rp)
-{
-  struct {
-    ip_addr_t lip;
-    ip_addr_t rip;
-    beui16_t lp;
-    beui16_t rp;
-  } __attribute__((packed)) hk =
-      { .lip = lip, .rip = rip, .lp = lp, .rp = rp };
-  MEM_BARRIER();
-  return rte_hash_crc(&hk, sizeof(hk), 0);
-}
-
-static inline int flow_slot_alloc(uint32_t h, uint32_t *pi, uint32_t *pd)
+static int flow_id_alloc_init(void)
 {
-  uint32_t j, i, l, k, d;
-  struct flextcp_pl_flowhte *hte = fp_state->flowht;
-
-  /* find slot */
-  j = h % FLEXNIC_PL_FLOWHT_ENTRIES;
-  l = (j + FLEXNIC_PL_FLOWHT_NBSZ) % FLEXNIC_PL_FLOWHT_ENTRIES;
-
-  /* look for empty slot */
-  d = 0;
-  for (i = j; i != l; i = (i + 1) % FLEXNIC_PL_FLOWHT_ENTRIES) {
-    if ((hte[i].flow_id & FLEXNIC_PL_FLOWHTE_VALID) == 0) {
-      *pi = i;
-      *pd = d;
-      return 0;
-    }
-    d++;
-  }
-
-  /* no free slot, try to clear up on */
-  k = (l + 4 * FLEXNIC_PL_FLOWHT_NBSZ) % FLEXNIC_PL_FLOWHT_ENTRIES;
-  /* looking for candidate empty slot to move back */
-  for (; i != k; i = (i + 1) % FLEXNIC_PL_FLOWHT_ENTRIES) {
-    if ((hte[i].flow_id & FLEXNIC_PL_FLOWHTE_VALID) == 0) {
-      break;
-    }
-  }
+  size_t i;
+  struct flow_id_item *it, *prev = NULL;
 
-  /* abort if no candidate slot found */
-  if (i == k) {
-    fprintf(stderr, "flow_slot_alloc: no empty slot found\n");
+  if ((flow_id_items = calloc(fp_state->flowst_num, sizeof(*flow_id_items)))
+      == NULL)
+  {
+    fprintf(stderr, "flow_id_alloc_init: calloc failed\n");
     return -1;
   }
 
-  /* move candidate backwards until in range for this insertion */
-  /* j < l -> (i < j || i >= l) */
-  /* j > l -> (i >= l && i < j) */
-  while ((j > l || (i < j || i >= l)) && (j < l || (i >= l && i < j))) {
-    k = i;
-
-    /* look for element to swap */
-    i = (k - FLEXNIC_PL_FLOWHT_NBSZ) % FLEXNIC_PL_FLOWHT_ENTRIES;
-    for (; i != k; i = (i + 1) % FLEXNIC_PL_FLOWHT_ENTRIES) {
-      assert((hte[i].flow_id & FLEXNIC_PL_FLOWHTE_VALID) != 0);
-
-      /* calculate how much further this element can be moved */
-      d = (hte[i].flow_id >> FLEXNIC_PL_FLOWHTE_POSSHIFT) &
-          (FLEXNIC_PL_FLOWHT_NBSZ - 1);
-      d = FLEXNIC_PL_FLOWHT_NBSZ - 1 - d;
-
-      /* check whether element can be moved */
-      if ((k - i) % FLEXNIC_PL_FLOWHT_ENTRIES <= d) {
-        break;
-      }
-    }
-
-    /* abort if none of the elements can be moved */
-    if (i == k) {
-      fprintf(stderr, "flow_slot_alloc: no element could be moved\n");
-      return -1;
-    }
-
-    /* move element up */
-    assert((hte[k].flow_id & FLEXNIC_PL_FLOWHTE_VALID) == 0);
-    d = (hte[i].flow_id >> FLEXNIC_PL_FLOWHTE_POSSHIFT) &
-        (FLEXNIC_PL_FLOWHT_NBSZ - 1);
-
-    /* write to empty entry first */
-    hte[k].flow_hash = hte[i].flow_hash;
-    MEM_BARRIER();
-    hte[k].flow_id = FLEXNIC_PL_FLOWHTE_VALID |
-        (d << FLEXNIC_PL_FLOWHTE_POSSHIFT) |
-        (((1 << FLEXNIC_PL_FLOWHTE_POSSHIFT) - 1) & hte[i].flow_id);
-    MEM_BARRIER();
-
-    /* empty original position */
-    hte[i].flow_id = 0;
-    MEM_BARRIER();
-  }
-
-  *pi = i;
-  *pd = (i - j) % FLEXNIC_PL_FLOWHT_ENTRIES;
-  return 0;
-}
-
-static inline int flow_slot_clear(uint32_t f_id, ip_addr_t lip, beui16_t lp,
-    ip_addr_t rip, beui16_t rp)
-{
-  uint32_t h, k, j, ffid, eh;
-  struct flextcp_pl_flowhte *e;
-
-  h = flow_hash(lip, lp, rip, rp);
-
-  for (j = 0; j < FLEXNIC_PL_FLOWHT_NBSZ; j++) {
-    k = (h + j) % FLEXNIC_PL_FLOWHT_ENTRIES;
-    e = &fp_state->flowht[k];
-
-    ffid = e->flow_id;
-    MEM_BARRIER();
-    eh = e->flow_hash;
-
-    if ((ffid & FLEXNIC_PL_FLOWHTE_VALID) == 0 || eh != h) {
-      continue;
-    }
-
-    if ((ffid & ((1 << FLEXNIC_PL_FLOWHTE_POSSHIFT) - 1)) == f_id) {
-      e->flow_id &= ~FLEXNIC_PL_FLOWHTE_VALID;
-      return 0;
-    }
-  }
-
-  fprintf(stderr, "flow_slot_clear: table entry not found\n");
-  return -1;
-}
-
-static void flow_id_alloc_init(void)
-{
-  size_t i;
-  struct flow_id_item *it, *prev = NULL;
-  for (i = 0; i < FLEXNIC_PL_FLOWST_NUM; i++) {
+  for (i = 0; i < fp_state->flowst_num; i++) {
     it = &flow_id_items[i];
     it->flow_id = i;
     it->next = NULL;
@@ -732,6 +667,8 @@ static void flow_id_alloc_init(void)
     }
     prev = it;
   }
+
+  return 0;
 }
 
 static int flow_id_alloc(uint32_t *fid)
@@ -31,41 +31,111 @@
 struct packetmem_handle {
   uintptr_t base;
   size_t len;
+  /* NUMA node the memory is on, index into freelists */
+  unsigned node;
 
   struct packetmem_handle *next;
 };
 
+static inline int fl_alloc(unsigned node, size_t length, uintptr_t *off,
+    struct packetmem_handle **handle);
 static inline struct packetmem_handle *ph_alloc(void);
 static inline void ph_free(struct packetmem_handle *ph);
-static inline void merge_items(struct packetmem_handle *ph_prev);
+static inline void merge_items(struct packetmem_handle **freelist,
+    struct packetmem_handle *ph_prev);
 
-static struct packetmem_handle *freelist;
+/* one free list per part of the DMA memory, see tas_shm_nodes */
+static struct packetmem_handle **freelists;
 
 int packetmem_init(void)
 {
   struct packetmem_handle *ph;
+  unsigned i;
 
-  if ((ph = ph_alloc()) == NULL) {
-    fprintf(stderr, "packetmem_init: ph_alloc failed\n");
+  if ((freelists = calloc(tas_shm_nodes, sizeof(*freelists))) == NULL) {
+    fprintf(stderr, "packetmem_init: calloc failed\n");
     return -1;
   }
 
-  ph->base = 0;
-  ph->len = tas_info->dma_mem_size;
-  ph->next = NULL;
-  freelist = ph;
+  for (i = 0; i < tas_shm_nodes; i++) {
+    if ((ph = ph_alloc()) == NULL) {
+      fprintf(stderr, "packetmem_init: ph_alloc failed\n");
+      return -1;
+    }
+
+    ph->base = i * tas_shm_node_len;
+    ph->len = (i == tas_shm_nodes - 1 ? tas_info->dma_mem_size - ph->base :
+        tas_shm_node_len);
+    ph->node = i;
+    ph->next = NULL;
+    freelists[i] = ph;
+  }
 
   return 0;
 }
 
 int packetmem_alloc(size_t length, uintptr_t *off,
     struct packetmem_handle **handle)
+{
+  return packetmem_alloc_node(length, 0, off, handle);
+}
+
+int packetmem_alloc_node(size_t length, unsigned node, uintptr_t *off,
+    struct packetmem_handle **handle)
+{
+  unsigned i;
+
+  /* fall back to other nodes in order if the requested one is full */
+  node %= tas_shm_nodes;
+  for (i = 0; i < tas_shm_nodes; i++) {
+    if (fl_alloc((node + i) % tas_shm_nodes, length, off, handle) == 0) {
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+unsigned packetmem_node(struct packetmem_handle *handle)
+{
+  return handle->node;
+}
+
+void packetmem_free(struct packetmem_handle *handle)
+{
+  struct packetmem_handle *ph, *ph_prev;
+  struct packetmem_handle **freelist = &freelists[handle->node];
+
+  /* look for first successor */
+  ph_prev = NULL;
+  ph = *freelist;
+  while (ph != NULL && ph->next != NULL && ph->next->base < handle->base) {
+    ph_prev = ph;
+    ph = ph->next;
+  }
+
+  /* add to list */
+  if (ph_prev == NULL) {
+    handle->next = *freelist;
+    *freelist = handle;
+  } else {
+    handle->next = ph_prev->next;
+    ph_prev->next = handle;
+  }
+
+  /* merge items if necessary */
+  merge_items(freelist, ph_prev);
+}
+
+static inline int fl_alloc(unsigned node, size_t length, uintptr_t *off,
+    struct packetmem_handle **handle)
 {
   struct packetmem_handle *ph, *ph_prev, *ph_new;
+  struct packetmem_handle **freelist = &freelists[node];
 
   /* look for first fit */
   ph_prev = NULL;
-  ph = freelist;
+  ph = *freelist;
   while (ph != NULL && ph->len < length) {
     ph_prev = ph;
     ph = ph->next;
@@ -81,7 +151,7 @@ int packetmem_alloc(size_t length, uintptr_t *off,
 
     /* pointer to previous next pointer for removal */
     if (ph_prev == NULL) {
-      freelist = ph->next;
+      *freelist = ph->next;
     } else {
       ph_prev->next = ph->next;
     }
@@ -98,6 +168,7 @@ int packetmem_alloc(size_t length, uintptr_t *off,
 
     ph_new->base = ph->base;
     ph_new->len = length;
+    ph_new->node = node;
     ph_new->next = NULL;
 
     ph->base += length;
@@ -110,35 +181,11 @@ int packetmem_alloc(size_t length, uintptr_t *off,
   return 0;
 }
 
-void packetmem_free(struct packetmem_handle *handle)
-{
-  struct packetmem_handle *ph, *ph_prev;
-
-  /* look for first successor */
-  ph_prev = NULL;
-  ph = freelist;
-  while (ph != NULL && ph->next != NULL && ph->next->base < handle->base) {
-    ph_prev = ph;
-    ph = ph->next;
-  }
-
-  /* add to list */
-  if (ph_prev == NULL) {
-    handle->next = freelist;
-    freelist = handle;
-  } else {
-    handle->next = ph_prev->next;
-    ph_prev->next = handle;
-  }
-
-  /* merge items if necessary */
-  merge_items(ph_prev);
-}
-
 /** Merge handles around newly inserted item (pointer to predecessor or NULL
  * passed).
  */
-static inline void merge_items(struct packetmem_handle *ph_prev)
+static inline void merge_items(struct packetmem_handle **freelist,
+    struct packetmem_handle *ph_prev)
 {
   struct packetmem_handle *ph, *ph_next;
 
@@ -153,7 +200,7 @@ static inline void merge_items(struct packetmem_handle *ph_prev)
       ph = ph_prev;
     }
   } else {
-    ph = freelist;
+    ph = *freelist;
   }
 
   /* try to merge with successor if there is one */
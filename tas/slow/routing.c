@@ -36,6 +36,8 @@ struct routing_table_entry {
   uint32_t dest_mask;
   /** Next hop IP address */
   uint32_t next_hop;
+  /** Network port for directly connected networks */
+  uint8_t port;
 };
 
 static inline uint32_t prefix_len_mask(uint8_t len);
@@ -52,7 +54,7 @@ int routing_init(void)
   uint32_t mask;
 
   /* count number of entries to be added */
-  routing_table_len = 1;
+  routing_table_len = config.ip_num;
   for (cr = config.routes; cr != NULL; routing_table_len++, cr = cr->next);
 
   /* allocate table */
@@ -63,14 +65,17 @@ int routing_init(void)
     return -1;
   }
 
-  /* first fill in network route based on ip and prefix */
-  mask = prefix_len_mask(config.ip_prefix);
-  routing_table[0].dest_ip = config.ip & mask;
-  routing_table[0].dest_mask = mask;
-  routing_table[0].next_hop = 0;
+  /* first fill in network routes based on ip and prefix of each port */
+  for (i = 0; i < config.ip_num; i++) {
+    mask = prefix_len_mask(config.ip_prefix[i]);
+    routing_table[i].dest_ip = config.ip[i] & mask;
+    routing_table[i].dest_mask = mask;
+    routing_table[i].next_hop = 0;
+    routing_table[i].port = i;
+  }
 
   /* fill in routing table */
-  for (i = 1, cr = config.routes; cr != NULL; i++, cr = cr->next) {
+  for (cr = config.routes; cr != NULL; i++, cr = cr->next) {
     mask = prefix_len_mask(cr->ip_prefix);
     if ((mask & cr->ip) != cr->ip) {
       fprintf(stderr, "routing_init: mask removes non-0 bits "
@@ -86,7 +91,8 @@ int routing_init(void)
   return 0;
 }
 
-int routing_resolve(struct nicif_completion *comp, uint32_t ip, uint64_t *mac)
+int routing_resolve(struct nicif_completion *comp, uint32_t ip, uint64_t *mac,
+    uint8_t *port)
 {
   struct routing_table_entry *rte;
 
@@ -104,7 +110,8 @@ int routing_resolve(struct nicif_completion *comp, uint32_t ip, uint64_t *mac)
     ip = rte->next_hop;
   }
 
-  return  arp_request(comp, ip, mac);
+  *port = rte->port;
+  return  arp_request(comp, ip, rte->port, mac);
 }
 
 static inline uint32_t prefix_len_mask(uint8_t len)
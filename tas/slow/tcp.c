@@ -66,11 +66,14 @@ struct listen_multi {
 struct backlog_slot {
   uint8_t buf[126];
   uint16_t len;
+  uint8_t port;
 };
 
 struct tcp_opts {
   struct tcp_mss_opt *mss;
   struct tcp_timestamp_opt *ts;
+  struct tcp_sack_permitted_opt *sackp;
+  struct tcp_wscale_opt *wscale;
 };
 
 static int conn_arp_done(struct connection *conn);
@@ -78,6 +81,7 @@ static void conn_packet(struct connection *c, const struct pkt_tcp *p,
     const struct tcp_opts *opts, uint32_t fn_core, uint16_t flow_group);
 static inline struct connection *conn_alloc(void);
 static inline void conn_free(struct connection *conn);
+static inline void conn_bufs_place(struct connection *conn);
 static void conn_register(struct connection *conn);
 static void conn_unregister(struct connection *conn);
 static struct connection *conn_lookup(const struct pkt_tcp *p);
@@ -91,16 +95,19 @@ static void conn_close_timeout(struct connection *c);
 
 static struct listener *listener_lookup(const struct pkt_tcp *p);
 static void listener_packet(struct listener *l, const struct pkt_tcp *p,
-    const struct tcp_opts *opts, uint32_t fn_core, uint16_t flow_group);
+    const struct tcp_opts *opts, uint32_t fn_core, uint16_t flow_group,
+    uint8_t port);
 static void listener_accept(struct listener *l);
 
 static inline uint16_t port_alloc(void);
 static inline int send_control(const struct connection *conn, uint16_t flags,
-    int ts_opt, uint32_t ts_echo, uint16_t mss_opt);
+    int ts_opt, uint32_t ts_echo, uint16_t mss_opt, int sackp_opt,
+    int wscale_opt);
 static inline int send_reset(const struct pkt_tcp *p,
-    const struct tcp_opts *opts);
+    const struct tcp_opts *opts, uint8_t port);
 static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
     struct tcp_opts *opts);
+static inline uint8_t wscale_shift(uint32_t buf_len);
 
 static uintptr_t ports[PORT_MAX + 1];
 static uint16_t port_eph_hint = PORT_FIRST_EPH;
@@ -171,7 +178,6 @@ int tcp_open(struct app_context *ctx, uint64_t opaque, uint32_t remote_ip,
   conn->opaque = opaque;
   conn->status = CONN_ARP_PENDING;
   conn->remote_ip = remote_ip;
-  conn->local_ip = config.ip;
   conn->remote_port = remote_port;
   conn->local_port = local_port;
   conn->local_seq = 0; /* TODO: assign random */
@@ -185,13 +191,19 @@ int tcp_open(struct app_context *ctx, uint64_t opaque, uint32_t remote_ip,
   conn->comp.status = 0;
 
 
-  /* resolve IP to mac */
-  ret = routing_resolve(&conn->comp, remote_ip, &conn->remote_mac);
+  /* resolve IP to mac and the port to send on */
+  ret = routing_resolve(&conn->comp, remote_ip, &conn->remote_mac,
+      &conn->net_port);
   if (ret < 0) {
     fprintf(stderr, "tcp_open: nicif_arp failed\n");
     conn_free(conn);
     return -1;
-  } else if (ret == 0) {
+  }
+
+  /* use the address of the port the peer is reached through */
+  conn->local_ip = config.ip[conn->net_port];
+
+  if (ret == 0) {
     CONN_DEBUG0(conn, "routing_resolve succeeded immediately\n");
     conn_register(conn);
 
@@ -348,13 +360,14 @@ int tcp_accept(struct app_context *ctx, uint64_t opaque,
 }
 
 int tcp_packet(const void *pkt, uint16_t len, uint32_t fn_core,
-    uint16_t flow_group)
+    uint16_t flow_group, uint8_t port)
 {
   struct connection *c;
   struct listener *l;
   const struct pkt_tcp *p = pkt;
   struct tcp_opts opts;
   int ret = 0;
+  uint8_t i;
 
   if (len < sizeof(*p)) {
     fprintf(stderr, "tcp_packet: incomplete TCP receive (%u received, "
@@ -362,9 +375,10 @@ int tcp_packet(const void *pkt, uint16_t len, uint32_t fn_core,
     return -1;
   }
 
-  if (f_beui32(p->ip.dest) != config.ip) {
-    fprintf(stderr, "tcp_packet: unexpected destination IP (%x received, "
-        "%x expected)\n", f_beui32(p->ip.dest), config.ip);
+  for (i = 0; i < config.ip_num && f_beui32(p->ip.dest) != config.ip[i]; i++);
+  if (i == config.ip_num) {
+    fprintf(stderr, "tcp_packet: unexpected destination IP (%x received)\n",
+        f_beui32(p->ip.dest));
     return -1;
   }
 
@@ -376,14 +390,14 @@ int tcp_packet(const void *pkt, uint16_t len, uint32_t fn_core,
   if ((c = conn_lookup(p)) != NULL) {
     conn_packet(c, p, &opts, fn_core, flow_group);
   } else if ((l = listener_lookup(p)) != NULL) {
-    listener_packet(l, p, &opts, fn_core, flow_group);
+    listener_packet(l, p, &opts, fn_core, flow_group, port);
   } else {
     ret = -1;
 
     /* send reset if the packet received wasn't a reset */
     if (!(TCPH_FLAGS(&p->tcp) & TCP_RST) &&
         config.kni_name == NULL)
-      send_reset(p, &opts);
+      send_reset(p, &opts, port);
   }
 
   return ret;
@@ -411,7 +425,7 @@ int tcp_close(struct connection *conn)
   conn->local_seq = tx_seq;
 
   if (!tx_c || !rx_c) {
-    send_control(conn, TCP_RST, 0, 0, 0);
+    send_control(conn, TCP_RST, 0, 0, 0, 0, -1);
   }
 
   cc_conn_remove(conn);
@@ -464,7 +478,8 @@ void tcp_timeout(struct timeout *to, enum timeout_type type)
   conn_timeout_arm(c, TO_TCP_HANDSHAKE);
 
   /* re-send SYN packet */
-  send_control(c, TCP_SYN | TCP_ECE | TCP_CWR, 1, 0, TCP_MSS);
+  send_control(c, TCP_SYN | TCP_ECE | TCP_CWR, 1, 0, TCP_MSS, 1,
+      c->local_wscale);
 }
 
 static void conn_packet(struct connection *c, const struct pkt_tcp *p,
@@ -499,7 +514,10 @@ static void conn_packet(struct connection *c, const struct pkt_tcp *p,
     }
 
     send_control(c, TCP_SYN | TCP_ACK | ecn_flags, 1,
-        f_beui32(opts->ts->ts_val), TCP_MSS);
+        f_beui32(opts->ts->ts_val), TCP_MSS,
+        (c->flags & NICIF_CONN_SACK) == NICIF_CONN_SACK,
+        (c->flags & NICIF_CONN_WSCALE) == NICIF_CONN_WSCALE ?
+          c->local_wscale : -1);
   } else if (c->status == CONN_OPEN &&
       (TCPH_FLAGS(&p->tcp) & TCP_SYN) == TCP_SYN)
   {
@@ -509,7 +527,7 @@ static void conn_packet(struct connection *c, const struct pkt_tcp *p,
   {
    /* silently ignore a FIN for an already closed connection: TODO figure out
     * why necessary*/
-    send_control(c, TCP_ACK, 1, 0, 0);
+    send_control(c, TCP_ACK, 1, 0, 0, 0, -1);
   } else {
     fprintf(stderr, "tcp_packet: unexpected connection state %u\n", c->status);
   }
@@ -527,7 +545,8 @@ static int conn_arp_done(struct connection *conn)
   conn_timeout_arm(conn, TO_TCP_HANDSHAKE);
 
   /* send SYN */
-  send_control(conn, TCP_SYN | TCP_ECE | TCP_CWR, 1, 0, TCP_MSS);
+  send_control(conn, TCP_SYN | TCP_ECE | TCP_CWR, 1, 0, TCP_MSS, 1,
+      conn->local_wscale);
 
   CONN_DEBUG0(conn, "SYN SENT\n");
   return 0;
@@ -562,17 +581,32 @@ static int conn_syn_sent_packet(struct connection *c, const struct pkt_tcp *p,
     c->flags |= NICIF_CONN_ECN;
   }
 
+  /* enable SACK if SYN-ACK confirms */
+  if (opts->sackp != NULL) {
+    c->flags |= NICIF_CONN_SACK;
+  }
+
+  /* enable window scaling if SYN-ACK confirms */
+  if (opts->wscale != NULL) {
+    c->flags |= NICIF_CONN_WSCALE;
+    c->remote_wscale = MIN(opts->wscale->shift, TCP_WSCALE_MAX);
+  } else {
+    c->local_wscale = 0;
+  }
+
   cc_conn_init(c);
 
   c->comp.q = &conn_async_q;
   c->comp.notify_fd = -1;
   c->comp.status = 0;
 
+  conn_bufs_place(c);
   if (nicif_connection_add(c->db_id, c->remote_mac, c->local_ip, c->local_port,
         c->remote_ip, c->remote_port, c->rx_buf - (uint8_t *) tas_shm,
         c->rx_len, c->tx_buf - (uint8_t *) tas_shm, c->tx_len,
-        c->remote_seq, c->local_seq, c->opaque, c->flags, c->cc_rate,
-        c->fn_core, c->flow_group, &c->flow_id)
+        c->remote_seq, c->local_seq, c->opaque, c->flags, c->remote_wscale,
+        c->local_wscale, c->cc_rate, c->fn_core, c->flow_group, c->net_port,
+        &c->flow_id)
       != 0)
   {
     fprintf(stderr, "conn_syn_sent_packet: nicif_connection_add failed\n");
@@ -584,7 +618,7 @@ static int conn_syn_sent_packet(struct connection *c, const struct pkt_tcp *p,
   c->status = CONN_OPEN;
 
   /* send ACK */
-  send_control(c, TCP_ACK, 1, c->syn_ts, 0);
+  send_control(c, TCP_ACK, 1, c->syn_ts, 0, 0, -1);
 
   CONN_DEBUG0(c, "conn_syn_sent_packet: ACK sent\n");
 
@@ -604,7 +638,10 @@ static int conn_reg_synack(struct connection *c)
   }
 
   /* send ACK */
-  send_control(c, TCP_SYN | TCP_ACK | ecn_flags, 1, c->syn_ts, TCP_MSS);
+  send_control(c, TCP_SYN | TCP_ACK | ecn_flags, 1, c->syn_ts, TCP_MSS,
+      (c->flags & NICIF_CONN_SACK) == NICIF_CONN_SACK,
+      (c->flags & NICIF_CONN_WSCALE) == NICIF_CONN_WSCALE ?
+        c->local_wscale : -1);
 
   appif_accept_conn(c, 0);
 
@@ -659,6 +696,8 @@ static inline struct connection *conn_alloc(void)
   conn->tx_buf = (uint8_t *) tas_shm + off_tx;
   conn->tx_len = config.tcp_txbuf_len;
   conn->to_armed = 0;
+  conn->local_wscale = wscale_shift(conn->rx_len);
+  conn->remote_wscale = 0;
 
   return conn;
 }
@@ -670,6 +709,50 @@ static inline void conn_free(struct connection *conn)
   free(conn);
 }
 
+/* Move connection buffers to the NUMA node of the fast path core handling the
+ * flow group, once it is known. Buffers are not touched before the connection
+ * is added to the fast path. */
+static inline void conn_bufs_place(struct connection *conn)
+{
+  struct packetmem_handle *rx_h, *tx_h;
+  uintptr_t off_rx, off_tx;
+  unsigned node;
+
+  if (tas_shm_nodes <= 1) {
+    return;
+  }
+
+  node = fp_core_nodes[conn->fn_core] % tas_shm_nodes;
+  if (packetmem_node(conn->rx_handle) == node &&
+      packetmem_node(conn->tx_handle) == node)
+  {
+    return;
+  }
+
+  /* keep the old buffers if the node is out of memory */
+  if (packetmem_alloc_node(conn->rx_len, node, &off_rx, &rx_h) != 0) {
+    return;
+  }
+  if (packetmem_node(rx_h) != node ||
+      packetmem_alloc_node(conn->tx_len, node, &off_tx, &tx_h) != 0)
+  {
+    packetmem_free(rx_h);
+    return;
+  }
+  if (packetmem_node(tx_h) != node) {
+    packetmem_free(tx_h);
+    packetmem_free(rx_h);
+    return;
+  }
+
+  packetmem_free(conn->tx_handle);
+  packetmem_free(conn->rx_handle);
+  conn->rx_handle = rx_h;
+  conn->tx_handle = tx_h;
+  conn->rx_buf = (uint8_t *) tas_shm + off_rx;
+  conn->tx_buf = (uint8_t *) tas_shm + off_tx;
+}
+
 static inline uint32_t conn_hash(uint32_t l_ip, uint32_t r_ip, uint16_t l_po,
     uint16_t r_po)
 {
@@ -825,7 +908,8 @@ static struct listener *listener_lookup(const struct pkt_tcp *p)
 }
 
 static void listener_packet(struct listener *l, const struct pkt_tcp *p,
-    const struct tcp_opts *opts, uint32_t fn_core, uint16_t flow_group)
+    const struct tcp_opts *opts, uint32_t fn_core, uint16_t flow_group,
+    uint8_t port)
 {
   struct backlog_slot *bls;
   uint16_t len;
@@ -835,7 +919,7 @@ static void listener_packet(struct listener *l, const struct pkt_tcp *p,
   if ((TCPH_FLAGS(&p->tcp) & ~(TCP_ECE | TCP_CWR)) != TCP_SYN) {
     fprintf(stderr, "listener_packet: Not a SYN (flags %x)\n",
             TCPH_FLAGS(&p->tcp));
-    send_reset(p, opts);
+    send_reset(p, opts, port);
     return;
   }
 
@@ -879,6 +963,7 @@ static void listener_packet(struct listener *l, const struct pkt_tcp *p,
   bls = l->backlog_ptrs[bp];
   memcpy(bls->buf, p, len);
   bls->len = len;
+  bls->port = port;
 
   l->backlog_used++;
 
@@ -919,7 +1004,8 @@ static void listener_accept(struct listener *l)
   c->remote_mac = 0;
   memcpy(&c->remote_mac, &p->eth.src, ETH_ADDR_LEN);
   c->remote_ip = f_beui32(p->ip.src);
-  c->local_ip = config.ip;
+  c->local_ip = f_beui32(p->ip.dest);
+  c->net_port = bls->port;
   c->remote_port = f_beui16(p->tcp.src);
   c->local_port = l->port;
 
@@ -933,6 +1019,19 @@ static void listener_accept(struct listener *l)
     c->flags |= NICIF_CONN_ECN;
   }
 
+  /* check if SACK is offered */
+  if (opts.sackp != NULL) {
+    c->flags |= NICIF_CONN_SACK;
+  }
+
+  /* check if window scaling is offered */
+  if (opts.wscale != NULL) {
+    c->flags |= NICIF_CONN_WSCALE;
+    c->remote_wscale = MIN(opts.wscale->shift, TCP_WSCALE_MAX);
+  } else {
+    c->local_wscale = 0;
+  }
+
   cc_conn_init(c);
 
   c->status = CONN_REG_SYNACK;
@@ -941,11 +1040,13 @@ static void listener_accept(struct listener *l)
   c->comp.notify_fd = -1;
   c->comp.status = 0;
 
+  conn_bufs_place(c);
   if (nicif_connection_add(c->db_id, c->remote_mac, c->local_ip, c->local_port,
         c->remote_ip, c->remote_port, c->rx_buf - (uint8_t *) tas_shm,
         c->rx_len, c->tx_buf - (uint8_t *) tas_shm, c->tx_len,
-        c->remote_seq, c->local_seq + 1, c->opaque, c->flags, c->cc_rate,
-        c->fn_core, c->flow_group, &c->flow_id)
+        c->remote_seq, c->local_seq + 1, c->opaque, c->flags,
+        c->remote_wscale, c->local_wscale, c->cc_rate, c->fn_core,
+        c->flow_group, c->net_port, &c->flow_id)
       != 0)
   {
     fprintf(stderr, "listener_packet: nicif_connection_add failed\n");
@@ -964,36 +1065,43 @@ out:
   }
 }
 
-static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
-    uint16_t remote_port, uint16_t local_port, uint32_t local_seq,
-    uint32_t remote_seq, uint16_t flags, int ts_opt, uint32_t ts_echo,
-    uint16_t mss_opt)
+static inline int send_control_raw(uint8_t port, uint64_t remote_mac,
+    uint32_t remote_ip, uint32_t local_ip, uint16_t remote_port,
+    uint16_t local_port, uint32_t local_seq, uint32_t remote_seq,
+    uint16_t flags, int ts_opt, uint32_t ts_echo, uint16_t mss_opt,
+    int sackp_opt, int wscale_opt)
 {
   uint32_t new_tail;
   struct pkt_tcp *p;
   struct tcp_mss_opt *opt_mss;
+  struct tcp_sack_permitted_opt *opt_sackp;
   struct tcp_timestamp_opt *opt_ts;
+  struct tcp_wscale_opt *opt_wscale;
   uint8_t optlen;
-  uint16_t len, off_ts, off_mss;
+  uint16_t len, off_ts, off_mss, off_sackp, off_wscale;
 
   /* calculate header length depending on options */
   optlen = 0;
   off_mss = optlen;
   optlen += (mss_opt ? sizeof(*opt_mss) : 0);
+  off_sackp = optlen;
+  optlen += (sackp_opt ? sizeof(*opt_sackp) : 0);
   off_ts = optlen;
   optlen += (ts_opt ? sizeof(*opt_ts) : 0);
+  off_wscale = optlen;
+  optlen += (wscale_opt >= 0 ? sizeof(*opt_wscale) : 0);
   optlen = (optlen + 3) & ~3;
   len = sizeof(*p) + optlen;
 
   /** allocate send buffer */
-  if (nicif_tx_alloc(len, (void **) &p, &new_tail) != 0) {
+  if (nicif_tx_alloc(len, port, (void **) &p, &new_tail) != 0) {
     fprintf(stderr, "send_control failed\n");
     return -1;
   }
 
   /* fill ethernet header */
   memcpy(&p->eth.dest, &remote_mac, ETH_ADDR_LEN);
-  memcpy(&p->eth.src, &eth_addr, ETH_ADDR_LEN);
+  memcpy(&p->eth.src, &eth_addrs[port], ETH_ADDR_LEN);
   p->eth.type = t_beui16(ETH_TYPE_IP);
 
   /* fill ipv4 header */
@@ -1005,7 +1113,7 @@ static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
   p->ip.ttl = 0xff;
   p->ip.proto = IP_PROTO_TCP;
   p->ip.chksum = 0;
-  p->ip.src = t_beui32(config.ip);
+  p->ip.src = t_beui32(local_ip);
   p->ip.dest = t_beui32(remote_ip);
 
   /* fill tcp header */
@@ -1018,6 +1126,9 @@ static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
   p->tcp.chksum = 0;
   p->tcp.urgp = t_beui16(0);
 
+  /* clear options, padding is end of options */
+  memset(p + 1, 0, optlen);
+
   /* if requested: add mss option */
   if (mss_opt) {
     opt_mss = (struct tcp_mss_opt *) ((uint8_t *) (p + 1) + off_mss);
@@ -1026,16 +1137,31 @@ static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
     opt_mss->mss = t_beui16(mss_opt);
   }
 
+  /* if requested: add sack permitted option */
+  if (sackp_opt) {
+    opt_sackp = (struct tcp_sack_permitted_opt *) ((uint8_t *) (p + 1) +
+        off_sackp);
+    opt_sackp->kind = TCP_OPT_SACK_PERMITTED;
+    opt_sackp->length = sizeof(*opt_sackp);
+  }
+
   /* if requested: add timestamp option */
   if (ts_opt) {
     opt_ts = (struct tcp_timestamp_opt *) ((uint8_t *) (p + 1) + off_ts);
-    memset(opt_ts, 0, optlen);
     opt_ts->kind = TCP_OPT_TIMESTAMP;
     opt_ts->length = sizeof(*opt_ts);
     opt_ts->ts_val = t_beui32(0);
     opt_ts->ts_ecr = t_beui32(ts_echo);
   }
 
+  /* if requested: add window scale option */
+  if (wscale_opt >= 0) {
+    opt_wscale = (struct tcp_wscale_opt *) ((uint8_t *) (p + 1) + off_wscale);
+    opt_wscale->kind = TCP_OPT_WINDOW_SCALE;
+    opt_wscale->length = sizeof(*opt_wscale);
+    opt_wscale->shift = wscale_opt;
+  }
+
   /* calculate header checksums */
   p->ip.chksum = rte_ipv4_cksum((void *) &p->ip);
   p->tcp.chksum = rte_ipv4_udptcp_cksum((void *) &p->ip, (void *) &p->tcp);
@@ -1046,15 +1172,17 @@ static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
 }
 
 static inline int send_control(const struct connection *conn, uint16_t flags,
-    int ts_opt, uint32_t ts_echo, uint16_t mss_opt)
+    int ts_opt, uint32_t ts_echo, uint16_t mss_opt, int sackp_opt,
+    int wscale_opt)
 {
-  return send_control_raw(conn->remote_mac, conn->remote_ip, conn->remote_port,
-      conn->local_port, conn->local_seq, conn->remote_seq, flags, ts_opt,
-      ts_echo, mss_opt);
+  return send_control_raw(conn->net_port, conn->remote_mac, conn->remote_ip,
+      conn->local_ip, conn->remote_port, conn->local_port, conn->local_seq,
+      conn->remote_seq, flags, ts_opt, ts_echo, mss_opt, sackp_opt,
+      wscale_opt);
 }
 
 static inline int send_reset(const struct pkt_tcp *p,
-    const struct tcp_opts *opts)
+    const struct tcp_opts *opts, uint8_t port)
 {
   int ts_opt = 0;
   uint32_t ts_val;
@@ -1066,9 +1194,10 @@ static inline int send_reset(const struct pkt_tcp *p,
   }
 
   memcpy(&remote_mac, &p->eth.src, ETH_ADDR_LEN);
-  return send_control_raw(remote_mac, f_beui32(p->ip.src), f_beui16(p->tcp.src),
-      f_beui16(p->tcp.dest), f_beui32(p->tcp.ackno), f_beui32(p->tcp.seqno) + 1,
-      TCP_RST | TCP_ACK, ts_opt, ts_val, 0);
+  return send_control_raw(port, remote_mac, f_beui32(p->ip.src),
+      f_beui32(p->ip.dest), f_beui16(p->tcp.src), f_beui16(p->tcp.dest),
+      f_beui32(p->tcp.ackno), f_beui32(p->tcp.seqno) + 1, TCP_RST | TCP_ACK,
+      ts_opt, ts_val, 0, 0, -1);
 }
 
 static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
@@ -1081,6 +1210,8 @@ static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
 
   opts->ts = NULL;
   opts->mss = NULL;
+  opts->sackp = NULL;
+  opts->wscale = NULL;
 
   /* whole header not in buf */
   if (TCPH_HDRLEN(&p->tcp) < 5 || opts_len > (len - sizeof(*p))) {
@@ -1117,6 +1248,24 @@ static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
         }
 
         opts->ts = (struct tcp_timestamp_opt *) (opt + off);
+      } else if (opt_kind == TCP_OPT_SACK_PERMITTED) {
+        if (opt_len != sizeof(struct tcp_sack_permitted_opt)) {
+          fprintf(stderr, "parse_options: sack permitted option size wrong "
+              "(expect %zu got %u)\n", sizeof(struct tcp_sack_permitted_opt),
+              opt_len);
+          return -1;
+        }
+
+        opts->sackp = (struct tcp_sack_permitted_opt *) (opt + off);
+      } else if (opt_kind == TCP_OPT_WINDOW_SCALE) {
+        if (opt_len != sizeof(struct tcp_wscale_opt)) {
+          fprintf(stderr, "parse_options: window scale option size wrong "
+              "(expect %zu got %u)\n", sizeof(struct tcp_wscale_opt),
+              opt_len);
+          return -1;
+        }
+
+        opts->wscale = (struct tcp_wscale_opt *) (opt + off);
       }
     }
     off += opt_len;
@@ -1124,3 +1273,15 @@ static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
 
   return 0;
 }
+
+/* smallest window scale shift that fits a buffer of `buf_len` bytes into the
+ * 16 bit window field */
+static inline uint8_t wscale_shift(uint32_t buf_len)
+{
+  uint8_t shift = 0;
+
+  while (shift < TCP_WSCALE_MAX && (buf_len >> shift) > 0xFFFF) {
+    shift++;
+  }
+  return shift;
+}
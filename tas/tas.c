@@ -53,6 +53,7 @@ struct configuration config;
 unsigned fp_cores_max;
 volatile unsigned fp_cores_cur = 1;
 volatile unsigned fp_scale_to = 0;
+uint8_t fp_core_nodes[FLEXNIC_PL_APPST_CTX_MCS];
 
 static unsigned threads_launched = 0;
 int exited;
@@ -213,6 +214,7 @@ static int start_threads(void)
   /* start common threads */
   RTE_LCORE_FOREACH_SLAVE(core) {
     if (threads_launched < fp_cores_max) {
+      fp_core_nodes[threads_launched] = rte_lcore_to_socket_id(core);
       arg = (void *) (uintptr_t) threads_launched;
       if (rte_eal_remote_launch(common_thread, arg, core) != 0) {
 	fprintf(stderr, "ERROR\n");
@@ -248,7 +250,9 @@ void flexnic_loadmon(uint32_t ts)
 {
   uint64_t cyc_busy = 0, x, tsc, cycles, id_cyc;
   unsigned i, num_cores;
-  static uint64_t ewma_busy = 0, ewma_cycles = 0, last_tsc = 0, kdrops = 0;
+  static uint64_t ewma_busy = 0, ewma_cycles = 0, last_tsc = 0, kdrops = 0,
+                  xdrops = 0, tx_stalls = 0, tx_drops = 0;
+  uint64_t bc_hits = 0, bc_misses = 0, b_fails = 0, b_shared = 0;
   static int waiting = 1, waiting_n = 0, count = 0;
 
   num_cores = fp_cores_cur;
@@ -264,6 +268,21 @@ void flexnic_loadmon(uint32_t ts)
 
     kdrops += ctxs[i]->kernel_drop;
     ctxs[i]->kernel_drop = 0;
+
+    xdrops += ctxs[i]->xsum_drop;
+    ctxs[i]->xsum_drop = 0;
+
+    tx_stalls += ctxs[i]->tx_stalls;
+    ctxs[i]->tx_stalls = 0;
+
+    tx_drops += ctxs[i]->tx_drops;
+    ctxs[i]->tx_drops = 0;
+
+    /* totals since start, only written by the owning core */
+    bc_hits += ctxs[i]->bufcache_hits;
+    bc_misses += ctxs[i]->bufcache_misses;
+    b_fails += ctxs[i]->net.stat_alloc_fails;
+    b_shared += ctxs[i]->net.stat_shared_allocs;
   }
 
   /* measure cpu cycles since last call */
@@ -283,9 +302,14 @@ void flexnic_loadmon(uint32_t ts)
   if (count++ % 100 == 0) {
     if (!config.quiet)
       fprintf(stderr, "flexnic_loadmon: status cores = %u   busy = %lu  "
-          "cycles =%lu  kdrops=%lu\n", num_cores, ewma_busy, ewma_cycles,
-          kdrops);
+          "cycles =%lu  kdrops=%lu  xsumdrops=%lu  bufcache hits=%lu "
+          "misses=%lu  buf allocfails=%lu shared=%lu  txstalls=%lu "
+          "txdrops=%lu\n", num_cores, ewma_busy, ewma_cycles, kdrops, xdrops,
+          bc_hits, bc_misses, b_fails, b_shared, tx_stalls, tx_drops);
     kdrops = 0;
+    xdrops = 0;
+    tx_stalls = 0;
+    tx_drops = 0;
   }
 
   /* waiting period after scaling decsions */
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Microbenchmark for the fast path flow lookup table: fills a table with
+ * random flows and measures lookup throughput for hits and misses. */
+
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <tas_memif.h>
+#include <flowht.h>
+
+#define LOOKUPS (16 * 1024 * 1024)
+
+static inline uint64_t get_nanos(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void run(uint32_t num_flows)
+{
+  struct flextcp_pl_flowhtb *ht;
+  struct flextcp_pl_flowst *fst, *fs;
+  uint32_t i, j, mask, nb, *order;
+  uint64_t t_start, t_hit, t_miss, found = 0;
+  int32_t fid;
+
+  /* buckets: power of two with at least 2x the number of flows as entries */
+  for (nb = 1; nb * FLEXNIC_PL_FLOWHT_WAYS < 2 * num_flows; nb *= 2);
+  mask = nb - 1;
+
+  ht = aligned_alloc(64, nb * sizeof(*ht));
+  fst = aligned_alloc(64, num_flows * sizeof(*fst));
+  order = malloc(LOOKUPS * sizeof(*order));
+  if (ht == NULL || fst == NULL || order == NULL) {
+    fprintf(stderr, "run: allocating memory failed\n");
+    abort();
+  }
+  memset(ht, 0, nb * sizeof(*ht));
+  memset(fst, 0, num_flows * sizeof(*fst));
+
+  for (i = 0; i < num_flows; i++) {
+    fs = &fst[i];
+    fs->local_ip = t_beui32(0x0a000001);
+    fs->remote_ip = t_beui32(0x0a000000 | (i >> 8));
+    fs->local_port = t_beui16(80);
+    fs->remote_port = t_beui16(1024 + (i & 0xff) + (rand() & 0xff00));
+    if (flowht_insert(ht, mask, flowht_hash(fs->local_ip, fs->remote_ip,
+            fs->local_port, fs->remote_port), i) != 0)
+    {
+      fprintf(stderr, "run: insert failed after %u flows\n", i);
+      abort();
+    }
+  }
+
+  for (j = 0; j < LOOKUPS; j++) {
+    order[j] = rand() % num_flows;
+  }
+
+  /* lookups for existing flows */
+  t_start = get_nanos();
+  for (j = 0; j < LOOKUPS; j++) {
+    fs = &fst[order[j]];
+    fid = flowht_lookup(ht, mask, fst, flowht_hash(fs->local_ip,
+          fs->remote_ip, fs->local_port, fs->remote_port), fs->local_ip,
+        fs->remote_ip, fs->local_port, fs->remote_port);
+    found += (fid == order[j]);
+  }
+  t_hit = get_nanos() - t_start;
+
+  /* lookups for unknown flows (different local port) */
+  t_start = get_nanos();
+  for (j = 0; j < LOOKUPS; j++) {
+    fs = &fst[order[j]];
+    fid = flowht_lookup(ht, mask, fst, flowht_hash(fs->local_ip,
+          fs->remote_ip, t_beui16(81), fs->remote_port), fs->local_ip,
+        fs->remote_ip, t_beui16(81), fs->remote_port);
+    found += (fid >= 0);
+  }
+  t_miss = get_nanos() - t_start;
+
+  printf("flows=%8u buckets=%7u hit=%6.2f ns/lookup miss=%6.2f ns/lookup "
+      "(%"PRIu64"/%u found)\n", num_flows, nb, (double) t_hit / LOOKUPS,
+      (double) t_miss / LOOKUPS, found, LOOKUPS);
+
+  free(order);
+  free(fst);
+  free(ht);
+}
+
+int main(int argc, char *argv[])
+{
+  srand(42);
+  if (argc > 1) {
+    run(atoi(argv[1]));
+  } else {
+    run(10000);
+    run(128 * 1024);
+    run(1024 * 1024);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Microbenchmark for NUMA placement: copies 1448B payloads out of a buffer
+ * larger than the cache allocated on each NUMA node in turn, while running
+ * on the first node. This is the access pattern of a fast-path core copying
+ * from a connection buffer on the local or a remote socket. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <numa.h>
+
+#define DURATION_NS (200ULL * 1000 * 1000)
+/** source buffer size, to not just measure copies within the L1 cache */
+#define SRC_SIZE (32 * 1024 * 1024)
+#define LEN 1448
+
+static inline uint64_t get_nanos(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double run(const uint8_t *src, uint8_t *dst, uint8_t *res)
+{
+  uint64_t t_start, n = 0;
+  size_t off = 0;
+  uint8_t x = 0;
+
+  t_start = get_nanos();
+  do {
+    memcpy(dst, src + off, LEN);
+    x += dst[n % LEN];
+
+    off += (LEN + 63) & ~63;
+    if (off + LEN > SRC_SIZE) {
+      off = 0;
+    }
+    n++;
+  } while ((n % 1024) != 0 || get_nanos() - t_start < DURATION_NS);
+
+  *res = x;
+  return (double) (get_nanos() - t_start) / n;
+}
+
+int main(int argc, char *argv[])
+{
+  uint8_t *src, dst[LEN], r;
+  double t;
+  int node, nodes;
+
+  if (numa_available() < 0) {
+    fprintf(stderr, "numa not available\n");
+    return EXIT_FAILURE;
+  }
+  nodes = numa_max_node() + 1;
+  if (numa_run_on_node(0) != 0) {
+    fprintf(stderr, "numa_run_on_node failed\n");
+    return EXIT_FAILURE;
+  }
+
+  for (node = 0; node < nodes; node++) {
+    if ((src = numa_alloc_onnode(SRC_SIZE, node)) == NULL) {
+      fprintf(stderr, "numa_alloc_onnode(%d) failed\n", node);
+      return EXIT_FAILURE;
+    }
+    memset(src, node + 1, SRC_SIZE);
+
+    t = run(src, dst, &r);
+    printf("cpu node 0 memory node %d: %8.1f ns per %uB copy (%5.2f GB/s) "
+        "[%02x]\n", node, t, LEN, LEN / t, r);
+    numa_free(src, SRC_SIZE);
+  }
+
+  return EXIT_SUCCESS;
+}
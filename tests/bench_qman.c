@@ -0,0 +1,238 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Microbenchmark for the queue manager: keeps 1K/10K/100K rate-limited
+ * queues permanently backlogged and measures the cost per scheduled chunk
+ * with the skip list and the timing wheel backend. A second scenario checks
+ * how bytes are shared between an application with 10K queues and one with
+ * 10 queues for different weights. The last one measures how many bytes of
+ * bulk traffic are scheduled ahead of a 64 byte RPC, with and without the
+ * priority class. */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <rte_config.h>
+
+#include <tas.h>
+#include <config.h>
+#include "../tas/fast/internal.h"
+
+#define DURATION_NS (1000ULL * 1000 * 1000)
+#define POLL_BATCH 32
+#define CHUNK 1448
+/** aggregate rate of all queues in kbps, high enough to stay backlogged */
+#define AGGREGATE_RATE (1000ULL * 1000 * 1000)
+/** RPC scenario: number of RPCs, size, and bulk bytes between RPCs */
+#define RPC_NUM 10000
+#define RPC_SIZE 64
+#define RPC_GAP (64 * 1024)
+
+struct configuration config;
+struct flextcp_pl_mem *fp_state;
+static struct flextcp_pl_mem state;
+
+static inline uint64_t get_nanos(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void run(enum config_qman backend, uint32_t num_queues)
+{
+  static struct dataplane_context ctx;
+  unsigned q_ids[POLL_BATCH], i;
+  uint16_t q_bytes[POLL_BATCH];
+  uint32_t rate = AGGREGATE_RATE / num_queues;
+  uint64_t t_start, t_end, events = 0, polls = 0;
+  int n;
+
+  memset(&ctx, 0, sizeof(ctx));
+  config.fp_qman = backend;
+  state.flowst_num = num_queues;
+  if (qman_thread_init(&ctx) != 0) {
+    fprintf(stderr, "run: qman_thread_init failed\n");
+    abort();
+  }
+
+  for (i = 0; i < num_queues; i++) {
+    if (qman_set(&ctx.qman, i, 0, rate, UINT32_MAX / 2, CHUNK,
+          QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_SET_AVAIL) != 0)
+    {
+      fprintf(stderr, "run: qman_set failed\n");
+      abort();
+    }
+  }
+
+  t_start = get_nanos();
+  do {
+    n = qman_poll(&ctx.qman, POLL_BATCH, q_ids, q_bytes);
+    events += n;
+    polls++;
+  } while ((polls % 1024) != 0 || get_nanos() - t_start < DURATION_NS);
+  t_end = get_nanos();
+
+  printf("%-8s queues=%6u events=%10"PRIu64" %6.1f ns/event "
+      "%5.1f events/poll\n",
+      backend == CONFIG_QMAN_WHEEL ? "wheel" : "skiplist", num_queues,
+      events, (double) (t_end - t_start) / events,
+      (double) events / polls);
+}
+
+static void run_classes(uint16_t weight_a, uint16_t weight_b)
+{
+  static struct dataplane_context ctx;
+  static const uint32_t num_a = 10000, num_b = 10;
+  unsigned q_ids[POLL_BATCH], i;
+  uint16_t q_bytes[POLL_BATCH];
+  uint64_t bytes[2] = { 0, 0 }, events = 0;
+  uint8_t cls;
+  int n;
+
+  memset(&ctx, 0, sizeof(ctx));
+  config.fp_qman = CONFIG_QMAN_WHEEL;
+  state.flowst_num = num_a + num_b;
+  state.appst[0].qm_weight = weight_a;
+  state.appst[1].qm_weight = weight_b;
+  if (qman_thread_init(&ctx) != 0) {
+    fprintf(stderr, "run_classes: qman_thread_init failed\n");
+    abort();
+  }
+
+  /* unlimited queues, so the split is only decided by the class weights */
+  for (i = 0; i < num_a + num_b; i++) {
+    cls = (i < num_a ? 0 : 1);
+    if (qman_set(&ctx.qman, i, cls, 0, UINT32_MAX / 2, CHUNK,
+          QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_SET_AVAIL) != 0)
+    {
+      fprintf(stderr, "run_classes: qman_set failed\n");
+      abort();
+    }
+  }
+
+  while (events < 10 * 1000 * 1000) {
+    n = qman_poll(&ctx.qman, POLL_BATCH, q_ids, q_bytes);
+    for (i = 0; i < n; i++) {
+      bytes[q_ids[i] < num_a ? 0 : 1] += q_bytes[i];
+    }
+    events += n;
+  }
+
+  printf("classes weights=%u:%u queues=%u:%u share=%4.1f%%:%4.1f%%\n",
+      weight_a, weight_b, num_a, num_b,
+      100.0 * bytes[0] / (bytes[0] + bytes[1]),
+      100.0 * bytes[1] / (bytes[0] + bytes[1]));
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+static void run_rpc(uint8_t rpc_cls)
+{
+  static struct dataplane_context ctx;
+  static uint64_t lat[RPC_NUM];
+  static const uint32_t num_bulk = 1000;
+  const uint32_t rpc_id = num_bulk;
+  unsigned q_ids[POLL_BATCH], i, rpcs = 0;
+  uint16_t q_bytes[POLL_BATCH];
+  uint64_t ahead = 0;
+  int n, pending = 0;
+
+  memset(&ctx, 0, sizeof(ctx));
+  memset(&state.appst, 0, sizeof(state.appst));
+  config.fp_qman = CONFIG_QMAN_WHEEL;
+  state.flowst_num = num_bulk + 1;
+  if (qman_thread_init(&ctx) != 0) {
+    fprintf(stderr, "run_rpc: qman_thread_init failed\n");
+    abort();
+  }
+
+  /* permanently backlogged bulk flows */
+  for (i = 0; i < num_bulk; i++) {
+    if (qman_set(&ctx.qman, i, 0, 0, UINT32_MAX / 2, CHUNK,
+          QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_SET_AVAIL) != 0)
+    {
+      fprintf(stderr, "run_rpc: qman_set failed\n");
+      abort();
+    }
+  }
+
+  while (rpcs < RPC_NUM) {
+    /* issue next RPC once the previous one went out, after some bulk */
+    if (!pending && ahead >= RPC_GAP) {
+      if (qman_set(&ctx.qman, rpc_id, rpc_cls, 0, RPC_SIZE, CHUNK,
+            QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_ADD_AVAIL) != 0)
+      {
+        fprintf(stderr, "run_rpc: qman_set failed\n");
+        abort();
+      }
+      pending = 1;
+      ahead = 0;
+    }
+
+    n = qman_poll(&ctx.qman, POLL_BATCH, q_ids, q_bytes);
+    for (i = 0; i < n; i++) {
+      if (q_ids[i] == rpc_id) {
+        lat[rpcs++] = ahead;
+        pending = 0;
+        ahead = 0;
+      } else {
+        ahead += q_bytes[i];
+      }
+    }
+  }
+
+  qsort(lat, RPC_NUM, sizeof(lat[0]), cmp_u64);
+  printf("rpc      class=%-4s bulk bytes ahead of rpc: p50=%8"PRIu64
+      " p99=%8"PRIu64" (%.1f us at 10G)\n",
+      rpc_cls == QMAN_CLASS_PRIO ? "prio" : "app", lat[RPC_NUM / 2],
+      lat[RPC_NUM * 99 / 100], lat[RPC_NUM * 99 / 100] * 8 / 10000.);
+}
+
+int main(int argc, char *argv[])
+{
+  static const uint32_t nums[] = { 1000, 10000, 100000 };
+  unsigned i;
+
+  fp_state = &state;
+  for (i = 0; i < sizeof(nums) / sizeof(nums[0]); i++) {
+    run(CONFIG_QMAN_SKIPLIST, nums[i]);
+    run(CONFIG_QMAN_WHEEL, nums[i]);
+  }
+
+  run_classes(1, 1);
+  run_classes(1, 3);
+
+  run_rpc(0);
+  run_rpc(QMAN_CLASS_PRIO);
+  return EXIT_SUCCESS;
+}
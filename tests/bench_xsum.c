@@ -0,0 +1,111 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Microbenchmark for software checksums: copies payloads of 64B to 9KB out
+ * of a transmit buffer larger than the cache, once with rte_memcpy followed by
+ * rte_raw_cksum (two passes, as before) and once with the fused xsum_copy. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <rte_config.h>
+#include <rte_memcpy.h>
+#include <rte_ip.h>
+
+#include "../tas/fast/xsum.h"
+
+#define DURATION_NS (200ULL * 1000 * 1000)
+/** source buffer size, to not just measure copies within the L1 cache */
+#define SRC_SIZE (32 * 1024 * 1024)
+
+static inline uint64_t get_nanos(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double run(const uint8_t *src, uint8_t *dst, size_t len, int fused,
+    uint16_t *res)
+{
+  uint64_t t_start, n = 0;
+  size_t off = 0;
+  uint16_t x = 0;
+
+  t_start = get_nanos();
+  do {
+    if (fused) {
+      x += __rte_raw_cksum_reduce(xsum_copy(dst, src + off, len, 0));
+    } else {
+      rte_memcpy(dst, src + off, len);
+      x += rte_raw_cksum(dst, len);
+    }
+
+    off += (len + 63) & ~63;
+    if (off + len > SRC_SIZE) {
+      off = 0;
+    }
+    n++;
+  } while ((n % 1024) != 0 || get_nanos() - t_start < DURATION_NS);
+
+  *res = x;
+  return (double) (get_nanos() - t_start) / n;
+}
+
+int main(int argc, char *argv[])
+{
+  static const size_t lens[] = { 64, 128, 256, 512, 768, 1024, 1448, 4096, 9000 };
+  uint8_t *src, *dst;
+  uint16_t r_two, r_fused;
+  double t_two, t_fused;
+  size_t i;
+
+  if ((src = malloc(SRC_SIZE)) == NULL || (dst = malloc(16384)) == NULL) {
+    fprintf(stderr, "malloc failed\n");
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < SRC_SIZE; i++) {
+    src[i] = rand();
+  }
+
+  for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+    if (__rte_raw_cksum_reduce(xsum_partial(src + 1, lens[i] + 1, 0)) !=
+        rte_raw_cksum(src + 1, lens[i] + 1))
+    {
+      fprintf(stderr, "checksum mismatch for %zu bytes\n", lens[i] + 1);
+      return EXIT_FAILURE;
+    }
+
+    t_two = run(src, dst, lens[i], 0, &r_two);
+    t_fused = run(src, dst, lens[i], 1, &r_fused);
+    printf("len=%5zu two-pass %8.1f ns (%5.2f GB/s) fused %8.1f ns "
+        "(%5.2f GB/s) [%04x %04x]\n", lens[i], t_two, lens[i] / t_two,
+        t_fused, lens[i] / t_fused, r_two, r_fused);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -13,6 +13,8 @@ struct harness_fpc_ctx {
 
   struct flextcp_pl_arx *arx_base;
   size_t arx_pos;
+
+  uint32_t txdb;
 };
 
 struct harness_ctx {
@@ -27,6 +29,8 @@ struct harness_ctx {
   size_t atx_len;
   size_t arx_len;
 
+  uint32_t sleeping;
+
   struct harness_fpc_ctx *fpcs;
 };
 
@@ -321,6 +325,8 @@ int flextcp_kernel_newctx(struct flextcp_context *ctx)
   ctx->kout_len = hc->ain_len;
   ctx->kout_head = 0;
 
+  ctx->sleeping = &hc->sleeping;
+
   ctx->db_id = 0; /* todo */
   ctx->num_queues = harness.num_fpcores;
   ctx->next_queue = 0;
@@ -333,6 +339,7 @@ int flextcp_kernel_newctx(struct flextcp_context *ctx)
       (uint8_t *) hc->fpcs[i].arx_base;
     ctx->queues[i].txq_base =
       (uint8_t *) hc->fpcs[i].atx_base;
+    ctx->queues[i].txdb = &hc->fpcs[i].txdb;
 
     ctx->queues[i].rxq_head = 0;
     ctx->queues[i].txq_tail = 0;
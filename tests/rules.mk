@@ -4,6 +4,10 @@ include mk/subdir_pre.mk
 TESTS_NONE := \
   tests/usocket_epoll_eof \
   tests/usocket_shutdown \
+  tests/bench_flowht \
+  tests/bench_qman \
+  tests/bench_xsum \
+  tests/bench_numa \
 
 # simple test programs linking against libtas
 TESTS_LIBTAS := \
@@ -48,6 +52,22 @@ $(TESTS_SOCKETS): CPPFLAGS += -Ilib/sockets/include/
 $(foreach t,$(TESTS_SOCKETS),$(eval $(t): $(t).o lib/libtas_sockets.so))
 
 
+tests/bench_flowht: CPPFLAGS += -Iinclude/ -Itas/include/
+tests/bench_flowht: tests/bench_flowht.o tas/slow/flowht.o
+
+tests/bench_qman: CPPFLAGS += -Itas/include $(DPDK_CPPFLAGS)
+tests/bench_qman: CFLAGS += $(DPDK_CFLAGS)
+tests/bench_qman: LDFLAGS += $(DPDK_LDFLAGS)
+tests/bench_qman: LDLIBS += -lrte_eal
+tests/bench_qman: tests/bench_qman.o tas/fast/qman.o lib/utils/rng.o
+
+tests/bench_xsum: CPPFLAGS += $(DPDK_CPPFLAGS)
+tests/bench_xsum: CFLAGS += $(DPDK_CFLAGS)
+tests/bench_xsum: tests/bench_xsum.o
+
+tests/bench_numa: LDLIBS += -lnuma
+tests/bench_numa: tests/bench_numa.o
+
 tests/libtas/tas_ll: CPPFLAGS += -Ilib/tas/include/
 tests/libtas/tas_ll: tests/libtas/tas_ll.o tests/libtas/harness.o \
   tests/testutils.o lib/libtas.so
@@ -61,7 +81,7 @@ tests/tas_unit/fastpath: CFLAGS+= $(DPDK_CFLAGS)
 tests/tas_unit/fastpath: LDFLAGS+= $(DPDK_LDFLAGS)
 tests/tas_unit/fastpath: LDLIBS+= -lrte_eal
 tests/tas_unit/fastpath: tests/tas_unit/fastpath.o tests/testutils.o \
-  tas/fast/fast_flows.o
+  tas/fast/fast_flows.o tas/slow/flowht.o
 
 # build tests
 tests: $(TESTS)
@@ -11,6 +11,7 @@
 
 #include <tas.h>
 #include <tas_memif.h>
+#include <flowht.h>
 #include "../../tas/include/config.h"
 #include "../../tas/fast/internal.h"
 #include "../../tas/fast/fastemu.h"
@@ -22,17 +23,25 @@
 #define TEST_LPORT 23456
 
 
-#if RTE_VER_YEAR < 19
-  typedef struct ether_addr macaddr_t;
-#else
-  typedef struct rte_ether_addr macaddr_t;
-#endif
-macaddr_t eth_addr;
+struct eth_addr eth_addrs[CONFIG_PORTS_MAX];
+uint16_t net_tso_max = 0;
+uint8_t net_tx_zerocopy = 0;
+struct rte_mempool *net_shared_pool = NULL;
 
 void *tas_shm = (void *) 0;
 
+/* one flow id above 16 bits, aliasing flow 1 if truncated */
+#define TEST_FLOW_HIGH (65536 + 1)
+#define TEST_FLOWS (TEST_FLOW_HIGH + 1)
 struct flextcp_pl_mem state_base;
 struct flextcp_pl_mem *fp_state = &state_base;
+struct flextcp_pl_flowst flowst_base[TEST_FLOWS];
+struct flextcp_pl_flowst_cold flowst_cold_base[TEST_FLOWS];
+#ifdef FLEXNIC_PL_OOO_RECV
+struct flextcp_pl_flowst_ooo flowst_ooo_base[TEST_FLOWS];
+#endif
+struct flextcp_pl_flowst_sack flowst_sack_base[TEST_FLOWS];
+struct flextcp_pl_flowst_hdr flowst_hdr_base[TEST_FLOWS];
 
 struct dataplane_context **ctxs = NULL;
 struct configuration config;
@@ -40,17 +49,19 @@ struct configuration config;
 struct qman_set_op {
   int got_op;
   uint32_t id;
+  uint8_t cls;
   uint32_t rate;
   uint32_t avail;
   uint16_t max_chunk;
   uint8_t flags;
 } qm_set_op = { .got_op = 0 };
 
-int qman_set(struct qman_thread *t, uint32_t id, uint32_t rate, uint32_t avail,
-    uint16_t max_chunk, uint8_t flags)
+int qman_set(struct qman_thread *t, uint32_t id, uint8_t cls, uint32_t rate,
+    uint32_t avail, uint16_t max_chunk, uint8_t flags)
 {
   qm_set_op.got_op = 1;
   qm_set_op.id = id;
+  qm_set_op.cls = cls;
   qm_set_op.rate = rate;
   qm_set_op.avail = avail;
   qm_set_op.max_chunk = max_chunk;
@@ -68,40 +79,97 @@ void notify_fastpath_core(unsigned core)
 static void flow_init(uint32_t fid, uint32_t rxlen, uint32_t txlen, uint64_t opaque)
 {
   struct flextcp_pl_flowst *fs = &state_base.flowst[fid];
+  struct flextcp_pl_flowst_cold *fc = &state_base.flowst_cold[fid];
   void *rxbuf = mmap(NULL, rxlen, PROT_READ | PROT_WRITE,
       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
   void *txbuf = mmap(NULL, rxlen, PROT_READ | PROT_WRITE,
       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
 
-  fs->opaque = opaque;
+  fc->opaque = opaque;
   fs->rx_base_sp = (uintptr_t) rxbuf;
-  fs->tx_base = (uintptr_t) txbuf;
+  fc->tx_base = (uintptr_t) txbuf;
   fs->rx_len = rxlen;
-  fs->tx_len = txlen;
+  fc->tx_len = txlen;
   fs->local_ip = t_beui32(TEST_LIP);
   fs->remote_ip = t_beui32(TEST_IP);
   fs->local_port = t_beui16(TEST_LPORT);
   fs->remote_port = t_beui16(TEST_PORT);
   fs->rx_avail = rxlen;
   fs->rx_remote_avail = rxlen;
-  fs->tx_rate = 10000;
-  fs->rtt_est = 18;
+  fc->tx_rate = 10000;
+  fc->rtt_est = 18;
+  fast_flows_hdr_init(fid, 0);
 }
 
 /* alloc dummy mbuf */
 static struct rte_mbuf *mbuf_alloc(void)
 {
-  struct rte_mbuf *tmb = calloc(1, 2048);
+  struct rte_mbuf *tmb = calloc(1, 4096);
   tmb->data_off = 256;
   tmb->buf_addr = (uint8_t *) (tmb + 1) + tmb->data_off;
-  tmb->buf_len = 2048 - sizeof(*tmb);
+  tmb->buf_len = 4096 - sizeof(*tmb);
   return tmb;
 }
 
+/* fill in data segment with timestamp option in dummy mbuf */
+static void pkt_init(struct rte_mbuf *tmb, uint32_t seq, uint32_t ack,
+    uint16_t payload, uint8_t fill, struct tcp_opts *opts)
+{
+  struct pkt_tcp *p = network_buf_bufoff((struct network_buf_handle *) tmb);
+  struct tcp_timestamp_opt *ts;
+  uint16_t optlen = 12;
+
+  memset(p, 0, sizeof(*p) + optlen);
+  p->eth.type = t_beui16(ETH_TYPE_IP);
+  IPH_VHL_SET(&p->ip, 4, 5);
+  p->ip.len = t_beui16(sizeof(p->ip) + sizeof(p->tcp) + optlen + payload);
+  p->ip.proto = IP_PROTO_TCP;
+  p->ip.src = t_beui32(TEST_IP);
+  p->ip.dest = t_beui32(TEST_LIP);
+  p->tcp.src = t_beui16(TEST_PORT);
+  p->tcp.dest = t_beui16(TEST_LPORT);
+  p->tcp.seqno = t_beui32(seq);
+  p->tcp.ackno = t_beui32(ack);
+  TCPH_HDRLEN_FLAGS_SET(&p->tcp, 5 + optlen / 4, TCP_ACK);
+  p->tcp.wnd = t_beui16(1024);
+
+  ts = (struct tcp_timestamp_opt *) ((uint8_t *) (p + 1) + 2);
+  ((uint8_t *) (p + 1))[0] = ((uint8_t *) (p + 1))[1] = TCP_OPT_NO_OP;
+  ts->kind = TCP_OPT_TIMESTAMP;
+  ts->length = sizeof(*ts);
+  memset((uint8_t *) (p + 1) + optlen, fill, payload);
+
+  tmb->data_len = sizeof(*p) + optlen + payload;
+  opts->ts = ts;
+  opts->sack = NULL;
+}
+
+/* append SACK option with one block to packet initialized with pkt_init */
+static void pkt_add_sack(struct rte_mbuf *tmb, uint32_t start, uint32_t end,
+    struct tcp_opts *opts)
+{
+  struct pkt_tcp *p = network_buf_bufoff((struct network_buf_handle *) tmb);
+  uint8_t *opt = (uint8_t *) (p + 1);
+  struct tcp_sack_opt *sack;
+
+  opt[12] = opt[13] = TCP_OPT_NO_OP;
+  sack = (struct tcp_sack_opt *) (opt + 14);
+  sack->kind = TCP_OPT_SACK;
+  sack->length = sizeof(*sack) + sizeof(sack->blocks[0]);
+  sack->blocks[0].start = t_beui32(start);
+  sack->blocks[0].end = t_beui32(end);
+
+  TCPH_HDRLEN_SET(&p->tcp, 5 + 24 / 4);
+  p->ip.len = t_beui16(f_beui16(p->ip.len) + 12);
+  tmb->data_len += 12;
+  opts->sack = sack;
+}
+
 void test_txbump_small(void *arg)
 {
   int ret;
   struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst_cold *fc = &state_base.flowst_cold[0];
   struct dataplane_context ctx;
   memset(&ctx, 0, sizeof(ctx));
 
@@ -114,7 +182,7 @@ void test_txbump_small(void *arg)
   test_assert("updated tx avail", fs->tx_avail == 32);
   test_assert("qman set sent", qm_set_op.got_op);
   test_assert("qman set id correct", qm_set_op.id == 0);
-  test_assert("qman set rate correct", qm_set_op.rate == fs->tx_rate);
+  test_assert("qman set rate correct", qm_set_op.rate == fc->tx_rate);
   test_assert("qman set avail correct", qm_set_op.avail == 32);
   test_assert("qman set max chunk correct", qm_set_op.max_chunk == 1448);
   test_assert("qman set flags", qm_set_op.flags ==
@@ -125,6 +193,7 @@ void test_txbump_full(void *arg)
 {
   int ret;
   struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst_cold *fc = &state_base.flowst_cold[0];
   struct dataplane_context ctx;
   memset(&ctx, 0, sizeof(ctx));
 
@@ -137,7 +206,7 @@ void test_txbump_full(void *arg)
   test_assert("updated tx avail", fs->tx_avail == 1024);
   test_assert("qman set sent", qm_set_op.got_op);
   test_assert("qman set id correct", qm_set_op.id == 0);
-  test_assert("qman set rate correct", qm_set_op.rate == fs->tx_rate);
+  test_assert("qman set rate correct", qm_set_op.rate == fc->tx_rate);
   test_assert("qman set avail correct", qm_set_op.avail == 1024);
   test_assert("qman set max chunk correct", qm_set_op.max_chunk == 1448);
   test_assert("qman set flags", qm_set_op.flags ==
@@ -261,6 +330,7 @@ void test_rxbump_fc_reopen_deadlock(void *arg)
 void test_retransmit(void *arg)
 {
   struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst_cold *fc = &state_base.flowst_cold[0];
   struct dataplane_context ctx;
   memset(&ctx, 0, sizeof(ctx));
 
@@ -280,18 +350,850 @@ void test_retransmit(void *arg)
 
   test_assert("qman set sent", qm_set_op.got_op);
   test_assert("qman set id correct", qm_set_op.id == 0);
-  test_assert("qman set rate correct", qm_set_op.rate == fs->tx_rate);
+  test_assert("qman set rate correct", qm_set_op.rate == fc->tx_rate);
   test_assert("qman set avail correct", qm_set_op.avail == 128);
   test_assert("qman set max chunk correct", qm_set_op.max_chunk == 1448);
   test_assert("qman set flags", qm_set_op.flags ==
       (QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_ADD_AVAIL));
 }
 
+/* Test receiving multiple out of order segments with holes in between, and
+ * catching up once the first hole is filled. */
+void test_rx_ooo_intervals(void *arg)
+{
+  int ret;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst_cold *fc = &state_base.flowst_cold[0];
+  struct flextcp_pl_flowst_ooo *ooo = &state_base.flowst_ooo[0];
+  struct dataplane_context ctx;
+  struct tcp_opts opts;
+  struct pkt_tcp *p;
+  struct tcp_sack_opt *sack;
+  uint8_t *rxbuf;
+
+  flow_init(0, 8192, 8192, 123456);
+  fs->rx_next_seq = 1000;
+  fs->rx_base_sp |= FLEXNIC_PL_FLOWST_SACK;
+  rxbuf = (uint8_t *) (uintptr_t) (fs->rx_base_sp & FLEXNIC_PL_FLOWST_RX_MASK);
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  /* first hole */
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 2000, 0, 100, 1, &opts);
+  ret = fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("ack sent", ret == 1 && ctx.tx_num == 1);
+  test_assert("one ooo interval", ooo->num == 1 && fc->rx_ooo_len == 100 &&
+      fc->rx_ooo_start == 2000);
+  test_assert("rx next seq unchanged", fs->rx_next_seq == 1000);
+
+  p = network_buf_bufoff((struct network_buf_handle *) tmb);
+  sack = (struct tcp_sack_opt *) ((uint8_t *) (p + 1) + 14);
+  test_assert("ack has sack option", TCPH_HDRLEN(&p->tcp) == 11 &&
+      sack->kind == TCP_OPT_SACK && sack->length == 10);
+  test_assert("sack block correct", f_beui32(sack->blocks[0].start) == 2000 &&
+      f_beui32(sack->blocks[0].end) == 2100);
+
+  /* second hole */
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 3000, 0, 100, 3, &opts);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("two ooo intervals", ooo->num == 2 &&
+      ooo->intervals[1].start == 3000 && ooo->intervals[1].len == 100);
+
+  p = network_buf_bufoff((struct network_buf_handle *) tmb);
+  sack = (struct tcp_sack_opt *) ((uint8_t *) (p + 1) + 14);
+  test_assert("two sack blocks, recent first", sack->length == 18 &&
+      f_beui32(sack->blocks[0].start) == 3000 &&
+      f_beui32(sack->blocks[1].start) == 2000);
+
+  /* extend first interval */
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 2100, 0, 100, 2, &opts);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("first interval extended", ooo->num == 2 &&
+      ooo->intervals[0].start == 2000 && ooo->intervals[0].len == 200);
+
+  /* fill first hole */
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 1000, 0, 1000, 4, &opts);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("caught up", fs->rx_next_seq == 2200 && fs->rx_next_pos == 1200 &&
+      fs->rx_avail == 8192 - 1200);
+  test_assert("app notified", ctx.arx_num == 1 &&
+      ctx.arx_cache[0].msg.connupdate.rx_bump == 1200);
+  test_assert("one ooo interval left", ooo->num == 1 &&
+      fc->rx_ooo_start == 3000 && fc->rx_ooo_len == 100);
+  test_assert("data placed correctly", rxbuf[999] == 4 && rxbuf[1000] == 1 &&
+      rxbuf[1100] == 2 && rxbuf[2000] == 3);
+}
+
+/* Test that a SACK reporting everything but the first segment only leads to
+ * the first segment being retransmitted. */
+void test_sack_retransmit(void *arg)
+{
+  int ret;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst_cold *fc = &state_base.flowst_cold[0];
+  struct flextcp_pl_flowst_sack *sb = &state_base.flowst_sack[0];
+  struct dataplane_context ctx;
+  struct tcp_opts opts;
+  struct pkt_tcp *p;
+
+  flow_init(0, 16384, 16384, 123456);
+  fs->rx_base_sp |= FLEXNIC_PL_FLOWST_SACK;
+  fs->tx_next_seq = 1 + 5 * 1448;
+  fs->tx_next_pos = 5 * 1448;
+  fs->tx_sent = 5 * 1448;
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  /* ack for first byte with SACK for segments 2-5 */
+  memset(&ctx, 0, sizeof(ctx));
+  qm_set_op.got_op = 0;
+  pkt_init(tmb, 1000, 1, 0, 0, &opts);
+  pkt_add_sack(tmb, 1 + 1448, 1 + 5 * 1448, &opts);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("in recovery", sb->state == FLEXNIC_PL_SACK_RECOVERY &&
+      (fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXSACK) != 0);
+  test_assert("no go-back-n", fs->tx_sent == 5 * 1448 &&
+      fs->tx_next_seq == 1 + 5 * 1448);
+  test_assert("qman set for hole", qm_set_op.got_op && qm_set_op.avail == 1448);
+  test_assert("rate cut", fc->tx_rate == 5000 && fc->cnt_tx_drops == 1);
+
+  /* queue manager retransmits only the hole */
+  memset(&ctx, 0, sizeof(ctx));
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  p = network_buf_buf((struct network_buf_handle *) tmb);
+  test_assert("segment sent", ret == 0 && ctx.tx_num == 1);
+  test_assert("retransmitted hole", f_beui32(p->tcp.seqno) == 1 &&
+      f_beui16(p->ip.len) == 20 + 32 + 1448);
+  test_assert("tx state unchanged", fs->tx_sent == 5 * 1448 &&
+      fs->tx_next_pos == 5 * 1448);
+
+  memset(&ctx, 0, sizeof(ctx));
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  test_assert("nothing more to send", ret == -1 && ctx.tx_num == 0);
+
+  /* cumulative ack for everything ends recovery */
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 1000, 1 + 5 * 1448, 0, 0, &opts);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("recovery done", sb->state == FLEXNIC_PL_SACK_NONE &&
+      sb->num == 0 && (fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXSACK) == 0);
+  test_assert("all acked", fs->tx_sent == 0);
+}
+
+/* Test that a retransmit timeout during SACK recovery also covers the
+ * unacknowledged tail after the highest SACK block. */
+void test_sack_rto(void *arg)
+{
+  int ret;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst_sack *sb = &state_base.flowst_sack[0];
+  struct dataplane_context ctx;
+  struct tcp_opts opts;
+  struct pkt_tcp *p;
+
+  flow_init(0, 16384, 16384, 123456);
+  fs->rx_base_sp |= FLEXNIC_PL_FLOWST_SACK;
+  fs->tx_next_seq = 1 + 5 * 1448;
+  fs->tx_next_pos = 5 * 1448;
+  fs->tx_sent = 5 * 1448;
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  /* SACK for second segment only, not enough to start recovery */
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 1000, 1, 0, 0, &opts);
+  pkt_add_sack(tmb, 1 + 1448, 1 + 2 * 1448, &opts);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("hole noted", sb->state == FLEXNIC_PL_SACK_HOLE && sb->num == 1);
+
+  /* timeout: first segment and the tail after the SACK block are lost */
+  memset(&ctx, 0, sizeof(ctx));
+  qm_set_op.got_op = 0;
+  fast_flows_retransmit(&ctx, 0);
+  test_assert("in recovery", sb->state == FLEXNIC_PL_SACK_RECOVERY &&
+      sb->recovery_end == 1 + 5 * 1448);
+  test_assert("qman set for holes and tail",
+      qm_set_op.got_op && qm_set_op.avail == 4 * 1448);
+
+  memset(&ctx, 0, sizeof(ctx));
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  p = network_buf_buf((struct network_buf_handle *) tmb);
+  test_assert("first hole sent", ret == 0 && f_beui32(p->tcp.seqno) == 1);
+
+  memset(&ctx, 0, sizeof(ctx));
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  p = network_buf_buf((struct network_buf_handle *) tmb);
+  test_assert("tail sent", ret == 0 &&
+      f_beui32(p->tcp.seqno) == 1 + 2 * 1448);
+}
+
+/* Test that in-order segments of one flow in a receive batch are grouped and
+ * processed as one segment with a single notification and ACK. */
+void test_rx_gro(void *arg)
+{
+  int ret;
+  unsigned i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  struct network_buf_handle *nbhs[4];
+  struct tcp_opts tos[4];
+  void *fss[4];
+  uint16_t runs[4];
+  uint8_t *rxbuf;
+
+  flow_init(0, 8192, 8192, 123456);
+  fs->rx_next_seq = 1000;
+  fs->tx_next_seq = 1;
+  rxbuf = (uint8_t *) (uintptr_t) (fs->rx_base_sp &
+      FLEXNIC_PL_FLOWST_RX_MASK);
+
+  /* three in-order segments, then one after a gap */
+  for (i = 0; i < 4; i++) {
+    nbhs[i] = (struct network_buf_handle *) mbuf_alloc();
+    fss[i] = fs;
+    pkt_init((struct rte_mbuf *) nbhs[i], 1000 + (i == 3 ? 3000 : i * 100), 1,
+        100, i + 1, &tos[i]);
+  }
+
+  fast_flows_packet_gro(&ctx, nbhs, fss, tos, runs, 4);
+  test_assert("grouped runs", runs[0] == 3 && runs[3] == 1);
+
+  memset(&ctx, 0, sizeof(ctx));
+  ret = fast_flows_packet_run(&ctx, nbhs, fs, tos, runs[0], 0);
+  test_assert("one ack", ret == 1 && ctx.tx_num == 1 &&
+      ctx.tx_handles[0] == nbhs[2]);
+  test_assert("one notification", ctx.arx_num == 1 &&
+      ctx.arx_cache[0].msg.connupdate.rx_bump == 300);
+  test_assert("flow state", fs->rx_next_seq == 1300 &&
+      fs->rx_next_pos == 300 && fs->rx_avail == 8192 - 300);
+  test_assert("data placed", rxbuf[0] == 1 && rxbuf[100] == 2 &&
+      rxbuf[299] == 3);
+
+  /* run that does not start at the expected sequence number is refused */
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init((struct rte_mbuf *) nbhs[0], 2000, 1, 100, 1, &tos[0]);
+  pkt_init((struct rte_mbuf *) nbhs[1], 2100, 1, 100, 1, &tos[1]);
+  ret = fast_flows_packet_run(&ctx, nbhs, fs, tos, 2, 0);
+  test_assert("run refused", ret == -1 && ctx.tx_num == 0 &&
+      ctx.arx_num == 0 && fs->rx_next_seq == 1300);
+}
+
+/* Test that segments with bad checksums are dropped during parsing, checking
+ * in software only when the NIC did not verify them. */
+void test_rx_xsum(void *arg)
+{
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  struct network_buf_handle *nbh;
+  struct tcp_opts tos;
+  struct pkt_tcp *p;
+  void *fss;
+  uint8_t drop;
+
+  flow_init(0, 8192, 8192, 123456);
+  nbh = (struct network_buf_handle *) mbuf_alloc();
+  memset(&ctx, 0, sizeof(ctx));
+
+  /* odd payload length with valid checksums */
+  pkt_init((struct rte_mbuf *) nbh, 1000, 1, 101, 7, &tos);
+  p = network_buf_bufoff(nbh);
+  p->ip.chksum = rte_ipv4_cksum((void *) &p->ip);
+  p->tcp.chksum = rte_ipv4_udptcp_cksum((void *) &p->ip, (void *) &p->tcp);
+  fss = fs;
+  fast_flows_packet_parse(&ctx, &nbh, &fss, &tos, &drop, 1);
+  test_assert("valid accepted", fss == fs && drop == 0 && ctx.xsum_drop == 0);
+
+  /* corrupted payload */
+  ((uint8_t *) p)[sizeof(*p) + 12 + 100] ^= 1;
+  fss = fs;
+  fast_flows_packet_parse(&ctx, &nbh, &fss, &tos, &drop, 1);
+  test_assert("bad payload dropped", fss == NULL && drop == 1 &&
+      ctx.xsum_drop == 1);
+
+  /* corrupted IP header */
+  ((uint8_t *) p)[sizeof(*p) + 12 + 100] ^= 1;
+  p->ip.ttl ^= 1;
+  fss = fs;
+  fast_flows_packet_parse(&ctx, &nbh, &fss, &tos, &drop, 1);
+  test_assert("bad ip header dropped", fss == NULL && drop == 1 &&
+      ctx.xsum_drop == 2);
+
+  /* verified by NIC, not checked again */
+  ((struct rte_mbuf *) nbh)->ol_flags = PKT_RX_IP_CKSUM_GOOD |
+    PKT_RX_L4_CKSUM_GOOD;
+  fss = fs;
+  fast_flows_packet_parse(&ctx, &nbh, &fss, &tos, &drop, 1);
+  test_assert("nic verified accepted", fss == fs && drop == 0);
+
+  /* NIC reports bad checksum */
+  p->ip.ttl ^= 1;
+  ((struct rte_mbuf *) nbh)->ol_flags = PKT_RX_IP_CKSUM_GOOD |
+    PKT_RX_L4_CKSUM_BAD;
+  fss = fs;
+  fast_flows_packet_parse(&ctx, &nbh, &fss, &tos, &drop, 1);
+  test_assert("nic bad dropped", fss == NULL && drop == 1 &&
+      ctx.xsum_drop == 3);
+}
+
+/* Test that with delayed ACKs only every second segment is acknowledged,
+ * with the timer and CE marks forcing ACKs out. */
+void test_rx_delayed_ack(void *arg)
+{
+  int ret;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst_cold *fc = &state_base.flowst_cold[0];
+  struct dataplane_context ctx;
+  struct tcp_opts opts;
+  struct pkt_tcp *p;
+
+  flow_init(0, 65536, 8192, 123456);
+  fs->rx_next_seq = 1000;
+  fs->tx_next_seq = 1;
+  config.fp_ack_segs = 2;
+  config.fp_ack_delay = 100;
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 1000, 1, 100, 1, &opts);
+  ret = fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts,
+      10);
+  test_assert("first ack delayed", ret == 0 && ctx.tx_num == 0 &&
+      fc->rx_ack_segs == 1);
+  test_assert("timer armed", ctx.acktimer_num == 1 &&
+      ctx.acktimers[0].flow_id == 0 && ctx.acktimers[0].ts == 110);
+  test_assert("app notified", ctx.arx_num == 1);
+
+  pkt_init(tmb, 1100, 1, 100, 1, &opts);
+  ret = fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts,
+      20);
+  test_assert("second segment acked", ret == 1 && ctx.tx_num == 1 &&
+      fc->rx_ack_segs == 0);
+
+  /* timer after ack was sent does nothing */
+  ret = fast_flows_delayed_ack(&ctx, 0, (struct network_buf_handle *) tmb,
+      110);
+  test_assert("stale timer ignored", ret == -1 && ctx.tx_num == 1);
+
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 1200, 1, 100, 1, &opts);
+  ret = fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts,
+      30);
+  test_assert("third ack delayed", ret == 0 && fc->rx_ack_segs == 1);
+
+  ret = fast_flows_delayed_ack(&ctx, 0, (struct network_buf_handle *) tmb,
+      130);
+  p = network_buf_buf((struct network_buf_handle *) tmb);
+  test_assert("timer sends ack", ret == 0 && ctx.tx_num == 1 &&
+      f_beui32(p->tcp.ackno) == 1300 && fc->rx_ack_segs == 0);
+
+  /* CE marked segment is acked immediately */
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 1300, 1, 100, 1, &opts);
+  p = network_buf_bufoff((struct network_buf_handle *) tmb);
+  IPH_ECN_SET(&p->ip, IP_ECN_CE);
+  ret = fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts,
+      40);
+  test_assert("ce acked immediately", ret == 1 && ctx.tx_num == 1 &&
+      ctx.acktimer_num == 0);
+
+  config.fp_ack_segs = 1;
+}
+
+/* Test that with TSO enabled one queue manager event sends out a single
+ * segment spanning multiple buffers. */
+void test_wscale(void *arg)
+{
+  int ret;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  struct tcp_opts opts;
+  struct pkt_tcp *p;
+
+  flow_init(0, 1024 * 1024, 8192, 123456);
+  fs->rx_next_seq = 1000;
+  fs->tx_next_seq = 1;
+  fs->wscale = 3 | (5 << 4);
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 1000, 1, 100, 1, &opts);
+  ret = fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts,
+      10);
+  p = network_buf_bufoff((struct network_buf_handle *) tmb);
+  test_assert("segment acked", ret == 1 && ctx.tx_num == 1);
+  test_assert("received window scaled up", fs->rx_remote_avail == 1024 << 3);
+  test_assert("advertised window scaled down",
+      f_beui16(p->tcp.wnd) == (1024 * 1024 - 100) >> 5);
+
+  fs->wscale = 0;
+}
+
+void test_tx_tso(void *arg)
+{
+  int ret;
+  unsigned i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst_cold *fc = &state_base.flowst_cold[0];
+  struct dataplane_context ctx;
+  struct rte_mbuf *seg;
+  struct pkt_tcp *p;
+  uint8_t *txbuf;
+  int data_ok = 1;
+
+  flow_init(0, 16384, 16384, 123456);
+  txbuf = (uint8_t *) (uintptr_t) fc->tx_base;
+  for (i = 0; i < 5000; i++) {
+    txbuf[i] = i % 251;
+  }
+  fs->tx_avail = 5000;
+  net_tso_max = 4 * 1448 + 100;
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  memset(&ctx, 0, sizeof(ctx));
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  p = network_buf_buf((struct network_buf_handle *) tmb);
+  test_assert("one segment sent", ret == 0 && ctx.tx_num == 1);
+  test_assert("tx state updated", fs->tx_sent == 5000 && fs->tx_avail == 0 &&
+      fs->tx_next_pos == 5000);
+  test_assert("chained buffers", tmb->nb_segs == 3 &&
+      tmb->pkt_len == 14 + 20 + 32 + 5000 &&
+      tmb->data_len == 2048);
+  test_assert("tso requested", (tmb->ol_flags & PKT_TX_TCP_SEG) != 0 &&
+      tmb->tso_segsz == 1448 && tmb->l4_len == 32);
+  test_assert("ip length", f_beui16(p->ip.len) == 20 + 32 + 5000);
+
+  for (i = 0, seg = tmb->next; seg != NULL; seg = seg->next) {
+    i += seg->data_len;
+  }
+  test_assert("chain length", i == 5000 - (2048 - 66));
+
+  seg = tmb->next->next;
+  for (i = 0; i < seg->data_len; i++) {
+    data_ok &= ((uint8_t *) seg->buf_addr)[i] ==
+      (2048 - 66 + 2048 + i) % 251;
+  }
+  test_assert("payload in last buffer", data_ok);
+
+  memset(&ctx, 0, sizeof(ctx));
+  tmb->next = NULL;
+  tmb->nb_segs = 1;
+  qm_set_op.got_op = 0;
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  test_assert("nothing more to send", ret == -1 && ctx.tx_num == 0);
+
+  net_tso_max = 0;
+}
+
+static int tx_xsum_ok(struct pkt_tcp *p)
+{
+  uint16_t ip_x = p->ip.chksum, tcp_x = p->tcp.chksum;
+  int ok;
+
+  p->ip.chksum = 0;
+  p->tcp.chksum = 0;
+  ok = ip_x == rte_ipv4_cksum((void *) &p->ip) &&
+    tcp_x == rte_ipv4_udptcp_cksum((void *) &p->ip, (void *) &p->tcp);
+  p->ip.chksum = ip_x;
+  p->tcp.chksum = tcp_x;
+  return ok;
+}
+
+void test_tx_swxsum(void *arg)
+{
+  int ret;
+  unsigned i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst_cold *fc = &state_base.flowst_cold[0];
+  struct dataplane_context ctx;
+  struct pkt_tcp *p;
+  uint8_t *txbuf, *payload;
+  int data_ok = 1;
+
+  flow_init(0, 2048, 2048, 123456);
+  txbuf = (uint8_t *) (uintptr_t) fc->tx_base;
+  for (i = 0; i < 2048; i++) {
+    txbuf[i] = i % 251;
+  }
+
+  /* payload wraps around the end of the buffer at an odd offset */
+  fs->tx_next_pos = 1001;
+  fs->tx_avail = 1200;
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  memset(&ctx, 0, sizeof(ctx));
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  p = network_buf_buf((struct network_buf_handle *) tmb);
+  payload = (uint8_t *) p + 66;
+  test_assert("segment sent", ret == 0 && ctx.tx_num == 1);
+  test_assert("no offload requested", tmb->ol_flags == 0);
+  for (i = 0; i < 1200; i++) {
+    data_ok &= payload[i] == ((1001 + i) % 2048) % 251;
+  }
+  test_assert("payload copied", data_ok);
+  test_assert("checksums wrapped payload", tx_xsum_ok(p));
+
+  /* odd payload length */
+  fs->tx_avail = 1201;
+  memset(&ctx, 0, sizeof(ctx));
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  test_assert("segment sent", ret == 0 && ctx.tx_num == 1);
+  test_assert("checksums odd payload", tx_xsum_ok(p));
+}
+
+/* Test that segments and ACKs built from the header template carry the flow's
+ * addresses and only the timestamp option. */
+void test_tx_hdr_tmpl(void *arg)
+{
+  int ret;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  struct tcp_opts opts;
+  struct pkt_tcp *p;
+  uint8_t *opt;
+
+  flow_init(0, 8192, 8192, 123456);
+  fs->rx_base_sp |= FLEXNIC_PL_FLOWST_ECN;
+  fs->rx_next_seq = 1000;
+  fast_flows_hdr_init(0, 0);
+  fs->tx_avail = 100;
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  memset(&ctx, 0, sizeof(ctx));
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  p = network_buf_buf((struct network_buf_handle *) tmb);
+  opt = (uint8_t *) (p + 1);
+  test_assert("segment sent", ret == 0 && ctx.tx_num == 1 &&
+      tmb->data_len == 66 + 100);
+  test_assert("segment addresses", f_beui32(p->ip.src) == TEST_LIP &&
+      f_beui32(p->ip.dest) == TEST_IP && f_beui16(p->tcp.src) == TEST_LPORT &&
+      f_beui16(p->tcp.dest) == TEST_PORT);
+  test_assert("segment ecn capable", IPH_ECN(&p->ip) == IP_ECN_ECT0);
+  test_assert("segment options", TCPH_HDRLEN(&p->tcp) == 8 &&
+      opt[0] == TCP_OPT_NO_OP && opt[1] == TCP_OPT_NO_OP &&
+      opt[2] == TCP_OPT_TIMESTAMP);
+  test_assert("segment checksums", tx_xsum_ok(p));
+
+  /* ACK for a CE marked segment with a SACK option */
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 1000, 1, 100, 1, &opts);
+  pkt_add_sack(tmb, 500, 600, &opts);
+  p = network_buf_bufoff((struct network_buf_handle *) tmb);
+  IPH_ECN_SET(&p->ip, IP_ECN_CE);
+  ret = fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts,
+      0);
+  test_assert("ack sent", ret == 1 && ctx.tx_num == 1 &&
+      tmb->data_len == 66);
+  test_assert("ack addresses", f_beui32(p->ip.src) == TEST_LIP &&
+      f_beui32(p->ip.dest) == TEST_IP && f_beui16(p->tcp.src) == TEST_LPORT &&
+      f_beui16(p->tcp.dest) == TEST_PORT);
+  test_assert("ack ecn", IPH_ECN(&p->ip) == IP_ECN_NONE &&
+      (TCPH_FLAGS(&p->tcp) & TCP_ECE) != 0);
+  test_assert("ack only timestamp", TCPH_HDRLEN(&p->tcp) == 8);
+  test_assert("ack checksums", tx_xsum_ok(p));
+}
+
+/* Test that segments and ACKs of a flow on the second port go out on that
+ * port with its MAC address. */
+void test_tx_port(void *arg)
+{
+  int ret;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  struct tcp_opts opts;
+  struct pkt_tcp *p;
+
+  memset(eth_addrs, 0, sizeof(eth_addrs));
+  eth_addrs[1].addr[0] = 0x02;
+  eth_addrs[1].addr[5] = 0x11;
+
+  flow_init(0, 8192, 8192, 123456);
+  fs->rx_next_seq = 1000;
+  fast_flows_hdr_init(0, 1);
+  fs->tx_avail = 100;
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  memset(&ctx, 0, sizeof(ctx));
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  p = network_buf_buf((struct network_buf_handle *) tmb);
+  test_assert("segment sent", ret == 0 && ctx.tx_num == 1);
+  test_assert("segment port", tmb->port == 1 &&
+      memcmp(&p->eth.src, &eth_addrs[1], ETH_ADDR_LEN) == 0);
+
+  memset(&ctx, 0, sizeof(ctx));
+  tmb->port = 0;
+  pkt_init(tmb, 1000, 1, 100, 1, &opts);
+  p = network_buf_bufoff((struct network_buf_handle *) tmb);
+  ret = fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts,
+      0);
+  test_assert("ack sent", ret == 1 && ctx.tx_num == 1);
+  test_assert("ack port", tmb->port == 1 &&
+      memcmp(&p->eth.src, &eth_addrs[1], ETH_ADDR_LEN) == 0);
+}
+
+/* Test that segments for flows of an app context with a blocked overflow queue
+ * are dropped without touching flow state. */
+void test_rx_arx_ovf(void *arg)
+{
+  int ret;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst_cold *fc = &state_base.flowst_cold[0];
+  struct dataplane_context ctx;
+  struct tcp_opts opts;
+
+  flow_init(0, 8192, 8192, 123456);
+  fs->rx_next_seq = 1000;
+  fc->db_id = 3;
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.arx_ovf_blocked = 1U << 3;
+  pkt_init(tmb, 1000, 1, 100, 1, &opts);
+  ret = fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts,
+      0);
+  test_assert("segment dropped", ret == 0 && ctx.tx_num == 0 &&
+      ctx.arx_num == 0);
+  test_assert("flow state untouched", fs->rx_next_seq == 1000 &&
+      fs->rx_avail == 8192);
+
+  ctx.arx_ovf_blocked = 1U << 2;
+  ret = fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts,
+      0);
+  test_assert("segment accepted", ret == 1 && ctx.arx_num == 1 &&
+      ctx.arx_ctx[0] == 3 && fs->rx_next_seq == 1100);
+}
+
+/* Test that a full send buffer spills into the software transmit queue
+ * instead of aborting, and that packets are dropped once that is full too. */
+void test_tx_spill(void *arg)
+{
+  unsigned i;
+  struct dataplane_context ctx;
+  struct network_buf_handle *txq[TXBUF_SIZE];
+  struct network_buf_handle *nbhs[2 * TXBUF_SIZE + 1];
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.txq_handles = txq;
+  ctx.txq_mask = TXBUF_SIZE - 1;
+
+  for (i = 0; i < 2 * TXBUF_SIZE + 1; i++) {
+    nbhs[i] = (struct network_buf_handle *) rte_pktmbuf_alloc(NULL);
+  }
+
+  for (i = 0; i < TXBUF_SIZE + 1; i++) {
+    tx_send(&ctx, nbhs[i], 0, 64, 0);
+  }
+  test_assert("send buffer spilled", ctx.tx_num == 1 &&
+      ctx.tx_handles[0] == nbhs[TXBUF_SIZE] && ctx.txq_num == TXBUF_SIZE);
+  test_assert("queue in order", ctx.txq_handles[0] == nbhs[0] &&
+      ctx.txq_handles[TXBUF_SIZE - 1] == nbhs[TXBUF_SIZE - 1]);
+
+  for (; i < 2 * TXBUF_SIZE + 1; i++) {
+    tx_send(&ctx, nbhs[i], 0, 64, 0);
+  }
+  test_assert("overflow dropped", ctx.tx_num == 1 &&
+      ctx.tx_handles[0] == nbhs[2 * TXBUF_SIZE] &&
+      ctx.txq_num == TXBUF_SIZE && ctx.tx_drops == TXBUF_SIZE);
+}
+
+void test_tx_zerocopy(void *arg)
+{
+  int ret;
+  unsigned i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst_cold *fc = &state_base.flowst_cold[0];
+  struct dataplane_context ctx;
+  struct rte_mbuf_ext_shared_info shinfo;
+  struct rte_mbuf *seg;
+  uint8_t *txbuf;
+
+  flow_init(0, 16384, 16384, 123456);
+  txbuf = (uint8_t *) (uintptr_t) fc->tx_base;
+  for (i = 0; i < 16384; i++) {
+    txbuf[i] = i % 251;
+  }
+  fs->tx_next_pos = 16384 - 1000;
+  fs->tx_avail = 3000;
+  net_tso_max = 4 * 1448 + 100;
+  net_tx_zerocopy = 1;
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  memset(&ctx, 0, sizeof(ctx));
+  memset(&shinfo, 0, sizeof(shinfo));
+  shinfo.refcnt = 1;
+  ctx.net.zc_shinfo = &shinfo;
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  test_assert("one segment sent", ret == 0 && ctx.tx_num == 1);
+  test_assert("tx state updated", fs->tx_sent == 3000 && fs->tx_avail == 0 &&
+      fs->tx_next_pos == 2000);
+  test_assert("headers only in first buffer", tmb->nb_segs == 3 &&
+      tmb->data_len == 14 + 20 + 32 && tmb->pkt_len == 14 + 20 + 32 + 3000);
+
+  seg = tmb->next;
+  test_assert("payload attached up to end of buffer",
+      seg->buf_addr == txbuf + 16384 - 1000 && seg->data_off == 0 &&
+      seg->data_len == 1000 && seg->shinfo == &shinfo);
+  seg = seg->next;
+  test_assert("wrapped payload attached from start of buffer",
+      seg->buf_addr == txbuf && seg->data_len == 2000 && seg->next == NULL);
+  test_assert("shared info references", shinfo.refcnt == 3);
+
+  net_tx_zerocopy = 0;
+  net_tso_max = 0;
+}
+
+/* Test that a flow group steered to another core is handed over by the owner
+ * and that segments are only processed by the new owner. */
+void test_flow_owner(void *arg)
+{
+  int ret;
+  unsigned i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  struct network_buf_handle *nbhs[2];
+  struct tcp_opts tos[2];
+
+  flow_init(0, 8192, 8192, 123456);
+  fs->rx_next_seq = 1000;
+  fs->tx_next_seq = 1;
+  fs->flow_group = 0;
+  fp_state->flow_group_owner[0] = 0;
+  fp_state->flow_group_steering[0] = 1;
+
+  for (i = 0; i < 2; i++) {
+    nbhs[i] = (struct network_buf_handle *) mbuf_alloc();
+    pkt_init((struct rte_mbuf *) nbhs[i], 1000 + i * 100, 1, 100, i + 1,
+        &tos[i]);
+  }
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.id = 0;
+  ret = fast_flows_packet_run(&ctx, nbhs, fs, tos, 2, 0);
+  test_assert("run refused on old owner", ret == -1 && ctx.tx_num == 0 &&
+      ctx.arx_num == 0 && fs->rx_next_seq == 1000);
+  test_assert("ownership handed over", fp_state->flow_group_owner[0] == 1);
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.id = 1;
+  ret = fast_flows_packet_run(&ctx, nbhs, fs, tos, 2, 0);
+  test_assert("run processed on new owner", ret == 1 && ctx.tx_num == 1 &&
+      fs->rx_next_seq == 1200);
+
+  fp_state->flow_group_owner[0] = 0;
+  fp_state->flow_group_steering[0] = 0;
+}
+
+/* Test that a flow with an id beyond 16 bits only uses its own state, and
+ * that the queue manager is set up for it. */
+void test_flow_id_high(void *arg)
+{
+  int ret;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[TEST_FLOW_HIGH];
+  struct flextcp_pl_flowst_ooo *ooo = &state_base.flowst_ooo[TEST_FLOW_HIGH];
+  struct flextcp_pl_flowst_ooo *alias =
+    &state_base.flowst_ooo[TEST_FLOW_HIGH & 0xffff];
+  struct dataplane_context ctx;
+  struct tcp_opts opts;
+
+  flow_init(TEST_FLOW_HIGH, 8192, 8192, 123456);
+  fs->rx_next_seq = 1000;
+  fs->rx_base_sp |= FLEXNIC_PL_FLOWST_SACK;
+  fs->flow_group = 0;
+  memset(ooo, 0, sizeof(*ooo));
+  memset(alias, 0, sizeof(*alias));
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+
+  memset(&ctx, 0, sizeof(ctx));
+  pkt_init(tmb, 2000, 0, 100, 1, &opts);
+  ret = fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("ooo interval on own flow", ret == 1 && ooo->num == 1 &&
+      alias->num == 0);
+
+  memset(&ctx, 0, sizeof(ctx));
+  qm_set_op.got_op = 0;
+  ret = fast_flows_qman_fwd(&ctx, fs);
+  test_assert("qman set for own flow", ret == 0 && qm_set_op.got_op &&
+      qm_set_op.id == TEST_FLOW_HIGH);
+}
+
+/* Test cuckoo flow table insertion with entries displaced to their alternate
+ * buckets, lookups, and removal. */
+void test_flowht(void *arg)
+{
+  static struct flextcp_pl_flowhtb ht[4];
+  static struct flextcp_pl_flowst fst[28];
+  const uint32_t mask = 3;
+  struct flextcp_pl_flowst *fs;
+  unsigned i, found;
+
+  memset(ht, 0, sizeof(ht));
+  memset(fst, 0, sizeof(fst));
+  for (i = 0; i < 28; i++) {
+    fs = &fst[i];
+    fs->local_ip = t_beui32(0x0a000001);
+    fs->remote_ip = t_beui32(0x0a000002);
+    fs->local_port = t_beui16(80);
+    fs->remote_port = t_beui16(1000 + i);
+  }
+
+  for (i = 0; i < 28; i++) {
+    fs = &fst[i];
+    if (flowht_insert(ht, mask, flowht_hash(fs->local_ip, fs->remote_ip,
+            fs->local_port, fs->remote_port), i) != 0)
+      break;
+  }
+  test_assert("flows inserted", i == 28);
+
+  for (found = 0, i = 0; i < 28; i++) {
+    fs = &fst[i];
+    found += flowht_lookup(ht, mask, fst, flowht_hash(fs->local_ip,
+          fs->remote_ip, fs->local_port, fs->remote_port), fs->local_ip,
+        fs->remote_ip, fs->local_port, fs->remote_port) == i;
+  }
+  test_assert("all flows found", found == 28);
+
+  fs = &fst[5];
+  test_assert("flow removed", flowht_remove(ht, mask,
+        flowht_hash(fs->local_ip, fs->remote_ip, fs->local_port,
+          fs->remote_port), 5) == 0);
+  test_assert("removed flow not found", flowht_lookup(ht, mask, fst,
+        flowht_hash(fs->local_ip, fs->remote_ip, fs->local_port,
+          fs->remote_port), fs->local_ip, fs->remote_ip, fs->local_port,
+        fs->remote_port) == -1);
+
+  fs = &fst[6];
+  test_assert("other flow still found", flowht_lookup(ht, mask, fst,
+        flowht_hash(fs->local_ip, fs->remote_ip, fs->local_port,
+          fs->remote_port), fs->local_ip, fs->remote_ip, fs->local_port,
+        fs->remote_port) == 6);
+}
+
 int main(int argc, char *argv[])
 {
   int ret = 0;
 
   memset(&state_base, 0, sizeof(state_base));
+  state_base.flowst = flowst_base;
+  state_base.flowst_cold = flowst_cold_base;
+#ifdef FLEXNIC_PL_OOO_RECV
+  state_base.flowst_ooo = flowst_ooo_base;
+#endif
+  state_base.flowst_sack = flowst_sack_base;
+  state_base.flowst_hdr = flowst_hdr_base;
+  state_base.flowst_num = TEST_FLOWS;
+  config.shm_len = UINT64_MAX;
 
   if (test_subcase("tx bump small", test_txbump_small, NULL))
     ret = 1;
@@ -318,5 +1220,56 @@ int main(int argc, char *argv[])
   if (test_subcase("retransmit", test_retransmit, NULL))
     ret = 1;
 
+  if (test_subcase("rx ooo intervals", test_rx_ooo_intervals, NULL))
+    ret = 1;
+
+  if (test_subcase("sack retransmit", test_sack_retransmit, NULL))
+    ret = 1;
+
+  if (test_subcase("sack rto", test_sack_rto, NULL))
+    ret = 1;
+
+  if (test_subcase("rx gro", test_rx_gro, NULL))
+    ret = 1;
+
+  if (test_subcase("rx checksums", test_rx_xsum, NULL))
+    ret = 1;
+
+  if (test_subcase("rx delayed ack", test_rx_delayed_ack, NULL))
+    ret = 1;
+
+  if (test_subcase("window scaling", test_wscale, NULL))
+    ret = 1;
+
+  if (test_subcase("tx tso", test_tx_tso, NULL))
+    ret = 1;
+
+  if (test_subcase("tx software checksum", test_tx_swxsum, NULL))
+    ret = 1;
+
+  if (test_subcase("tx header template", test_tx_hdr_tmpl, NULL))
+    ret = 1;
+
+  if (test_subcase("tx port", test_tx_port, NULL))
+    ret = 1;
+
+  if (test_subcase("rx app overflow", test_rx_arx_ovf, NULL))
+    ret = 1;
+
+  if (test_subcase("tx spill", test_tx_spill, NULL))
+    ret = 1;
+
+  if (test_subcase("tx zerocopy", test_tx_zerocopy, NULL))
+    ret = 1;
+
+  if (test_subcase("flow owner", test_flow_owner, NULL))
+    ret = 1;
+
+  if (test_subcase("flow table", test_flowht, NULL))
+    ret = 1;
+
+  if (test_subcase("flow id above 16 bits", test_flow_id_high, NULL))
+    ret = 1;
+
   return ret;
 }
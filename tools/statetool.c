@@ -31,6 +31,10 @@
 #include <tas_memif.h>
 
 struct flextcp_pl_mem *plm;
+static uint32_t flowst_num;
+static struct flextcp_pl_flowst *flowst;
+static struct flextcp_pl_flowst_cold *flowst_cold;
+static uint32_t appctx_num;
 
 /** connect to flexnic shared memory regions */
 static int connect_flexnic(void)
@@ -54,6 +58,12 @@ static int connect_flexnic(void)
     return -1;
   }
 
+  /* pointers in plm are only valid in TAS, use offsets */
+  flowst_num = info->flowst_num;
+  flowst = (void *) ((uint8_t *) int_mem_start + info->flowst_off);
+  flowst_cold = (void *) ((uint8_t *) int_mem_start + info->flowst_cold_off);
+  appctx_num = info->appctx_num;
+
   return 0;
 }
 
@@ -62,7 +72,7 @@ static int dump_appctx(uint16_t db_id)
 #if 0
   struct flextcp_pl_appctx *ctx;
 
-  if (db_id >= FLEXNIC_PL_APPCTX_NUM) {
+  if (db_id >= appctx_num) {
     fprintf(stderr, "dump_appctx: invalid doorbell id %u\n", db_id);
     return -1;
   }
@@ -103,24 +113,28 @@ static int dump_appctx(uint16_t db_id)
 static int dump_flow(uint32_t flow_id)
 {
   struct flextcp_pl_flowst *fs;
+  struct flextcp_pl_flowst_cold *fc;
   uint64_t mac = 0;
 
-  if (flow_id >= FLEXNIC_PL_FLOWST_NUM) {
+  if (flow_id >= flowst_num) {
     fprintf(stderr, "dump_appctx: invalid doorbell id %u\n", flow_id);
     return -1;
   }
 
-  fs = &plm->flowst[flow_id];
+  fs = &flowst[flow_id];
+  fc = &flowst_cold[flow_id];
 
   /* skip flows without receive and transmit buffers */
-  if (fs->rx_len == 0 && fs->tx_len == 0) {
+  if (fs->rx_len == 0 && fc->tx_len == 0) {
     return 0;
   }
 
-  memcpy(&mac, &fs->remote_mac, 6);
+  memcpy(&mac, &fc->remote_mac, 6);
   printf("flow %u {\n"
          "  opaque=%016"PRIx64"\n"
          "  db_id=%03u\n"
+         "  appst_id=%03u\n"
+         "  prio=%u\n"
          "  flag_slowpath=%u\n"
          "  flag_ecn=%u\n"
          "  flag_txfin=%u\n"
@@ -163,23 +177,24 @@ static int dump_flow(uint32_t flow_id)
          "    rx_ecn_bytes=%10u\n"
          "         rtt_est=%10u\n"
          "  }\n"
-         "}\n", flow_id, fs->opaque, fs->db_id,
+         "}\n", flow_id, fc->opaque, fc->db_id, fc->appst_id,
+      fc->prio,
       !!(fs->rx_base_sp & FLEXNIC_PL_FLOWST_SLOWPATH),
       !!(fs->rx_base_sp & FLEXNIC_PL_FLOWST_ECN),
       !!(fs->rx_base_sp & FLEXNIC_PL_FLOWST_TXFIN),
       !!(fs->rx_base_sp & FLEXNIC_PL_FLOWST_RXFIN),
-      fs->bump_seq,
+      fc->bump_seq,
       f_beui32(fs->local_ip), f_beui16(fs->local_port), f_beui32(fs->remote_ip),
       f_beui16(fs->remote_port), mac,
       (fs->rx_base_sp & FLEXNIC_PL_FLOWST_RX_MASK), fs->rx_len, fs->rx_avail,
       fs->rx_remote_avail, fs->rx_next_pos, fs->rx_next_seq, fs->rx_dupack_cnt,
 #ifdef FLEXNIC_PL_OOO_RECV
-      fs->rx_ooo_start, fs->rx_ooo_len,
+      fc->rx_ooo_start, fc->rx_ooo_len,
 #endif
-      fs->tx_base, fs->tx_len, fs->tx_avail, fs->tx_sent, fs->tx_next_pos,
+      fc->tx_base, fc->tx_len, fs->tx_avail, fs->tx_sent, fs->tx_next_pos,
       fs->tx_next_seq, fs->tx_next_ts,
-      fs->tx_rate, fs->cnt_tx_drops, fs->cnt_rx_acks, fs->cnt_rx_ack_bytes,
-      fs->cnt_rx_ecn_bytes, fs->rtt_est);
+      fc->tx_rate, fc->cnt_tx_drops, fc->cnt_rx_acks, fc->cnt_rx_ack_bytes,
+      fc->cnt_rx_ecn_bytes, fc->rtt_est);
 
   return 0;
 }
@@ -192,10 +207,10 @@ int main(int argc, char *argv[])
     return EXIT_FAILURE;
   }
 
-  for (i = 0; i < FLEXNIC_PL_APPCTX_NUM; i++) {
+  for (i = 0; i < appctx_num; i++) {
     dump_appctx(i);
   }
-  for (i = 0; i < FLEXNIC_PL_FLOWST_NUM; i++) {
+  for (i = 0; i < flowst_num; i++) {
     dump_flow(i);
   }
 